@@ -0,0 +1,181 @@
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pops one task, blocks while the queue is empty;
+// returns 0 with a task, ECANCELED once shut down and drained
+static int thread_pool_pop(struct thread_pool *pool,
+                           struct thread_pool_task *task) {
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->count && !pool->shutdown) {
+    pthread_cond_wait(&pool->not_empty, &pool->lock);
+  }
+  if (!pool->count) { // shutdown and nothing left to drain
+    pthread_mutex_unlock(&pool->lock);
+    return ECANCELED;
+  }
+  *task = pool->tasks[pool->head];
+  pool->head = (pool->head + 1) % pool->capacity;
+  pool->count--;
+  pthread_cond_signal(&pool->not_full);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+static void *thread_pool_worker(void *param) {
+  struct thread_pool *pool = (struct thread_pool *)param;
+  struct thread_pool_task task;
+
+  while (!thread_pool_pop(pool, &task)) {
+    task.fn(task.arg);
+
+    pthread_mutex_lock(&pool->lock);
+    if (!--pool->pending) {
+      pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return NULL;
+}
+
+// caller holds pool->lock and has checked there is a free slot
+static void thread_pool_push_locked(struct thread_pool *pool,
+                                    thread_pool_task_fn fn, void *arg) {
+  pool->tasks[pool->tail].fn = fn;
+  pool->tasks[pool->tail].arg = arg;
+  pool->tail = (pool->tail + 1) % pool->capacity;
+  pool->count++;
+  pool->pending++;
+  pthread_cond_signal(&pool->not_empty);
+}
+
+// attr_stride 0: every worker uses attrs[0] (or NULL), else attrs[i]
+static int thread_pool_init(struct thread_pool *pool, size_t worker_num,
+                            size_t queue_size, const pthread_attr_t *attrs,
+                            size_t attr_stride) {
+  if (!pool || !worker_num || !queue_size) {
+    return EINVAL;
+  }
+  memset(pool, 0, sizeof(*pool));
+
+  pool->tasks = calloc(queue_size, sizeof(*pool->tasks));
+  pool->workers = calloc(worker_num, sizeof(*pool->workers));
+  if (!pool->tasks || !pool->workers) {
+    free(pool->tasks);
+    free(pool->workers);
+    return ENOMEM;
+  }
+  pool->capacity = queue_size;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pthread_cond_init(&pool->not_full, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for (size_t i = 0; i < worker_num; i++) {
+    const pthread_attr_t *attr = attrs ? &attrs[i * attr_stride] : NULL;
+    int rc =
+        pthread_create(&pool->workers[i], attr, &thread_pool_worker, pool);
+    if (rc) {
+      // tear down the ones already running
+      pool->worker_num = i;
+      thread_pool_shutdown(pool);
+      return rc;
+    }
+  }
+  pool->worker_num = worker_num;
+  return 0;
+}
+
+int thread_pool_create(struct thread_pool *pool, size_t worker_num,
+                       size_t queue_size, const pthread_attr_t *attr) {
+  return thread_pool_init(pool, worker_num, queue_size, attr, 0);
+}
+
+int thread_pool_create_attrs(struct thread_pool *pool, size_t worker_num,
+                             size_t queue_size, const pthread_attr_t *attrs) {
+  if (!attrs) {
+    return EINVAL;
+  }
+  return thread_pool_init(pool, worker_num, queue_size, attrs, 1);
+}
+
+int thread_pool_submit(struct thread_pool *pool, thread_pool_task_fn fn,
+                       void *arg) {
+  if (!pool || !fn) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&pool->lock);
+  while (pool->count == pool->capacity && !pool->shutdown) {
+    pthread_cond_wait(&pool->not_full, &pool->lock);
+  }
+  if (pool->shutdown) {
+    pthread_mutex_unlock(&pool->lock);
+    return ECANCELED;
+  }
+  thread_pool_push_locked(pool, fn, arg);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+int thread_pool_try_submit(struct thread_pool *pool, thread_pool_task_fn fn,
+                           void *arg) {
+  if (!pool || !fn) {
+    return EINVAL;
+  }
+  int rc = 0;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->shutdown) {
+    rc = ECANCELED;
+  } else if (pool->count == pool->capacity) {
+    rc = EAGAIN;
+  } else {
+    thread_pool_push_locked(pool, fn, arg);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return rc;
+}
+
+int thread_pool_wait(struct thread_pool *pool) {
+  if (!pool) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending) {
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+int thread_pool_shutdown(struct thread_pool *pool) {
+  if (!pool) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  // wake everyone: workers drain what is left, producers give up
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_cond_broadcast(&pool->not_full);
+  pthread_mutex_unlock(&pool->lock);
+
+  int err = 0;
+  for (size_t i = 0; i < pool->worker_num; i++) {
+    int rc = pthread_join(pool->workers[i], NULL);
+    if (rc && !err) {
+      err = rc;
+    }
+  }
+
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->not_full);
+  pthread_cond_destroy(&pool->not_empty);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool->tasks);
+  pool->workers = NULL;
+  pool->tasks = NULL;
+  return err;
+}
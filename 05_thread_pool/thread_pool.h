@@ -0,0 +1,67 @@
+/*
+ * Fixed-size thread pool with a bounded task queue.
+ *
+ * 01_pthread_basic/pthread_demo.c creates one thread per unit of work and
+ * throws it away afterwards; here THREAD_NUM-like workers are created once
+ * (pthread_create) and fed through a bounded MPMC queue:
+ *
+ * - thread_pool_create(): spawn worker_num joinable workers, queue with
+ *                         queue_size slots.
+ * - thread_pool_submit(): enqueue a task, blocks while the queue is full.
+ * - thread_pool_try_submit(): same, but returns EAGAIN if the queue is full.
+ * - thread_pool_wait():   blocks until every submitted task has finished.
+ * - thread_pool_shutdown(): drain the queue, wake & join all the workers and
+ *                           release the pool resources.
+ *
+ * Workers sleep on a condition variable (no sleep()/ polling) while the
+ * queue is empty; producers sleep on another one while it is full.
+ * All APIs return 0 on success or an errno value, like the pthread APIs.
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef void (*thread_pool_task_fn)(void *arg);
+
+struct thread_pool_task {
+  thread_pool_task_fn fn;
+  void *arg;
+};
+
+struct thread_pool {
+  pthread_t *workers;
+  size_t worker_num;
+
+  // bounded ring of tasks, guarded by lock
+  struct thread_pool_task *tasks;
+  size_t capacity;
+  size_t head; // next slot to pop
+  size_t tail; // next slot to push
+  size_t count;
+
+  size_t pending; // submitted, but not yet finished tasks
+  int shutdown;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty; // workers wait here
+  pthread_cond_t not_full;  // producers wait here
+  pthread_cond_t idle;      // thread_pool_wait() waits here
+};
+
+// attr may be NULL (default attributes); it must keep the default
+// PTHREAD_CREATE_JOINABLE detach state, as the workers are joined on shutdown
+int thread_pool_create(struct thread_pool *pool, size_t worker_num,
+                       size_t queue_size, const pthread_attr_t *attr);
+// same, with one attr per worker, e.g. for per-worker CPU affinity or stacks
+int thread_pool_create_attrs(struct thread_pool *pool, size_t worker_num,
+                             size_t queue_size, const pthread_attr_t *attrs);
+int thread_pool_submit(struct thread_pool *pool, thread_pool_task_fn fn,
+                       void *arg);
+int thread_pool_try_submit(struct thread_pool *pool, thread_pool_task_fn fn,
+                           void *arg);
+int thread_pool_wait(struct thread_pool *pool);
+int thread_pool_shutdown(struct thread_pool *pool);
+
+#endif // THREAD_POOL_H
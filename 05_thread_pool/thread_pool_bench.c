@@ -0,0 +1,113 @@
+/*
+ * Tasks/sec: thread_pool vs. one pthread_create()/pthread_join() per task,
+ * the way 01_pthread_basic/pthread_demo.c runs each unit of work.
+ *
+ * usage: ./thread_pool_bench [workers] [tasks] [queue_size]
+ */
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_WORKERS 4U
+#define DEF_TASKS 100000U
+#define DEF_QUEUE_SIZE 1024U
+#define TASK_SPIN 100U // some work per task, keeps the compiler honest
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_task(void *arg) {
+  uint64_t acc = (uintptr_t)arg;
+  for (unsigned int i = 0; i < TASK_SPIN; i++) {
+    acc = acc * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  __atomic_fetch_add(&sink, acc & 1, __ATOMIC_RELAXED);
+}
+
+static void *bench_thread(void *arg) {
+  bench_task(arg);
+  return NULL;
+}
+
+// keeps up to workers threads in flight, like the demo's THREAD_NUM batch
+static double bench_raw_threads(size_t workers, size_t tasks) {
+  pthread_t *tid = calloc(workers, sizeof(*tid));
+  if (!tid) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  uint64_t start = now_ns();
+  for (size_t done = 0; done < tasks; done += workers) {
+    size_t batch = tasks - done < workers ? tasks - done : workers;
+    for (size_t i = 0; i < batch; i++) {
+      int rc = pthread_create(&tid[i], NULL, &bench_thread,
+                              (void *)(uintptr_t)(done + i));
+      ERROR_CHECK(rc, 0);
+    }
+    for (size_t i = 0; i < batch; i++) {
+      int rc = pthread_join(tid[i], NULL);
+      ERROR_CHECK(rc, 0);
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  free(tid);
+  return tasks / (elapsed / 1e9);
+}
+
+static double bench_pool(size_t workers, size_t tasks, size_t queue_size) {
+  struct thread_pool pool;
+  int rc = thread_pool_create(&pool, workers, queue_size, NULL);
+  ERROR_CHECK(rc, 0);
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < tasks; i++) {
+    rc = thread_pool_submit(&pool, &bench_task, (void *)(uintptr_t)i);
+    ERROR_CHECK(rc, 0);
+  }
+  rc = thread_pool_wait(&pool);
+  ERROR_CHECK(rc, 0);
+  uint64_t elapsed = now_ns() - start;
+
+  rc = thread_pool_shutdown(&pool);
+  ERROR_CHECK(rc, 0);
+  return tasks / (elapsed / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+  size_t workers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_WORKERS;
+  size_t tasks = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_TASKS;
+  size_t queue_size = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_QUEUE_SIZE;
+  if (!workers || !tasks || !queue_size) {
+    printf("usage: %s [workers] [tasks] [queue_size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("workers: %zu, tasks: %zu, queue size: %zu\n", workers, tasks,
+         queue_size);
+  double raw = bench_raw_threads(workers, tasks);
+  double pooled = bench_pool(workers, tasks, queue_size);
+  printf("pthread_create per task: %12.0f tasks/sec\n", raw);
+  printf("thread_pool            : %12.0f tasks/sec (x%.1f)\n", pooled,
+         pooled / raw);
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include "work_stealing.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WS_INJECT_INIT_CAP 256U
+#define WS_STEAL_ROUNDS 4U // full sweeps over the victims before parking
+
+static __thread struct ws_worker *ws_self;
+
+int ws_executor_worker_index(void) {
+  return ws_self ? (int)ws_self->index : -1;
+}
+
+static uint64_t ws_rand(struct ws_worker *w) {
+  uint64_t x = w->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return w->rng = x;
+}
+
+static int ws_inject_push(struct ws_executor *ex,
+                          const struct thread_pool_task *task) {
+  pthread_mutex_lock(&ex->inject_lock);
+  if (ex->inject_count == ex->inject_cap) {
+    size_t cap = ex->inject_cap * 2;
+    struct thread_pool_task *ring = malloc(cap * sizeof(*ring));
+    if (!ring) {
+      pthread_mutex_unlock(&ex->inject_lock);
+      return ENOMEM;
+    }
+    for (size_t i = 0; i < ex->inject_count; i++) {
+      ring[i] = ex->inject[(ex->inject_head + i) % ex->inject_cap];
+    }
+    free(ex->inject);
+    ex->inject = ring;
+    ex->inject_cap = cap;
+    ex->inject_head = 0;
+  }
+  ex->inject[(ex->inject_head + ex->inject_count) % ex->inject_cap] = *task;
+  ex->inject_count++;
+  atomic_store_explicit(&ex->inject_size, ex->inject_count,
+                        memory_order_release);
+  pthread_mutex_unlock(&ex->inject_lock);
+  return 0;
+}
+
+static int ws_inject_pop(struct ws_executor *ex,
+                         struct thread_pool_task *task) {
+  if (!atomic_load_explicit(&ex->inject_size, memory_order_acquire)) {
+    return 0;
+  }
+  int found = 0;
+  pthread_mutex_lock(&ex->inject_lock);
+  if (ex->inject_count) {
+    *task = ex->inject[ex->inject_head];
+    ex->inject_head = (ex->inject_head + 1) % ex->inject_cap;
+    ex->inject_count--;
+    atomic_store_explicit(&ex->inject_size, ex->inject_count,
+                          memory_order_release);
+    found = 1;
+  }
+  pthread_mutex_unlock(&ex->inject_lock);
+  return found;
+}
+
+static int ws_try_steal(struct ws_worker *self, struct thread_pool_task *task) {
+  struct ws_executor *ex = self->ex;
+  if (ex->worker_num < 2) {
+    return 0;
+  }
+  for (unsigned int round = 0; round < WS_STEAL_ROUNDS; round++) {
+    // random starting victim, then sweep so every deque is looked at
+    size_t start = ws_rand(self) % ex->worker_num;
+    for (size_t i = 0; i < ex->worker_num; i++) {
+      struct ws_worker *victim = &ex->workers[(start + i) % ex->worker_num];
+      if (victim == self) {
+        continue;
+      }
+      int rc;
+      do {
+        rc = ws_deque_steal(&victim->deque, task);
+      } while (rc == WS_DEQUE_ABORT);
+      if (rc == WS_DEQUE_OK) {
+        self->stolen++;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int ws_find_task(struct ws_worker *self, struct thread_pool_task *task) {
+  return ws_deque_take(&self->deque, task) == WS_DEQUE_OK ||
+         ws_inject_pop(self->ex, task) || ws_try_steal(self, task);
+}
+
+static void ws_task_done(struct ws_executor *ex) {
+  if (atomic_fetch_sub(&ex->pending, 1) == 1) {
+    pthread_mutex_lock(&ex->idle_lock);
+    pthread_cond_broadcast(&ex->idle_cond);
+    pthread_mutex_unlock(&ex->idle_lock);
+  }
+}
+
+static void ws_wake(struct ws_executor *ex) {
+  // seq_cst bump/load pairs with the sleeper's increment/load in ws_park():
+  // either the submitter sees the sleeper or the sleeper sees the new epoch
+  atomic_fetch_add(&ex->epoch, 1);
+  if (atomic_load(&ex->sleepers)) {
+    pthread_mutex_lock(&ex->park_lock);
+    pthread_cond_signal(&ex->park_cond);
+    pthread_mutex_unlock(&ex->park_lock);
+  }
+}
+
+static void ws_park(struct ws_executor *ex, uint64_t seen_epoch) {
+  pthread_mutex_lock(&ex->park_lock);
+  atomic_fetch_add(&ex->sleepers, 1);
+  while (atomic_load(&ex->epoch) == seen_epoch && !atomic_load(&ex->shutdown)) {
+    pthread_cond_wait(&ex->park_cond, &ex->park_lock);
+  }
+  atomic_fetch_sub(&ex->sleepers, 1);
+  pthread_mutex_unlock(&ex->park_lock);
+}
+
+static void *ws_worker_main(void *param) {
+  struct ws_worker *self = (struct ws_worker *)param;
+  struct ws_executor *ex = self->ex;
+  struct thread_pool_task task;
+  ws_self = self;
+
+  while (1) {
+    // epoch is read before looking for work, so a submit racing with the
+    // search below is never missed by ws_park()
+    uint64_t epoch = atomic_load(&ex->epoch);
+    if (ws_find_task(self, &task)) {
+      task.fn(task.arg);
+      self->executed++;
+      ws_task_done(ex);
+      continue;
+    }
+    if (atomic_load(&ex->shutdown)) {
+      break;
+    }
+    ws_park(ex, epoch);
+  }
+  ws_self = NULL;
+  return NULL;
+}
+
+int ws_executor_create(struct ws_executor *ex, size_t worker_num,
+                       size_t deque_size) {
+  if (!ex || !worker_num) {
+    return EINVAL;
+  }
+  memset(ex, 0, sizeof(*ex));
+  ex->workers = calloc(worker_num, sizeof(*ex->workers));
+  ex->inject = calloc(WS_INJECT_INIT_CAP, sizeof(*ex->inject));
+  if (!ex->workers || !ex->inject) {
+    free(ex->workers);
+    free(ex->inject);
+    return ENOMEM;
+  }
+  ex->inject_cap = WS_INJECT_INIT_CAP;
+  atomic_init(&ex->inject_size, 0);
+  atomic_init(&ex->epoch, 0);
+  atomic_init(&ex->sleepers, 0);
+  atomic_init(&ex->pending, 0);
+  atomic_init(&ex->shutdown, 0);
+  pthread_mutex_init(&ex->inject_lock, NULL);
+  pthread_mutex_init(&ex->park_lock, NULL);
+  pthread_cond_init(&ex->park_cond, NULL);
+  pthread_mutex_init(&ex->idle_lock, NULL);
+  pthread_cond_init(&ex->idle_cond, NULL);
+
+  for (size_t i = 0; i < worker_num; i++) {
+    struct ws_worker *w = &ex->workers[i];
+    int rc = ws_deque_init(&w->deque, deque_size);
+    if (rc) {
+      ex->worker_num = i;
+      ws_executor_shutdown(ex);
+      return rc;
+    }
+    w->ex = ex;
+    w->index = i;
+    w->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+  }
+  ex->worker_num = worker_num;
+
+  for (size_t i = 0; i < worker_num; i++) {
+    int rc =
+        pthread_create(&ex->workers[i].tid, NULL, &ws_worker_main,
+                       &ex->workers[i]);
+    if (rc) {
+      // workers [i, worker_num) never started, don't join them
+      for (size_t j = i; j < worker_num; j++) {
+        ws_deque_destroy(&ex->workers[j].deque);
+      }
+      ex->worker_num = i;
+      ws_executor_shutdown(ex);
+      return rc;
+    }
+  }
+  return 0;
+}
+
+int ws_executor_submit(struct ws_executor *ex, thread_pool_task_fn fn,
+                       void *arg) {
+  if (!ex || !fn) {
+    return EINVAL;
+  }
+  if (atomic_load(&ex->shutdown)) {
+    return ECANCELED;
+  }
+  struct thread_pool_task task = {.fn = fn, .arg = arg};
+  atomic_fetch_add(&ex->pending, 1);
+
+  int rc = EAGAIN;
+  if (ws_self && ws_self->ex == ex) {
+    rc = ws_deque_push(&ws_self->deque, &task);
+  }
+  if (rc) { // external submitter, or own deque is full
+    rc = ws_inject_push(ex, &task);
+    if (rc) {
+      ws_task_done(ex);
+      return rc;
+    }
+  }
+  ws_wake(ex);
+  return 0;
+}
+
+int ws_executor_wait(struct ws_executor *ex) {
+  if (!ex) {
+    return EINVAL;
+  }
+  if (ws_self && ws_self->ex == ex) {
+    return EDEADLK; // a worker waiting for itself never finishes
+  }
+  pthread_mutex_lock(&ex->idle_lock);
+  while (atomic_load(&ex->pending)) {
+    pthread_cond_wait(&ex->idle_cond, &ex->idle_lock);
+  }
+  pthread_mutex_unlock(&ex->idle_lock);
+  return 0;
+}
+
+int ws_executor_shutdown(struct ws_executor *ex) {
+  if (!ex) {
+    return EINVAL;
+  }
+  // finish everything already submitted, then stop the workers
+  ws_executor_wait(ex);
+  atomic_store(&ex->shutdown, 1);
+  pthread_mutex_lock(&ex->park_lock);
+  pthread_cond_broadcast(&ex->park_cond);
+  pthread_mutex_unlock(&ex->park_lock);
+
+  int err = 0;
+  for (size_t i = 0; i < ex->worker_num; i++) {
+    if (ex->workers[i].tid) {
+      int rc = pthread_join(ex->workers[i].tid, NULL);
+      if (rc && !err) {
+        err = rc;
+      }
+    }
+    ws_deque_destroy(&ex->workers[i].deque);
+  }
+
+  pthread_cond_destroy(&ex->idle_cond);
+  pthread_mutex_destroy(&ex->idle_lock);
+  pthread_cond_destroy(&ex->park_cond);
+  pthread_mutex_destroy(&ex->park_lock);
+  pthread_mutex_destroy(&ex->inject_lock);
+  free(ex->inject);
+  free(ex->workers);
+  ex->inject = NULL;
+  ex->workers = NULL;
+  return err;
+}
@@ -0,0 +1,72 @@
+/*
+ * Work-stealing executor: one Chase-Lev deque per worker.
+ *
+ * - Tasks submitted from a worker (i.e. from inside a running task) go to
+ *   that worker's own deque, without any lock.
+ * - Tasks submitted from outside go to a shared injection queue.
+ * - A worker looks for work in order: own deque (LIFO) -> injection queue
+ *   -> steal from randomly chosen victims (FIFO end).
+ * - A worker which finds nothing parks on a condition variable; submitters
+ *   only take the park lock when someone is actually sleeping.
+ *
+ * API follows 05_thread_pool: 0 on success or an errno value.
+ */
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "thread_pool.h"
+#include "ws_deque.h"
+
+struct ws_executor;
+
+struct ws_worker {
+  struct ws_deque deque;
+  struct ws_executor *ex;
+  pthread_t tid;
+  size_t index;
+  uint64_t rng; // xorshift state for victim selection
+  uint64_t executed;
+  uint64_t stolen;
+};
+
+struct ws_executor {
+  struct ws_worker *workers;
+  size_t worker_num;
+
+  // shared injection queue for external submitters (growable ring)
+  pthread_mutex_t inject_lock;
+  struct thread_pool_task *inject;
+  size_t inject_cap, inject_head, inject_count;
+  atomic_size_t inject_size; // lock-free peek for idle workers
+
+  // parking
+  pthread_mutex_t park_lock;
+  pthread_cond_t park_cond;
+  atomic_uint_fast64_t epoch; // bumped on every submit
+  atomic_size_t sleepers;
+
+  // completion tracking for ws_executor_wait()
+  atomic_size_t pending;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+
+  atomic_int shutdown;
+};
+
+// deque_size must be a power of two
+int ws_executor_create(struct ws_executor *ex, size_t worker_num,
+                       size_t deque_size);
+int ws_executor_submit(struct ws_executor *ex, thread_pool_task_fn fn,
+                       void *arg);
+int ws_executor_wait(struct ws_executor *ex);
+int ws_executor_shutdown(struct ws_executor *ex);
+
+// index of the calling worker, or -1 if not called from a worker
+int ws_executor_worker_index(void);
+
+#endif // WORK_STEALING_H
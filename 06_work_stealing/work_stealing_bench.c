@@ -0,0 +1,235 @@
+/*
+ * Throughput and tail latency on deliberately unbalanced task mixes.
+ *
+ * "skewed": task i costs (i % 5 + 1) units, like sleep(task_no + 1) in
+ *           01_pthread_basic/pthread_demo.c, and every 64th task is 50x.
+ * "nested": root tasks spawn (i % 5 + 1) * NEST_FANOUT children from inside
+ *           the workers, so all the work is created on few workers.
+ *
+ * Schedulers: static (task i -> thread i % N, as the demo assigns one thread
+ * per task), 05_thread_pool (one locked queue), ws_executor (work stealing).
+ *
+ * usage: ./work_stealing_bench [workers] [tasks]
+ */
+#include "thread_pool.h"
+#include "work_stealing.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_WORKERS 4U
+#define DEF_TASKS 20000U
+#define UNIT_SPIN 2000U
+#define HEAVY_EVERY 64U
+#define HEAVY_FACTOR 50U
+#define NEST_ROOTS 64U
+#define NEST_FANOUT 32U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+struct bench_task {
+  uint64_t submit_ns;
+  uint64_t done_ns;
+  unsigned int cost;
+};
+
+struct bench_run {
+  struct bench_task *tasks;
+  size_t task_num;
+  atomic_size_t next_child; // nested: next free record for a child
+  struct thread_pool *pool;
+  struct ws_executor *ex;
+};
+
+static struct bench_run run;
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void spin(unsigned int units) {
+  uint64_t acc = units;
+  for (uint64_t i = 0; i < (uint64_t)units * UNIT_SPIN; i++) {
+    acc = acc * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  __atomic_fetch_add(&sink, acc & 1, __ATOMIC_RELAXED);
+}
+
+static void leaf_task(void *arg) {
+  struct bench_task *t = (struct bench_task *)arg;
+  spin(t->cost);
+  t->done_ns = now_ns();
+}
+
+static void spawn(struct bench_task *t, thread_pool_task_fn fn) {
+  t->submit_ns = now_ns();
+  int rc = run.ex ? ws_executor_submit(run.ex, fn, t)
+                  : thread_pool_submit(run.pool, fn, t);
+  ERROR_CHECK(rc, 0);
+}
+
+static void root_task(void *arg) {
+  struct bench_task *t = (struct bench_task *)arg;
+  size_t idx = t - run.tasks;
+  size_t children = (idx % 5 + 1) * NEST_FANOUT;
+  for (size_t i = 0; i < children; i++) {
+    size_t c = atomic_fetch_add(&run.next_child, 1);
+    run.tasks[c].cost = 1;
+    spawn(&run.tasks[c], &leaf_task);
+  }
+  t->done_ns = now_ns();
+}
+
+static void prepare_skewed(size_t task_num) {
+  for (size_t i = 0; i < task_num; i++) {
+    run.tasks[i].cost = (i % 5 + 1) * (i % HEAVY_EVERY ? 1 : HEAVY_FACTOR);
+  }
+  run.task_num = task_num;
+}
+
+static size_t nested_task_num(void) {
+  size_t n = NEST_ROOTS;
+  for (size_t i = 0; i < NEST_ROOTS; i++) {
+    n += (i % 5 + 1) * NEST_FANOUT;
+  }
+  return n;
+}
+
+static void prepare_nested(void) {
+  run.task_num = nested_task_num();
+  atomic_store(&run.next_child, NEST_ROOTS);
+}
+
+struct static_arg {
+  size_t first, stride;
+};
+
+static void *static_worker(void *param) {
+  struct static_arg *a = (struct static_arg *)param;
+  for (size_t i = a->first; i < run.task_num; i += a->stride) {
+    leaf_task(&run.tasks[i]);
+  }
+  return NULL;
+}
+
+static uint64_t run_static(size_t workers) {
+  pthread_t tid[workers];
+  struct static_arg args[workers];
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < run.task_num; i++) {
+    run.tasks[i].submit_ns = start;
+  }
+  for (size_t i = 0; i < workers; i++) {
+    args[i].first = i;
+    args[i].stride = workers;
+    int rc = pthread_create(&tid[i], NULL, &static_worker, &args[i]);
+    ERROR_CHECK(rc, 0);
+  }
+  for (size_t i = 0; i < workers; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  return now_ns() - start;
+}
+
+// roots only for nested, everything for skewed
+static uint64_t run_scheduler(size_t roots, thread_pool_task_fn fn) {
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < roots; i++) {
+    spawn(&run.tasks[i], fn);
+  }
+  int rc = run.ex ? ws_executor_wait(run.ex) : thread_pool_wait(run.pool);
+  ERROR_CHECK(rc, 0);
+  return now_ns() - start;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, uint64_t elapsed) {
+  uint64_t *lat = malloc(run.task_num * sizeof(*lat));
+  if (!lat) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t i = 0; i < run.task_num; i++) {
+    lat[i] = run.tasks[i].done_ns - run.tasks[i].submit_ns;
+  }
+  qsort(lat, run.task_num, sizeof(*lat), &cmp_u64);
+  printf("  %-12s %10.0f tasks/sec  p50 %8.3f ms  p99 %8.3f ms  max %8.3f "
+         "ms\n",
+         name, run.task_num / (elapsed / 1e9), lat[run.task_num / 2] / 1e6,
+         lat[run.task_num * 99 / 100] / 1e6, lat[run.task_num - 1] / 1e6);
+  free(lat);
+}
+
+int main(int argc, char *argv[]) {
+  size_t workers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_WORKERS;
+  size_t task_num = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_TASKS;
+  if (!workers || !task_num) {
+    printf("usage: %s [workers] [tasks]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t records = task_num > nested_task_num() ? task_num : nested_task_num();
+  run.tasks = calloc(records, sizeof(*run.tasks));
+  if (!run.tasks) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+
+  struct thread_pool pool;
+  struct ws_executor ex;
+  int rc = thread_pool_create(&pool, workers, records, NULL);
+  ERROR_CHECK(rc, 0);
+  rc = ws_executor_create(&ex, workers, 4096);
+  ERROR_CHECK(rc, 0);
+
+  printf("workers: %zu\n", workers);
+  printf("skewed (%zu tasks):\n", task_num);
+  prepare_skewed(task_num);
+  report("static", run_static(workers));
+  run.pool = &pool;
+  run.ex = NULL;
+  report("thread_pool", run_scheduler(task_num, &leaf_task));
+  run.ex = &ex;
+  report("ws_executor", run_scheduler(task_num, &leaf_task));
+
+  printf("nested (%zu roots, %zu tasks):\n", (size_t)NEST_ROOTS,
+         nested_task_num());
+  prepare_nested();
+  run.ex = NULL;
+  report("thread_pool", run_scheduler(NEST_ROOTS, &root_task));
+  prepare_nested();
+  run.ex = &ex;
+  report("ws_executor", run_scheduler(NEST_ROOTS, &root_task));
+
+  uint64_t executed = 0, stolen = 0;
+  for (size_t i = 0; i < workers; i++) {
+    executed += ex.workers[i].executed;
+    stolen += ex.workers[i].stolen;
+  }
+  printf("ws_executor: %lu tasks executed, %lu stolen\n",
+         (unsigned long)executed, (unsigned long)stolen);
+
+  rc = ws_executor_shutdown(&ex);
+  ERROR_CHECK(rc, 0);
+  rc = thread_pool_shutdown(&pool);
+  ERROR_CHECK(rc, 0);
+  free(run.tasks);
+  return 0;
+}
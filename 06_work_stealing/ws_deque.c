@@ -0,0 +1,92 @@
+#include "ws_deque.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+// slots are read by thieves while the owner may be writing a wrapped-around
+// slot; such reads are thrown away by the failing CAS on top, but they still
+// have to be atomic accesses
+static inline void slot_store(struct thread_pool_task *slot,
+                              const struct thread_pool_task *task) {
+  __atomic_store_n(&slot->fn, task->fn, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->arg, task->arg, __ATOMIC_RELAXED);
+}
+
+static inline void slot_load(struct thread_pool_task *slot,
+                             struct thread_pool_task *task) {
+  task->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+  task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+}
+
+int ws_deque_init(struct ws_deque *dq, size_t capacity) {
+  if (!dq || !capacity || (capacity & (capacity - 1))) {
+    return EINVAL; // must be a power of two
+  }
+  dq->buf = calloc(capacity, sizeof(*dq->buf));
+  if (!dq->buf) {
+    return ENOMEM;
+  }
+  dq->mask = (int64_t)capacity - 1;
+  atomic_init(&dq->top, 0);
+  atomic_init(&dq->bottom, 0);
+  return 0;
+}
+
+void ws_deque_destroy(struct ws_deque *dq) {
+  free(dq->buf);
+  dq->buf = NULL;
+}
+
+int ws_deque_push(struct ws_deque *dq, const struct thread_pool_task *task) {
+  int64_t b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  if (b - t > dq->mask) {
+    return EAGAIN;
+  }
+  slot_store(&dq->buf[b & dq->mask], task);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+  return 0;
+}
+
+int ws_deque_take(struct ws_deque *dq, struct thread_pool_task *task) {
+  int64_t b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+  if (t > b) { // empty
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    return WS_DEQUE_EMPTY;
+  }
+  slot_load(&dq->buf[b & dq->mask], task);
+  if (t != b) { // more than one left, no thief can reach this one
+    return WS_DEQUE_OK;
+  }
+  // last element: race against the thieves for it
+  int rc = WS_DEQUE_OK;
+  if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    rc = WS_DEQUE_EMPTY;
+  }
+  atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+  return rc;
+}
+
+int ws_deque_steal(struct ws_deque *dq, struct thread_pool_task *task) {
+  int64_t t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+  if (t >= b) {
+    return WS_DEQUE_EMPTY;
+  }
+  slot_load(&dq->buf[t & dq->mask], task);
+  if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return WS_DEQUE_ABORT;
+  }
+  return WS_DEQUE_OK;
+}
@@ -0,0 +1,39 @@
+/*
+ * Chase-Lev work-stealing deque, C11 memory model version from
+ * "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (Le, Pop, Cohen, Zappa Nardelli - PPoPP 2013).
+ *
+ * - ws_deque_push(): owner only, pushes at the bottom. EAGAIN when full.
+ * - ws_deque_take(): owner only, pops at the bottom (LIFO, cache warm).
+ * - ws_deque_steal(): any thread, pops at the top (FIFO, oldest task).
+ *
+ * The ring has a fixed power-of-two capacity; the owner falls back to the
+ * executor's shared queue when it is full instead of growing the ring.
+ */
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "thread_pool.h" // struct thread_pool_task
+
+#define WS_DEQUE_EMPTY 0
+#define WS_DEQUE_OK 1
+#define WS_DEQUE_ABORT 2 // lost a race with the owner or another thief
+
+struct ws_deque {
+  _Alignas(64) atomic_int_fast64_t top;
+  _Alignas(64) atomic_int_fast64_t bottom;
+  _Alignas(64) struct thread_pool_task *buf;
+  int64_t mask;
+};
+
+int ws_deque_init(struct ws_deque *dq, size_t capacity);
+void ws_deque_destroy(struct ws_deque *dq);
+int ws_deque_push(struct ws_deque *dq, const struct thread_pool_task *task);
+int ws_deque_take(struct ws_deque *dq, struct thread_pool_task *task);
+int ws_deque_steal(struct ws_deque *dq, struct thread_pool_task *task);
+
+#endif // WS_DEQUE_H
@@ -0,0 +1,222 @@
+#include "thread_context.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREAD_CTX_CACHE_LINE 64U
+#define THREAD_CTX_SLAB_OBJS 64U // objects carved out of one slab chunk
+
+struct thread_ctx_free {
+  struct thread_ctx_free *next;
+};
+
+struct thread_ctx_key_info {
+  size_t size; // rounded up to a multiple of the cache line
+  void (*destructor)(void *obj);
+  atomic_int live; // created, not deleted
+  pthread_mutex_t lock; // guards free_list and chunks, slow path only
+  struct thread_ctx_free *free_list;
+  void *chunks; // slab chunks, freed by thread_ctx_key_delete()
+};
+
+// a thread with objects, so thread_ctx_key_delete() can clear its slot
+struct thread_ctx_thread {
+  void **slot;
+  struct thread_ctx_thread *next;
+  struct thread_ctx_thread **pprev; // NULL while not listed
+};
+
+__thread void *thread_ctx_slot[THREAD_CTX_MAX_KEYS];
+static __thread int thread_ctx_registered;
+static __thread struct thread_ctx_thread thread_ctx_self;
+
+static struct thread_ctx_key_info thread_ctx_keys[THREAD_CTX_MAX_KEYS];
+static atomic_uint thread_ctx_key_num; // high water mark of the key ids
+// guards key creation/deletion, thread_ctx_threads and, against
+// thread_ctx_key_delete(), the slots of listed threads
+static pthread_mutex_t thread_ctx_key_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct thread_ctx_thread *thread_ctx_threads;
+
+// one real pthread key, only used to get a callback at thread exit
+static pthread_key_t thread_ctx_exit_key;
+static pthread_once_t thread_ctx_once = PTHREAD_ONCE_INIT;
+
+static void thread_ctx_exit(void *param) {
+  (void)param;
+  thread_ctx_release();
+}
+
+static void thread_ctx_init(void) {
+  pthread_key_create(&thread_ctx_exit_key, &thread_ctx_exit);
+}
+
+int thread_ctx_key_create(thread_ctx_key_t *key, size_t size,
+                          void (*destructor)(void *obj)) {
+  if (!key || !size) {
+    return EINVAL;
+  }
+  pthread_once(&thread_ctx_once, &thread_ctx_init);
+
+  pthread_mutex_lock(&thread_ctx_key_lock);
+  unsigned int num = atomic_load_explicit(&thread_ctx_key_num,
+                                          memory_order_relaxed);
+  // the first deleted id, if any
+  unsigned int k = 0;
+  while (k < num &&
+         atomic_load_explicit(&thread_ctx_keys[k].live, memory_order_relaxed)) {
+    k++;
+  }
+  if (k == THREAD_CTX_MAX_KEYS) {
+    pthread_mutex_unlock(&thread_ctx_key_lock);
+    return EAGAIN; // same as pthread_key_create() with PTHREAD_KEYS_MAX
+  }
+  struct thread_ctx_key_info *info = &thread_ctx_keys[k];
+  info->size = (size + THREAD_CTX_CACHE_LINE - 1) & ~(THREAD_CTX_CACHE_LINE - 1);
+  info->destructor = destructor;
+  info->free_list = NULL;
+  info->chunks = NULL;
+  pthread_mutex_init(&info->lock, NULL);
+  // publish the filled in entry
+  atomic_store_explicit(&info->live, 1, memory_order_release);
+  if (k == num) {
+    atomic_store_explicit(&thread_ctx_key_num, k + 1, memory_order_release);
+  }
+  pthread_mutex_unlock(&thread_ctx_key_lock);
+
+  *key = k;
+  return 0;
+}
+
+int thread_ctx_key_delete(thread_ctx_key_t key) {
+  pthread_mutex_lock(&thread_ctx_key_lock);
+  if (key >= atomic_load_explicit(&thread_ctx_key_num, memory_order_relaxed) ||
+      !atomic_load_explicit(&thread_ctx_keys[key].live, memory_order_relaxed)) {
+    pthread_mutex_unlock(&thread_ctx_key_lock);
+    return EINVAL;
+  }
+  struct thread_ctx_key_info *info = &thread_ctx_keys[key];
+  atomic_store_explicit(&info->live, 0, memory_order_relaxed);
+  // threads still running keep their object in the slot: a new key with
+  // this id must not find it
+  for (struct thread_ctx_thread *t = thread_ctx_threads; t; t = t->next) {
+    t->slot[key] = NULL;
+  }
+  while (info->chunks) {
+    void *next = *(void **)info->chunks;
+    free(info->chunks);
+    info->chunks = next;
+  }
+  info->free_list = NULL;
+  pthread_mutex_destroy(&info->lock);
+  pthread_mutex_unlock(&thread_ctx_key_lock);
+  return 0;
+}
+
+static void *thread_ctx_slab_alloc(struct thread_ctx_key_info *info) {
+  pthread_mutex_lock(&info->lock);
+  if (!info->free_list) {
+    // chunks are only returned by thread_ctx_key_delete(), the objects are
+    // recycled between threads; the first cache line links the chunks
+    char *chunk = aligned_alloc(THREAD_CTX_CACHE_LINE,
+                                THREAD_CTX_CACHE_LINE +
+                                    info->size * THREAD_CTX_SLAB_OBJS);
+    if (!chunk) {
+      pthread_mutex_unlock(&info->lock);
+      return NULL;
+    }
+    *(void **)chunk = info->chunks;
+    info->chunks = chunk;
+    for (unsigned int i = 0; i < THREAD_CTX_SLAB_OBJS; i++) {
+      struct thread_ctx_free *obj =
+          (struct thread_ctx_free *)(chunk + THREAD_CTX_CACHE_LINE +
+                                     i * info->size);
+      obj->next = info->free_list;
+      info->free_list = obj;
+    }
+  }
+  struct thread_ctx_free *obj = info->free_list;
+  info->free_list = obj->next;
+  pthread_mutex_unlock(&info->lock);
+
+  memset(obj, 0, info->size);
+  return obj;
+}
+
+static void thread_ctx_slab_free(struct thread_ctx_key_info *info, void *ptr) {
+  struct thread_ctx_free *obj = (struct thread_ctx_free *)ptr;
+  pthread_mutex_lock(&info->lock);
+  obj->next = info->free_list;
+  info->free_list = obj;
+  pthread_mutex_unlock(&info->lock);
+}
+
+void *thread_ctx_get_slow(thread_ctx_key_t key) {
+  if (key >= atomic_load_explicit(&thread_ctx_key_num, memory_order_acquire) ||
+      !atomic_load_explicit(&thread_ctx_keys[key].live, memory_order_acquire)) {
+    return NULL;
+  }
+  if (!thread_ctx_registered) {
+    // any non NULL value, just to have thread_ctx_exit() called
+    if (pthread_setspecific(thread_ctx_exit_key, &thread_ctx_registered)) {
+      return NULL;
+    }
+    thread_ctx_registered = 1;
+    struct thread_ctx_thread *self = &thread_ctx_self;
+    self->slot = thread_ctx_slot;
+    pthread_mutex_lock(&thread_ctx_key_lock);
+    self->next = thread_ctx_threads;
+    if (self->next) {
+      self->next->pprev = &self->next;
+    }
+    thread_ctx_threads = self;
+    self->pprev = &thread_ctx_threads;
+    pthread_mutex_unlock(&thread_ctx_key_lock);
+  }
+  void *obj = thread_ctx_slab_alloc(&thread_ctx_keys[key]);
+  thread_ctx_slot[key] = obj;
+  return obj;
+}
+
+void thread_ctx_release(void) {
+  unsigned int key_num =
+      atomic_load_explicit(&thread_ctx_key_num, memory_order_acquire);
+  if (!key_num) {
+    return;
+  }
+  // a destructor calling thread_ctx_get() registers the thread again, and
+  // the exit callback is then repeated (PTHREAD_DESTRUCTOR_ITERATIONS)
+  thread_ctx_registered = 0;
+  if (pthread_getspecific(thread_ctx_exit_key)) {
+    pthread_setspecific(thread_ctx_exit_key, NULL);
+  }
+  // taken out under the lock, thread_ctx_key_delete() may be clearing them
+  void *objs[THREAD_CTX_MAX_KEYS];
+  struct thread_ctx_thread *self = &thread_ctx_self;
+  pthread_mutex_lock(&thread_ctx_key_lock);
+  if (self->pprev) {
+    *self->pprev = self->next;
+    if (self->next) {
+      self->next->pprev = self->pprev;
+    }
+    self->next = NULL;
+    self->pprev = NULL;
+  }
+  for (unsigned int k = 0; k < key_num; k++) {
+    objs[k] = thread_ctx_slot[k];
+    thread_ctx_slot[k] = NULL;
+  }
+  pthread_mutex_unlock(&thread_ctx_key_lock);
+  for (unsigned int k = 0; k < key_num; k++) {
+    void *obj = objs[k];
+    if (!obj) {
+      continue;
+    }
+    if (thread_ctx_keys[k].destructor) {
+      thread_ctx_keys[k].destructor(obj);
+    }
+    thread_ctx_slab_free(&thread_ctx_keys[k], obj);
+  }
+}
@@ -0,0 +1,50 @@
+/*
+ * Per-thread context, a faster alternative to pthread_key/pthread_once for
+ * thread specific data (see hello_key in 01_pthread_basic/pthread_demo.c).
+ *
+ * - thread_ctx_key_create(): register a per-thread object of "size" bytes
+ *                            and its destructor, like pthread_key_create().
+ * - thread_ctx_key_delete(): give the id back, like pthread_key_delete():
+ *                            no destructor runs, every thread's object for
+ *                            the key is freed. No thread may be using the
+ *                            key any more.
+ * - thread_ctx_get():        the calling thread's object for the key;
+ *                            allocated (zeroed) on first use.
+ * - thread_ctx_release():    run the destructors for the calling thread now
+ *                            (otherwise done at thread exit).
+ *
+ * Hot path: thread_ctx_get() is inlined and reads a "__thread" pointer
+ * array, i.e. one TLS load with no call and no lock. Only the first access
+ * per key and thread takes the slow path.
+ *
+ * Objects come from a per-key slab of cache-line-sized blocks, so contexts
+ * of different threads never share a cache line and are recycled for the
+ * next thread on exit instead of malloc()/free() per thread.
+ * The destructor releases what the object owns, not the object itself.
+ */
+#ifndef THREAD_CONTEXT_H
+#define THREAD_CONTEXT_H
+
+#include <stddef.h>
+
+#define THREAD_CTX_MAX_KEYS 32U // live at once, deleted ids are reused
+
+typedef unsigned int thread_ctx_key_t;
+
+extern __thread void *thread_ctx_slot[THREAD_CTX_MAX_KEYS];
+
+int thread_ctx_key_create(thread_ctx_key_t *key, size_t size,
+                          void (*destructor)(void *obj));
+int thread_ctx_key_delete(thread_ctx_key_t key);
+void *thread_ctx_get_slow(thread_ctx_key_t key);
+void thread_ctx_release(void);
+
+static inline void *thread_ctx_get(thread_ctx_key_t key) {
+  void *obj = thread_ctx_slot[key];
+  if (__builtin_expect(!obj, 0)) {
+    obj = thread_ctx_get_slow(key);
+  }
+  return obj;
+}
+
+#endif // THREAD_CONTEXT_H
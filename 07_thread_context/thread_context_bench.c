@@ -0,0 +1,160 @@
+/*
+ * ns/op of the thread specific data lookup done in hello_thread_function()
+ * (01_pthread_basic/pthread_demo.c): pthread_getspecific() vs.
+ * thread_ctx_get() vs. a plain "__thread" variable, across 1-64 threads.
+ *
+ * Each thread measures its own CPU time (CLOCK_THREAD_CPUTIME_ID), so the
+ * numbers stay meaningful when there are more threads than cores.
+ *
+ * usage: ./thread_context_bench [iterations per thread] [max threads]
+ */
+#include "thread_context.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_ITERATIONS 1000000U
+#define DEF_MAX_THREADS 64U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+// same TSD as the demo
+struct hello_thread_spec_data {
+  int task_no;
+  const char *task_name;
+};
+
+enum bench_mode { MODE_GETSPECIFIC, MODE_THREAD_CTX, MODE_TLS, MODE_NUM };
+static const char *mode_name[MODE_NUM] = {"pthread_getspecific",
+                                          "thread_ctx_get", "__thread"};
+
+static pthread_key_t hello_key;
+static thread_ctx_key_t hello_ctx_key;
+static __thread struct hello_thread_spec_data hello_tls;
+
+static size_t iterations;
+static enum bench_mode mode;
+
+struct bench_result {
+  uint64_t cpu_ns;
+  uint64_t checksum;
+};
+
+static uint64_t thread_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hello_key_destructor(void *param) { free(param); }
+
+static void *bench_thread(void *param) {
+  struct bench_result *res = (struct bench_result *)param;
+  uint64_t sum = 0;
+  uint64_t start = 0;
+
+  switch (mode) {
+  case MODE_GETSPECIFIC: {
+    struct hello_thread_spec_data *t_data = malloc(sizeof(*t_data));
+    if (!t_data) {
+      ERROR_CHECK(ENOMEM, 0);
+    }
+    t_data->task_no = 1;
+    pthread_setspecific(hello_key, t_data);
+    start = thread_cpu_ns();
+    for (size_t i = 0; i < iterations; i++) {
+      sum += ((struct hello_thread_spec_data *)pthread_getspecific(hello_key))
+                 ->task_no;
+      // keeps the lookup inside the loop, as if printf() was called here
+      __asm__ volatile("" ::: "memory");
+    }
+    break;
+  }
+  case MODE_THREAD_CTX: {
+    struct hello_thread_spec_data *t_data = thread_ctx_get(hello_ctx_key);
+    t_data->task_no = 1;
+    start = thread_cpu_ns();
+    for (size_t i = 0; i < iterations; i++) {
+      sum += ((struct hello_thread_spec_data *)thread_ctx_get(hello_ctx_key))
+                 ->task_no;
+      __asm__ volatile("" ::: "memory");
+    }
+    break;
+  }
+  default:
+    hello_tls.task_no = 1;
+    start = thread_cpu_ns();
+    for (size_t i = 0; i < iterations; i++) {
+      sum += hello_tls.task_no;
+      __asm__ volatile("" ::: "memory");
+    }
+    break;
+  }
+  res->cpu_ns = thread_cpu_ns() - start;
+  res->checksum = sum;
+  return NULL;
+}
+
+static double run(size_t threads) {
+  pthread_t tid[threads];
+  struct bench_result res[threads];
+  for (size_t i = 0; i < threads; i++) {
+    int rc = pthread_create(&tid[i], NULL, &bench_thread, &res[i]);
+    ERROR_CHECK(rc, 0);
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < threads; i++) {
+    pthread_join(tid[i], NULL);
+    if (res[i].checksum != iterations) {
+      printf("checksum mismatch in thread %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+    total += res[i].cpu_ns;
+  }
+  return (double)total / (threads * iterations);
+}
+
+int main(int argc, char *argv[]) {
+  iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_ITERATIONS;
+  size_t max_threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_MAX_THREADS;
+  if (!iterations || !max_threads) {
+    printf("usage: %s [iterations per thread] [max threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int rc = pthread_key_create(&hello_key, &hello_key_destructor);
+  ERROR_CHECK(rc, 0);
+  rc = thread_ctx_key_create(&hello_ctx_key,
+                             sizeof(struct hello_thread_spec_data), NULL);
+  ERROR_CHECK(rc, 0);
+
+  printf("%-8s", "threads");
+  for (int m = 0; m < MODE_NUM; m++) {
+    printf(" %20s", mode_name[m]);
+  }
+  printf("   (ns/op)\n");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("%-8zu", threads);
+    for (mode = 0; mode < MODE_NUM; mode++) {
+      printf(" %20.2f", run(threads));
+    }
+    printf("\n");
+  }
+
+  pthread_key_delete(hello_key);
+  return 0;
+}
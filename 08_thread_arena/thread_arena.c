@@ -0,0 +1,338 @@
+#include "thread_arena.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREAD_ARENA_ALIGN 16U
+#define THREAD_OBJ_POOL_CHUNK 256U // objects per malloc()ed chunk
+
+#define ALIGN_UP(X, A) (((X) + (A)-1) & ~((size_t)(A)-1))
+
+struct thread_arena_block {
+  struct thread_arena_block *next;
+  size_t size; // payload bytes
+  size_t used;
+  _Alignas(THREAD_ARENA_ALIGN) char data[];
+};
+
+struct thread_arena {
+  struct thread_arena_block *first; // blocks in acquisition order
+  struct thread_arena_block *cur;   // block being bumped
+  struct thread_arena_block *large; // dedicated blocks for big allocations
+};
+
+#define THREAD_ARENA_PAYLOAD                                                   \
+  (THREAD_ARENA_BLOCK_SIZE - sizeof(struct thread_arena_block))
+
+// process wide depot of free blocks, only touched once per block refill
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct thread_arena_block *depot;
+static size_t depot_free, depot_total, depot_large;
+
+static thread_ctx_key_t arena_key;
+static int arena_key_rc;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void thread_arena_destructor(void *obj);
+
+static void thread_arena_init(void) {
+  arena_key_rc = thread_ctx_key_create(&arena_key, sizeof(struct thread_arena),
+                                       &thread_arena_destructor);
+}
+
+static struct thread_arena *thread_arena_self(void) {
+  pthread_once(&arena_once, &thread_arena_init);
+  return arena_key_rc ? NULL : thread_ctx_get(arena_key);
+}
+
+static struct thread_arena_block *depot_get(void) {
+  pthread_mutex_lock(&depot_lock);
+  struct thread_arena_block *blk = depot;
+  if (blk) {
+    depot = blk->next;
+    depot_free--;
+  }
+  pthread_mutex_unlock(&depot_lock);
+
+  if (!blk) {
+    blk = aligned_alloc(THREAD_ARENA_ALIGN, THREAD_ARENA_BLOCK_SIZE);
+    if (!blk) {
+      return NULL;
+    }
+    blk->size = THREAD_ARENA_PAYLOAD;
+    pthread_mutex_lock(&depot_lock);
+    depot_total++;
+    pthread_mutex_unlock(&depot_lock);
+  }
+  blk->next = NULL;
+  blk->used = 0;
+  return blk;
+}
+
+// gives back a whole list in one go
+static void depot_put(struct thread_arena_block *list) {
+  if (!list) {
+    return;
+  }
+  size_t n = 1;
+  struct thread_arena_block *last = list;
+  while (last->next) {
+    last = last->next;
+    n++;
+  }
+  pthread_mutex_lock(&depot_lock);
+  last->next = depot;
+  depot = list;
+  depot_free += n;
+  pthread_mutex_unlock(&depot_lock);
+}
+
+static void free_large(struct thread_arena *arena) {
+  size_t n = 0;
+  while (arena->large) {
+    struct thread_arena_block *blk = arena->large;
+    arena->large = blk->next;
+    free(blk);
+    n++;
+  }
+  if (n) {
+    pthread_mutex_lock(&depot_lock);
+    depot_large -= n;
+    pthread_mutex_unlock(&depot_lock);
+  }
+}
+
+static void *alloc_large(struct thread_arena *arena, size_t size) {
+  struct thread_arena_block *blk =
+      aligned_alloc(THREAD_ARENA_ALIGN,
+                    ALIGN_UP(sizeof(*blk) + size, THREAD_ARENA_ALIGN));
+  if (!blk) {
+    return NULL;
+  }
+  blk->size = blk->used = size;
+  blk->next = arena->large;
+  arena->large = blk;
+  pthread_mutex_lock(&depot_lock);
+  depot_large++;
+  pthread_mutex_unlock(&depot_lock);
+  return blk->data;
+}
+
+void *thread_arena_alloc(size_t size) {
+  struct thread_arena *arena = thread_arena_self();
+  if (!arena) {
+    return NULL;
+  }
+  size = ALIGN_UP(size ? size : 1, THREAD_ARENA_ALIGN);
+  if (size > THREAD_ARENA_PAYLOAD) {
+    return alloc_large(arena, size);
+  }
+
+  struct thread_arena_block *blk = arena->cur;
+  while (!blk || blk->used + size > blk->size) {
+    if (blk && blk->next) { // left over from before thread_arena_reset()
+      blk = blk->next;
+      blk->used = 0;
+      continue;
+    }
+    struct thread_arena_block *fresh = depot_get();
+    if (!fresh) {
+      return NULL;
+    }
+    if (blk) {
+      blk->next = fresh;
+    } else {
+      arena->first = fresh;
+    }
+    blk = fresh;
+  }
+  arena->cur = blk;
+  void *ptr = blk->data + blk->used;
+  blk->used += size;
+  return ptr;
+}
+
+void thread_arena_reset(void) {
+  struct thread_arena *arena = thread_arena_self();
+  if (!arena) {
+    return;
+  }
+  free_large(arena);
+  arena->cur = arena->first;
+  if (arena->cur) {
+    arena->cur->used = 0;
+  }
+}
+
+static void thread_arena_destructor(void *obj) {
+  struct thread_arena *arena = (struct thread_arena *)obj;
+  free_large(arena);
+  depot_put(arena->first);
+  arena->first = arena->cur = NULL;
+}
+
+void thread_arena_release(void) {
+  struct thread_arena *arena = thread_arena_self();
+  if (arena) {
+    thread_arena_destructor(arena);
+  }
+}
+
+void thread_arena_trim(void) {
+  pthread_mutex_lock(&depot_lock);
+  struct thread_arena_block *list = depot;
+  depot = NULL;
+  depot_total -= depot_free;
+  depot_free = 0;
+  pthread_mutex_unlock(&depot_lock);
+
+  while (list) {
+    struct thread_arena_block *next = list->next;
+    free(list);
+    list = next;
+  }
+}
+
+void thread_arena_get_stats(struct thread_arena_stats *stats) {
+  pthread_mutex_lock(&depot_lock);
+  stats->blocks_total = depot_total;
+  stats->blocks_free = depot_free;
+  stats->large_in_use = depot_large;
+  pthread_mutex_unlock(&depot_lock);
+}
+
+/* thread_obj_pool */
+
+struct pool_free {
+  struct pool_free *next;
+};
+
+struct pool_magazine {
+  struct thread_obj_pool *pool;
+  size_t count;
+  void *objs[THREAD_OBJ_POOL_MAGAZINE];
+};
+
+static void pool_spill(struct pool_magazine *mag, size_t n) {
+  struct thread_obj_pool *pool = mag->pool;
+  pthread_mutex_lock(&pool->lock);
+  while (n-- && mag->count) {
+    struct pool_free *obj = (struct pool_free *)mag->objs[--mag->count];
+    obj->next = (struct pool_free *)pool->free_list;
+    pool->free_list = obj;
+    pool->obj_free++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static int pool_refill(struct pool_magazine *mag, size_t n) {
+  struct thread_obj_pool *pool = mag->pool;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->obj_free < n) {
+    // first word of the chunk links the chunks, objects follow it
+    size_t header = ALIGN_UP(sizeof(void *), THREAD_ARENA_ALIGN);
+    char *chunk = malloc(header + pool->obj_size * THREAD_OBJ_POOL_CHUNK);
+    if (chunk) {
+      *(void **)chunk = pool->chunks;
+      pool->chunks = chunk;
+      for (size_t i = 0; i < THREAD_OBJ_POOL_CHUNK; i++) {
+        struct pool_free *obj =
+            (struct pool_free *)(chunk + header + i * pool->obj_size);
+        obj->next = (struct pool_free *)pool->free_list;
+        pool->free_list = obj;
+      }
+      pool->obj_total += THREAD_OBJ_POOL_CHUNK;
+      pool->obj_free += THREAD_OBJ_POOL_CHUNK;
+    }
+  }
+  while (n-- && pool->free_list) {
+    struct pool_free *obj = (struct pool_free *)pool->free_list;
+    pool->free_list = obj->next;
+    pool->obj_free--;
+    mag->objs[mag->count++] = obj;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return mag->count ? 0 : ENOMEM;
+}
+
+static void pool_magazine_destructor(void *obj) {
+  struct pool_magazine *mag = (struct pool_magazine *)obj;
+  if (mag->pool) {
+    pool_spill(mag, mag->count);
+  }
+}
+
+static struct pool_magazine *pool_magazine_self(struct thread_obj_pool *pool) {
+  struct pool_magazine *mag = thread_ctx_get(pool->magazine_key);
+  if (mag && !mag->pool) {
+    mag->pool = pool;
+  }
+  return mag;
+}
+
+int thread_obj_pool_init(struct thread_obj_pool *pool, size_t obj_size) {
+  if (!pool || !obj_size) {
+    return EINVAL;
+  }
+  memset(pool, 0, sizeof(*pool));
+  pool->obj_size = ALIGN_UP(obj_size < sizeof(struct pool_free)
+                                ? sizeof(struct pool_free)
+                                : obj_size,
+                            THREAD_ARENA_ALIGN);
+  int rc = thread_ctx_key_create(&pool->magazine_key,
+                                 sizeof(struct pool_magazine),
+                                 &pool_magazine_destructor);
+  if (rc) {
+    return rc;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  return 0;
+}
+
+void *thread_obj_pool_alloc(struct thread_obj_pool *pool) {
+  struct pool_magazine *mag = pool_magazine_self(pool);
+  if (!mag) {
+    return NULL;
+  }
+  if (!mag->count && pool_refill(mag, THREAD_OBJ_POOL_MAGAZINE / 2)) {
+    return NULL;
+  }
+  return mag->objs[--mag->count];
+}
+
+void thread_obj_pool_free(struct thread_obj_pool *pool, void *obj) {
+  if (!obj) {
+    return;
+  }
+  struct pool_magazine *mag = pool_magazine_self(pool);
+  if (!mag) { // no magazine for this thread, straight to the pool
+    struct pool_free *f = (struct pool_free *)obj;
+    pthread_mutex_lock(&pool->lock);
+    f->next = (struct pool_free *)pool->free_list;
+    pool->free_list = f;
+    pool->obj_free++;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+  if (mag->count == THREAD_OBJ_POOL_MAGAZINE) {
+    pool_spill(mag, THREAD_OBJ_POOL_MAGAZINE / 2);
+  }
+  mag->objs[mag->count++] = obj;
+}
+
+void thread_obj_pool_destroy(struct thread_obj_pool *pool) {
+  // frees the magazines still alive (the calling thread's) without their
+  // destructor, and gives the key back: its objects are freed with the
+  // chunks below
+  thread_ctx_key_delete(pool->magazine_key);
+  while (pool->chunks) {
+    void *next = *(void **)pool->chunks;
+    free(pool->chunks);
+    pool->chunks = next;
+  }
+  pool->free_list = NULL;
+  pool->obj_total = pool->obj_free = 0;
+  pthread_mutex_destroy(&pool->lock);
+}
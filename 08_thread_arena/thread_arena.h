@@ -0,0 +1,69 @@
+/*
+ * Per-thread allocators for the short-lived allocations done by every
+ * worker (thread specific data, scratch buffers, exit codes), instead of
+ * malloc()/free() from thousands of starting and stopping threads.
+ *
+ * thread_arena: bump allocator owned by the calling thread.
+ * - thread_arena_alloc():   carve size bytes (16 bytes aligned) from the
+ *                           current block, no lock.
+ * - thread_arena_reset():   forget all the allocations, keep the blocks.
+ * - thread_arena_release(): give the blocks back to the process wide block
+ *                           depot. Done automatically at thread exit, both
+ *                           for pthread_exit() and pthread_cancel() (it is
+ *                           a 07_thread_context destructor), so the cancel
+ *                           path does not leak.
+ * Memory from thread_arena_alloc() must not outlive the thread.
+ *
+ * thread_obj_pool: fixed-size objects which may outlive the allocating
+ * thread, e.g. the exit code given to pthread_exit() and freed by the
+ * joiner. Each thread keeps a small magazine of free objects and only
+ * takes the pool lock to refill/spill a batch of them; the magazine goes
+ * back to the pool at thread exit.
+ *
+ * APIs return 0 or an errno value; allocators return NULL on failure.
+ */
+#ifndef THREAD_ARENA_H
+#define THREAD_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "thread_context.h"
+
+#define THREAD_ARENA_BLOCK_SIZE (64U * 1024U)
+#define THREAD_OBJ_POOL_MAGAZINE 64U
+
+void *thread_arena_alloc(size_t size);
+void thread_arena_reset(void);
+void thread_arena_release(void);
+// free() the blocks parked in the depot, e.g. before exiting main()
+void thread_arena_trim(void);
+
+// process wide numbers, for leak checks
+struct thread_arena_stats {
+  size_t blocks_total;  // blocks ever malloc()ed (and still owned)
+  size_t blocks_free;   // blocks sitting in the depot
+  size_t large_in_use;  // allocations bigger than a block, not yet released
+};
+void thread_arena_get_stats(struct thread_arena_stats *stats);
+
+struct thread_obj_pool {
+  size_t obj_size;
+  thread_ctx_key_t magazine_key;
+  pthread_mutex_t lock;
+  void *free_list;
+  void *chunks;     // every malloc()ed chunk, freed by destroy
+  size_t obj_total; // objects ever carved, for leak checks
+  size_t obj_free;  // objects in free_list
+};
+
+// takes a thread_ctx key until destroyed: THREAD_CTX_MAX_KEYS (shared with
+// the other 07_thread_context users) pools at most at once
+int thread_obj_pool_init(struct thread_obj_pool *pool, size_t obj_size);
+void *thread_obj_pool_alloc(struct thread_obj_pool *pool);
+// may be called from any thread, not only the allocating one
+void thread_obj_pool_free(struct thread_obj_pool *pool, void *obj);
+// all the objects must be freed and the threads using the pool finished
+void thread_obj_pool_destroy(struct thread_obj_pool *pool);
+
+#endif // THREAD_ARENA_H
@@ -0,0 +1,219 @@
+/*
+ * Allocation rate of thread_arena/thread_obj_pool vs. glibc malloc() for the
+ * allocations every demo thread does: exit code, TSD struct and a name
+ * buffer (see hello_thread_function() and print_attr()).
+ *
+ * "steady": long running threads allocate and free in a loop.
+ * "churn":  thousands of short-lived threads, half of them cancel
+ *           themselves like the even tasks of pthread_demo.c; a leak check
+ *           is done on the arena/pool counters afterwards.
+ *
+ * usage: ./thread_arena_bench [threads] [iterations] [churn threads]
+ */
+#include "thread_arena.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_THREADS 8U
+#define DEF_ITERATIONS 200000U
+#define DEF_CHURN_THREADS 20000U
+#define CHURN_WAVE 64U // threads alive at once
+#define NAME_LEN 40U
+#define SCRATCH_ALLOCS 4U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+struct hello_thread_spec_data {
+  int task_no;
+  const char *task_name;
+};
+
+static struct thread_obj_pool exit_code_pool;
+static pthread_key_t hello_key; // malloc flavour keeps the demo's TSD key
+static size_t iterations;
+static int use_arena;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hello_key_destructor(void *param) { free(param); }
+
+static void *steady_thread(void *param) {
+  int task_no = (int)(intptr_t)param;
+  for (size_t i = 0; i < iterations; i++) {
+    if (use_arena) {
+      int *exit_code = thread_obj_pool_alloc(&exit_code_pool);
+      struct hello_thread_spec_data *t_data = thread_arena_alloc(sizeof(*t_data));
+      char *t_name = thread_arena_alloc(NAME_LEN);
+      if (!exit_code || !t_data || !t_name) {
+        ERROR_CHECK(ENOMEM, 0);
+      }
+      t_data->task_no = task_no;
+      t_data->task_name = t_name;
+      *exit_code = 0;
+      thread_obj_pool_free(&exit_code_pool, exit_code);
+      thread_arena_reset();
+    } else {
+      int *exit_code = malloc(sizeof(int));
+      struct hello_thread_spec_data *t_data = malloc(sizeof(*t_data));
+      char *t_name = malloc(NAME_LEN);
+      if (!exit_code || !t_data || !t_name) {
+        ERROR_CHECK(ENOMEM, 0);
+      }
+      t_data->task_no = task_no;
+      t_data->task_name = t_name;
+      *exit_code = 0;
+      free(t_name);
+      free(t_data);
+      free(exit_code);
+    }
+  }
+  return NULL;
+}
+
+static void free_cleanup(void *param) { free(param); }
+
+static void *churn_thread(void *param) {
+  int task_no = (int)(intptr_t)param;
+  int *exit_code = NULL;
+
+  if (use_arena) {
+    struct hello_thread_spec_data *t_data = thread_arena_alloc(sizeof(*t_data));
+    t_data->task_no = task_no;
+    t_data->task_name = thread_arena_alloc(NAME_LEN);
+    for (unsigned int i = 0; i < SCRATCH_ALLOCS; i++) {
+      memset(thread_arena_alloc(NAME_LEN), 0, NAME_LEN);
+    }
+    if (!(task_no % 2)) {
+      // nothing to clean up by hand: the arena goes back at thread exit
+      pthread_cancel(pthread_self());
+      pthread_testcancel();
+    }
+    // allocated last, so there is nothing to leak on the cancel path
+    exit_code = thread_obj_pool_alloc(&exit_code_pool);
+    *exit_code = 0;
+    return exit_code;
+  }
+
+  exit_code = malloc(sizeof(int));
+  *exit_code = 0;
+  struct hello_thread_spec_data *t_data = malloc(sizeof(*t_data));
+  t_data->task_no = task_no;
+  t_data->task_name = malloc(NAME_LEN);
+  pthread_setspecific(hello_key, t_data);
+  pthread_cleanup_push(&free_cleanup, exit_code);
+  pthread_cleanup_push(&free_cleanup, (void *)t_data->task_name);
+  for (unsigned int i = 0; i < SCRATCH_ALLOCS; i++) {
+    char *scratch = malloc(NAME_LEN);
+    memset(scratch, 0, NAME_LEN);
+    free(scratch);
+  }
+  if (!(task_no % 2)) {
+    pthread_cancel(pthread_self());
+    pthread_testcancel();
+  }
+  pthread_cleanup_pop(1);
+  pthread_cleanup_pop(0);
+  return exit_code;
+}
+
+static double run_steady(size_t threads) {
+  pthread_t tid[threads];
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < threads; i++) {
+    int rc = pthread_create(&tid[i], NULL, &steady_thread, (void *)(intptr_t)i);
+    ERROR_CHECK(rc, 0);
+  }
+  for (size_t i = 0; i < threads; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  // 3 allocations + 3 frees (or one reset) per iteration
+  return threads * iterations * 3 / ((now_ns() - start) / 1e9);
+}
+
+static double run_churn(size_t total) {
+  pthread_t tid[CHURN_WAVE];
+  uint64_t start = now_ns();
+  for (size_t done = 0; done < total; done += CHURN_WAVE) {
+    size_t wave = total - done < CHURN_WAVE ? total - done : CHURN_WAVE;
+    for (size_t i = 0; i < wave; i++) {
+      int rc = pthread_create(&tid[i], NULL, &churn_thread,
+                              (void *)(intptr_t)(done + i));
+      ERROR_CHECK(rc, 0);
+    }
+    for (size_t i = 0; i < wave; i++) {
+      void *ret = NULL;
+      int rc = pthread_join(tid[i], &ret);
+      ERROR_CHECK(rc, 0);
+      if (ret != PTHREAD_CANCELED) {
+        if (use_arena) {
+          thread_obj_pool_free(&exit_code_pool, ret);
+        } else {
+          free(ret);
+        }
+      }
+    }
+  }
+  return total / ((now_ns() - start) / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+  size_t threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_THREADS;
+  iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_ITERATIONS;
+  size_t churn = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_CHURN_THREADS;
+  if (!threads || !iterations || !churn) {
+    printf("usage: %s [threads] [iterations] [churn threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int rc = pthread_key_create(&hello_key, &hello_key_destructor);
+  ERROR_CHECK(rc, 0);
+  rc = thread_obj_pool_init(&exit_code_pool, sizeof(int));
+  ERROR_CHECK(rc, 0);
+
+  printf("steady, %zu threads x %zu iterations:\n", threads, iterations);
+  use_arena = 0;
+  printf("  malloc      : %12.0f allocs/sec\n", run_steady(threads));
+  use_arena = 1;
+  printf("  thread_arena: %12.0f allocs/sec\n", run_steady(threads));
+
+  printf("churn, %zu threads (%u alive at once):\n", churn, CHURN_WAVE);
+  use_arena = 0;
+  printf("  malloc      : %12.0f threads/sec\n", run_churn(churn));
+  use_arena = 1;
+  printf("  thread_arena: %12.0f threads/sec\n", run_churn(churn));
+
+  // give back main's own magazine, then everything must be home
+  thread_ctx_release();
+  struct thread_arena_stats stats;
+  thread_arena_get_stats(&stats);
+  printf("arena blocks: %zu total, %zu free, %zu large in use\n",
+         stats.blocks_total, stats.blocks_free, stats.large_in_use);
+  printf("exit codes  : %zu total, %zu free\n", exit_code_pool.obj_total,
+         exit_code_pool.obj_free);
+  int leaked = stats.blocks_total != stats.blocks_free || stats.large_in_use ||
+               exit_code_pool.obj_total != exit_code_pool.obj_free;
+  printf("%s\n", leaked ? "LEAK detected!" : "no leaks");
+
+  thread_obj_pool_destroy(&exit_code_pool);
+  thread_arena_trim();
+  pthread_key_delete(hello_key);
+  return leaked ? EXIT_FAILURE : 0;
+}
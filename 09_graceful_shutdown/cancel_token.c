@@ -0,0 +1,69 @@
+#include "cancel_token.h"
+
+#include <errno.h>
+#include <time.h>
+
+int cancel_token_init(struct cancel_token *tok) {
+  if (!tok) {
+    return EINVAL;
+  }
+  atomic_init(&tok->cancelled, 0);
+
+  pthread_condattr_t attr;
+  int rc = pthread_condattr_init(&attr);
+  if (rc) {
+    return rc;
+  }
+  // timeouts must not jump with the wall clock
+  rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  if (!rc) {
+    rc = pthread_cond_init(&tok->cond, &attr);
+  }
+  pthread_condattr_destroy(&attr);
+  if (rc) {
+    return rc;
+  }
+  return pthread_mutex_init(&tok->lock, NULL);
+}
+
+void cancel_token_destroy(struct cancel_token *tok) {
+  pthread_cond_destroy(&tok->cond);
+  pthread_mutex_destroy(&tok->lock);
+}
+
+void cancel_token_cancel(struct cancel_token *tok) {
+  pthread_mutex_lock(&tok->lock);
+  atomic_store_explicit(&tok->cancelled, 1, memory_order_release);
+  pthread_cond_broadcast(&tok->cond);
+  pthread_mutex_unlock(&tok->lock);
+}
+
+static void cancel_token_unlock(void *lock) {
+  pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
+int cancel_token_sleep(struct cancel_token *tok, uint64_t ns) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += ns / 1000000000ULL;
+  deadline.tv_nsec += ns % 1000000000ULL;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  int cancelled = 0;
+  pthread_mutex_lock(&tok->lock);
+  // a hard pthread_cancel() acts inside the wait with the lock held
+  pthread_cleanup_push(&cancel_token_unlock, &tok->lock);
+  // declared inside the cleanup region: not live across its setjmp()
+  int rc = 0;
+  while (!atomic_load_explicit(&tok->cancelled, memory_order_acquire) &&
+         rc != ETIMEDOUT) {
+    // a cancellation point, like sleep()
+    rc = pthread_cond_timedwait(&tok->cond, &tok->lock, &deadline);
+  }
+  cancelled = atomic_load_explicit(&tok->cancelled, memory_order_acquire);
+  pthread_cleanup_pop(1);
+  return cancelled ? ECANCELED : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Cooperative cancellation token.
+ *
+ * Instead of pthread_cancel() (01_pthread_basic/pthread_demo.c cancels its
+ * even tasks), the owner of a group of threads calls cancel_token_cancel()
+ * and the workers leave at a point of their own choosing:
+ *
+ * - cancel_token_is_cancelled(): one relaxed atomic load, cheap enough for
+ *                                hot loops.
+ * - cancel_token_sleep():        replacement for sleep()/usleep() which
+ *                                returns ECANCELED as soon as the token is
+ *                                cancelled, 0 once the time is up.
+ */
+#ifndef CANCEL_TOKEN_H
+#define CANCEL_TOKEN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct cancel_token {
+  atomic_int cancelled;
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // CLOCK_MONOTONIC based
+};
+
+int cancel_token_init(struct cancel_token *tok);
+void cancel_token_destroy(struct cancel_token *tok);
+void cancel_token_cancel(struct cancel_token *tok);
+int cancel_token_sleep(struct cancel_token *tok, uint64_t ns);
+
+static inline int cancel_token_is_cancelled(struct cancel_token *tok) {
+  return atomic_load_explicit(&tok->cancelled, memory_order_relaxed);
+}
+
+#endif // CANCEL_TOKEN_H
@@ -0,0 +1,194 @@
+/*
+ * Shutdown latency of N workers doing the demo's work loop (work, then
+ * sleep (task_no % 5 + 1) units, see hello_thread_function()):
+ *
+ * "polling": workers nanosleep() and check the token afterwards.
+ * "token":   workers sleep with cancel_token_sleep().
+ * "stuck":   "token" plus one worker blocked in read() that never looks at
+ *            the token, so the soft deadline expires and it is
+ *            pthread_cancel()ed.
+ *
+ * Each worker owns TSD under a pthread key, freed by a registry cleanup
+ * handler; the key is deleted right after every shutdown, which is the
+ * SIGSEGV race pthread_demo.c avoids with getchar(). Exit codes are
+ * checked for every worker of every run.
+ *
+ * usage: ./shutdown_bench [workers] [runs] [soft deadline ms]
+ */
+#include "cancel_token.h"
+#include "thread_registry.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_WORKERS 16U
+#define DEF_RUNS 100U
+#define DEF_SOFT_MS 20U
+#define HARD_MS 100U
+#define SLEEP_UNIT_NS 2000000ULL // 2 ms per "second" of the demo
+#define RUN_TIME_NS 3000000ULL   // let the workers run before shutting down
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+enum bench_mode { MODE_POLLING, MODE_TOKEN, MODE_STUCK, MODE_NUM };
+static const char *mode_name[MODE_NUM] = {"polling", "token", "stuck"};
+
+struct hello_thread_spec_data {
+  int task_no;
+};
+
+static pthread_key_t hello_key;
+static enum bench_mode mode;
+static int stuck_pipe[2];
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void release_tsd(void *param) {
+  (void)param;
+  free(pthread_getspecific(hello_key));
+  pthread_setspecific(hello_key, NULL);
+}
+
+static int worker(void *arg, struct cancel_token *token) {
+  int task_no = (int)(intptr_t)arg;
+  struct hello_thread_spec_data *t_data = malloc(sizeof(*t_data));
+  if (!t_data) {
+    return ENOMEM;
+  }
+  t_data->task_no = task_no;
+  pthread_setspecific(hello_key, t_data);
+  thread_registry_cleanup_push(&release_tsd, NULL);
+
+  while (!cancel_token_is_cancelled(token)) {
+    uint64_t acc = task_no;
+    for (int i = 0; i < 10000; i++) {
+      acc = acc * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    __atomic_fetch_add(&sink, acc & 1, __ATOMIC_RELAXED);
+
+    uint64_t ns = (task_no % 5 + 1) * SLEEP_UNIT_NS;
+    if (mode == MODE_POLLING) {
+      struct timespec ts = {.tv_sec = ns / 1000000000ULL,
+                            .tv_nsec = ns % 1000000000ULL};
+      nanosleep(&ts, NULL);
+    } else if (cancel_token_sleep(token, ns) == ECANCELED) {
+      break;
+    }
+  }
+  thread_registry_cleanup_pop(1);
+  return task_no;
+}
+
+static int stuck_worker(void *arg, struct cancel_token *token) {
+  (void)arg;
+  (void)token;
+  char c;
+  // never written to; read() is a cancellation point
+  while (read(stuck_pipe[0], &c, 1) < 0 && errno == EINTR)
+    ;
+  return 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run_mode(size_t workers, size_t runs, uint64_t soft_ns) {
+  uint64_t *lat = calloc(runs, sizeof(*lat));
+  if (!lat) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  size_t missed = 0, hard = 0, codes_ok = 0, codes_total = 0;
+
+  for (size_t r = 0; r < runs; r++) {
+    struct thread_registry reg;
+    int rc = pthread_key_create(&hello_key, NULL);
+    ERROR_CHECK(rc, 0);
+    rc = thread_registry_init(&reg, workers + 1);
+    ERROR_CHECK(rc, 0);
+
+    for (size_t i = 0; i < workers; i++) {
+      rc = thread_registry_spawn(&reg, &worker, (void *)(intptr_t)i, NULL);
+      ERROR_CHECK(rc, 0);
+    }
+    if (mode == MODE_STUCK) {
+      rc = thread_registry_spawn(&reg, &stuck_worker, NULL, NULL);
+      ERROR_CHECK(rc, 0);
+    }
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = RUN_TIME_NS};
+    nanosleep(&ts, NULL);
+
+    uint64_t start = now_ns();
+    rc = thread_registry_shutdown(&reg, soft_ns, HARD_MS * 1000000ULL);
+    lat[r] = now_ns() - start;
+    ERROR_CHECK(rc, 0);
+    missed += lat[r] > soft_ns;
+    hard += reg.hard_canceled;
+
+    for (size_t i = 0; i < reg.spawned; i++) {
+      struct thread_registry_entry *e = &reg.entries[i];
+      codes_total++;
+      if (e->fn == &stuck_worker) {
+        codes_ok += e->state == THREAD_REGISTRY_CANCELED &&
+                    e->exit_code == ECANCELED;
+      } else {
+        codes_ok += e->state == THREAD_REGISTRY_RETURNED &&
+                    e->exit_code == (int)i;
+      }
+    }
+    // every worker has run its cleanup handlers: safe to drop the key now
+    pthread_key_delete(hello_key);
+    thread_registry_destroy(&reg);
+  }
+
+  qsort(lat, runs, sizeof(*lat), &cmp_u64);
+  printf("  %-8s p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms  deadline "
+         "missed %zu/%zu  hard cancels %zu  exit codes %zu/%zu\n",
+         mode_name[mode], lat[runs / 2] / 1e6, lat[runs * 99 / 100] / 1e6,
+         lat[runs - 1] / 1e6, missed, runs, hard, codes_ok, codes_total);
+  free(lat);
+}
+
+int main(int argc, char *argv[]) {
+  size_t workers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_WORKERS;
+  size_t runs = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_RUNS;
+  uint64_t soft_ms = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_SOFT_MS;
+  if (!workers || !runs || !soft_ms) {
+    printf("usage: %s [workers] [runs] [soft deadline ms]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (pipe(stuck_pipe)) {
+    ERROR_CHECK(errno, 0);
+  }
+
+  printf("shutdown latency, %zu workers, soft deadline %lu ms:\n", workers,
+         (unsigned long)soft_ms);
+  for (mode = 0; mode < MODE_NUM; mode++) {
+    // the stuck runs always wait for the whole soft deadline
+    run_mode(workers, mode == MODE_STUCK ? (runs + 4) / 5 : runs,
+             soft_ms * 1000000ULL);
+  }
+  close(stuck_pipe[0]);
+  close(stuck_pipe[1]);
+  return 0;
+}
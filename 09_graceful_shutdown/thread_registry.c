@@ -0,0 +1,214 @@
+#include "thread_registry.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static __thread struct thread_registry_entry *registry_self;
+
+static void deadline_after(struct timespec *ts, uint64_t ns) {
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += ns / 1000000000ULL;
+  ts->tv_nsec += ns % 1000000000ULL;
+  if (ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+// last thing a registered thread does, for all the ways out
+static void registry_finish(void *param) {
+  struct thread_registry_entry *entry = (struct thread_registry_entry *)param;
+  struct thread_registry *reg = entry->reg;
+  int old_state;
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+  while (entry->cleanup_num) {
+    entry->cleanup_num--;
+    entry->cleanup[entry->cleanup_num].fn(entry->cleanup[entry->cleanup_num].arg);
+  }
+
+  pthread_mutex_lock(&reg->lock);
+  if (entry->state == THREAD_REGISTRY_RUNNING) {
+    // neither returned nor exited: cancelled
+    entry->state = THREAD_REGISTRY_CANCELED;
+    entry->exit_code = ECANCELED;
+  }
+  if (!--reg->live) {
+    pthread_cond_broadcast(&reg->done);
+  }
+  // from here on, nothing of the registry may be touched by this thread
+  pthread_mutex_unlock(&reg->lock);
+  registry_self = NULL;
+}
+
+static void *registry_thread_main(void *param) {
+  struct thread_registry_entry *entry = (struct thread_registry_entry *)param;
+  registry_self = entry;
+
+  pthread_cleanup_push(&registry_finish, entry);
+  int code = entry->fn(entry->arg, &entry->reg->token);
+  pthread_mutex_lock(&entry->reg->lock);
+  entry->exit_code = code;
+  entry->state = THREAD_REGISTRY_RETURNED;
+  pthread_mutex_unlock(&entry->reg->lock);
+  pthread_cleanup_pop(1);
+  return NULL;
+}
+
+void thread_registry_exit(int exit_code) {
+  struct thread_registry_entry *entry = registry_self;
+  if (entry) {
+    pthread_mutex_lock(&entry->reg->lock);
+    entry->exit_code = exit_code;
+    entry->state = THREAD_REGISTRY_EXITED;
+    pthread_mutex_unlock(&entry->reg->lock);
+  }
+  pthread_exit(NULL); // runs registry_finish()
+}
+
+int thread_registry_cleanup_push(void (*fn)(void *arg), void *arg) {
+  struct thread_registry_entry *entry = registry_self;
+  if (!entry || !fn) {
+    return EINVAL;
+  }
+  if (entry->cleanup_num == THREAD_REGISTRY_MAX_CLEANUP) {
+    return ENOMEM;
+  }
+  entry->cleanup[entry->cleanup_num].fn = fn;
+  entry->cleanup[entry->cleanup_num].arg = arg;
+  entry->cleanup_num++;
+  return 0;
+}
+
+void thread_registry_cleanup_pop(int execute) {
+  struct thread_registry_entry *entry = registry_self;
+  if (!entry || !entry->cleanup_num) {
+    return;
+  }
+  entry->cleanup_num--;
+  if (execute) {
+    entry->cleanup[entry->cleanup_num].fn(entry->cleanup[entry->cleanup_num].arg);
+  }
+}
+
+int thread_registry_init(struct thread_registry *reg, size_t capacity) {
+  if (!reg || !capacity) {
+    return EINVAL;
+  }
+  memset(reg, 0, sizeof(*reg));
+  reg->entries = calloc(capacity, sizeof(*reg->entries));
+  if (!reg->entries) {
+    return ENOMEM;
+  }
+  reg->capacity = capacity;
+
+  int rc = cancel_token_init(&reg->token);
+  if (rc) {
+    free(reg->entries);
+    return rc;
+  }
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&reg->done, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&reg->lock, NULL);
+  return 0;
+}
+
+void thread_registry_destroy(struct thread_registry *reg) {
+  pthread_mutex_destroy(&reg->lock);
+  pthread_cond_destroy(&reg->done);
+  cancel_token_destroy(&reg->token);
+  free(reg->entries);
+  reg->entries = NULL;
+}
+
+int thread_registry_spawn(struct thread_registry *reg, thread_registry_fn fn,
+                          void *arg, size_t *slot) {
+  if (!reg || !fn) {
+    return EINVAL;
+  }
+  if (cancel_token_is_cancelled(&reg->token)) {
+    return ECANCELED;
+  }
+  pthread_attr_t attr;
+  int rc = pthread_attr_init(&attr);
+  if (rc) {
+    return rc;
+  }
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  pthread_mutex_lock(&reg->lock);
+  if (reg->spawned == reg->capacity) {
+    pthread_mutex_unlock(&reg->lock);
+    pthread_attr_destroy(&attr);
+    return EAGAIN;
+  }
+  size_t idx = reg->spawned;
+  struct thread_registry_entry *entry = &reg->entries[idx];
+  entry->reg = reg;
+  entry->fn = fn;
+  entry->arg = arg;
+  entry->state = THREAD_REGISTRY_RUNNING;
+  // the new thread can't report completion before we unlock, so tid stays
+  // valid while the state says RUNNING
+  rc = pthread_create(&entry->tid, &attr, &registry_thread_main, entry);
+  if (rc) {
+    entry->state = THREAD_REGISTRY_FREE;
+  } else {
+    reg->spawned++;
+    reg->live++;
+  }
+  pthread_mutex_unlock(&reg->lock);
+  pthread_attr_destroy(&attr);
+
+  if (!rc && slot) {
+    *slot = idx;
+  }
+  return rc;
+}
+
+// caller holds reg->lock
+static int registry_wait_locked(struct thread_registry *reg,
+                                const struct timespec *deadline) {
+  int rc = 0;
+  while (reg->live && rc != ETIMEDOUT) {
+    rc = deadline ? pthread_cond_timedwait(&reg->done, &reg->lock, deadline)
+                  : pthread_cond_wait(&reg->done, &reg->lock);
+  }
+  return reg->live ? ETIMEDOUT : 0;
+}
+
+int thread_registry_wait(struct thread_registry *reg) {
+  pthread_mutex_lock(&reg->lock);
+  int rc = registry_wait_locked(reg, NULL);
+  pthread_mutex_unlock(&reg->lock);
+  return rc;
+}
+
+int thread_registry_shutdown(struct thread_registry *reg, uint64_t soft_ns,
+                             uint64_t hard_ns) {
+  struct timespec deadline;
+  deadline_after(&deadline, soft_ns);
+  cancel_token_cancel(&reg->token);
+
+  pthread_mutex_lock(&reg->lock);
+  int rc = registry_wait_locked(reg, &deadline);
+  if (rc) {
+    // escalate: whoever is still at it gets a real cancel request, acted
+    // upon at its next cancellation point
+    for (size_t i = 0; i < reg->spawned; i++) {
+      if (reg->entries[i].state == THREAD_REGISTRY_RUNNING) {
+        pthread_cancel(reg->entries[i].tid);
+        reg->hard_canceled++;
+      }
+    }
+    deadline_after(&deadline, hard_ns);
+    rc = registry_wait_locked(reg, &deadline);
+  }
+  pthread_mutex_unlock(&reg->lock);
+  return rc;
+}
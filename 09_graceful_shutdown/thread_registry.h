@@ -0,0 +1,90 @@
+/*
+ * Registry of detached worker threads with completion tracking and a
+ * deadline bounded shutdown.
+ *
+ * 01_pthread_basic/pthread_demo.c detaches half of its threads and then
+ * relies on getchar() to keep the process (and hello_key) alive until they
+ * are done. Here every thread is started through the registry:
+ *
+ * - thread_registry_spawn():  start a detached thread running
+ *                             fn(arg, token); its return value is the exit
+ *                             code, stored in the registry slot (no
+ *                             malloc()ed exit codes to leak).
+ * - thread_registry_exit():   pthread_exit() replacement keeping the code.
+ * - thread_registry_cleanup_push()/_pop(): per-thread cleanup handlers,
+ *                             run LIFO on return, exit and hard cancel, and
+ *                             *before* the thread is reported as finished,
+ *                             so shared state (keys, buffers) can be freed
+ *                             safely once the registry says "done".
+ * - thread_registry_shutdown(): cancel the token, wait up to soft_ns for
+ *                             the workers to leave on their own, then
+ *                             pthread_cancel() the rest and wait up to
+ *                             hard_ns more. ETIMEDOUT if some still run.
+ *
+ * A slot is used once; capacity bounds the threads spawned per registry.
+ */
+#ifndef THREAD_REGISTRY_H
+#define THREAD_REGISTRY_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cancel_token.h"
+
+#define THREAD_REGISTRY_MAX_CLEANUP 8U
+
+typedef int (*thread_registry_fn)(void *arg, struct cancel_token *token);
+
+enum thread_registry_state {
+  THREAD_REGISTRY_FREE = 0,
+  THREAD_REGISTRY_RUNNING,
+  THREAD_REGISTRY_RETURNED, // fn returned
+  THREAD_REGISTRY_EXITED,   // thread_registry_exit()
+  THREAD_REGISTRY_CANCELED, // pthread_cancel()
+};
+
+struct thread_registry;
+
+struct thread_registry_entry {
+  struct thread_registry *reg;
+  pthread_t tid;
+  thread_registry_fn fn;
+  void *arg;
+  int state;
+  int exit_code;
+  size_t cleanup_num;
+  struct {
+    void (*fn)(void *arg);
+    void *arg;
+  } cleanup[THREAD_REGISTRY_MAX_CLEANUP];
+};
+
+struct thread_registry {
+  struct thread_registry_entry *entries;
+  size_t capacity;
+  size_t spawned;
+  size_t live;
+  size_t hard_canceled; // threads that needed pthread_cancel()
+  struct cancel_token token;
+  pthread_mutex_t lock;
+  pthread_cond_t done; // CLOCK_MONOTONIC based
+};
+
+int thread_registry_init(struct thread_registry *reg, size_t capacity);
+// all the threads must be finished (see thread_registry_shutdown())
+void thread_registry_destroy(struct thread_registry *reg);
+
+// slot receives the index of the entry, may be NULL
+int thread_registry_spawn(struct thread_registry *reg, thread_registry_fn fn,
+                          void *arg, size_t *slot);
+void thread_registry_exit(int exit_code) __attribute__((noreturn));
+int thread_registry_cleanup_push(void (*fn)(void *arg), void *arg);
+void thread_registry_cleanup_pop(int execute);
+
+int thread_registry_shutdown(struct thread_registry *reg, uint64_t soft_ns,
+                             uint64_t hard_ns);
+// waits for all the threads, without cancelling them
+int thread_registry_wait(struct thread_registry *reg);
+
+#endif // THREAD_REGISTRY_H
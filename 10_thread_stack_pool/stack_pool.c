@@ -0,0 +1,184 @@
+#define _GNU_SOURCE // MADV_HUGEPAGE, MAP_STACK
+
+#include "stack_pool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ALIGN_UP(X, A) (((X) + (A)-1) & ~((size_t)(A)-1))
+
+int stack_pool_init(struct stack_pool *pool, size_t stack_size,
+                    size_t guard_size, size_t max_cached, int flags) {
+  if (!pool) {
+    return EINVAL;
+  }
+  size_t page_size = getpagesize();
+  if (stack_size < (size_t)PTHREAD_STACK_MIN) {
+    stack_size = PTHREAD_STACK_MIN;
+  }
+  memset(pool, 0, sizeof(*pool));
+  pool->flags = flags;
+  pool->stack_size = ALIGN_UP(stack_size, flags & STACK_POOL_HUGEPAGE
+                                              ? STACK_POOL_HUGEPAGE_SIZE
+                                              : page_size);
+  pool->guard_size = ALIGN_UP(guard_size, page_size);
+  pool->max_cached = max_cached;
+  return pthread_mutex_init(&pool->lock, NULL);
+}
+
+static int stack_map(struct stack_pool *pool, struct stack_pool_stack *stk) {
+  size_t align = pool->flags & STACK_POOL_HUGEPAGE ? STACK_POOL_HUGEPAGE_SIZE
+                                                    : (size_t)getpagesize();
+  // over-allocate so the usable part can start on an "align" boundary
+  size_t len = pool->guard_size + pool->stack_size + align - getpagesize();
+  char *base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (base == MAP_FAILED) {
+    return errno;
+  }
+  char *stack = (char *)ALIGN_UP((uintptr_t)base + pool->guard_size, align);
+  char *map_base = stack - pool->guard_size;
+  char *map_end = stack + pool->stack_size;
+  // trim the slack on both sides
+  if (map_base > base) {
+    munmap(base, map_base - base);
+  }
+  if (base + len > map_end) {
+    munmap(map_end, base + len - map_end);
+  }
+  if (pool->guard_size && mprotect(map_base, pool->guard_size, PROT_NONE)) {
+    int err = errno;
+    munmap(map_base, map_end - map_base);
+    return err;
+  }
+  if (pool->flags & STACK_POOL_HUGEPAGE) {
+    // best effort: THP may be disabled ("never") on this system
+    madvise(stack, pool->stack_size, MADV_HUGEPAGE);
+  }
+  stk->map_base = map_base;
+  stk->map_size = map_end - map_base;
+  stk->stack = stack;
+  stk->stack_size = pool->stack_size;
+  return 0;
+}
+
+int stack_pool_get(struct stack_pool *pool, struct stack_pool_stack **stack) {
+  if (!pool || !stack) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&pool->lock);
+  struct stack_pool_stack *stk = pool->free_list;
+  if (stk) {
+    pool->free_list = stk->next;
+    pool->cached--;
+    pool->reused++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (!stk) {
+    stk = malloc(sizeof(*stk));
+    if (!stk) {
+      return ENOMEM;
+    }
+    int rc = stack_map(pool, stk);
+    if (rc) {
+      free(stk);
+      return rc;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->mapped++;
+    pthread_mutex_unlock(&pool->lock);
+  }
+  stk->next = NULL;
+  *stack = stk;
+  return 0;
+}
+
+void stack_pool_put(struct stack_pool *pool, struct stack_pool_stack *stack) {
+  if (!stack) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  if (pool->cached < pool->max_cached) {
+    stack->next = pool->free_list;
+    pool->free_list = stack;
+    pool->cached++;
+    stack = NULL;
+  } else {
+    pool->unmapped++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (stack) {
+    munmap(stack->map_base, stack->map_size);
+    free(stack);
+  }
+}
+
+void stack_pool_destroy(struct stack_pool *pool) {
+  while (pool->free_list) {
+    struct stack_pool_stack *stk = pool->free_list;
+    pool->free_list = stk->next;
+    munmap(stk->map_base, stk->map_size);
+    free(stk);
+    pool->unmapped++;
+  }
+  pool->cached = 0;
+  pthread_mutex_destroy(&pool->lock);
+}
+
+int stack_pool_thread_create(struct stack_pool *pool,
+                             struct stack_pool_thread *thread,
+                             pthread_attr_t *attr,
+                             void *(*fn)(void *arg), void *arg) {
+  if (!pool || !thread || !fn) {
+    return EINVAL;
+  }
+  pthread_attr_t local_attr;
+  pthread_attr_t *use_attr = attr;
+  if (!use_attr) {
+    int rc = pthread_attr_init(&local_attr);
+    if (rc) {
+      return rc;
+    }
+    use_attr = &local_attr;
+  }
+
+  thread->pool = pool;
+  thread->stack = NULL;
+  int rc = stack_pool_get(pool, &thread->stack);
+  if (!rc) {
+    rc = pthread_attr_setstack(use_attr, thread->stack->stack,
+                               thread->stack->stack_size);
+  }
+  if (!rc) {
+    rc = pthread_create(&thread->tid, use_attr, fn, arg);
+  }
+  if (rc && thread->stack) {
+    stack_pool_put(pool, thread->stack);
+    thread->stack = NULL;
+  }
+
+  if (use_attr == &local_attr) {
+    pthread_attr_destroy(&local_attr);
+  }
+  return rc;
+}
+
+int stack_pool_thread_join(struct stack_pool_thread *thread, void **ret) {
+  if (!thread || !thread->pool) {
+    return EINVAL;
+  }
+  int rc = pthread_join(thread->tid, ret);
+  if (!rc) {
+    // the thread is gone, nobody runs on this stack anymore
+    stack_pool_put(thread->pool, thread->stack);
+    thread->stack = NULL;
+  }
+  return rc;
+}
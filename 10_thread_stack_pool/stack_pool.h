@@ -0,0 +1,73 @@
+/*
+ * Pool of custom thread stacks for pthread_attr_setstack().
+ *
+ * 03_pthread_attributes/pthread_attr_demo.c gives thread 1 a malloc()ed
+ * stack with no guard. Here stacks are:
+ * - mmap()ed and page aligned, with a PROT_NONE guard area below the
+ *   lowest usable address (stacks grow down), since the guardsize
+ *   attribute is ignored for user provided stacks.
+ * - optionally backed by transparent huge pages (STACK_POOL_HUGEPAGE):
+ *   stack size rounded up to, and aligned on, 2 MB and madvise()d.
+ * - recycled: a joined thread's stack goes back to the pool (up to
+ *   max_cached of them) instead of munmap(), so spawning short-lived
+ *   threads does not pay mmap()/mprotect()/munmap() every time.
+ *
+ * A stack can only be reused once its thread is gone for good, so the
+ * threads must be joinable and are joined with stack_pool_thread_join().
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef STACK_POOL_H
+#define STACK_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define STACK_POOL_HUGEPAGE 0x1
+#define STACK_POOL_HUGEPAGE_SIZE (2UL * 1024 * 1024)
+
+struct stack_pool_stack {
+  struct stack_pool_stack *next;
+  void *map_base; // whole mapping, guard included
+  size_t map_size;
+  void *stack; // lowest usable address, for pthread_attr_setstack()
+  size_t stack_size;
+};
+
+struct stack_pool {
+  size_t stack_size;
+  size_t guard_size;
+  size_t max_cached;
+  int flags;
+
+  pthread_mutex_t lock;
+  struct stack_pool_stack *free_list;
+  size_t cached;
+
+  // counters
+  size_t mapped;   // mmap() calls
+  size_t unmapped; // munmap() calls
+  size_t reused;   // stacks served from the cache
+};
+
+struct stack_pool_thread {
+  pthread_t tid;
+  struct stack_pool *pool;
+  struct stack_pool_stack *stack;
+};
+
+int stack_pool_init(struct stack_pool *pool, size_t stack_size,
+                    size_t guard_size, size_t max_cached, int flags);
+void stack_pool_destroy(struct stack_pool *pool);
+int stack_pool_get(struct stack_pool *pool, struct stack_pool_stack **stack);
+void stack_pool_put(struct stack_pool *pool, struct stack_pool_stack *stack);
+
+// attr may be NULL; if given, its stack attributes are overwritten and
+// its detach state must be PTHREAD_CREATE_JOINABLE
+int stack_pool_thread_create(struct stack_pool *pool,
+                             struct stack_pool_thread *thread,
+                             pthread_attr_t *attr,
+                             void *(*fn)(void *arg), void *arg);
+int stack_pool_thread_join(struct stack_pool_thread *thread, void **ret);
+
+#endif // STACK_POOL_H
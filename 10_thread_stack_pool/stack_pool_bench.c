@@ -0,0 +1,144 @@
+/*
+ * Spawn rate of short-lived threads with different stack strategies:
+ *
+ * "glibc":      default attributes with the same stack size (glibc keeps
+ *               its own cache of default stacks).
+ * "malloc":     posix_memalign() stack per thread, no guard, as thread 1 of
+ *               03_pthread_attributes/pthread_attr_demo.c.
+ * "mmap":       stack_pool with max_cached = 0: mmap()/mprotect()/munmap()
+ *               for every thread.
+ * "pooled":     stack_pool recycling the stacks.
+ * "pooled+thp": same with 2 MB, transparent huge page backed stacks.
+ *
+ * usage: ./stack_pool_bench [threads] [stack kB] [alive at once]
+ */
+#include "stack_pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_THREADS 20000U
+#define DEF_STACK_KB 256U
+#define DEF_WAVE 32U
+#define TOUCH_BYTES (16U * 1024U) // stack actually used by each thread
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+enum bench_mode {
+  MODE_GLIBC,
+  MODE_MALLOC,
+  MODE_MMAP,
+  MODE_POOLED,
+  MODE_POOLED_THP,
+  MODE_NUM
+};
+static const char *mode_name[MODE_NUM] = {"glibc", "malloc", "mmap", "pooled",
+                                          "pooled+thp"};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *bench_thread(void *param) {
+  volatile char buf[TOUCH_BYTES];
+  for (size_t i = 0; i < sizeof(buf); i += 512) {
+    buf[i] = (char)(uintptr_t)param;
+  }
+  return (void *)(uintptr_t)buf[0];
+}
+
+static void run(enum bench_mode mode, size_t total, size_t stack_size,
+                size_t wave) {
+  struct stack_pool pool;
+  int rc = 0;
+  if (mode >= MODE_MMAP) {
+    rc = stack_pool_init(&pool, stack_size, getpagesize(),
+                         mode == MODE_MMAP ? 0 : wave,
+                         mode == MODE_POOLED_THP ? STACK_POOL_HUGEPAGE : 0);
+    ERROR_CHECK(rc, 0);
+  }
+  struct stack_pool_thread thr[wave];
+  pthread_t tid[wave];
+  void *stacks[wave];
+
+  uint64_t start = now_ns();
+  for (size_t done = 0; done < total; done += wave) {
+    size_t n = total - done < wave ? total - done : wave;
+    for (size_t i = 0; i < n; i++) {
+      pthread_attr_t attr;
+      pthread_attr_init(&attr);
+      switch (mode) {
+      case MODE_GLIBC:
+        pthread_attr_setstacksize(&attr, stack_size);
+        rc = pthread_create(&tid[i], &attr, &bench_thread, NULL);
+        break;
+      case MODE_MALLOC:
+        rc = posix_memalign(&stacks[i], getpagesize(), stack_size);
+        ERROR_CHECK(rc, 0);
+        pthread_attr_setstack(&attr, stacks[i], stack_size);
+        rc = pthread_create(&tid[i], &attr, &bench_thread, NULL);
+        break;
+      default:
+        rc = stack_pool_thread_create(&pool, &thr[i], &attr, &bench_thread,
+                                      NULL);
+        break;
+      }
+      ERROR_CHECK(rc, 0);
+      pthread_attr_destroy(&attr);
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (mode >= MODE_MMAP) {
+        rc = stack_pool_thread_join(&thr[i], NULL);
+      } else {
+        rc = pthread_join(tid[i], NULL);
+        if (mode == MODE_MALLOC) {
+          free(stacks[i]);
+        }
+      }
+      ERROR_CHECK(rc, 0);
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  printf("  %-11s %10.0f threads/sec", mode_name[mode],
+         total / (elapsed / 1e9));
+  if (mode >= MODE_MMAP) {
+    printf("  (mmap %zu, munmap %zu, reused %zu, stack %zu kB)",
+           pool.mapped, pool.unmapped, pool.reused, pool.stack_size / 1024);
+    stack_pool_destroy(&pool);
+  }
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  size_t total = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_THREADS;
+  size_t stack_kb = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_STACK_KB;
+  size_t wave = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_WAVE;
+  if (!total || !stack_kb || !wave) {
+    printf("usage: %s [threads] [stack kB] [alive at once]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu threads, %zu kB stacks, %zu alive at once:\n", total, stack_kb,
+         wave);
+  for (int mode = 0; mode < MODE_NUM; mode++) {
+    run(mode, total, stack_kb * 1024, wave);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Wakeup jitter of a periodic thread under background load, for several
+ * thread profiles: how late clock_nanosleep(TIMER_ABSTIME) wakes the
+ * thread up compared to the programmed time.
+ *
+ * Without CAP_SYS_NICE the SCHED_FIFO profiles fall back to SCHED_OTHER,
+ * which is reported next to the numbers.
+ *
+ * usage: ./jitter_bench [samples] [period us] [load threads]
+ */
+#define _GNU_SOURCE
+
+#include "thread_profile.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_SAMPLES 500U
+#define DEF_PERIOD_US 1000U
+#define HIST_BUCKETS 18U // log2 buckets of us: <1us ... >=65ms
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static size_t samples;
+static uint64_t period_ns;
+static atomic_int stop_load;
+static volatile uint64_t sink;
+
+struct jitter_result {
+  uint64_t *late_ns;
+  size_t hist[HIST_BUCKETS];
+};
+
+static uint64_t ts_ns(const struct timespec *ts) {
+  return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static void *load_thread(void *param) {
+  (void)param;
+  uint64_t acc = 1;
+  while (!atomic_load_explicit(&stop_load, memory_order_relaxed)) {
+    acc = acc * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  __atomic_fetch_add(&sink, acc & 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static void *periodic_thread(void *param) {
+  struct jitter_result *res = (struct jitter_result *)param;
+  struct timespec target, now;
+  clock_gettime(CLOCK_MONOTONIC, &target);
+
+  for (size_t i = 0; i < samples; i++) {
+    target.tv_nsec += period_ns;
+    while (target.tv_nsec >= 1000000000L) {
+      target.tv_nsec -= 1000000000L;
+      target.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) ==
+           EINTR)
+      ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t late = ts_ns(&now) - ts_ns(&target);
+    res->late_ns[i] = late;
+
+    unsigned int bucket = 0;
+    for (uint64_t us = late / 1000; us && bucket < HIST_BUCKETS - 1; us >>= 1) {
+      bucket++;
+    }
+    res->hist[bucket]++;
+  }
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run_profile(const struct thread_profile *profile) {
+  struct jitter_result res = {0};
+  res.late_ns = calloc(samples, sizeof(*res.late_ns));
+  if (!res.late_ns) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  void *args[1] = {&res};
+  struct thread_group group;
+  int rc = thread_group_create(&group, profile, 1, &periodic_thread, args);
+  ERROR_CHECK(rc, 0);
+  struct thread_profile_report report = group.report;
+  rc = thread_group_join(&group);
+  ERROR_CHECK(rc, 0);
+
+  thread_profile_report_print(profile, &report);
+  qsort(res.late_ns, samples, sizeof(*res.late_ns), &cmp_u64);
+  printf("  late by: p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+         res.late_ns[samples / 2] / 1e3, res.late_ns[samples * 99 / 100] / 1e3,
+         res.late_ns[samples - 1] / 1e3);
+  printf("  histogram:");
+  for (unsigned int b = 0; b < HIST_BUCKETS; b++) {
+    if (res.hist[b]) {
+      printf(" [<%luus]=%zu", 1UL << b, res.hist[b]);
+    }
+  }
+  printf("\n");
+  free(res.late_ns);
+}
+
+int main(int argc, char *argv[]) {
+  samples = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_SAMPLES;
+  period_ns = (argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_PERIOD_US) * 1000;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t load = argc > 3 ? strtoul(argv[3], NULL, 0) : (size_t)cpus * 2;
+  if (!samples || !period_ns) {
+    printf("usage: %s [samples] [period us] [load threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct thread_profile profiles[4] = {
+      {.name = "other", .policy = SCHED_OTHER},
+      {.name = "other+pin", .policy = SCHED_OTHER, .pin = 1},
+      {.name = "fifo", .policy = SCHED_FIFO, .priority = 80},
+      {.name = "fifo+pin", .policy = SCHED_FIFO, .priority = 80, .pin = 1},
+  };
+  for (int i = 0; i < 4; i++) {
+    CPU_ZERO(&profiles[i].cpus);
+    CPU_SET(0, &profiles[i].cpus);
+  }
+
+  pthread_t load_tid[load ? load : 1];
+  for (size_t i = 0; i < load; i++) {
+    int rc = pthread_create(&load_tid[i], NULL, &load_thread, NULL);
+    ERROR_CHECK(rc, 0);
+  }
+  printf("%zu samples every %lu us, %zu busy threads on %ld CPUs\n", samples,
+         (unsigned long)(period_ns / 1000), load, cpus);
+  for (int i = 0; i < 4; i++) {
+    run_profile(&profiles[i]);
+  }
+  atomic_store(&stop_load, 1);
+  for (size_t i = 0; i < load; i++) {
+    pthread_join(load_tid[i], NULL);
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+// for pthread_attr_setaffinity_np, cpu_set_t
+#define _GNU_SOURCE
+
+#include "thread_profile.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *thread_profile_policy_name(int policy) {
+  return policy == SCHED_FIFO ? "SCHED_FIFO"
+         : policy == SCHED_RR ? "SCHED_RR"
+                              : "SCHED_OTHER";
+}
+
+static int profile_priority(const struct thread_profile *profile) {
+  if (profile->policy == SCHED_OTHER) {
+    return 0; // only priority of SCHED_OTHER, nice value is used instead
+  }
+  int min_priority = sched_get_priority_min(profile->policy);
+  int max_priority = sched_get_priority_max(profile->policy);
+  if (profile->priority == THREAD_PROFILE_PRIO_MID) {
+    return min_priority + ((max_priority - min_priority) / 2);
+  }
+  return profile->priority < min_priority   ? min_priority
+         : profile->priority > max_priority ? max_priority
+                                            : profile->priority;
+}
+
+int thread_profile_attr(const struct thread_profile *profile,
+                        pthread_attr_t *attr, int with_sched,
+                        int with_affinity) {
+  int rc = pthread_attr_init(attr);
+  if (rc) {
+    return rc;
+  }
+  if (profile->stack_size) {
+    rc = pthread_attr_setstacksize(attr, profile->stack_size);
+  }
+  if (!rc && profile->guard_size) {
+    rc = pthread_attr_setguardsize(attr, profile->guard_size);
+  }
+  if (!rc && with_sched) {
+    // without EXPLICIT, policy & param of the attr are ignored
+    struct sched_param sched_params = {.sched_priority =
+                                           profile_priority(profile)};
+    rc = pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    if (!rc) {
+      rc = pthread_attr_setschedpolicy(attr, profile->policy);
+    }
+    if (!rc) {
+      rc = pthread_attr_setschedparam(attr, &sched_params);
+    }
+  }
+  if (!rc && with_affinity && profile->pin) {
+    rc = pthread_attr_setaffinity_np(attr, sizeof(profile->cpus),
+                                     &profile->cpus);
+  }
+  if (rc) {
+    pthread_attr_destroy(attr);
+  }
+  return rc;
+}
+
+// what the thread really runs with
+static void profile_inspect(pthread_t tid, const struct thread_profile *profile,
+                            struct thread_profile_report *report) {
+  struct sched_param sched_params = {0};
+  if (!pthread_getschedparam(tid, &report->policy, &sched_params)) {
+    report->priority = sched_params.sched_priority;
+  }
+  report->pinned = 0;
+  if (profile->pin) {
+    cpu_set_t cpus;
+    if (!pthread_getaffinity_np(tid, sizeof(cpus), &cpus)) {
+      report->pinned = CPU_EQUAL(&cpus, &profile->cpus);
+    }
+  }
+}
+
+int thread_profile_apply_self(const struct thread_profile *profile,
+                              struct thread_profile_report *report) {
+  memset(report, 0, sizeof(*report));
+  pthread_t self = pthread_self();
+  struct sched_param sched_params = {.sched_priority =
+                                         profile_priority(profile)};
+  int rc = pthread_setschedparam(self, profile->policy, &sched_params);
+  if (rc) {
+    report->sched_fallback = rc;
+  }
+  if (profile->pin) {
+    rc = pthread_setaffinity_np(self, sizeof(profile->cpus), &profile->cpus);
+    if (rc) {
+      report->affinity_fallback = rc;
+    }
+  }
+  profile_inspect(self, profile, report);
+  return 0;
+}
+
+int thread_group_create(struct thread_group *group,
+                        const struct thread_profile *profile, size_t n,
+                        void *(*fn)(void *arg), void **args) {
+  if (!group || !profile || !n || !fn) {
+    return EINVAL;
+  }
+  memset(group, 0, sizeof(*group));
+  group->tids = calloc(n, sizeof(*group->tids));
+  if (!group->tids) {
+    return ENOMEM;
+  }
+
+  int with_sched = 1, with_affinity = profile->pin;
+  pthread_attr_t attr;
+  int rc = 0;
+  while (group->num < n) {
+    size_t i = group->num;
+    rc = thread_profile_attr(profile, &attr, with_sched, with_affinity);
+    if (rc) {
+      break;
+    }
+    rc = pthread_create(&group->tids[i], &attr, fn, args ? args[i] : NULL);
+    pthread_attr_destroy(&attr);
+
+    // degrade step by step, and remember why
+    if (rc == EPERM && with_sched) {
+      group->report.sched_fallback = rc;
+      with_sched = 0;
+      continue;
+    }
+    if (rc == EINVAL && with_affinity) {
+      group->report.affinity_fallback = rc;
+      with_affinity = 0;
+      continue;
+    }
+    if (rc) {
+      break;
+    }
+    group->num++;
+  }
+  if (group->num) {
+    profile_inspect(group->tids[0], profile, &group->report);
+  }
+  if (rc) {
+    thread_group_join(group);
+  }
+  return rc;
+}
+
+int thread_group_join(struct thread_group *group) {
+  int err = 0;
+  for (size_t i = 0; i < group->num; i++) {
+    int rc = pthread_join(group->tids[i], NULL);
+    if (rc && !err) {
+      err = rc;
+    }
+  }
+  free(group->tids);
+  group->tids = NULL;
+  group->num = 0;
+  return err;
+}
+
+void thread_profile_report_print(const struct thread_profile *profile,
+                                 const struct thread_profile_report *report) {
+  printf("profile \"%s\": asked %s prio %d%s, got %s prio %d%s\n",
+         profile->name ? profile->name : "?",
+         thread_profile_policy_name(profile->policy), profile_priority(profile),
+         profile->pin ? " pinned" : "",
+         thread_profile_policy_name(report->policy), report->priority,
+         report->pinned ? " pinned" : "");
+  if (report->sched_fallback) {
+    printf("  policy/priority dropped: %s\n", strerror(report->sched_fallback));
+  }
+  if (report->affinity_fallback) {
+    printf("  affinity dropped: %s\n", strerror(report->affinity_fallback));
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * Declarative thread profiles: what main() of
+ * 03_pthread_attributes/pthread_attr_demo.c sets up by hand for one thread
+ * (policy, priority, inherit-sched, stack, guard), plus CPU affinity, and
+ * applied to a whole group of threads.
+ *
+ * - thread_profile_attr():  fill a pthread_attr_t from a profile.
+ * - thread_group_create():  start n threads with a profile. When a part of
+ *                           the profile can't be applied (EPERM for RT
+ *                           policies without CAP_SYS_NICE, EINVAL for an
+ *                           affinity mask without online CPUs), the threads
+ *                           are started without it and the degradation is
+ *                           recorded in the group's report instead of
+ *                           silently ignored.
+ * - thread_profile_apply_self(): same for the calling thread.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef THREAD_PROFILE_H
+#define THREAD_PROFILE_H
+
+// users must build with _GNU_SOURCE: cpu_set_t
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+
+#define THREAD_PROFILE_PRIO_MID -1 // middle of the policy's priority range
+
+struct thread_profile {
+  const char *name;
+  int policy;   // SCHED_OTHER, SCHED_FIFO, SCHED_RR
+  int priority; // ignored for SCHED_OTHER
+  int pin;      // apply "cpus" as affinity mask
+  cpu_set_t cpus;
+  size_t stack_size; // 0: default
+  size_t guard_size; // 0: default
+};
+
+// what was asked vs. what the threads really got
+struct thread_profile_report {
+  int policy;
+  int priority;
+  int pinned;
+  int sched_fallback;    // error which made us drop policy/priority, or 0
+  int affinity_fallback; // error which made us drop the affinity, or 0
+};
+
+struct thread_group {
+  pthread_t *tids;
+  size_t num;
+  struct thread_profile_report report;
+};
+
+// initializes attr, to be released with pthread_attr_destroy()
+int thread_profile_attr(const struct thread_profile *profile,
+                        pthread_attr_t *attr, int with_sched,
+                        int with_affinity);
+int thread_profile_apply_self(const struct thread_profile *profile,
+                              struct thread_profile_report *report);
+
+// args may be NULL (every thread gets NULL), else args[i] goes to thread i
+int thread_group_create(struct thread_group *group,
+                        const struct thread_profile *profile, size_t n,
+                        void *(*fn)(void *arg), void **args);
+int thread_group_join(struct thread_group *group);
+
+void thread_profile_report_print(const struct thread_profile *profile,
+                                 const struct thread_profile_report *report);
+const char *thread_profile_policy_name(int policy);
+
+#endif // THREAD_PROFILE_H
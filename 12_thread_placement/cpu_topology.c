@@ -0,0 +1,207 @@
+#include "cpu_topology.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYS_CPU "/sys/devices/system/cpu"
+#define SYS_NODE "/sys/devices/system/node"
+#define CPU_MAX 4096U
+#define LINE_LEN 4096U
+
+static int read_line(const char *path, char *buf, size_t len) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return errno;
+  }
+  int rc = fgets(buf, len, f) ? 0 : EIO;
+  fclose(f);
+  buf[strcspn(buf, "\n")] = '\0';
+  return rc;
+}
+
+static int read_int(const char *path, int def) {
+  char buf[32];
+  return read_line(path, buf, sizeof(buf)) ? def : atoi(buf);
+}
+
+int cpu_list_parse(const char *list, unsigned char *bits, size_t max) {
+  memset(bits, 0, max);
+  const char *p = list;
+  while (*p) {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p) {
+      return EINVAL;
+    }
+    long last = first;
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+      if (end == p) {
+        return EINVAL;
+      }
+    }
+    for (long c = first; c <= last && c < (long)max; c++) {
+      bits[c] = 1;
+    }
+    if (*end == ',') {
+      p = end + 1;
+    } else if (!*end) {
+      break;
+    } else {
+      return EINVAL;
+    }
+  }
+  return 0;
+}
+
+static int first_cpu(const unsigned char *bits, size_t max) {
+  for (size_t c = 0; c < max; c++) {
+    if (bits[c]) {
+      return (int)c;
+    }
+  }
+  return -1;
+}
+
+// llc id: first CPU sharing the highest level cache with "cpu"
+static int cpu_llc(int cpu) {
+  char path[256], buf[LINE_LEN];
+  unsigned char bits[CPU_MAX];
+  int best_level = -1, llc = cpu;
+  for (int idx = 0;; idx++) {
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu,
+             idx);
+    int level = read_int(path, -1);
+    if (level < 0) {
+      break;
+    }
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list",
+             cpu, idx);
+    if (level > best_level && !read_line(path, buf, sizeof(buf)) &&
+        !cpu_list_parse(buf, bits, CPU_MAX)) {
+      best_level = level;
+      llc = first_cpu(bits, CPU_MAX);
+    }
+  }
+  return llc;
+}
+
+static size_t count_distinct(const struct cpu_topology *topo, size_t off) {
+  size_t n = 0;
+  for (size_t i = 0; i < topo->cpu_num; i++) {
+    int v = *(const int *)((const char *)&topo->cpus[i] + off);
+    size_t j = 0;
+    while (j < i && *(const int *)((const char *)&topo->cpus[j] + off) != v) {
+      j++;
+    }
+    n += j == i;
+  }
+  return n;
+}
+
+int cpu_topology_load(struct cpu_topology *topo) {
+  char path[256], buf[LINE_LEN];
+  unsigned char online[CPU_MAX], bits[CPU_MAX];
+  memset(topo, 0, sizeof(*topo));
+
+  int rc = read_line(SYS_CPU "/online", buf, sizeof(buf));
+  if (!rc) {
+    rc = cpu_list_parse(buf, online, CPU_MAX);
+  }
+  if (rc) {
+    return rc;
+  }
+  size_t n = 0;
+  for (size_t c = 0; c < CPU_MAX; c++) {
+    n += online[c];
+  }
+  topo->cpus = calloc(n, sizeof(*topo->cpus));
+  if (!topo->cpus) {
+    return ENOMEM;
+  }
+
+  for (int c = 0; c < (int)CPU_MAX; c++) {
+    if (!online[c]) {
+      continue;
+    }
+    struct cpu_info *ci = &topo->cpus[topo->cpu_num++];
+    ci->cpu = c;
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id",
+             c);
+    ci->package = read_int(path, 0);
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", c);
+    // core_id is only unique within a package
+    ci->core = ci->package * 65536 + read_int(path, c);
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list",
+             c);
+    ci->smt = 0;
+    if (!read_line(path, buf, sizeof(buf)) &&
+        !cpu_list_parse(buf, bits, CPU_MAX)) {
+      for (int s = 0; s < c; s++) {
+        ci->smt += bits[s];
+      }
+    }
+    ci->llc = cpu_llc(c);
+    ci->node = 0;
+  }
+
+  // NUMA nodes: node<N>/cpulist
+  DIR *dir = opendir(SYS_NODE);
+  if (dir) {
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+      int node;
+      if (sscanf(de->d_name, "node%d", &node) != 1) {
+        continue;
+      }
+      snprintf(path, sizeof(path), SYS_NODE "/node%d/cpulist", node);
+      if (read_line(path, buf, sizeof(buf)) ||
+          cpu_list_parse(buf, bits, CPU_MAX)) {
+        continue;
+      }
+      for (size_t i = 0; i < topo->cpu_num; i++) {
+        if (bits[topo->cpus[i].cpu]) {
+          topo->cpus[i].node = node;
+        }
+      }
+    }
+    closedir(dir);
+  }
+
+  topo->core_num = count_distinct(topo, offsetof(struct cpu_info, core));
+  topo->llc_num = count_distinct(topo, offsetof(struct cpu_info, llc));
+  topo->node_num = count_distinct(topo, offsetof(struct cpu_info, node));
+  topo->package_num = count_distinct(topo, offsetof(struct cpu_info, package));
+  return 0;
+}
+
+void cpu_topology_free(struct cpu_topology *topo) {
+  free(topo->cpus);
+  topo->cpus = NULL;
+  topo->cpu_num = 0;
+}
+
+const struct cpu_info *cpu_topology_find(const struct cpu_topology *topo,
+                                         int cpu) {
+  for (size_t i = 0; i < topo->cpu_num; i++) {
+    if (topo->cpus[i].cpu == cpu) {
+      return &topo->cpus[i];
+    }
+  }
+  return NULL;
+}
+
+void cpu_topology_print(const struct cpu_topology *topo) {
+  printf("%zu CPUs, %zu cores, %zu LLCs, %zu NUMA nodes, %zu packages\n",
+         topo->cpu_num, topo->core_num, topo->llc_num, topo->node_num,
+         topo->package_num);
+  for (size_t i = 0; i < topo->cpu_num; i++) {
+    const struct cpu_info *ci = &topo->cpus[i];
+    printf("  cpu %3d: package %d core %d smt %d llc %d node %d\n", ci->cpu,
+           ci->package, ci->core & 0xffff, ci->smt, ci->llc, ci->node);
+  }
+}
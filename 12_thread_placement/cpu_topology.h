@@ -0,0 +1,43 @@
+/*
+ * CPU topology as exported by the kernel under /sys/devices/system/cpu and
+ * /sys/devices/system/node:
+ * - core:    topology/core_id + physical_package_id, SMT siblings share it
+ * - smt:     index of the CPU among its thread_siblings_list
+ * - llc:     first CPU of the last level cache's shared_cpu_list
+ * - node:    NUMA node whose cpulist has the CPU (0 without NUMA)
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <stddef.h>
+
+struct cpu_info {
+  int cpu;
+  int package;
+  int core; // unique over packages
+  int smt;
+  int llc;
+  int node;
+};
+
+struct cpu_topology {
+  struct cpu_info *cpus; // online CPUs, ascending
+  size_t cpu_num;
+  size_t core_num;
+  size_t llc_num;
+  size_t node_num;
+  size_t package_num;
+};
+
+int cpu_topology_load(struct cpu_topology *topo);
+void cpu_topology_free(struct cpu_topology *topo);
+void cpu_topology_print(const struct cpu_topology *topo);
+const struct cpu_info *cpu_topology_find(const struct cpu_topology *topo,
+                                         int cpu);
+
+// parses a kernel cpu list ("0-3,8,10-11") into a bitmap of max bits
+int cpu_list_parse(const char *list, unsigned char *bits, size_t max);
+
+#endif // CPU_TOPOLOGY_H
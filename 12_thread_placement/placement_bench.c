@@ -0,0 +1,283 @@
+/*
+ * What placement buys:
+ * - memory read bandwidth from a thread on node A over a buffer bound to
+ *   node B, for every (A, B) pair: local vs. cross-socket.
+ * - one-way handoff latency between two pinned threads over a shared cache
+ *   line, for every kind of CPU pair found: same CPU, SMT siblings, same
+ *   LLC, same node, cross node.
+ * - a 05_thread_pool pool started with per-worker placement attrs, checked
+ *   with sched_getcpu() from inside the tasks.
+ *
+ * usage: ./placement_bench [buffer MB] [round trips]
+ */
+#define _GNU_SOURCE
+
+#include "cpu_topology.h"
+#include "thread_placement.h"
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_BUFFER_MB 64U
+#define DEF_ROUND_TRIPS 20000U
+#define READ_PASSES 3U
+#define SPIN_BEFORE_YIELD 100U // needed when both ends share a CPU
+#define POOL_TASKS 256U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int run_pinned(int cpu, void *(*fn)(void *), void *arg,
+                      pthread_t *tid) {
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_attr_init(&attr);
+  pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  int rc = pthread_create(tid, &attr, fn, arg);
+  pthread_attr_destroy(&attr);
+  return rc;
+}
+
+/* bandwidth */
+
+struct bw_arg {
+  int mem_node;
+  size_t size;
+  double gbps;
+};
+
+static void *bw_thread(void *param) {
+  struct bw_arg *a = (struct bw_arg *)param;
+  uint64_t *buf = placement_alloc_onnode(a->size, a->mem_node);
+  if (!buf) {
+    a->gbps = 0;
+    return NULL;
+  }
+  size_t n = a->size / sizeof(*buf);
+  for (size_t i = 0; i < n; i++) { // fault the pages in (on mem_node)
+    buf[i] = i;
+  }
+  uint64_t sum = 0, start = now_ns();
+  for (unsigned int pass = 0; pass < READ_PASSES; pass++) {
+    for (size_t i = 0; i < n; i++) {
+      sum += buf[i];
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  a->gbps = (double)a->size * READ_PASSES / elapsed;
+  if (sum == 42) { // keep the loop
+    printf(" ");
+  }
+  placement_free(buf, a->size);
+  return NULL;
+}
+
+static void bench_bandwidth(const struct cpu_topology *topo, size_t size) {
+  // one CPU per node: the first one found
+  int node_cpu[topo->node_num], node_id[topo->node_num];
+  size_t nodes = 0;
+  for (size_t i = 0; i < topo->cpu_num; i++) {
+    size_t k = 0;
+    while (k < nodes && node_id[k] != topo->cpus[i].node) {
+      k++;
+    }
+    if (k == nodes && nodes < topo->node_num) {
+      node_id[nodes] = topo->cpus[i].node;
+      node_cpu[nodes++] = topo->cpus[i].cpu;
+    }
+  }
+
+  printf("read bandwidth (GB/s), rows: thread node, columns: memory node\n");
+  for (size_t a = 0; a < nodes; a++) {
+    printf("  node %d:", node_id[a]);
+    for (size_t b = 0; b < nodes; b++) {
+      struct bw_arg arg = {.mem_node = node_id[b], .size = size};
+      pthread_t tid;
+      int rc = run_pinned(node_cpu[a], &bw_thread, &arg, &tid);
+      ERROR_CHECK(rc, 0);
+      pthread_join(tid, NULL);
+      printf("  [%d] %6.2f", node_id[b], arg.gbps);
+    }
+    printf("\n");
+  }
+}
+
+/* handoff latency */
+
+struct pingpong {
+  _Alignas(64) atomic_uint_fast64_t ball;
+  size_t round_trips;
+};
+
+static void wait_for(struct pingpong *pp, uint64_t value) {
+  unsigned int spins = 0;
+  while (atomic_load_explicit(&pp->ball, memory_order_acquire) != value) {
+    if (++spins == SPIN_BEFORE_YIELD) {
+      spins = 0;
+      sched_yield();
+    }
+  }
+}
+
+static void *pong_thread(void *param) {
+  struct pingpong *pp = (struct pingpong *)param;
+  for (uint64_t i = 0; i < pp->round_trips; i++) {
+    wait_for(pp, 2 * i + 1);
+    atomic_store_explicit(&pp->ball, 2 * i + 2, memory_order_release);
+  }
+  return NULL;
+}
+
+static void *ping_thread(void *param) {
+  struct pingpong *pp = (struct pingpong *)param;
+  for (uint64_t i = 0; i < pp->round_trips; i++) {
+    atomic_store_explicit(&pp->ball, 2 * i + 1, memory_order_release);
+    wait_for(pp, 2 * i + 2);
+  }
+  return NULL;
+}
+
+static double handoff_ns(int cpu_a, int cpu_b, size_t round_trips) {
+  struct pingpong pp = {.round_trips = round_trips};
+  atomic_init(&pp.ball, 0);
+  pthread_t ping, pong;
+  int rc = run_pinned(cpu_b, &pong_thread, &pp, &pong);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  rc = run_pinned(cpu_a, &ping_thread, &pp, &ping);
+  ERROR_CHECK(rc, 0);
+  pthread_join(ping, NULL);
+  uint64_t elapsed = now_ns() - start;
+  pthread_join(pong, NULL);
+  return (double)elapsed / (2 * round_trips);
+}
+
+enum pair_kind { PAIR_SAME_CPU, PAIR_SMT, PAIR_LLC, PAIR_NODE, PAIR_REMOTE,
+                 PAIR_NUM };
+static const char *pair_name[PAIR_NUM] = {"same cpu", "smt siblings",
+                                          "same llc", "same node",
+                                          "cross node"};
+
+static enum pair_kind classify(const struct cpu_info *a,
+                               const struct cpu_info *b) {
+  return a->cpu == b->cpu     ? PAIR_SAME_CPU
+         : a->core == b->core ? PAIR_SMT
+         : a->llc == b->llc   ? PAIR_LLC
+         : a->node == b->node ? PAIR_NODE
+                              : PAIR_REMOTE;
+}
+
+static void bench_handoff(const struct cpu_topology *topo,
+                          size_t round_trips) {
+  printf("one-way handoff latency over a shared cache line:\n");
+  for (int kind = 0; kind < PAIR_NUM; kind++) {
+    const struct cpu_info *a = NULL, *b = NULL;
+    for (size_t i = 0; i < topo->cpu_num && !a; i++) {
+      for (size_t j = 0; j < topo->cpu_num; j++) {
+        if (classify(&topo->cpus[i], &topo->cpus[j]) == (enum pair_kind)kind) {
+          a = &topo->cpus[i];
+          b = &topo->cpus[j];
+          break;
+        }
+      }
+    }
+    if (!a) {
+      printf("  %-12s n/a on this machine\n", pair_name[kind]);
+      continue;
+    }
+    printf("  %-12s cpu %d <-> cpu %d: %8.1f ns\n", pair_name[kind], a->cpu,
+           b->cpu, handoff_ns(a->cpu, b->cpu, round_trips));
+  }
+}
+
+/* placed pool */
+
+static atomic_int pool_cpu_seen[CPU_SETSIZE];
+
+static void where_task(void *arg) {
+  (void)arg;
+  int cpu = sched_getcpu();
+  if (cpu >= 0 && cpu < CPU_SETSIZE) {
+    atomic_fetch_add(&pool_cpu_seen[cpu], 1);
+  }
+}
+
+static void bench_pool(const struct cpu_topology *topo,
+                       enum placement_policy policy) {
+  size_t workers = topo->cpu_num < 8 ? topo->cpu_num : 8;
+  struct thread_placement pl;
+  int rc = thread_placement_init(&pl, topo, workers, policy, 256 * 1024);
+  ERROR_CHECK(rc, 0);
+  printf("%s placement of %zu workers:",
+         policy == PLACEMENT_COMPACT ? "compact" : "spread", workers);
+  for (size_t i = 0; i < workers; i++) {
+    printf(" %d(n%d)", pl.cpus[i], pl.nodes[i]);
+  }
+  printf("\n");
+
+  memset(pool_cpu_seen, 0, sizeof(pool_cpu_seen));
+  struct thread_pool pool;
+  rc = thread_pool_create_attrs(&pool, workers, POOL_TASKS, pl.attrs);
+  ERROR_CHECK(rc, 0);
+  for (unsigned int i = 0; i < POOL_TASKS; i++) {
+    rc = thread_pool_submit(&pool, &where_task, NULL);
+    ERROR_CHECK(rc, 0);
+  }
+  thread_pool_shutdown(&pool);
+
+  size_t stray = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    int placed = 0;
+    for (size_t i = 0; i < workers; i++) {
+      placed |= pl.cpus[i] == cpu;
+    }
+    stray += placed ? 0 : atomic_load(&pool_cpu_seen[cpu]);
+  }
+  printf("  %u tasks, %zu ran outside the placed CPUs\n", POOL_TASKS, stray);
+  thread_placement_destroy(&pl);
+}
+
+int main(int argc, char *argv[]) {
+  size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_BUFFER_MB;
+  size_t round_trips = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_ROUND_TRIPS;
+  if (!size_mb || !round_trips) {
+    printf("usage: %s [buffer MB] [round trips]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct cpu_topology topo;
+  int rc = cpu_topology_load(&topo);
+  ERROR_CHECK(rc, 0);
+  cpu_topology_print(&topo);
+
+  bench_bandwidth(&topo, size_mb * 1024 * 1024);
+  bench_handoff(&topo, round_trips);
+  bench_pool(&topo, PLACEMENT_COMPACT);
+  bench_pool(&topo, PLACEMENT_SPREAD);
+
+  cpu_topology_free(&topo);
+  return 0;
+}
@@ -0,0 +1,183 @@
+// for pthread_attr_setaffinity_np, cpu_set_t
+#define _GNU_SOURCE
+
+#include "thread_placement.h"
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NODE_MASK_BITS 1024U
+
+static int cmp_compact(const void *a, const void *b) {
+  const struct cpu_info *x = a, *y = b;
+  if (x->node != y->node) {
+    return x->node - y->node;
+  }
+  if (x->llc != y->llc) {
+    return x->llc - y->llc;
+  }
+  if (x->core != y->core) {
+    return x->core - y->core;
+  }
+  return x->smt - y->smt;
+}
+
+// lexicographic: shared cores first, then LLCs, then nodes
+static int score_less(const size_t *a, const size_t *b) {
+  for (int i = 0; i < 3; i++) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i];
+    }
+  }
+  return 0;
+}
+
+// greedy: next CPU is the one sharing the least with the CPUs taken so far
+static void order_spread(const struct cpu_topology *topo,
+                         struct cpu_info *order) {
+  size_t n = topo->cpu_num;
+  unsigned char *used = calloc(n, 1);
+  if (!used) {
+    memcpy(order, topo->cpus, n * sizeof(*order));
+    return;
+  }
+  for (size_t k = 0; k < n; k++) {
+    size_t best = n;
+    size_t best_score[3] = {0};
+    for (size_t i = 0; i < n; i++) {
+      if (used[i]) {
+        continue;
+      }
+      // how many already taken share core / llc / node with cpu i
+      size_t score[3] = {0};
+      for (size_t j = 0; j < k; j++) {
+        score[0] += order[j].core == topo->cpus[i].core;
+        score[1] += order[j].llc == topo->cpus[i].llc;
+        score[2] += order[j].node == topo->cpus[i].node;
+      }
+      if (best == n || score_less(score, best_score)) {
+        best = i;
+        memcpy(best_score, score, sizeof(score));
+      }
+    }
+    used[best] = 1;
+    order[k] = topo->cpus[best];
+  }
+  free(used);
+}
+
+void *placement_alloc_onnode(size_t size, int node) {
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+  if (node >= 0 && node < (int)NODE_MASK_BITS) {
+    unsigned long mask[NODE_MASK_BITS / (8 * sizeof(unsigned long))] = {0};
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    // no libnuma needed; on failure the pages land where first touched
+    syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask, NODE_MASK_BITS + 1, 0);
+  }
+  return ptr;
+}
+
+void placement_free(void *ptr, size_t size) {
+  if (ptr) {
+    munmap(ptr, size);
+  }
+}
+
+int placement_pin_self(int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+int thread_placement_init(struct thread_placement *pl,
+                          const struct cpu_topology *topo, size_t workers,
+                          enum placement_policy policy, size_t stack_size) {
+  if (!pl || !topo || !topo->cpu_num || !workers) {
+    return EINVAL;
+  }
+  memset(pl, 0, sizeof(*pl));
+  struct cpu_info *order = calloc(topo->cpu_num, sizeof(*order));
+  pl->cpus = calloc(workers, sizeof(*pl->cpus));
+  pl->nodes = calloc(workers, sizeof(*pl->nodes));
+  pl->attrs = calloc(workers, sizeof(*pl->attrs));
+  pl->stacks = calloc(workers, sizeof(*pl->stacks));
+  if (!order || !pl->cpus || !pl->nodes || !pl->attrs || !pl->stacks) {
+    free(order);
+    thread_placement_destroy(pl);
+    return ENOMEM;
+  }
+
+  if (policy == PLACEMENT_COMPACT) {
+    memcpy(order, topo->cpus, topo->cpu_num * sizeof(*order));
+    qsort(order, topo->cpu_num, sizeof(*order), &cmp_compact);
+  } else {
+    order_spread(topo, order);
+  }
+
+  size_t page_size = getpagesize();
+  if (stack_size) {
+    stack_size = (stack_size + page_size - 1) & ~(page_size - 1);
+    pl->stack_size = stack_size + page_size; // one guard page below
+  }
+
+  int rc = 0;
+  for (size_t i = 0; i < workers && !rc; i++) {
+    const struct cpu_info *ci = &order[i % topo->cpu_num];
+    pl->cpus[i] = ci->cpu;
+    pl->nodes[i] = ci->node;
+
+    rc = pthread_attr_init(&pl->attrs[i]);
+    if (rc) {
+      break;
+    }
+    pl->num = i + 1;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(ci->cpu, &cpus);
+    rc = pthread_attr_setaffinity_np(&pl->attrs[i], sizeof(cpus), &cpus);
+
+    if (!rc && stack_size) {
+      pl->stacks[i] = placement_alloc_onnode(pl->stack_size, ci->node);
+      if (!pl->stacks[i]) {
+        rc = ENOMEM;
+      } else if (mprotect(pl->stacks[i], page_size, PROT_NONE)) {
+        rc = errno;
+      } else {
+        rc = pthread_attr_setstack(&pl->attrs[i],
+                                   (char *)pl->stacks[i] + page_size,
+                                   stack_size);
+      }
+    }
+  }
+  free(order);
+  if (rc) {
+    thread_placement_destroy(pl);
+  }
+  return rc;
+}
+
+void thread_placement_destroy(struct thread_placement *pl) {
+  for (size_t i = 0; i < pl->num; i++) {
+    pthread_attr_destroy(&pl->attrs[i]);
+    if (pl->stacks) {
+      placement_free(pl->stacks[i], pl->stack_size);
+    }
+  }
+  free(pl->cpus);
+  free(pl->nodes);
+  free(pl->attrs);
+  free(pl->stacks);
+  memset(pl, 0, sizeof(*pl));
+}
@@ -0,0 +1,50 @@
+/*
+ * Topology aware placement of pool workers.
+ *
+ * - thread_placement_init(): choose one CPU per worker and build one
+ *   pthread_attr_t per worker with pthread_attr_setaffinity_np() and a
+ *   stack allocated on the worker's NUMA node, ready for
+ *   thread_pool_create_attrs() (05_thread_pool).
+ *     PLACEMENT_COMPACT: fill a node, LLC and core (SMT siblings) before
+ *                        moving on; workers share caches, cheap handoffs.
+ *     PLACEMENT_SPREAD:  one worker per core, round robin over nodes and
+ *                        LLCs, SMT siblings last; most cache & bandwidth.
+ *   More workers than CPUs wrap around.
+ * - placement_alloc_onnode(): mmap() + mbind(MPOL_PREFERRED), for stacks,
+ *   arenas and buffers which must be local to a node. Falls back to first
+ *   touch placement where mbind() isn't permitted.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "cpu_topology.h"
+
+enum placement_policy { PLACEMENT_COMPACT, PLACEMENT_SPREAD };
+
+struct thread_placement {
+  size_t num;
+  int *cpus;  // cpu of worker i
+  int *nodes; // node of worker i
+  pthread_attr_t *attrs;
+  void **stacks;
+  size_t stack_size;
+};
+
+// stack_size 0: keep the default stack (no node local stack)
+int thread_placement_init(struct thread_placement *pl,
+                          const struct cpu_topology *topo, size_t workers,
+                          enum placement_policy policy, size_t stack_size);
+// the workers must be joined already (their stacks are unmapped)
+void thread_placement_destroy(struct thread_placement *pl);
+
+void *placement_alloc_onnode(size_t size, int node);
+void placement_free(void *ptr, size_t size);
+// pins the calling thread to one CPU
+int placement_pin_self(int cpu);
+
+#endif // THREAD_PLACEMENT_H
@@ -0,0 +1,277 @@
+#include "buffered_io.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// writes all of iov[0..cnt), advancing over short writes; *written: the
+// bytes that went out, on failure too
+static int write_all(int fd, struct iovec *iov, int cnt,
+                     struct buf_io_stats *stats, size_t *written) {
+  *written = 0;
+  while (cnt > 0) {
+    ssize_t n = writev(fd, iov, cnt < IOV_MAX ? cnt : IOV_MAX);
+    stats->syscalls++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    *written += n;
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static int writer_sync(struct buf_writer *w) {
+  if (w->sync == BUF_SYNC_NONE || !w->unsynced) {
+    return 0;
+  }
+  int rc = w->sync == BUF_SYNC_DATA ? fdatasync(w->fd) : fsync(w->fd);
+  w->stats.syscalls++;
+  w->stats.syncs++;
+  if (rc) {
+    return errno; // still unsynced: the next flush or close tries again
+  }
+  w->unsynced = 0;
+  return 0;
+}
+
+static int writer_wrote(struct buf_writer *w, size_t bytes) {
+  w->unsynced += bytes;
+  if (w->sync != BUF_SYNC_NONE && w->unsynced >= w->sync_bytes) {
+    return writer_sync(w);
+  }
+  return 0;
+}
+
+// buffered bytes + iov[0..cnt) in as few writev() calls as possible
+static int writer_flush_with(struct buf_writer *w, const struct iovec *iov,
+                             int cnt) {
+  struct iovec local[64];
+  struct iovec *vec = local;
+  if (cnt + 1 > (int)(sizeof(local) / sizeof(local[0]))) {
+    vec = malloc((cnt + 1) * sizeof(*vec));
+    if (!vec) {
+      return ENOMEM;
+    }
+  }
+  int n = 0;
+  size_t bytes = w->len;
+  if (w->len) {
+    vec[n].iov_base = w->buf;
+    vec[n++].iov_len = w->len;
+  }
+  for (int i = 0; i < cnt; i++) {
+    vec[n++] = iov[i];
+    bytes += iov[i].iov_len;
+  }
+  size_t written;
+  int rc = write_all(w->fd, vec, n, &w->stats, &written);
+  if (vec != local) {
+    free(vec);
+  }
+  if (rc) {
+    // keep only the unwritten tail, a retried flush must not repeat what
+    // is in the file already
+    size_t done = written < w->len ? written : w->len;
+    memmove(w->buf, w->buf + done, w->len - done);
+    w->len -= done;
+    w->unsynced += written;
+    return rc;
+  }
+  w->len = 0;
+  return writer_wrote(w, bytes);
+}
+
+int buf_writer_open(struct buf_writer *w, int fd, size_t buf_size,
+                    enum buf_sync sync, size_t sync_bytes) {
+  if (!w || fd < 0 || !buf_size) {
+    return EINVAL;
+  }
+  memset(w, 0, sizeof(*w));
+  w->buf = malloc(buf_size);
+  if (!w->buf) {
+    return ENOMEM;
+  }
+  w->fd = fd;
+  w->cap = buf_size;
+  w->sync = sync;
+  w->sync_bytes = sync_bytes;
+  return 0;
+}
+
+int buf_writer_write(struct buf_writer *w, const void *data, size_t len) {
+  w->stats.records++;
+  w->stats.bytes += len;
+  if (len <= w->cap - w->len) {
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    return w->len == w->cap ? buf_writer_flush(w) : 0;
+  }
+  struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+  return writer_flush_with(w, &iov, 1);
+}
+
+int buf_writer_writev(struct buf_writer *w, const struct iovec *iov,
+                      int cnt) {
+  size_t total = 0;
+  for (int i = 0; i < cnt; i++) {
+    total += iov[i].iov_len;
+  }
+  w->stats.records += cnt;
+  w->stats.bytes += total;
+  if (total > w->cap - w->len) {
+    return writer_flush_with(w, iov, cnt);
+  }
+  for (int i = 0; i < cnt; i++) {
+    memcpy(w->buf + w->len, iov[i].iov_base, iov[i].iov_len);
+    w->len += iov[i].iov_len;
+  }
+  return w->len == w->cap ? buf_writer_flush(w) : 0;
+}
+
+int buf_writer_flush(struct buf_writer *w) {
+  if (!w->len) {
+    return 0;
+  }
+  return writer_flush_with(w, NULL, 0);
+}
+
+int buf_writer_close(struct buf_writer *w) {
+  int rc = buf_writer_flush(w);
+  if (!rc) {
+    rc = writer_sync(w);
+  }
+  free(w->buf);
+  w->buf = NULL;
+  w->cap = w->len = 0;
+  return rc;
+}
+
+int buf_reader_open(struct buf_reader *r, int fd, size_t buf_size,
+                    off_t offset) {
+  if (!r || fd < 0 || !buf_size) {
+    return EINVAL;
+  }
+  memset(r, 0, sizeof(*r));
+  r->buf = malloc(buf_size);
+  if (!r->buf) {
+    return ENOMEM;
+  }
+  r->fd = fd;
+  r->cap = buf_size;
+  r->offset = offset;
+  return 0;
+}
+
+// reads into iov[0..cnt) at r->offset until full or EOF
+static int read_all(struct buf_reader *r, struct iovec *iov, int cnt,
+                    size_t *got) {
+  *got = 0;
+  while (cnt > 0) {
+    ssize_t n = preadv(r->fd, iov, cnt < IOV_MAX ? cnt : IOV_MAX, r->offset);
+    r->stats.syscalls++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (!n) {
+      break;
+    }
+    r->offset += n;
+    *got += n;
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static int reader_fill(struct buf_reader *r) {
+  ssize_t n;
+  do {
+    n = pread(r->fd, r->buf, r->cap, r->offset);
+    r->stats.syscalls++;
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return errno;
+  }
+  r->pos = 0;
+  r->len = n;
+  r->offset += n;
+  return 0;
+}
+
+int buf_reader_read(struct buf_reader *r, void *dst, size_t len,
+                    size_t *got) {
+  struct iovec iov = {.iov_base = dst, .iov_len = len};
+  return buf_reader_readv(r, &iov, 1, got);
+}
+
+int buf_reader_readv(struct buf_reader *r, const struct iovec *iov, int cnt,
+                     size_t *got) {
+  *got = 0;
+  for (int i = 0; i < cnt; i++) {
+    char *dst = iov[i].iov_base;
+    size_t want = iov[i].iov_len;
+    while (want) {
+      if (r->pos == r->len) {
+        if (want >= r->cap) {
+          // bigger than the buffer: straight into dst, no copy
+          struct iovec direct = {.iov_base = dst, .iov_len = want};
+          size_t n;
+          int rc = read_all(r, &direct, 1, &n);
+          *got += n;
+          r->stats.bytes += n;
+          if (rc || n < want) {
+            return rc;
+          }
+          break;
+        }
+        int rc = reader_fill(r);
+        if (rc || !r->len) {
+          return rc;
+        }
+      }
+      size_t n = r->len - r->pos < want ? r->len - r->pos : want;
+      memcpy(dst, r->buf + r->pos, n);
+      r->pos += n;
+      dst += n;
+      want -= n;
+      *got += n;
+      r->stats.bytes += n;
+    }
+    r->stats.records++;
+  }
+  return 0;
+}
+
+void buf_reader_close(struct buf_reader *r) {
+  free(r->buf);
+  r->buf = NULL;
+  r->cap = r->pos = r->len = 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Buffered and vectored file I/O.
+ *
+ * 04_file_operation/file_operation_demo.c does one write() per record and
+ * one lseek() + read() to get it back: a syscall per record, which is what
+ * dominates once records are small. Here:
+ *
+ * - buf_writer: records are copied into a large user space buffer which is
+ *   written out by one write() when full. A record, or a batch of records
+ *   (buf_writer_writev()), that does not fit goes out together with the
+ *   buffered bytes in a single writev(), without being copied.
+ * - buf_reader: pread()s big blocks at its own offset (so several readers
+ *   can share one fd) and serves records from the block; requests bigger
+ *   than the buffer go straight to the destination with preadv().
+ * - sync policy: BUF_SYNC_NONE leaves it to the page cache,
+ *   BUF_SYNC_DATA uses fdatasync(), BUF_SYNC_FULL fsync(); either every
+ *   sync_bytes written (0: on every flush) and on buf_writer_close().
+ *
+ * A writer or reader belongs to one thread at a time. Short writes and
+ * EINTR are retried. When a write fails, the buffered bytes that did go
+ * out are dropped from the buffer: a later flush writes only the rest.
+ * The stats count the syscalls actually made.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef BUFFERED_IO_H
+#define BUFFERED_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+enum buf_sync { BUF_SYNC_NONE, BUF_SYNC_DATA, BUF_SYNC_FULL };
+
+struct buf_io_stats {
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t syscalls; // write/writev/pread/preadv/fsync/fdatasync
+  uint64_t syncs;
+};
+
+struct buf_writer {
+  int fd;
+  char *buf;
+  size_t cap;
+  size_t len;
+  enum buf_sync sync;
+  size_t sync_bytes;
+  size_t unsynced;
+  struct buf_io_stats stats;
+};
+
+struct buf_reader {
+  int fd;
+  char *buf;
+  size_t cap;
+  size_t pos; // next byte to hand out
+  size_t len; // valid bytes in buf
+  off_t offset; // file offset of buf[len]
+  struct buf_io_stats stats;
+};
+
+// writes at the fd's current offset (use O_APPEND for shared files)
+int buf_writer_open(struct buf_writer *w, int fd, size_t buf_size,
+                    enum buf_sync sync, size_t sync_bytes);
+int buf_writer_write(struct buf_writer *w, const void *data, size_t len);
+int buf_writer_writev(struct buf_writer *w, const struct iovec *iov, int cnt);
+int buf_writer_flush(struct buf_writer *w);
+// flush + sync (unless BUF_SYNC_NONE); the fd is left open
+int buf_writer_close(struct buf_writer *w);
+
+int buf_reader_open(struct buf_reader *r, int fd, size_t buf_size,
+                    off_t offset);
+// *got < len only at end of file
+int buf_reader_read(struct buf_reader *r, void *dst, size_t len, size_t *got);
+int buf_reader_readv(struct buf_reader *r, const struct iovec *iov, int cnt,
+                     size_t *got);
+void buf_reader_close(struct buf_reader *r);
+
+#endif // BUFFERED_IO_H
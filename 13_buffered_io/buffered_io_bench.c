@@ -0,0 +1,250 @@
+/*
+ * Unbuffered vs. buffered vs. vectored record I/O.
+ *
+ * Writes N records of R bytes (100 by default, the size of the input buffer
+ * in 04_file_operation/file_operation_demo.c) and reads them back:
+ * - write()/read() per record, as the demo does
+ * - buf_writer/buf_reader with several buffer sizes
+ * - batches of records with buf_writer_writev()/buf_reader_readv()
+ * - fdatasync() on every flush and every few MB
+ * Every read back is checked against what was written.
+ *
+ * usage: ./buffered_io_bench [records] [record size] [batch]
+ */
+#include "buffered_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_RECORDS 200000U
+#define DEF_RECORD_SIZE 100U
+#define DEF_BATCH 64U
+#define SYNC_EVERY (4U * 1024 * 1024)
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static size_t record_num, record_size, batch;
+static char *records; // record_num * record_size bytes
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill_records(void) {
+  for (size_t i = 0; i < record_num; i++) {
+    char *rec = records + i * record_size;
+    for (size_t j = 0; j < record_size; j++) {
+      rec[j] = 'a' + (i + j) % 26;
+    }
+    if (record_size >= sizeof(i)) {
+      memcpy(rec, &i, sizeof(i));
+    }
+  }
+}
+
+static void report(const char *name, uint64_t elapsed, uint64_t syscalls) {
+  double mb = (double)record_num * record_size / (1024 * 1024);
+  printf("  %-34s %9.1f MB/s  %8.4f syscalls/record\n", name,
+         mb * 1e9 / elapsed, (double)syscalls / record_num);
+}
+
+static int open_file(const char *path) {
+  int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  return fd;
+}
+
+/* writers */
+
+static void write_unbuffered(const char *path) {
+  int fd = open_file(path);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num; i++) {
+    if (write(fd, records + i * record_size, record_size) !=
+        (ssize_t)record_size) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+  report("write() per record", now_ns() - start, record_num);
+  close(fd);
+}
+
+static void write_buffered(const char *path, const char *name,
+                           size_t buf_size, enum buf_sync sync,
+                           size_t sync_bytes) {
+  int fd = open_file(path);
+  struct buf_writer w;
+  int rc = buf_writer_open(&w, fd, buf_size, sync, sync_bytes);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num && !rc; i++) {
+    rc = buf_writer_write(&w, records + i * record_size, record_size);
+  }
+  ERROR_CHECK(rc, 0);
+  rc = buf_writer_close(&w);
+  ERROR_CHECK(rc, 0);
+  report(name, now_ns() - start, w.stats.syscalls);
+  close(fd);
+}
+
+static void write_vectored(const char *path, const char *name,
+                           size_t buf_size) {
+  int fd = open_file(path);
+  struct buf_writer w;
+  struct iovec iov[batch];
+  int rc = buf_writer_open(&w, fd, buf_size, BUF_SYNC_NONE, 0);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num && !rc; i += batch) {
+    size_t n = record_num - i < batch ? record_num - i : batch;
+    for (size_t k = 0; k < n; k++) {
+      iov[k].iov_base = records + (i + k) * record_size;
+      iov[k].iov_len = record_size;
+    }
+    rc = buf_writer_writev(&w, iov, n);
+  }
+  ERROR_CHECK(rc, 0);
+  rc = buf_writer_close(&w);
+  ERROR_CHECK(rc, 0);
+  report(name, now_ns() - start, w.stats.syscalls);
+  close(fd);
+}
+
+/* readers */
+
+static void check(const char *rec, size_t i) {
+  if (memcmp(rec, records + i * record_size, record_size)) {
+    printf("record %zu read back corrupted\n", i);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void read_unbuffered(int fd) {
+  char rec[record_size];
+  lseek(fd, 0, SEEK_SET);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num; i++) {
+    if (read(fd, rec, record_size) != (ssize_t)record_size) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+    check(rec, i);
+  }
+  report("read() per record", now_ns() - start, record_num);
+}
+
+static void read_buffered(int fd, const char *name, size_t buf_size) {
+  char rec[record_size];
+  struct buf_reader r;
+  int rc = buf_reader_open(&r, fd, buf_size, 0);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num; i++) {
+    size_t got;
+    rc = buf_reader_read(&r, rec, record_size, &got);
+    ERROR_CHECK(rc ? rc : got != record_size ? EIO : 0, 0);
+    check(rec, i);
+  }
+  report(name, now_ns() - start, r.stats.syscalls);
+  buf_reader_close(&r);
+}
+
+static void read_vectored(int fd, const char *name, size_t buf_size) {
+  char *recs = malloc(batch * record_size);
+  struct iovec iov[batch];
+  struct buf_reader r;
+  int rc = recs ? buf_reader_open(&r, fd, buf_size, 0) : ENOMEM;
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < record_num; i += batch) {
+    size_t n = record_num - i < batch ? record_num - i : batch, got;
+    for (size_t k = 0; k < n; k++) {
+      iov[k].iov_base = recs + k * record_size;
+      iov[k].iov_len = record_size;
+    }
+    rc = buf_reader_readv(&r, iov, n, &got);
+    ERROR_CHECK(rc ? rc : got != n * record_size ? EIO : 0, 0);
+    for (size_t k = 0; k < n; k++) {
+      check(recs + k * record_size, i + k);
+    }
+  }
+  report(name, now_ns() - start, r.stats.syscalls);
+  buf_reader_close(&r);
+  free(recs);
+}
+
+int main(int argc, char *argv[]) {
+  record_num = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_RECORDS;
+  record_size = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_RECORD_SIZE;
+  batch = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_BATCH;
+  if (!record_num || !record_size || !batch || batch > 1024) {
+    printf("usage: %s [records] [record size] [batch <= 1024]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  records = malloc(record_num * record_size);
+  if (!records) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  fill_records();
+
+  char path[64];
+  snprintf(path, sizeof(path), "%d-buffered_io.dat", getpid());
+  char name[64];
+  printf("%zu records of %zu bytes, batches of %zu\n", record_num,
+         record_size, batch);
+
+  printf("write:\n");
+  write_unbuffered(path);
+  size_t buf_sizes[] = {4096, 64 * 1024, 1024 * 1024};
+  for (size_t i = 0; i < sizeof(buf_sizes) / sizeof(buf_sizes[0]); i++) {
+    snprintf(name, sizeof(name), "buf_writer %zu KB", buf_sizes[i] / 1024);
+    write_buffered(path, name, buf_sizes[i], BUF_SYNC_NONE, 0);
+  }
+  snprintf(name, sizeof(name), "writev %zu/call (no copy)", batch);
+  write_vectored(path, name, record_size); // batches never fit: direct
+  snprintf(name, sizeof(name), "buf_writer_writev %zu/call 64 KB", batch);
+  write_vectored(path, name, 64 * 1024);
+  write_buffered(path, "64 KB + fdatasync every flush", 64 * 1024,
+                 BUF_SYNC_DATA, 0);
+  snprintf(name, sizeof(name), "64 KB + fdatasync every %u MB",
+           SYNC_EVERY / (1024 * 1024));
+  write_buffered(path, name, 64 * 1024, BUF_SYNC_DATA, SYNC_EVERY);
+
+  printf("read (page cache):\n");
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  read_unbuffered(fd);
+  for (size_t i = 0; i < sizeof(buf_sizes) / sizeof(buf_sizes[0]); i++) {
+    snprintf(name, sizeof(name), "buf_reader %zu KB", buf_sizes[i] / 1024);
+    read_buffered(fd, name, buf_sizes[i]);
+  }
+  snprintf(name, sizeof(name), "buf_reader_readv %zu/call 64 KB", batch);
+  read_vectored(fd, name, 64 * 1024);
+  close(fd);
+
+  unlink(path);
+  free(records);
+  return 0;
+}
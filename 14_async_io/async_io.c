@@ -0,0 +1,476 @@
+// for syscall(), statx()
+#define _GNU_SOURCE
+
+#include "async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PROBE_OPS 256U
+
+static const unsigned char uring_opcode[AIO_OP_NUM] = {
+    [AIO_NOP] = IORING_OP_NOP,
+    [AIO_OPENAT] = IORING_OP_OPENAT,
+    [AIO_CLOSE] = IORING_OP_CLOSE,
+    [AIO_READ] = IORING_OP_READ,
+    [AIO_WRITE] = IORING_OP_WRITE,
+    [AIO_FSYNC] = IORING_OP_FSYNC,
+    [AIO_FDATASYNC] = IORING_OP_FSYNC,
+    [AIO_UNLINKAT] = IORING_OP_UNLINKAT,
+    [AIO_LINKAT] = IORING_OP_LINKAT,
+    [AIO_SYMLINKAT] = IORING_OP_SYMLINKAT,
+    [AIO_STATX] = IORING_OP_STATX,
+    // AIO_FCHMODAT: no io_uring opcode
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned n) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, n);
+}
+
+static void complete(struct aio_engine *eng, struct aio_request *req,
+                     long result) {
+  req->result = result;
+  if (req->cb) {
+    // nobody aio_wait()s for it; the callback may reuse req
+    __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+    req->cb(req, req->arg);
+    return;
+  }
+  pthread_mutex_lock(&eng->done_lock);
+  req->done = 1;
+  pthread_cond_broadcast(&eng->done_cond);
+  pthread_mutex_unlock(&eng->done_lock);
+}
+
+/* thread pool backend */
+
+static long run_blocking(const struct aio_request *req) {
+  long rc;
+  switch (req->op) {
+  case AIO_NOP:
+    rc = 0;
+    break;
+  case AIO_OPENAT:
+    rc = openat(req->fd, req->path, req->flags, req->mode);
+    break;
+  case AIO_CLOSE:
+    rc = close(req->fd);
+    break;
+  case AIO_READ:
+    rc = pread(req->fd, req->buf, req->len, req->offset);
+    break;
+  case AIO_WRITE:
+    rc = pwrite(req->fd, req->buf, req->len, req->offset);
+    break;
+  case AIO_FSYNC:
+    rc = fsync(req->fd);
+    break;
+  case AIO_FDATASYNC:
+    rc = fdatasync(req->fd);
+    break;
+  case AIO_UNLINKAT:
+    rc = unlinkat(req->fd, req->path, req->flags);
+    break;
+  case AIO_LINKAT:
+    rc = linkat(req->fd, req->path, req->fd2, req->path2, req->flags);
+    break;
+  case AIO_SYMLINKAT:
+    rc = symlinkat(req->path, req->fd, req->path2);
+    break;
+  case AIO_FCHMODAT:
+    rc = fchmodat(req->fd, req->path, req->mode, req->flags);
+    break;
+  case AIO_STATX:
+    rc = statx(req->fd, req->path, req->flags, req->len, req->buf);
+    break;
+  default:
+    errno = EINVAL;
+    rc = -1;
+  }
+  return rc < 0 ? -errno : rc;
+}
+
+struct pool_job {
+  struct aio_engine *eng;
+  struct aio_request *req;
+};
+
+static void pool_task(void *arg) {
+  struct pool_job job = *(struct pool_job *)arg;
+  free(arg);
+  complete(job.eng, job.req, run_blocking(job.req));
+}
+
+static int pool_submit(struct aio_engine *eng, struct aio_request *req) {
+  struct pool_job *job = malloc(sizeof(*job));
+  if (!job) {
+    return ENOMEM;
+  }
+  job->eng = eng;
+  job->req = req;
+  int rc = thread_pool_submit(&eng->pool, &pool_task, job);
+  if (rc) {
+    free(job);
+  }
+  return rc;
+}
+
+/* io_uring backend */
+
+static void fill_sqe(struct io_uring_sqe *sqe, const struct aio_request *req) {
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = uring_opcode[req->op];
+  sqe->fd = req->fd;
+  sqe->user_data = (uint64_t)(uintptr_t)req;
+  switch (req->op) {
+  case AIO_OPENAT:
+    sqe->addr = (uintptr_t)req->path;
+    sqe->len = req->mode;
+    sqe->open_flags = req->flags;
+    break;
+  case AIO_READ:
+  case AIO_WRITE:
+    sqe->addr = (uintptr_t)req->buf;
+    sqe->len = req->len;
+    sqe->off = req->offset;
+    break;
+  case AIO_FDATASYNC:
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    break;
+  case AIO_UNLINKAT:
+    sqe->addr = (uintptr_t)req->path;
+    sqe->unlink_flags = req->flags;
+    break;
+  case AIO_LINKAT:
+    sqe->addr = (uintptr_t)req->path;
+    sqe->len = req->fd2;
+    sqe->addr2 = (uintptr_t)req->path2;
+    sqe->hardlink_flags = req->flags;
+    break;
+  case AIO_SYMLINKAT:
+    sqe->addr = (uintptr_t)req->path;
+    sqe->addr2 = (uintptr_t)req->path2;
+    break;
+  case AIO_STATX:
+    sqe->addr = (uintptr_t)req->path;
+    sqe->len = req->len;
+    sqe->addr2 = (uintptr_t)req->buf; // shares the "off" field
+    sqe->statx_flags = req->flags;
+    break;
+  default:
+    break;
+  }
+}
+
+// pushes reqs to the SQ ring and enters the kernel once; sq_lock held.
+// *pushed: how many the kernel took. On failure the others are taken back
+// out of the SQ ring, so they are not submitted by a later enter
+static int ring_push(struct aio_engine *eng, struct aio_request **reqs,
+                     unsigned num, unsigned *pushed) {
+  unsigned tail = *eng->sq_tail;
+  for (unsigned i = 0; i < num; i++) {
+    unsigned idx = tail & *eng->sq_mask;
+    // reqs == NULL: the reaper's wake up NOP
+    struct aio_request nop = {.op = AIO_NOP};
+    fill_sqe(&eng->sqes[idx], reqs ? reqs[i] : &nop);
+    if (!reqs) {
+      eng->sqes[idx].user_data = 0;
+    }
+    eng->sq_array[idx] = idx;
+    tail++;
+  }
+  __atomic_store_n(eng->sq_tail, tail, __ATOMIC_RELEASE);
+  unsigned left = num;
+  while (left) {
+    int n = uring_enter(eng->ring_fd, left, 0, 0);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+      int err = errno;
+      // no SQPOLL: the kernel only reads the SQ ring in io_uring_enter()
+      unsigned head = __atomic_load_n(eng->sq_head, __ATOMIC_ACQUIRE);
+      __atomic_store_n(eng->sq_tail, head, __ATOMIC_RELEASE);
+      *pushed = num - (tail - head);
+      return err;
+    }
+    left -= n;
+  }
+  *pushed = num;
+  return 0;
+}
+
+static int ring_submit(struct aio_engine *eng, struct aio_request **reqs,
+                       unsigned num, unsigned *pushed) {
+  pthread_mutex_lock(&eng->sq_lock);
+  // the reaper (a callback resubmitting) must not wait for itself
+  int reaper = pthread_equal(pthread_self(), eng->reaper);
+  while (!reaper && eng->inflight + num > eng->cq_entries) {
+    pthread_cond_wait(&eng->sq_space, &eng->sq_lock);
+  }
+  eng->inflight += num;
+  int rc = ring_push(eng, reqs, num, pushed);
+  eng->inflight -= num - *pushed;
+  pthread_mutex_unlock(&eng->sq_lock);
+  return rc;
+}
+
+static void *reaper_thread(void *arg) {
+  struct aio_engine *eng = (struct aio_engine *)arg;
+  for (;;) {
+    unsigned head = *eng->cq_head;
+    unsigned tail = __atomic_load_n(eng->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      pthread_mutex_lock(&eng->sq_lock);
+      int stop = eng->stopping && !eng->inflight;
+      pthread_mutex_unlock(&eng->sq_lock);
+      if (stop) {
+        break;
+      }
+      uring_enter(eng->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+    struct io_uring_cqe cqe = eng->cqes[head & *eng->cq_mask];
+    __atomic_store_n(eng->cq_head, head + 1, __ATOMIC_RELEASE);
+    struct aio_request *req = (struct aio_request *)(uintptr_t)cqe.user_data;
+
+    pthread_mutex_lock(&eng->sq_lock);
+    eng->inflight--;
+    pthread_cond_broadcast(&eng->sq_space);
+    pthread_mutex_unlock(&eng->sq_lock);
+    if (req) {
+      complete(eng, req, cqe.res);
+    }
+  }
+  return NULL;
+}
+
+static void ring_unmap(struct aio_engine *eng) {
+  if (eng->sqes) {
+    munmap(eng->sqes, eng->sqes_size);
+  }
+  if (eng->cq_map && eng->cq_map != eng->sq_map) {
+    munmap(eng->cq_map, eng->cq_map_size);
+  }
+  if (eng->sq_map) {
+    munmap(eng->sq_map, eng->sq_map_size);
+  }
+  close(eng->ring_fd);
+  eng->ring_fd = -1;
+}
+
+static int ring_init(struct aio_engine *eng, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  eng->ring_fd = uring_setup(entries, &p);
+  if (eng->ring_fd < 0) {
+    return errno;
+  }
+
+  eng->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  eng->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (eng->cq_map_size > eng->sq_map_size) {
+      eng->sq_map_size = eng->cq_map_size;
+    }
+    eng->cq_map_size = eng->sq_map_size;
+  }
+  eng->sq_map = mmap(NULL, eng->sq_map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, eng->ring_fd, IORING_OFF_SQ_RING);
+  if (eng->sq_map == MAP_FAILED) {
+    int err = errno;
+    eng->sq_map = NULL;
+    ring_unmap(eng);
+    return err;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    eng->cq_map = eng->sq_map;
+  } else {
+    eng->cq_map = mmap(NULL, eng->cq_map_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, eng->ring_fd,
+                       IORING_OFF_CQ_RING);
+    if (eng->cq_map == MAP_FAILED) {
+      int err = errno;
+      eng->cq_map = NULL;
+      ring_unmap(eng);
+      return err;
+    }
+  }
+  eng->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  eng->sqes = mmap(NULL, eng->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, eng->ring_fd, IORING_OFF_SQES);
+  if (eng->sqes == MAP_FAILED) {
+    int err = errno;
+    eng->sqes = NULL;
+    ring_unmap(eng);
+    return err;
+  }
+
+  char *sq = eng->sq_map, *cq = eng->cq_map;
+  eng->sq_head = (unsigned *)(sq + p.sq_off.head);
+  eng->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  eng->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  eng->sq_array = (unsigned *)(sq + p.sq_off.array);
+  eng->cq_head = (unsigned *)(cq + p.cq_off.head);
+  eng->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  eng->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  eng->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  eng->sq_entries = p.sq_entries;
+  // more in flight than sq_entries is fine, only the CQ must not overflow
+  eng->cq_entries = p.cq_entries;
+
+  // which of our ops does this kernel know?
+  struct io_uring_probe *probe =
+      calloc(1, sizeof(*probe) + PROBE_OPS * sizeof(probe->ops[0]));
+  if (probe && !uring_register(eng->ring_fd, IORING_REGISTER_PROBE, probe,
+                               PROBE_OPS)) {
+    for (int op = 0; op < AIO_OP_NUM; op++) {
+      unsigned code = uring_opcode[op];
+      eng->uring_op[op] = op != AIO_FCHMODAT && code <= probe->last_op &&
+                          (probe->ops[code].flags & IO_URING_OP_SUPPORTED);
+    }
+  } else {
+    // no probe (< 5.6): keep the ring for the 5.1 ops only
+    eng->uring_op[AIO_NOP] = eng->uring_op[AIO_FSYNC] =
+        eng->uring_op[AIO_FDATASYNC] = 1;
+  }
+  free(probe);
+  return 0;
+}
+
+/* API */
+
+int aio_engine_init(struct aio_engine *eng, unsigned entries, size_t workers,
+                    int flags) {
+  if (!eng || !entries || !workers) {
+    return EINVAL;
+  }
+  memset(eng, 0, sizeof(*eng));
+  eng->ring_fd = -1;
+  pthread_mutex_init(&eng->done_lock, NULL);
+  pthread_cond_init(&eng->done_cond, NULL);
+  pthread_mutex_init(&eng->sq_lock, NULL);
+  pthread_cond_init(&eng->sq_space, NULL);
+
+  int rc = thread_pool_create(&eng->pool, workers, entries, NULL);
+  if (rc) {
+    goto err;
+  }
+  if (!(flags & AIO_ENGINE_POOL_ONLY) && !ring_init(eng, entries)) {
+    rc = pthread_create(&eng->reaper, NULL, &reaper_thread, eng);
+    if (rc) {
+      ring_unmap(eng);
+      thread_pool_shutdown(&eng->pool);
+      goto err;
+    }
+  }
+  return 0;
+
+err:
+  pthread_cond_destroy(&eng->sq_space);
+  pthread_mutex_destroy(&eng->sq_lock);
+  pthread_cond_destroy(&eng->done_cond);
+  pthread_mutex_destroy(&eng->done_lock);
+  return rc;
+}
+
+void aio_engine_destroy(struct aio_engine *eng) {
+  if (eng->ring_fd >= 0) {
+    pthread_mutex_lock(&eng->sq_lock);
+    eng->stopping = 1;
+    pthread_mutex_unlock(&eng->sq_lock);
+    unsigned pushed;
+    ring_submit(eng, NULL, 1, &pushed); // wakes the reaper up
+    pthread_join(eng->reaper, NULL);
+    ring_unmap(eng);
+  }
+  thread_pool_shutdown(&eng->pool);
+  pthread_cond_destroy(&eng->sq_space);
+  pthread_mutex_destroy(&eng->sq_lock);
+  pthread_cond_destroy(&eng->done_cond);
+  pthread_mutex_destroy(&eng->done_lock);
+}
+
+const char *aio_engine_backend(const struct aio_engine *eng) {
+  return eng->ring_fd >= 0 ? "io_uring" : "thread pool";
+}
+
+int aio_submit(struct aio_engine *eng, struct aio_request *req) {
+  return aio_submit_batch(eng, &req, 1, NULL);
+}
+
+// pushes the ring run reqs[*start, *start + *run) in one enter
+static int ring_flush(struct aio_engine *eng, struct aio_request **reqs,
+                      size_t *start, size_t *run) {
+  unsigned pushed;
+  int rc = ring_submit(eng, reqs + *start, (unsigned)*run, &pushed);
+  *start += pushed;
+  *run = 0;
+  return rc;
+}
+
+int aio_submit_batch(struct aio_engine *eng, struct aio_request **reqs,
+                     size_t num, size_t *queued) {
+  if (queued) {
+    *queued = 0;
+  }
+  for (size_t i = 0; i < num; i++) {
+    if ((unsigned)reqs[i]->op >= AIO_OP_NUM) {
+      return EINVAL; // nothing queued
+    }
+  }
+  size_t start = 0; // reqs[0, start) queued
+  size_t run = 0;   // reqs[start, start + run) gathered for the ring
+  int rc = 0;
+  for (size_t i = 0; i < num && !rc; i++) {
+    struct aio_request *req = reqs[i];
+    req->done = 0;
+    if (eng->ring_fd >= 0 && eng->uring_op[req->op]) {
+      if (++run == eng->sq_entries) {
+        rc = ring_flush(eng, reqs, &start, &run);
+      }
+      continue;
+    }
+    // the pool takes it right away: the ring run goes first, so what is
+    // queued stays a prefix of reqs
+    if (run) {
+      rc = ring_flush(eng, reqs, &start, &run);
+    }
+    if (!rc) {
+      rc = pool_submit(eng, req);
+      start += !rc;
+    }
+  }
+  if (!rc && run) {
+    rc = ring_flush(eng, reqs, &start, &run);
+  }
+  if (queued) {
+    *queued = start;
+  }
+  return rc;
+}
+
+long aio_wait(struct aio_engine *eng, struct aio_request *req) {
+  pthread_mutex_lock(&eng->done_lock);
+  while (!req->done) {
+    pthread_cond_wait(&eng->done_cond, &eng->done_lock);
+  }
+  pthread_mutex_unlock(&eng->done_lock);
+  return req->result;
+}
@@ -0,0 +1,192 @@
+/*
+ * Asynchronous file operations over io_uring, with a thread pool fallback.
+ *
+ * Every file operation in 04_file_operation/file_operation_demo.c (open,
+ * write, read, link, symlink, unlink, chmod, stat...) blocks the calling
+ * thread. Here a request is described by a struct aio_request (see the
+ * aio_prep_* helpers), handed to aio_submit() and completed later:
+ *
+ * - io_uring backend: io_uring_setup()/io_uring_enter() straight through
+ *   syscall(), no liburing. Submissions are pushed to the SQ ring under a
+ *   lock; one reaper thread waits for completions and finishes requests.
+ *   Operations the running kernel lacks (IORING_REGISTER_PROBE) and chmod,
+ *   which has no io_uring opcode, go to the thread pool.
+ * - thread pool backend: when io_uring is unavailable (old kernel, seccomp,
+ *   kernel.io_uring_disabled) or AIO_ENGINE_POOL_ONLY is given, workers of
+ *   05_thread_pool run the blocking syscalls.
+ *
+ * Completion: req->result is the syscall's return value or -errno, then
+ * req->cb (if any) runs on the reaper thread or a pool worker, so it must
+ * not block for long. A callback may resubmit requests. Requests without a
+ * callback are futures: aio_wait() blocks until they are done.
+ *
+ * Reads and writes take an explicit offset (there is no lseek()).
+ * Requests and the buffers/paths they point to must stay valid until they
+ * complete; every request must be complete before aio_engine_destroy().
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "thread_pool.h"
+
+#define AIO_ENGINE_POOL_ONLY 0x1
+
+enum aio_op {
+  AIO_NOP,
+  AIO_OPENAT,
+  AIO_CLOSE,
+  AIO_READ,
+  AIO_WRITE,
+  AIO_FSYNC,
+  AIO_FDATASYNC,
+  AIO_UNLINKAT,
+  AIO_LINKAT,
+  AIO_SYMLINKAT,
+  AIO_FCHMODAT,
+  AIO_STATX,
+  AIO_OP_NUM
+};
+
+struct aio_request;
+typedef void (*aio_callback)(struct aio_request *req, void *arg);
+
+struct aio_request {
+  enum aio_op op;
+  int fd; // file, or directory fd of the *at() calls
+  int fd2; // linkat() new directory fd
+  const char *path;
+  const char *path2; // linkat()/symlinkat() new path
+  void *buf;
+  size_t len;
+  off_t offset;
+  int flags;
+  mode_t mode;
+  aio_callback cb;
+  void *arg;
+
+  long result;
+  int done;
+};
+
+struct aio_engine {
+  int ring_fd; // -1: thread pool backend
+  unsigned char uring_op[AIO_OP_NUM]; // op supported by the ring
+
+  // SQ ring, guarded by sq_lock
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+  // CQ ring, owned by the reaper
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned sq_entries, cq_entries;
+  void *sq_map, *cq_map;
+  size_t sq_map_size, cq_map_size, sqes_size;
+
+  pthread_mutex_t sq_lock;
+  pthread_cond_t sq_space;
+  unsigned inflight; // in the ring, kept <= cq_entries
+  int stopping;
+  pthread_t reaper;
+
+  struct thread_pool pool;
+
+  pthread_mutex_t done_lock;
+  pthread_cond_t done_cond; // aio_wait()
+};
+
+// entries: ring size / pool queue size, workers: pool threads
+int aio_engine_init(struct aio_engine *eng, unsigned entries, size_t workers,
+                    int flags);
+void aio_engine_destroy(struct aio_engine *eng);
+const char *aio_engine_backend(const struct aio_engine *eng);
+
+int aio_submit(struct aio_engine *eng, struct aio_request *req);
+// one io_uring_enter() per run of ring requests (up to the SQ size).
+// *queued (if not NULL): reqs[0, *queued) were queued and complete as
+// usual, even on failure; the rest were not, and must not be aio_wait()ed
+// until resubmitted. EINVAL (an unknown op) queues none
+int aio_submit_batch(struct aio_engine *eng, struct aio_request **reqs,
+                     size_t num, size_t *queued);
+// returns req->result
+long aio_wait(struct aio_engine *eng, struct aio_request *req);
+
+static inline void aio_prep(struct aio_request *req, enum aio_op op, int fd,
+                            aio_callback cb, void *arg) {
+  *req = (struct aio_request){.op = op, .fd = fd, .cb = cb, .arg = arg};
+}
+
+static inline void aio_prep_openat(struct aio_request *req, int dfd,
+                                   const char *path, int flags, mode_t mode,
+                                   aio_callback cb, void *arg) {
+  aio_prep(req, AIO_OPENAT, dfd, cb, arg);
+  req->path = path;
+  req->flags = flags;
+  req->mode = mode;
+}
+
+static inline void aio_prep_rw(struct aio_request *req, enum aio_op op,
+                               int fd, void *buf, size_t len, off_t offset,
+                               aio_callback cb, void *arg) {
+  aio_prep(req, op, fd, cb, arg);
+  req->buf = buf;
+  req->len = len;
+  req->offset = offset;
+}
+
+static inline void aio_prep_linkat(struct aio_request *req, int olddfd,
+                                   const char *oldpath, int newdfd,
+                                   const char *newpath, int flags,
+                                   aio_callback cb, void *arg) {
+  aio_prep(req, AIO_LINKAT, olddfd, cb, arg);
+  req->path = oldpath;
+  req->fd2 = newdfd;
+  req->path2 = newpath;
+  req->flags = flags;
+}
+
+static inline void aio_prep_symlinkat(struct aio_request *req,
+                                      const char *target, int newdfd,
+                                      const char *linkpath, aio_callback cb,
+                                      void *arg) {
+  aio_prep(req, AIO_SYMLINKAT, newdfd, cb, arg);
+  req->path = target;
+  req->path2 = linkpath;
+}
+
+static inline void aio_prep_unlinkat(struct aio_request *req, int dfd,
+                                     const char *path, int flags,
+                                     aio_callback cb, void *arg) {
+  aio_prep(req, AIO_UNLINKAT, dfd, cb, arg);
+  req->path = path;
+  req->flags = flags;
+}
+
+static inline void aio_prep_fchmodat(struct aio_request *req, int dfd,
+                                     const char *path, mode_t mode,
+                                     aio_callback cb, void *arg) {
+  aio_prep(req, AIO_FCHMODAT, dfd, cb, arg);
+  req->path = path;
+  req->mode = mode;
+}
+
+// stx: a struct statx, filled with the fields of mask (STATX_*)
+static inline void aio_prep_statx(struct aio_request *req, int dfd,
+                                  const char *path, int flags,
+                                  unsigned int mask, void *stx,
+                                  aio_callback cb, void *arg) {
+  aio_prep(req, AIO_STATX, dfd, cb, arg);
+  req->path = path;
+  req->flags = flags;
+  req->len = mask;
+  req->buf = stx;
+}
+
+#endif // ASYNC_IO_H
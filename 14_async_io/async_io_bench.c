@@ -0,0 +1,295 @@
+/*
+ * Blocking vs. asynchronous file I/O.
+ *
+ * - the file_operation_demo sequence (open, write, fsync, read, link,
+ *   symlink, chmod, unlink, close) through the engine, futures style.
+ * - random 4 KB reads of a test file: blocking pread() in a loop vs. the
+ *   io_uring and thread pool backends at queue depths 1..256, keeping the
+ *   queue full from the completion callbacks. IOPS and p50/p99 latency
+ *   (submission to completion). The file sits in the page cache, so this
+ *   measures the per request overhead of each path.
+ *
+ * usage: ./async_io_bench [reads per run] [file MB] [pool workers]
+ */
+#define _GNU_SOURCE
+
+#include "async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_READS 50000U
+#define DEF_FILE_MB 64U
+#define DEF_WORKERS 8U
+#define READ_SIZE 4096U
+#define MAX_QD 256U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+/* demo sequence */
+
+static long run(struct aio_engine *eng, struct aio_request *req,
+                const char *what) {
+  int rc = aio_submit(eng, req);
+  ERROR_CHECK(rc, 0);
+  long res = aio_wait(eng, req);
+  printf("  %-28s -> %ld%s%s\n", what, res, res < 0 ? " " : "",
+         res < 0 ? strerror(-res) : "");
+  return res;
+}
+
+static void demo_sequence(struct aio_engine *eng) {
+  char file[64], soft[64], hard[64];
+  snprintf(file, sizeof(file), "%d-aio.txt", getpid());
+  snprintf(soft, sizeof(soft), "%d-aio.soft", getpid());
+  snprintf(hard, sizeof(hard), "%d-aio.hard", getpid());
+  char input[100] = "written through the async engine\n";
+  char output[100] = {0};
+  struct aio_request req;
+
+  printf("file operations over %s:\n", aio_engine_backend(eng));
+  aio_prep_openat(&req, AT_FDCWD, file, O_CREAT | O_RDWR, 0666, NULL, NULL);
+  long fd = run(eng, &req, "openat");
+  if (fd < 0) {
+    return;
+  }
+  aio_prep_rw(&req, AIO_WRITE, fd, input, sizeof(input), 0, NULL, NULL);
+  run(eng, &req, "write");
+  aio_prep(&req, AIO_FDATASYNC, fd, NULL, NULL);
+  run(eng, &req, "fdatasync");
+  aio_prep_rw(&req, AIO_READ, fd, output, sizeof(output), 0, NULL, NULL);
+  run(eng, &req, "read");
+  printf("  read back: %s", output);
+  aio_prep_symlinkat(&req, file, AT_FDCWD, soft, NULL, NULL);
+  run(eng, &req, "symlinkat");
+  aio_prep_linkat(&req, AT_FDCWD, file, AT_FDCWD, hard, 0, NULL, NULL);
+  run(eng, &req, "linkat");
+  aio_prep_fchmodat(&req, AT_FDCWD, file, 0444, NULL, NULL);
+  run(eng, &req, "fchmodat 0444");
+  const char *names[] = {soft, hard, file};
+  for (int i = 0; i < 3; i++) {
+    aio_prep_unlinkat(&req, AT_FDCWD, names[i], 0, NULL, NULL);
+    run(eng, &req, "unlinkat");
+  }
+  aio_prep(&req, AIO_CLOSE, fd, NULL, NULL);
+  run(eng, &req, "close");
+}
+
+/* random reads */
+
+struct bench_run {
+  int fd;
+  size_t blocks;
+  size_t total;
+  atomic_size_t issued;
+  atomic_size_t done;
+  atomic_size_t errors;
+  size_t retired; // requests not resubmitted, qd in the end; under lock
+  size_t qd;
+  uint64_t *lat;
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+  struct aio_engine *eng;
+};
+
+struct bench_req {
+  struct aio_request req; // first: the callback gets &req
+  struct bench_run *run;
+  uint64_t seed;
+  uint64_t start;
+  char *buf;
+};
+
+static void bench_issue(struct bench_req *br) {
+  off_t off = (xorshift(&br->seed) % br->run->blocks) * READ_SIZE;
+  aio_prep_rw(&br->req, AIO_READ, br->run->fd, br->buf, READ_SIZE, off,
+              br->req.cb, br);
+  br->start = now_ns();
+}
+
+static void bench_done(struct aio_request *req, void *arg) {
+  struct bench_req *br = (struct bench_req *)arg;
+  struct bench_run *r = br->run;
+  uint64_t lat = now_ns() - br->start;
+  if (req->result != READ_SIZE) {
+    atomic_fetch_add(&r->errors, 1);
+  }
+  size_t n = atomic_fetch_add(&r->done, 1);
+  r->lat[n] = lat;
+  if (atomic_fetch_add(&r->issued, 1) < r->total) {
+    bench_issue(br);
+    int rc = aio_submit(r->eng, &br->req);
+    ERROR_CHECK(rc, 0);
+  } else {
+    // last access to r: bench_async() reads retired under the lock
+    pthread_mutex_lock(&r->lock);
+    if (++r->retired == r->qd) {
+      pthread_cond_signal(&r->finished);
+    }
+    pthread_mutex_unlock(&r->lock);
+  }
+}
+
+static void report(const char *name, size_t qd, size_t total, uint64_t elapsed,
+                   uint64_t *lat) {
+  qsort(lat, total, sizeof(*lat), &cmp_u64);
+  printf("  %-12s qd %3zu: %9.0f IOPS  p50 %7.1f us  p99 %7.1f us\n", name,
+         qd, total * 1e9 / elapsed, lat[total / 2] / 1e3,
+         lat[total * 99 / 100] / 1e3);
+}
+
+static void bench_blocking(int fd, size_t blocks, size_t total,
+                           uint64_t *lat) {
+  char buf[READ_SIZE];
+  uint64_t seed = 88172645463325252ULL;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < total; i++) {
+    off_t off = (xorshift(&seed) % blocks) * READ_SIZE;
+    uint64_t t = now_ns();
+    if (pread(fd, buf, READ_SIZE, off) != READ_SIZE) {
+      ERROR_CHECK(EIO, 0);
+    }
+    lat[i] = now_ns() - t;
+  }
+  report("blocking", 1, total, now_ns() - start, lat);
+}
+
+static void bench_async(struct aio_engine *eng, int fd, size_t blocks,
+                        size_t total, size_t qd, uint64_t *lat) {
+  struct bench_run r = {.fd = fd, .blocks = blocks, .total = total,
+                        .qd = qd, .lat = lat, .eng = eng};
+  atomic_init(&r.issued, qd);
+  atomic_init(&r.done, 0);
+  atomic_init(&r.errors, 0);
+  pthread_mutex_init(&r.lock, NULL);
+  pthread_cond_init(&r.finished, NULL);
+  struct bench_req *brs = calloc(qd, sizeof(*brs));
+  struct aio_request *reqs[MAX_QD];
+  char *bufs = aligned_alloc(READ_SIZE, qd * READ_SIZE);
+  if (!brs || !bufs) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t i = 0; i < qd; i++) {
+    brs[i].run = &r;
+    brs[i].seed = 88172645463325252ULL + i * 7919;
+    brs[i].buf = bufs + i * READ_SIZE;
+    brs[i].req.cb = &bench_done;
+    reqs[i] = &brs[i].req;
+  }
+
+  uint64_t start = now_ns();
+  pthread_mutex_lock(&r.lock);
+  for (size_t i = 0; i < qd; i++) {
+    bench_issue(&brs[i]);
+  }
+  int rc = aio_submit_batch(eng, reqs, qd, NULL);
+  ERROR_CHECK(rc, 0);
+  while (r.retired < qd) {
+    pthread_cond_wait(&r.finished, &r.lock);
+  }
+  pthread_mutex_unlock(&r.lock);
+  uint64_t elapsed = now_ns() - start;
+
+  if (atomic_load(&r.errors)) {
+    printf("  %zu reads failed\n", atomic_load(&r.errors));
+  }
+  report(aio_engine_backend(eng), qd, total, elapsed, lat);
+  free(bufs);
+  free(brs);
+  pthread_cond_destroy(&r.finished);
+  pthread_mutex_destroy(&r.lock);
+}
+
+int main(int argc, char *argv[]) {
+  size_t total = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_READS;
+  size_t file_mb = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_FILE_MB;
+  size_t workers = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_WORKERS;
+  if (total < MAX_QD || !file_mb || !workers) {
+    printf("usage: %s [reads per run >= %u] [file MB] [pool workers]\n",
+           argv[0], MAX_QD);
+    return EXIT_FAILURE;
+  }
+
+  struct aio_engine uring, pool;
+  int rc = aio_engine_init(&uring, MAX_QD, workers, 0);
+  ERROR_CHECK(rc, 0);
+  rc = aio_engine_init(&pool, MAX_QD, workers, AIO_ENGINE_POOL_ONLY);
+  ERROR_CHECK(rc, 0);
+  if (uring.ring_fd < 0) {
+    printf("io_uring unavailable, both runs use the thread pool\n");
+  }
+  demo_sequence(&uring);
+
+  char path[64];
+  snprintf(path, sizeof(path), "%d-aio.dat", getpid());
+  int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  char *chunk = malloc(1024 * 1024);
+  if (!chunk) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  memset(chunk, 'x', 1024 * 1024);
+  for (size_t i = 0; i < file_mb; i++) {
+    if (write(fd, chunk, 1024 * 1024) != 1024 * 1024) {
+      ERROR_CHECK(EIO, 0);
+    }
+  }
+  free(chunk);
+  size_t blocks = file_mb * 1024 * 1024 / READ_SIZE;
+
+  uint64_t *lat = malloc(total * sizeof(*lat));
+  if (!lat) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  printf("random %u B reads, %zu per run, %zu MB file, %zu pool workers:\n",
+         READ_SIZE, total, file_mb, workers);
+  bench_blocking(fd, blocks, total, lat);
+  for (size_t qd = 1; qd <= MAX_QD; qd *= 4) {
+    bench_async(&uring, fd, blocks, total, qd, lat);
+    bench_async(&pool, fd, blocks, total, qd, lat);
+  }
+
+  free(lat);
+  close(fd);
+  unlink(path);
+  aio_engine_destroy(&pool);
+  aio_engine_destroy(&uring);
+  return 0;
+}
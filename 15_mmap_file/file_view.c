@@ -0,0 +1,172 @@
+#include "file_view.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t page_round(size_t len) {
+  size_t page_size = getpagesize();
+  return (len + page_size - 1) & ~(page_size - 1);
+}
+
+static int view_prot(const struct file_view *view) {
+  return view->flags & FILE_VIEW_RDWR ? PROT_READ | PROT_WRITE : PROT_READ;
+}
+
+// PROT_NONE & MAP_NORESERVE: address space only, no memory committed
+static char *reserve_range(size_t len) {
+  return mmap(NULL, len, PROT_NONE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+// maps file bytes [from, to) (page aligned) over the reservation
+static int map_range(struct file_view *view, size_t from, size_t to) {
+  if (to <= from) {
+    return 0;
+  }
+  void *ptr = mmap(view->base + from, to - from, view_prot(view),
+                   MAP_SHARED | MAP_FIXED, view->fd, from);
+  return ptr == MAP_FAILED ? errno : 0;
+}
+
+int file_view_open(struct file_view *view, const char *path, int flags,
+                   enum file_view_sync sync, size_t reserve) {
+  if (!view || !path) {
+    return EINVAL;
+  }
+  memset(view, 0, sizeof(*view));
+  view->flags = flags;
+  view->sync = sync;
+  int oflags = flags & FILE_VIEW_RDWR ? O_RDWR : O_RDONLY;
+  if (flags & FILE_VIEW_CREATE) {
+    oflags |= O_CREAT;
+  }
+  view->fd = open(path, oflags | O_CLOEXEC, 0666);
+  if (view->fd < 0) {
+    return errno;
+  }
+  struct stat st;
+  if (fstat(view->fd, &st)) {
+    int err = errno;
+    close(view->fd);
+    return err;
+  }
+  view->size = st.st_size;
+  view->mapped = page_round(view->size);
+  view->reserve = page_round(reserve > view->size ? reserve : view->size);
+  if (!view->reserve) {
+    view->reserve = page_round(1); // an empty file still gets a base
+  }
+
+  view->base = reserve_range(view->reserve);
+  if (view->base == MAP_FAILED) {
+    int err = errno;
+    close(view->fd);
+    return err;
+  }
+  int rc = map_range(view, 0, view->mapped);
+  if (rc) {
+    munmap(view->base, view->reserve);
+    close(view->fd);
+  }
+  return rc;
+}
+
+int file_view_grow(struct file_view *view, size_t new_size) {
+  if (!(view->flags & FILE_VIEW_RDWR)) {
+    return EBADF;
+  }
+  if (new_size <= view->size) {
+    return 0;
+  }
+  if (ftruncate(view->fd, new_size)) {
+    return errno;
+  }
+  size_t mapped = page_round(new_size);
+  if (mapped > view->reserve) {
+    // out of reserved address space: move to a reservation twice the size
+    // and map the whole file there
+    size_t reserve = mapped * 2;
+    char *base = reserve_range(reserve);
+    if (base == MAP_FAILED) {
+      return errno;
+    }
+    void *ptr = mmap(base, mapped, view_prot(view), MAP_SHARED | MAP_FIXED,
+                     view->fd, 0);
+    if (ptr == MAP_FAILED) {
+      int err = errno;
+      munmap(base, reserve);
+      return err;
+    }
+    munmap(view->base, view->reserve);
+    view->base = base;
+    view->reserve = reserve;
+    view->mapped = mapped;
+  }
+  int rc = map_range(view, view->mapped, mapped);
+  if (rc) {
+    return rc;
+  }
+  view->mapped = mapped;
+  view->size = new_size;
+  return 0;
+}
+
+int file_view_advise(struct file_view *view, size_t offset, size_t len,
+                     enum file_view_advice advice) {
+  static const int madv[] = {
+      [FILE_VIEW_NORMAL] = MADV_NORMAL,
+      [FILE_VIEW_SEQUENTIAL] = MADV_SEQUENTIAL,
+      [FILE_VIEW_RANDOM] = MADV_RANDOM,
+      [FILE_VIEW_WILLNEED] = MADV_WILLNEED,
+      [FILE_VIEW_DONTNEED] = MADV_DONTNEED,
+  };
+  if ((unsigned)advice > FILE_VIEW_DONTNEED || offset > view->mapped) {
+    return EINVAL;
+  }
+  size_t page_size = getpagesize();
+  size_t start = offset & ~(page_size - 1);
+  size_t end = len > view->mapped - offset ? view->mapped : offset + len;
+  if (end <= start) {
+    return 0;
+  }
+  return madvise(view->base + start, end - start, madv[advice]) ? errno : 0;
+}
+
+int file_view_sync_range(struct file_view *view, size_t offset, size_t len,
+                         int wait) {
+  if (offset > view->mapped) {
+    return EINVAL;
+  }
+  size_t page_size = getpagesize();
+  size_t start = offset & ~(page_size - 1);
+  size_t end = len > view->mapped - offset ? view->mapped : offset + len;
+  if (end <= start) {
+    return 0;
+  }
+  return msync(view->base + start, end - start, wait ? MS_SYNC : MS_ASYNC)
+             ? errno
+             : 0;
+}
+
+int file_view_flush(struct file_view *view) {
+  if (view->sync == FILE_VIEW_SYNC_NONE || !(view->flags & FILE_VIEW_RDWR)) {
+    return 0;
+  }
+  return file_view_sync_range(view, 0, view->mapped,
+                              view->sync == FILE_VIEW_SYNC_SYNC);
+}
+
+int file_view_close(struct file_view *view) {
+  int rc = file_view_flush(view);
+  munmap(view->base, view->reserve);
+  if (close(view->fd) && !rc) {
+    rc = errno;
+  }
+  memset(view, 0, sizeof(*view));
+  view->fd = -1;
+  return rc;
+}
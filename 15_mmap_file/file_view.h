@@ -0,0 +1,84 @@
+/*
+ * Memory mapped view of a whole file.
+ *
+ * 04_file_operation/file_operation_demo.c copies the file through a 100
+ * byte read_buff with lseek() + read(). A file_view maps the file instead,
+ * so callers (any number of threads) read and write it in place:
+ *
+ * - read-only (PROT_READ, MAP_SHARED) or read-write views.
+ * - address space for "reserve" bytes is set aside at open (PROT_NONE),
+ *   and the file is mapped at its start with MAP_FIXED. file_view_grow()
+ *   ftruncate()s the file and maps the new pages right behind the old
+ *   ones, so the base pointer stays put as long as the file fits the
+ *   reservation; past it the view moves to a new reservation twice as
+ *   large.
+ * - file_view_advise(): madvise() hints (sequential read ahead, random
+ *   access, prefetch, drop).
+ * - sync policy for file_view_flush() and file_view_close():
+ *     FILE_VIEW_SYNC_NONE:  leave dirty pages to the kernel's writeback
+ *     FILE_VIEW_SYNC_ASYNC: msync(MS_ASYNC), schedule the writeback
+ *     FILE_VIEW_SYNC_SYNC:  msync(MS_SYNC), durable on return
+ *
+ * Within the reservation, file_view_grow() may run while other threads
+ * use the already mapped bytes; growing past it, and closing, must not
+ * race with any access. Growing is not thread safe itself. Accessing
+ * bytes past the end of a file truncated by someone else raises SIGBUS.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef FILE_VIEW_H
+#define FILE_VIEW_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define FILE_VIEW_RDWR 0x1
+#define FILE_VIEW_CREATE 0x2
+
+enum file_view_advice {
+  FILE_VIEW_NORMAL,
+  FILE_VIEW_SEQUENTIAL,
+  FILE_VIEW_RANDOM,
+  FILE_VIEW_WILLNEED,
+  FILE_VIEW_DONTNEED
+};
+
+enum file_view_sync {
+  FILE_VIEW_SYNC_NONE,
+  FILE_VIEW_SYNC_ASYNC,
+  FILE_VIEW_SYNC_SYNC
+};
+
+struct file_view {
+  int fd;
+  int flags;
+  enum file_view_sync sync;
+  char *base;
+  size_t size;    // file size
+  size_t mapped;  // bytes mapped from the file, size rounded up to pages
+  size_t reserve; // bytes of address space owned by the view
+};
+
+// reserve: address space to set aside for growth (0: the current size)
+int file_view_open(struct file_view *view, const char *path, int flags,
+                   enum file_view_sync sync, size_t reserve);
+int file_view_close(struct file_view *view);
+
+int file_view_grow(struct file_view *view, size_t new_size);
+int file_view_advise(struct file_view *view, size_t offset, size_t len,
+                     enum file_view_advice advice);
+// msync() of the whole view according to the sync policy
+int file_view_flush(struct file_view *view);
+// msync() of a range, MS_SYNC if wait else MS_ASYNC
+int file_view_sync_range(struct file_view *view, size_t offset, size_t len,
+                         int wait);
+
+static inline void *file_view_data(const struct file_view *view) {
+  return view->base;
+}
+
+static inline size_t file_view_size(const struct file_view *view) {
+  return view->size;
+}
+
+#endif // FILE_VIEW_H
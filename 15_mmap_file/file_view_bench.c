@@ -0,0 +1,284 @@
+/*
+ * read()/write() vs. a memory mapped file_view.
+ *
+ * - build the file: write() 4 KB at a time vs. file_view_grow() 1 MB at a
+ *   time + memcpy() into the mapping.
+ * - sequential scan (checksum): read() into a 100 byte buffer like
+ *   file_operation_demo's read_buff, read() into 64 KB, the mapping with
+ *   FILE_VIEW_SEQUENTIAL, and the mapping split over several threads.
+ * - random 100 byte records: lseek() + read() like the demo, pread(), and
+ *   the mapping with FILE_VIEW_RANDOM.
+ * The file is in the page cache, so this compares the copy and syscall
+ * costs, not the disk.
+ *
+ * usage: ./file_view_bench [file MB] [random reads] [threads]
+ */
+#include "file_view.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_FILE_MB 128U
+#define DEF_RANDOM_READS 1000000U
+#define DEF_THREADS 4U
+#define RECORD_SIZE 100U
+#define GROW_STEP (1024U * 1024)
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static size_t file_size;
+static char path[64];
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static uint64_t checksum(const char *buf, size_t len) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum = sum * 31 + (unsigned char)buf[i];
+  }
+  return sum;
+}
+
+static void report_mb(const char *name, size_t bytes, uint64_t elapsed) {
+  printf("  %-32s %9.1f MB/s\n", name,
+         (double)bytes / (1024 * 1024) * 1e9 / elapsed);
+}
+
+static void report_ops(const char *name, size_t ops, uint64_t elapsed) {
+  printf("  %-32s %9.0f records/s\n", name, ops * 1e9 / elapsed);
+}
+
+static void fill_chunk(char *chunk, size_t len, size_t off) {
+  for (size_t i = 0; i < len; i++) {
+    chunk[i] = 'a' + (off + i) % 26;
+  }
+}
+
+/* build */
+
+static void build_write(void) {
+  char chunk[4096];
+  int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  uint64_t start = now_ns();
+  for (size_t off = 0; off < file_size; off += sizeof(chunk)) {
+    fill_chunk(chunk, sizeof(chunk), off);
+    if (write(fd, chunk, sizeof(chunk)) != sizeof(chunk)) {
+      ERROR_CHECK(EIO, 0);
+    }
+  }
+  report_mb("write() 4 KB", file_size, now_ns() - start);
+  close(fd);
+}
+
+static void build_mmap(void) {
+  char chunk[4096];
+  unlink(path);
+  struct file_view view;
+  int rc = file_view_open(&view, path, FILE_VIEW_RDWR | FILE_VIEW_CREATE,
+                          FILE_VIEW_SYNC_NONE, 0);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  for (size_t off = 0; off < file_size; off += sizeof(chunk)) {
+    if (off == file_view_size(&view)) {
+      rc = file_view_grow(&view, off + GROW_STEP);
+      ERROR_CHECK(rc, 0);
+    }
+    fill_chunk(chunk, sizeof(chunk), off);
+    memcpy((char *)file_view_data(&view) + off, chunk, sizeof(chunk));
+  }
+  report_mb("file_view_grow() 1 MB + memcpy", file_size, now_ns() - start);
+  rc = file_view_close(&view);
+  ERROR_CHECK(rc, 0);
+}
+
+/* sequential */
+
+static uint64_t seq_read(size_t buf_size, const char *name) {
+  char *buf = malloc(buf_size);
+  int fd = open(path, O_RDONLY);
+  if (!buf || fd < 0) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  uint64_t sum = 0, start = now_ns();
+  ssize_t n;
+  lseek(fd, 0, SEEK_SET);
+  while ((n = read(fd, buf, buf_size)) > 0) {
+    sum += checksum(buf, n);
+  }
+  report_mb(name, file_size, now_ns() - start);
+  close(fd);
+  free(buf);
+  return sum;
+}
+
+static uint64_t seq_mmap(struct file_view *view) {
+  int rc = file_view_advise(view, 0, file_size, FILE_VIEW_SEQUENTIAL);
+  ERROR_CHECK(rc, 0);
+  uint64_t start = now_ns();
+  // same chunking as the read() path, so the sums match
+  uint64_t sum = 0;
+  const char *data = file_view_data(view);
+  for (size_t off = 0; off < file_size; off += 64 * 1024) {
+    size_t len = file_size - off < 64 * 1024 ? file_size - off : 64 * 1024;
+    sum += checksum(data + off, len);
+  }
+  report_mb("file_view sequential", file_size, now_ns() - start);
+  return sum;
+}
+
+struct scan_arg {
+  const char *data;
+  size_t from, to;
+  uint64_t sum;
+};
+
+static void *scan_thread(void *param) {
+  struct scan_arg *a = (struct scan_arg *)param;
+  for (size_t off = a->from; off < a->to; off += 64 * 1024) {
+    size_t len = a->to - off < 64 * 1024 ? a->to - off : 64 * 1024;
+    a->sum += checksum(a->data + off, len);
+  }
+  return NULL;
+}
+
+static uint64_t seq_mmap_threads(struct file_view *view, size_t threads) {
+  pthread_t tids[threads];
+  struct scan_arg args[threads];
+  size_t blocks = (file_size + 64 * 1024 - 1) / (64 * 1024);
+  uint64_t start = now_ns();
+  for (size_t t = 0; t < threads; t++) {
+    args[t].data = file_view_data(view);
+    args[t].from = blocks * t / threads * 64 * 1024;
+    args[t].to = blocks * (t + 1) / threads * 64 * 1024;
+    if (args[t].to > file_size) {
+      args[t].to = file_size;
+    }
+    args[t].sum = 0;
+    int rc = pthread_create(&tids[t], NULL, &scan_thread, &args[t]);
+    ERROR_CHECK(rc, 0);
+  }
+  uint64_t sum = 0;
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    sum += args[t].sum;
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "file_view sequential, %zu threads", threads);
+  report_mb(name, file_size, now_ns() - start);
+  return sum;
+}
+
+/* random */
+
+static void random_read(size_t reads, int use_pread) {
+  char rec[RECORD_SIZE];
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  uint64_t seed = 88172645463325252ULL, sum = 0;
+  size_t records = file_size / RECORD_SIZE;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < reads; i++) {
+    off_t off = (xorshift(&seed) % records) * RECORD_SIZE;
+    ssize_t n;
+    if (use_pread) {
+      n = pread(fd, rec, RECORD_SIZE, off);
+    } else {
+      lseek(fd, off, SEEK_SET);
+      n = read(fd, rec, RECORD_SIZE);
+    }
+    if (n != RECORD_SIZE) {
+      ERROR_CHECK(EIO, 0);
+    }
+    sum += rec[0];
+  }
+  report_ops(use_pread ? "pread()" : "lseek() + read()", reads,
+             now_ns() - start);
+  sink += sum;
+  close(fd);
+}
+
+static void random_mmap(struct file_view *view, size_t reads) {
+  int rc = file_view_advise(view, 0, file_size, FILE_VIEW_RANDOM);
+  ERROR_CHECK(rc, 0);
+  const char *data = file_view_data(view);
+  uint64_t seed = 88172645463325252ULL, sum = 0;
+  size_t records = file_size / RECORD_SIZE;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < reads; i++) {
+    size_t off = (xorshift(&seed) % records) * RECORD_SIZE;
+    sum += data[off]; // zero-copy: the record is used in place
+  }
+  report_ops("file_view (no copy)", reads, now_ns() - start);
+  sink += sum;
+}
+
+int main(int argc, char *argv[]) {
+  size_t file_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_FILE_MB;
+  size_t reads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_RANDOM_READS;
+  size_t threads = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_THREADS;
+  if (!file_mb || !reads || !threads || threads > 256) {
+    printf("usage: %s [file MB] [random reads] [threads <= 256]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  file_size = file_mb * 1024 * 1024;
+  snprintf(path, sizeof(path), "%d-file_view.dat", getpid());
+
+  printf("build a %zu MB file:\n", file_mb);
+  build_write();
+  build_mmap();
+
+  struct file_view view;
+  int rc = file_view_open(&view, path, 0, FILE_VIEW_SYNC_NONE, 0);
+  ERROR_CHECK(rc, 0);
+  printf("sequential scan:\n");
+  sink += seq_read(RECORD_SIZE, "read() 100 B"); // chunked differently
+  uint64_t sum = seq_read(64 * 1024, "read() 64 KB");
+  if (seq_mmap(&view) != sum || seq_mmap_threads(&view, threads) != sum) {
+    printf("checksum mismatch!\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("random %u B records:\n", RECORD_SIZE);
+  random_read(reads, 0);
+  random_read(reads, 1);
+  random_mmap(&view, reads);
+
+  rc = file_view_close(&view);
+  ERROR_CHECK(rc, 0);
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,270 @@
+// for statx(), O_DIRECTORY
+#define _GNU_SOURCE
+
+#include "dir_walker.h"
+#include "work_stealing.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define GETDENTS_BUF_SIZE (256U * 1024)
+#define STAT_BATCH 256U
+#define DEQUE_SIZE 4096U
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+struct walk {
+  struct ws_executor ex;
+  int flags;
+  struct aio_engine *engine; // NULL: statx() per entry
+  dir_walk_fn fn;
+  void *arg;
+  char **bufs; // one getdents64() buffer per worker
+  atomic_uint_fast64_t entries, dirs, getdents, statx, statx_submits, errors;
+};
+
+struct dir_task {
+  struct walk *walk;
+  size_t depth;
+  char path[]; // directory to list
+};
+
+static void list_dir(void *arg);
+
+static int submit_dir(struct walk *w, const char *parent, const char *name,
+                      size_t depth) {
+  size_t plen = parent ? strlen(parent) : 0, nlen = strlen(name);
+  struct dir_task *t = malloc(sizeof(*t) + plen + nlen + 2);
+  if (!t) {
+    return ENOMEM;
+  }
+  t->walk = w;
+  t->depth = depth;
+  if (parent) {
+    memcpy(t->path, parent, plen);
+    t->path[plen] = '/';
+    memcpy(t->path + plen + 1, name, nlen + 1);
+  } else {
+    memcpy(t->path, name, nlen + 1);
+  }
+  int rc = ws_executor_submit(&w->ex, &list_dir, t);
+  if (rc) {
+    free(t);
+  }
+  return rc;
+}
+
+static unsigned char mode_type(uint16_t mode) {
+  switch (mode & S_IFMT) {
+  case S_IFREG:
+    return DT_REG;
+  case S_IFDIR:
+    return DT_DIR;
+  case S_IFLNK:
+    return DT_LNK;
+  case S_IFCHR:
+    return DT_CHR;
+  case S_IFBLK:
+    return DT_BLK;
+  case S_IFIFO:
+    return DT_FIFO;
+  case S_IFSOCK:
+    return DT_SOCK;
+  default:
+    return DT_UNKNOWN;
+  }
+}
+
+// statx() results of a batch: types filled in, stx_mask 0 on failure
+static void stat_done(struct walk *w, struct linux_dirent64 *ent,
+                      struct statx *stx, long rc) {
+  if (rc) {
+    atomic_fetch_add(&w->errors, 1);
+    stx->stx_mask = 0;
+    return;
+  }
+  if (ent->d_type == DT_UNKNOWN) {
+    ent->d_type = mode_type(stx->stx_mode);
+  }
+}
+
+// the statx() calls of a batch as one io_uring submission; returns how
+// many went through the ring, the caller does the rest itself
+static size_t stat_ring(struct walk *w, int fd, struct linux_dirent64 **ents,
+                        struct statx *stx, const size_t *idx, size_t num,
+                        unsigned int mask) {
+  struct aio_request reqs[STAT_BATCH], *batch[STAT_BATCH];
+  for (size_t k = 0; k < num; k++) {
+    size_t i = idx[k];
+    aio_prep_statx(&reqs[k], fd, ents[i]->d_name, AT_SYMLINK_NOFOLLOW, mask,
+                   &stx[i], NULL, NULL);
+    batch[k] = &reqs[k];
+  }
+  size_t queued;
+  aio_submit_batch(w->engine, batch, num, &queued);
+  if (queued) {
+    atomic_fetch_add(&w->statx_submits, 1);
+  }
+  // every queued request is waited for, reqs is on this stack
+  for (size_t k = 0; k < queued; k++) {
+    long rc = aio_wait(w->engine, &reqs[k]);
+    stat_done(w, ents[idx[k]], &stx[idx[k]], rc);
+  }
+  return queued;
+}
+
+// reports one getdents64() batch, statx()ing the entries which need it
+static void report_batch(struct walk *w, struct dir_task *t, int fd,
+                         struct linux_dirent64 **ents, size_t num) {
+  struct statx stx[STAT_BATCH];
+  unsigned int mask = w->flags & DIR_WALK_STAT ? STATX_BASIC_STATS
+                                               : STATX_TYPE;
+  size_t idx[STAT_BATCH], stats = 0;
+  for (size_t i = 0; i < num; i++) {
+    if (w->flags & DIR_WALK_STAT || ents[i]->d_type == DT_UNKNOWN) {
+      idx[stats++] = i;
+    }
+  }
+  // first all the statx() calls of the batch, together...
+  size_t done = 0;
+  if (stats > 1 && w->engine && w->engine->ring_fd >= 0 &&
+      w->engine->uring_op[AIO_STATX]) {
+    done = stat_ring(w, fd, ents, stx, idx, stats, mask);
+  }
+  for (size_t k = done; k < stats; k++) { // back to back without a ring
+    size_t i = idx[k];
+    long rc = statx(fd, ents[i]->d_name, AT_SYMLINK_NOFOLLOW, mask, &stx[i]);
+    stat_done(w, ents[i], &stx[i], rc);
+  }
+  if (stats) {
+    atomic_fetch_add(&w->statx, stats);
+  }
+
+  // ...then the callbacks and the fan out
+  uint64_t dirs = 0;
+  for (size_t i = 0; i < num; i++) {
+    struct dir_walk_entry e = {
+        .dir = t->path,
+        .name = ents[i]->d_name,
+        .dirfd = fd,
+        .type = ents[i]->d_type,
+        .depth = t->depth,
+        .stx = w->flags & DIR_WALK_STAT && stx[i].stx_mask ? &stx[i] : NULL,
+    };
+    int skip = w->fn ? w->fn(&e, w->arg) : 0;
+    if (e.type == DT_DIR && !skip) {
+      dirs++;
+      if (submit_dir(w, t->path, e.name, t->depth + 1)) {
+        atomic_fetch_add(&w->errors, 1);
+      }
+    }
+  }
+  atomic_fetch_add(&w->entries, num);
+  if (dirs) {
+    atomic_fetch_add(&w->dirs, dirs);
+  }
+}
+
+static void list_dir(void *arg) {
+  struct dir_task *t = (struct dir_task *)arg;
+  struct walk *w = t->walk;
+  char *buf = w->bufs[ws_executor_worker_index()];
+  int fd = open(t->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    atomic_fetch_add(&w->errors, 1);
+    free(t);
+    return;
+  }
+
+  struct linux_dirent64 *ents[STAT_BATCH];
+  uint64_t calls = 0;
+  for (;;) {
+    long n = syscall(SYS_getdents64, fd, buf, GETDENTS_BUF_SIZE);
+    calls++;
+    if (n <= 0) {
+      if (n < 0) {
+        atomic_fetch_add(&w->errors, 1);
+      }
+      break;
+    }
+    size_t num = 0;
+    for (long off = 0; off < n;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+      off += d->d_reclen;
+      const char *name = d->d_name;
+      if (name[0] == '.' &&
+          (!name[1] || (name[1] == '.' && !name[2]))) { // "." and ".."
+        continue;
+      }
+      ents[num++] = d;
+      if (num == STAT_BATCH) {
+        report_batch(w, t, fd, ents, num);
+        num = 0;
+      }
+    }
+    if (num) {
+      report_batch(w, t, fd, ents, num);
+    }
+  }
+  atomic_fetch_add(&w->getdents, calls);
+  close(fd);
+  free(t);
+}
+
+int dir_walk(const char *root, size_t threads, int flags,
+             struct aio_engine *engine, dir_walk_fn fn, void *arg,
+             struct dir_walk_stats *stats) {
+  if (!root || !threads) {
+    return EINVAL;
+  }
+  struct walk *w = calloc(1, sizeof(*w));
+  if (!w) {
+    return ENOMEM;
+  }
+  w->flags = flags;
+  w->engine = engine;
+  w->fn = fn;
+  w->arg = arg;
+  w->bufs = calloc(threads, sizeof(*w->bufs));
+  int rc = w->bufs ? 0 : ENOMEM;
+  for (size_t i = 0; i < threads && !rc; i++) {
+    w->bufs[i] = malloc(GETDENTS_BUF_SIZE);
+    rc = w->bufs[i] ? 0 : ENOMEM;
+  }
+  if (!rc) {
+    rc = ws_executor_create(&w->ex, threads, DEQUE_SIZE);
+  }
+  if (!rc) {
+    rc = submit_dir(w, NULL, root, 0);
+    ws_executor_wait(&w->ex);
+    ws_executor_shutdown(&w->ex);
+  }
+
+  if (stats) {
+    stats->entries = atomic_load(&w->entries);
+    stats->dirs = atomic_load(&w->dirs);
+    stats->getdents = atomic_load(&w->getdents);
+    stats->statx = atomic_load(&w->statx);
+    stats->statx_submits = atomic_load(&w->statx_submits);
+    stats->errors = atomic_load(&w->errors);
+  }
+  for (size_t i = 0; w->bufs && i < threads; i++) {
+    free(w->bufs[i]);
+  }
+  free(w->bufs);
+  free(w);
+  return rc;
+}
@@ -0,0 +1,219 @@
+/*
+ * Recursive opendir()/readdir() vs. dir_walk() on 1..N threads.
+ *
+ * Builds a synthetic tree (fanout^depth leaf directories with files in
+ * each) unless a directory to scan is given, then walks it:
+ * - names only: readdir() recursion (the file_operation_demo loop, made
+ *   recursive) vs. dir_walk() using d_type
+ * - with metadata: readdir() + lstat() of every entry vs. DIR_WALK_STAT,
+ *   with statx() per entry and with the statx() calls of every
+ *   getdents64() batch in one io_uring submission (14_async_io)
+ * and reports entries/sec, plus the syscalls dir_walk() needed.
+ *
+ * usage: ./dir_walker_bench [max threads] [dir to scan]
+ */
+#define _GNU_SOURCE
+
+#include "dir_walker.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_MAX_THREADS 8U
+#define TREE_FANOUT 8U
+#define TREE_DEPTH 3U
+#define TREE_FILES 40U
+#define ENGINE_ENTRIES 256U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* synthetic tree */
+
+static void build_tree(const char *path, unsigned int depth) {
+  if (mkdir(path, 0777) && errno != EEXIST) {
+    ERROR_CHECK(errno, 0);
+  }
+  char child[PATH_MAX];
+  if (!depth) {
+    for (unsigned int i = 0; i < TREE_FILES; i++) {
+      if (snprintf(child, sizeof(child), "%s/file-%u.txt", path, i) >=
+          (int)sizeof(child)) {
+        ERROR_CHECK(ENAMETOOLONG, 0);
+      }
+      int fd = open(child, O_CREAT | O_WRONLY, 0666);
+      if (fd < 0) {
+        ERROR_CHECK(errno, 0);
+      }
+      close(fd);
+    }
+    return;
+  }
+  for (unsigned int i = 0; i < TREE_FANOUT; i++) {
+    if (snprintf(child, sizeof(child), "%s/dir-%u", path, i) >=
+        (int)sizeof(child)) {
+      ERROR_CHECK(ENAMETOOLONG, 0);
+    }
+    build_tree(child, depth - 1);
+  }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+  (void)st;
+  (void)flag;
+  (void)ftw;
+  return remove(path);
+}
+
+/* baseline: readdir() recursion */
+
+static uint64_t readdir_walk(const char *path, int with_stat,
+                             uint64_t *stats) {
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return 0;
+  }
+  uint64_t entries = 0;
+  struct dirent *de;
+  char child[PATH_MAX];
+  while ((de = readdir(dir))) {
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+      continue;
+    }
+    entries++;
+    if (snprintf(child, sizeof(child), "%s/%s", path, de->d_name) >=
+        (int)sizeof(child)) {
+      continue; // too long for lstat()/opendir() anyway
+    }
+    int is_dir = de->d_type == DT_DIR;
+    if (with_stat || de->d_type == DT_UNKNOWN) {
+      struct stat st;
+      (*stats)++;
+      if (!lstat(child, &st)) {
+        is_dir = S_ISDIR(st.st_mode);
+      }
+    }
+    if (is_dir) {
+      entries += readdir_walk(child, with_stat, stats);
+    }
+  }
+  closedir(dir);
+  return entries;
+}
+
+/* dir_walk() */
+
+static atomic_uint_fast64_t bytes_seen;
+
+static int count_bytes(const struct dir_walk_entry *e, void *arg) {
+  (void)arg;
+  if (e->stx) {
+    atomic_fetch_add_explicit(&bytes_seen, e->stx->stx_size,
+                              memory_order_relaxed);
+  }
+  return 0;
+}
+
+static void report(const char *name, uint64_t entries, uint64_t elapsed,
+                   const struct dir_walk_stats *st) {
+  printf("  %-26s %9.0f entries/s", name, entries * 1e9 / elapsed);
+  if (st) {
+    printf("  (%llu getdents64, %llu statx in %llu submits, %llu errors)",
+           (unsigned long long)st->getdents, (unsigned long long)st->statx,
+           (unsigned long long)st->statx_submits,
+           (unsigned long long)st->errors);
+  }
+  printf("\n");
+}
+
+static void walk(const char *root, size_t threads, int with_stat,
+                 struct aio_engine *engine, uint64_t expected) {
+  struct dir_walk_stats st;
+  uint64_t start = now_ns();
+  int rc = dir_walk(root, threads, with_stat ? DIR_WALK_STAT : 0, engine,
+                    &count_bytes, NULL, &st);
+  ERROR_CHECK(rc, 0);
+  uint64_t elapsed = now_ns() - start;
+  if (st.entries != expected) {
+    printf("  dir_walk found %llu entries, readdir %llu\n",
+           (unsigned long long)st.entries, (unsigned long long)expected);
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "dir_walk %zu thread%s%s", threads,
+           threads > 1 ? "s" : "", engine ? " + aio" : "");
+  report(name, st.entries, elapsed, &st);
+}
+
+static void bench(const char *root, size_t max_threads, int with_stat,
+                  struct aio_engine *engine) {
+  printf("%s:\n", with_stat ? "with metadata" : "names only");
+  uint64_t stats = 0, start = now_ns();
+  uint64_t expected = readdir_walk(root, with_stat, &stats);
+  char name[64];
+  snprintf(name, sizeof(name), "readdir()%s", with_stat ? " + lstat()" : "");
+  report(name, expected, now_ns() - start, NULL);
+
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    walk(root, threads, with_stat, NULL, expected);
+    if (engine) {
+      walk(root, threads, with_stat, engine, expected);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_THREADS;
+  if (!max_threads) {
+    printf("usage: %s [max threads] [dir to scan]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char root[64];
+  const char *scan = argc > 2 ? argv[2] : NULL;
+  if (!scan) {
+    snprintf(root, sizeof(root), "%d-tree", getpid());
+    uint64_t start = now_ns();
+    build_tree(root, TREE_DEPTH);
+    printf("built %s: %u^%u leaf dirs x %u files in %.2f s\n", root,
+           TREE_FANOUT, TREE_DEPTH, TREE_FILES, (now_ns() - start) / 1e9);
+    scan = root;
+  }
+
+  struct aio_engine engine;
+  int rc = aio_engine_init(&engine, ENGINE_ENTRIES, 1, 0);
+  ERROR_CHECK(rc, 0);
+  printf("aio engine: %s\n", aio_engine_backend(&engine));
+  bench(scan, max_threads, 0, NULL);
+  bench(scan, max_threads, 1, &engine);
+  aio_engine_destroy(&engine);
+
+  if (scan == root) {
+    nftw(root, &remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+  }
+  return 0;
+}
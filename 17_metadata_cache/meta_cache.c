@@ -0,0 +1,458 @@
+// for statx()
+#define _GNU_SOURCE
+
+#include "meta_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct meta_inode {
+  struct meta_inode *next;
+  uint64_t dev, ino;
+  uint64_t stamp;
+  struct statx stx; // stx.stx_mask: fields which are valid
+};
+
+struct meta_path {
+  struct meta_path *next;
+  uint64_t hash;
+  int flags;
+  uint64_t dev, ino;
+  uint64_t stamp;
+  char path[];
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void count(uint64_t *counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t path_hash(const char *path, int flags) {
+  uint64_t h = 1469598103934665603ULL ^ (uint64_t)flags; // FNV-1a
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    h = (h ^ *p) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t inode_hash(uint64_t dev, uint64_t ino) {
+  return (ino ^ (dev << 32 | dev >> 32)) * 0x9e3779b97f4a7c15ULL;
+}
+
+static uint64_t stx_dev(const struct statx *stx) {
+  return (uint64_t)stx->stx_dev_major << 32 | stx->stx_dev_minor;
+}
+
+static struct meta_shard *shard_of(struct meta_cache *cache, uint64_t h) {
+  return &cache->shards[h % META_CACHE_SHARDS];
+}
+
+static size_t bucket_of(const struct meta_shard *shard, uint64_t h) {
+  return (h / META_CACHE_SHARDS) % shard->buckets;
+}
+
+static int fresh(const struct meta_cache *cache, uint64_t stamp,
+                 uint64_t now) {
+  return !cache->ttl_ns || now - stamp < cache->ttl_ns;
+}
+
+/* path -> inode */
+
+static struct meta_path **path_find(struct meta_shard *shard, uint64_t h,
+                                    const char *path, int flags) {
+  struct meta_path **pp = &shard->paths[bucket_of(shard, h)];
+  for (; *pp; pp = &(*pp)->next) {
+    if ((*pp)->hash == h && (*pp)->flags == flags &&
+        !strcmp((*pp)->path, path)) {
+      break;
+    }
+  }
+  return pp;
+}
+
+static int path_lookup(struct meta_cache *cache, const char *path, int flags,
+                       uint64_t *dev, uint64_t *ino) {
+  uint64_t h = path_hash(path, flags);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_path *p = *path_find(shard, h, path, flags);
+  int found = p && fresh(cache, p->stamp, now_ns());
+  if (found) {
+    *dev = p->dev;
+    *ino = p->ino;
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return found;
+}
+
+static void path_store(struct meta_cache *cache, const char *path, int flags,
+                       uint64_t dev, uint64_t ino) {
+  uint64_t h = path_hash(path, flags);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_path **pp = path_find(shard, h, path, flags);
+  if (!*pp) {
+    size_t len = strlen(path);
+    struct meta_path *p = malloc(sizeof(*p) + len + 1);
+    if (!p) { // not cached, that's all
+      pthread_mutex_unlock(&shard->lock);
+      return;
+    }
+    p->next = NULL;
+    p->hash = h;
+    p->flags = flags;
+    memcpy(p->path, path, len + 1);
+    *pp = p;
+  }
+  (*pp)->dev = dev;
+  (*pp)->ino = ino;
+  (*pp)->stamp = now_ns();
+  pthread_mutex_unlock(&shard->lock);
+}
+
+static void path_drop(struct meta_cache *cache, const char *path, int flags) {
+  uint64_t h = path_hash(path, flags);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_path **pp = path_find(shard, h, path, flags);
+  struct meta_path *p = *pp;
+  if (p) {
+    *pp = p->next;
+  }
+  pthread_mutex_unlock(&shard->lock);
+  free(p);
+}
+
+/* inode -> statx */
+
+static struct meta_inode **inode_find(struct meta_shard *shard, uint64_t h,
+                                      uint64_t dev, uint64_t ino) {
+  struct meta_inode **pi = &shard->inodes[bucket_of(shard, h)];
+  for (; *pi; pi = &(*pi)->next) {
+    if ((*pi)->ino == ino && (*pi)->dev == dev) {
+      break;
+    }
+  }
+  return pi;
+}
+
+// copies the entry if it has every field of mask; *have: fields it has
+static int inode_lookup(struct meta_cache *cache, uint64_t dev, uint64_t ino,
+                        unsigned int mask, struct statx *stx,
+                        unsigned int *have) {
+  uint64_t h = inode_hash(dev, ino);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_inode *i = *inode_find(shard, h, dev, ino);
+  int hit = 0;
+  *have = 0;
+  if (i && fresh(cache, i->stamp, now_ns())) {
+    *have = i->stx.stx_mask;
+    if ((i->stx.stx_mask & mask) == mask) {
+      *stx = i->stx;
+      hit = 1;
+    }
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return hit;
+}
+
+static void inode_store(struct meta_cache *cache, const struct statx *stx) {
+  uint64_t dev = stx_dev(stx), h = inode_hash(dev, stx->stx_ino);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_inode **pi = inode_find(shard, h, dev, stx->stx_ino);
+  if (!*pi) {
+    *pi = calloc(1, sizeof(**pi));
+    if (!*pi) {
+      pthread_mutex_unlock(&shard->lock);
+      return;
+    }
+    (*pi)->dev = dev;
+    (*pi)->ino = stx->stx_ino;
+  }
+  (*pi)->stx = *stx;
+  (*pi)->stamp = now_ns();
+  pthread_mutex_unlock(&shard->lock);
+}
+
+static void inode_drop(struct meta_cache *cache, uint64_t dev, uint64_t ino) {
+  uint64_t h = inode_hash(dev, ino);
+  struct meta_shard *shard = shard_of(cache, h);
+  pthread_mutex_lock(&shard->lock);
+  struct meta_inode **pi = inode_find(shard, h, dev, ino);
+  struct meta_inode *i = *pi;
+  if (i) {
+    *pi = i->next;
+  }
+  pthread_mutex_unlock(&shard->lock);
+  if (i) {
+    count(&cache->stats.invalidations, 1);
+    free(i);
+  }
+}
+
+/* queries */
+
+static int at_flags(int flags) {
+  return AT_STATX_SYNC_AS_STAT |
+         (flags & META_NOFOLLOW ? AT_SYMLINK_NOFOLLOW : 0);
+}
+
+// cache only; on a miss *want is the mask to ask statx() for
+static int lookup(struct meta_cache *cache, const char *path,
+                  unsigned int mask, int flags, struct statx *stx,
+                  unsigned int *want) {
+  uint64_t dev, ino;
+  unsigned int have = 0;
+  if (path_lookup(cache, path, flags, &dev, &ino) &&
+      inode_lookup(cache, dev, ino, mask, stx, &have)) {
+    return 1;
+  }
+  // fetch what was cached too, so one entry keeps every field
+  *want = mask | have | STATX_INO;
+  return 0;
+}
+
+static void store(struct meta_cache *cache, const char *path, int flags,
+                  const struct statx *stx) {
+  inode_store(cache, stx);
+  path_store(cache, path, flags, stx_dev(stx), stx->stx_ino);
+}
+
+// inode behind path, from the cache or a minimal statx()
+static int path_inode(struct meta_cache *cache, const char *path, int flags,
+                      uint64_t *dev, uint64_t *ino) {
+  if (path_lookup(cache, path, flags, dev, ino)) {
+    return 0;
+  }
+  struct statx stx;
+  count(&cache->stats.statx, 1);
+  if (statx(AT_FDCWD, path, at_flags(flags), STATX_INO, &stx)) {
+    return errno;
+  }
+  *dev = stx_dev(&stx);
+  *ino = stx.stx_ino;
+  return 0;
+}
+
+int meta_stat(struct meta_cache *cache, const char *path, unsigned int mask,
+              int flags, struct statx *stx) {
+  struct meta_result res;
+  int rc = meta_stat_batch(cache, &path, 1, mask, flags, &res);
+  if (!rc) {
+    *stx = res.stx;
+  }
+  return rc;
+}
+
+int meta_stat_batch(struct meta_cache *cache, const char *const *paths,
+                    size_t num, unsigned int mask, int flags,
+                    struct meta_result *res) {
+  uint64_t start = now_ns();
+  size_t *miss = malloc(num * sizeof(*miss));
+  unsigned int *want = malloc(num * sizeof(*want));
+  if (!miss || !want) {
+    free(miss);
+    free(want);
+    return ENOMEM;
+  }
+  size_t misses = 0;
+  for (size_t i = 0; i < num; i++) {
+    res[i].err = 0;
+    if (!lookup(cache, paths[i], mask, flags, &res[i].stx, &want[i])) {
+      miss[misses++] = i;
+    }
+  }
+  uint64_t looked_up = now_ns();
+  count(&cache->stats.hits, num - misses);
+  count(&cache->stats.hit_ns, (looked_up - start) * (num - misses) /
+                                  (num ? num : 1));
+
+  struct aio_request *reqs = NULL, **batch = NULL;
+  if (cache->engine && misses > 1) {
+    reqs = malloc(misses * sizeof(*reqs));
+    batch = malloc(misses * sizeof(*batch));
+  }
+  if (reqs && batch) {
+    // one submission for all the misses
+    for (size_t m = 0; m < misses; m++) {
+      size_t i = miss[m];
+      aio_prep_statx(&reqs[m], AT_FDCWD, paths[i], at_flags(flags), want[i],
+                     &res[i].stx, NULL, NULL);
+      batch[m] = &reqs[m];
+    }
+    size_t queued;
+    int rc = aio_submit_batch(cache->engine, batch, misses, &queued);
+    // every queued request is waited for before reqs is freed
+    for (size_t m = 0; m < misses; m++) {
+      long r = m < queued ? aio_wait(cache->engine, &reqs[m]) : -rc;
+      res[miss[m]].err = r < 0 ? -r : 0;
+    }
+  } else {
+    for (size_t m = 0; m < misses; m++) {
+      size_t i = miss[m];
+      if (statx(AT_FDCWD, paths[i], at_flags(flags), want[i], &res[i].stx)) {
+        res[i].err = errno;
+      }
+    }
+  }
+  free(batch);
+  free(reqs);
+
+  int first_err = 0;
+  for (size_t m = 0; m < misses; m++) {
+    size_t i = miss[m];
+    if (!res[i].err) {
+      store(cache, paths[i], flags, &res[i].stx);
+    } else if (!first_err) {
+      first_err = res[i].err;
+    }
+  }
+  if (misses) {
+    count(&cache->stats.misses, misses);
+    count(&cache->stats.statx, misses);
+    count(&cache->stats.miss_ns, now_ns() - looked_up);
+  }
+  free(want);
+  free(miss);
+  return first_err;
+}
+
+/* operations which change metadata */
+
+int meta_chmod(struct meta_cache *cache, const char *path, mode_t mode) {
+  uint64_t dev, ino;
+  int known = !path_inode(cache, path, 0, &dev, &ino);
+  if (chmod(path, mode)) {
+    return errno;
+  }
+  if (known) {
+    inode_drop(cache, dev, ino); // mode & ctime
+  }
+  return 0;
+}
+
+int meta_link(struct meta_cache *cache, const char *oldpath,
+              const char *newpath) {
+  uint64_t dev, ino;
+  // link() doesn't follow a symlink oldpath
+  int known = !path_inode(cache, oldpath, META_NOFOLLOW, &dev, &ino);
+  if (link(oldpath, newpath)) {
+    return errno;
+  }
+  if (known) {
+    inode_drop(cache, dev, ino); // nlink & ctime
+  }
+  path_drop(cache, newpath, 0);
+  path_drop(cache, newpath, META_NOFOLLOW);
+  return 0;
+}
+
+int meta_symlink(struct meta_cache *cache, const char *target,
+                 const char *linkpath) {
+  if (symlink(target, linkpath)) {
+    return errno;
+  }
+  path_drop(cache, linkpath, 0);
+  path_drop(cache, linkpath, META_NOFOLLOW);
+  return 0;
+}
+
+int meta_unlink(struct meta_cache *cache, const char *path) {
+  uint64_t dev, ino;
+  int known = !path_inode(cache, path, META_NOFOLLOW, &dev, &ino);
+  if (unlink(path)) {
+    return errno;
+  }
+  if (known) {
+    inode_drop(cache, dev, ino); // nlink, or gone
+  }
+  path_drop(cache, path, 0);
+  path_drop(cache, path, META_NOFOLLOW);
+  return 0;
+}
+
+void meta_cache_invalidate(struct meta_cache *cache, const char *path) {
+  for (int flags = 0; flags <= META_NOFOLLOW; flags++) {
+    uint64_t dev, ino;
+    if (path_lookup(cache, path, flags, &dev, &ino)) {
+      inode_drop(cache, dev, ino);
+    }
+    path_drop(cache, path, flags);
+  }
+}
+
+/* setup */
+
+int meta_cache_init(struct meta_cache *cache, size_t buckets, uint64_t ttl_ns,
+                    struct aio_engine *engine) {
+  if (!cache || !buckets) {
+    return EINVAL;
+  }
+  memset(cache, 0, sizeof(*cache));
+  cache->ttl_ns = ttl_ns;
+  cache->engine = engine;
+  for (size_t s = 0; s < META_CACHE_SHARDS; s++) {
+    struct meta_shard *shard = &cache->shards[s];
+    shard->buckets = buckets;
+    shard->inodes = calloc(buckets, sizeof(*shard->inodes));
+    shard->paths = calloc(buckets, sizeof(*shard->paths));
+    if (!shard->inodes || !shard->paths) {
+      free(shard->inodes);
+      free(shard->paths);
+      shard->inodes = NULL;
+      shard->paths = NULL;
+      meta_cache_destroy(cache);
+      return ENOMEM;
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+  }
+  return 0;
+}
+
+void meta_cache_destroy(struct meta_cache *cache) {
+  for (size_t s = 0; s < META_CACHE_SHARDS; s++) {
+    struct meta_shard *shard = &cache->shards[s];
+    if (!shard->inodes) {
+      break; // init failed here
+    }
+    for (size_t b = 0; b < shard->buckets; b++) {
+      while (shard->inodes[b]) {
+        struct meta_inode *i = shard->inodes[b];
+        shard->inodes[b] = i->next;
+        free(i);
+      }
+      while (shard->paths[b]) {
+        struct meta_path *p = shard->paths[b];
+        shard->paths[b] = p->next;
+        free(p);
+      }
+    }
+    free(shard->inodes);
+    free(shard->paths);
+    shard->inodes = NULL;
+    shard->paths = NULL;
+    pthread_mutex_destroy(&shard->lock);
+  }
+}
+
+void meta_cache_get_stats(struct meta_cache *cache,
+                          struct meta_cache_stats *stats) {
+  stats->hits = __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+  stats->misses = __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+  stats->statx = __atomic_load_n(&cache->stats.statx, __ATOMIC_RELAXED);
+  stats->invalidations =
+      __atomic_load_n(&cache->stats.invalidations, __ATOMIC_RELAXED);
+  stats->hit_ns = __atomic_load_n(&cache->stats.hit_ns, __ATOMIC_RELAXED);
+  stats->miss_ns = __atomic_load_n(&cache->stats.miss_ns, __ATOMIC_RELAXED);
+}
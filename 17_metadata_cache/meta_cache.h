@@ -0,0 +1,93 @@
+/*
+ * Cached, batched file metadata queries.
+ *
+ * print_file_permissions() in 04_file_operation/file_operation_demo.c does
+ * a full stat() on every call, for the same few files over and over. A
+ * meta_cache answers from memory where it can:
+ *
+ * - statx() with only the STATX_* fields asked for; what it returns is
+ *   cached per inode, keyed by (dev, ino), and paths map to their inode,
+ *   so hard links and the target of a link share one entry.
+ * - meta_stat_batch(): the misses of a batch are looked up together, with
+ *   one io_uring_enter() for all of them when an aio_engine is given
+ *   (14_async_io), else back to back.
+ * - meta_chmod()/meta_link()/meta_symlink()/meta_unlink() do the operation
+ *   and drop what it made stale. Changes made behind the cache's back are
+ *   caught by the ttl (0: entries never expire), or meta_cache_invalidate().
+ * - counters: hits, misses, statx calls, invalidations, and the time spent
+ *   answering hits and misses.
+ *
+ * The cache is sharded, every shard has its own lock; any thread may use
+ * it. It grows with the set of files queried.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef META_CACHE_H
+#define META_CACHE_H
+
+// users must build with _GNU_SOURCE: struct statx
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "async_io.h"
+
+#define META_CACHE_SHARDS 16U
+#define META_NOFOLLOW 0x1 // lstat() semantics
+
+struct meta_inode;
+struct meta_path;
+
+struct meta_shard {
+  pthread_mutex_t lock;
+  struct meta_inode **inodes;
+  struct meta_path **paths;
+  size_t buckets;
+};
+
+struct meta_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t statx;
+  uint64_t invalidations;
+  uint64_t hit_ns; // total time spent in answered-from-cache queries
+  uint64_t miss_ns;
+};
+
+struct meta_cache {
+  struct meta_shard shards[META_CACHE_SHARDS];
+  uint64_t ttl_ns;
+  struct aio_engine *engine;
+  struct meta_cache_stats stats; // updated atomically
+};
+
+struct meta_result {
+  int err; // 0 or errno of the statx()
+  struct statx stx;
+};
+
+// buckets: hash buckets per shard, engine may be NULL
+int meta_cache_init(struct meta_cache *cache, size_t buckets, uint64_t ttl_ns,
+                    struct aio_engine *engine);
+void meta_cache_destroy(struct meta_cache *cache);
+
+int meta_stat(struct meta_cache *cache, const char *path, unsigned int mask,
+              int flags, struct statx *stx);
+// paths[i] -> res[i]; returns the first error, every res[i].err is set
+int meta_stat_batch(struct meta_cache *cache, const char *const *paths,
+                    size_t num, unsigned int mask, int flags,
+                    struct meta_result *res);
+
+int meta_chmod(struct meta_cache *cache, const char *path, mode_t mode);
+int meta_link(struct meta_cache *cache, const char *oldpath,
+              const char *newpath);
+int meta_symlink(struct meta_cache *cache, const char *target,
+                 const char *linkpath);
+int meta_unlink(struct meta_cache *cache, const char *path);
+void meta_cache_invalidate(struct meta_cache *cache, const char *path);
+
+void meta_cache_get_stats(struct meta_cache *cache,
+                          struct meta_cache_stats *stats);
+
+#endif // META_CACHE_H
@@ -0,0 +1,282 @@
+/*
+ * stat() per query vs. meta_cache, sync and with io_uring batches.
+ *
+ * Creates files (plus a hard link and a symlink to each) and then:
+ * - permissions: the print_file_permissions() pattern of
+ *   04_file_operation/file_operation_demo.c, mode of file, link and target
+ *   before and after a chmod, checking the cache never shows a stale mode
+ * - random: threads query random batches of paths, first with a cold cache
+ *   (every batch misses) then warm
+ * and reports queries/s, hit rate and the average time of hits and misses.
+ *
+ * usage: ./meta_cache_bench [files] [threads] [batch]
+ */
+#define _GNU_SOURCE
+
+#include "meta_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_FILES 1024U
+#define DEF_THREADS 4U
+#define DEF_BATCH 32U
+#define ROUNDS 8U           // of the permissions pattern
+#define QUERIES 200000U     // per random run, split over the threads
+#define NAME_LEN 64U
+#define ENGINE_ENTRIES 256U
+#define ENGINE_WORKERS 4U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t num_files;
+static char (*files)[NAME_LEN], (*hardlinks)[NAME_LEN], (*symlinks)[NAME_LEN];
+
+enum mode { STAT, CACHE_SYNC, CACHE_URING, MODE_NUM };
+
+static const char *mode_name[MODE_NUM] = {
+    [STAT] = "stat()",
+    [CACHE_SYNC] = "meta_cache",
+    [CACHE_URING] = "meta_cache + io_uring",
+};
+
+static void report(const char *name, uint64_t queries, uint64_t elapsed,
+                   struct meta_cache *cache) {
+  printf("  %-26s %10.0f queries/s", name, queries * 1e9 / elapsed);
+  if (cache) {
+    struct meta_cache_stats st;
+    meta_cache_get_stats(cache, &st);
+    uint64_t total = st.hits + st.misses;
+    printf("  hit %5.1f%%  hit %6.0f ns  miss %7.0f ns  %llu statx",
+           total ? 100.0 * st.hits / total : 0.0,
+           st.hits ? (double)st.hit_ns / st.hits : 0.0,
+           st.misses ? (double)st.miss_ns / st.misses : 0.0,
+           (unsigned long long)st.statx);
+  }
+  printf("\n");
+}
+
+/* print_file_permissions() pattern */
+
+static mode_t query_mode(enum mode mode, struct meta_cache *cache,
+                         const char *path, int nofollow) {
+  if (mode == STAT) {
+    struct stat st;
+    int rc = nofollow ? lstat(path, &st) : stat(path, &st);
+    ERROR_CHECK(rc ? errno : 0, 0);
+    return st.st_mode;
+  }
+  struct statx stx;
+  int rc = meta_stat(cache, path, STATX_MODE, nofollow ? META_NOFOLLOW : 0,
+                     &stx);
+  ERROR_CHECK(rc, 0);
+  return stx.stx_mode;
+}
+
+static void bench_permissions(enum mode mode, struct aio_engine *engine) {
+  struct meta_cache cache;
+  ERROR_CHECK(meta_cache_init(&cache, 1024, 0, engine), 0);
+  uint64_t queries = 0, stale = 0, start = now_ns();
+  for (unsigned int round = 0; round < ROUNDS; round++) {
+    mode_t perm = round & 1 ? 0644 : 0444;
+    for (size_t i = 0; i < num_files; i++) {
+      query_mode(mode, &cache, files[i], 0);
+      query_mode(mode, &cache, hardlinks[i], 0);
+      query_mode(mode, &cache, symlinks[i], 1);
+      int rc = mode == STAT ? (chmod(files[i], perm) ? errno : 0)
+                            : meta_chmod(&cache, files[i], perm);
+      ERROR_CHECK(rc, 0);
+      // after the chmod: the file, its hard link and the symlink target
+      stale += (query_mode(mode, &cache, files[i], 0) & 0777) != perm;
+      stale += (query_mode(mode, &cache, hardlinks[i], 0) & 0777) != perm;
+      stale += (query_mode(mode, &cache, symlinks[i], 0) & 0777) != perm;
+      queries += 6;
+    }
+  }
+  report(mode_name[mode], queries, now_ns() - start,
+         mode == STAT ? NULL : &cache);
+  if (stale) {
+    printf("  %llu stale modes!\n", (unsigned long long)stale);
+  }
+  meta_cache_destroy(&cache);
+}
+
+/* random batches */
+
+struct run {
+  enum mode mode;
+  struct meta_cache *cache;
+  size_t batch;
+  size_t queries; // per thread
+  unsigned int seed;
+};
+
+static void *random_queries(void *arg) {
+  struct run *r = (struct run *)arg;
+  const char **paths = malloc(r->batch * sizeof(*paths));
+  struct meta_result *res = malloc(r->batch * sizeof(*res));
+  if (!paths || !res) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t done = 0; done < r->queries; done += r->batch) {
+    for (size_t i = 0; i < r->batch; i++) {
+      paths[i] = files[rand_r(&r->seed) % num_files];
+    }
+    if (r->mode == STAT) {
+      for (size_t i = 0; i < r->batch; i++) {
+        struct stat st;
+        if (stat(paths[i], &st)) {
+          ERROR_CHECK(errno, 0);
+        }
+      }
+    } else {
+      int rc = meta_stat_batch(r->cache, paths, r->batch,
+                               STATX_MODE | STATX_SIZE, 0, res);
+      ERROR_CHECK(rc, 0);
+    }
+  }
+  free(res);
+  free(paths);
+  return NULL;
+}
+
+static void run_threads(struct run *proto, size_t threads) {
+  pthread_t tids[threads];
+  struct run runs[threads];
+  for (size_t t = 0; t < threads; t++) {
+    runs[t] = *proto;
+    runs[t].seed = proto->seed + t;
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &random_queries, &runs[t]), 0);
+  }
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+}
+
+static void bench_random(enum mode mode, struct aio_engine *engine,
+                         size_t threads, size_t batch) {
+  struct meta_cache cache;
+  ERROR_CHECK(meta_cache_init(&cache, 1024, 0, engine), 0);
+  struct run proto = {
+      .mode = mode,
+      .cache = &cache,
+      .batch = batch,
+      .queries = QUERIES / threads,
+      .seed = 1,
+  };
+  char name[64];
+  if (mode != STAT) {
+    // cold: one batch per file set, every query a miss
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < num_files; i += batch) {
+      size_t n = num_files - i < batch ? num_files - i : batch;
+      const char *paths[n];
+      struct meta_result res[n];
+      for (size_t j = 0; j < n; j++) {
+        paths[j] = files[i + j];
+      }
+      ERROR_CHECK(meta_stat_batch(&cache, paths, n, STATX_MODE | STATX_SIZE,
+                                  0, res),
+                  0);
+    }
+    snprintf(name, sizeof(name), "%s cold", mode_name[mode]);
+    report(name, num_files, now_ns() - start, &cache);
+  }
+  uint64_t start = now_ns();
+  run_threads(&proto, threads);
+  snprintf(name, sizeof(name), "%s%s", mode_name[mode],
+           mode == STAT ? "" : " warm");
+  report(name, proto.queries * threads, now_ns() - start,
+         mode == STAT ? NULL : &cache);
+  meta_cache_destroy(&cache);
+}
+
+int main(int argc, char *argv[]) {
+  num_files = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_FILES;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_THREADS;
+  size_t batch = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_BATCH;
+  if (!num_files || !threads || !batch) {
+    printf("usage: %s [files] [threads] [batch]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  files = calloc(num_files, NAME_LEN);
+  hardlinks = calloc(num_files, NAME_LEN);
+  symlinks = calloc(num_files, NAME_LEN);
+  if (!files || !hardlinks || !symlinks) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t i = 0; i < num_files; i++) {
+    snprintf(files[i], NAME_LEN, "%d-file-%zu.txt", getpid(), i);
+    snprintf(hardlinks[i], NAME_LEN, "%d-hard-%zu.txt", getpid(), i);
+    snprintf(symlinks[i], NAME_LEN, "%d-soft-%zu.txt", getpid(), i);
+    int fd = open(files[i], O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+      ERROR_CHECK(errno, 0);
+    }
+    close(fd);
+    if (link(files[i], hardlinks[i]) || symlink(files[i], symlinks[i])) {
+      ERROR_CHECK(errno, 0);
+    }
+  }
+
+  struct aio_engine engine;
+  ERROR_CHECK(aio_engine_init(&engine, ENGINE_ENTRIES, ENGINE_WORKERS, 0), 0);
+  printf("%zu files, %zu threads, batches of %zu, aio backend: %s\n",
+         num_files, threads, batch, aio_engine_backend(&engine));
+
+  printf("permissions (file, hard link, symlink; chmod in between):\n");
+  for (enum mode m = STAT; m < MODE_NUM; m++) {
+    bench_permissions(m, m == CACHE_URING ? &engine : NULL);
+  }
+  printf("random batches:\n");
+  for (enum mode m = STAT; m < MODE_NUM; m++) {
+    bench_random(m, m == CACHE_URING ? &engine : NULL, threads, batch);
+  }
+
+  // unlink through a cache: a later query of the path must fail
+  struct meta_cache cache;
+  ERROR_CHECK(meta_cache_init(&cache, 1024, 0, NULL), 0);
+  for (size_t i = 0; i < num_files; i++) {
+    struct statx stx;
+    meta_stat(&cache, symlinks[i], STATX_MODE, META_NOFOLLOW, &stx);
+    meta_stat(&cache, hardlinks[i], STATX_NLINK, 0, &stx);
+    ERROR_CHECK(meta_unlink(&cache, symlinks[i]), 0);
+    ERROR_CHECK(meta_unlink(&cache, files[i]), 0);
+    ERROR_CHECK(meta_stat(&cache, hardlinks[i], STATX_NLINK, 0, &stx), 0);
+    if (stx.stx_nlink != 1 ||
+        meta_stat(&cache, files[i], STATX_MODE, 0, &stx) != ENOENT) {
+      printf("stale entry for %s after unlink\n", files[i]);
+    }
+    ERROR_CHECK(meta_unlink(&cache, hardlinks[i]), 0);
+  }
+  meta_cache_destroy(&cache);
+  aio_engine_destroy(&engine);
+  free(files);
+  free(hardlinks);
+  free(symlinks);
+  return 0;
+}
@@ -0,0 +1,186 @@
+// for O_TMPFILE, AT_EMPTY_PATH
+#define _GNU_SOURCE
+
+#include "temp_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEMP_RETRIES 16U
+
+enum { NO_TMPFILE, TMPFILE_EMPTY_PATH, TMPFILE_PROC };
+
+// per-thread name state, nothing shared past the first name
+static __thread struct {
+  int init;
+  unsigned int no;
+  uint64_t counter;
+  uint64_t rng;
+} self;
+
+static unsigned int thread_nos;
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static void self_init(void) {
+  self.no = __atomic_fetch_add(&thread_nos, 1, __ATOMIC_RELAXED);
+  if (getrandom(&self.rng, sizeof(self.rng), GRND_NONBLOCK) !=
+      sizeof(self.rng)) {
+    // no entropy yet: still differs per thread and run
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    self.rng = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    self.rng ^= (uint64_t)(uintptr_t)&self << 16;
+  }
+  self.init = 1;
+}
+
+int temp_name(struct temp_dir *dir, char *name, size_t len) {
+  if (!self.init) {
+    self_init();
+  }
+  int n = snprintf(name, len, "%s-%x-%x-%llx-%016llx", dir->prefix,
+                   (unsigned int)getpid(), self.no,
+                   (unsigned long long)self.counter++,
+                   (unsigned long long)splitmix64(&self.rng));
+  return n < 0 || (size_t)n >= len ? ENAMETOOLONG : 0;
+}
+
+static void count(uint64_t *counter) {
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static int link_anon(const struct temp_dir *dir, int fd, const char *name) {
+  if (dir->tmpfile == TMPFILE_EMPTY_PATH) {
+    return linkat(fd, "", dir->dirfd, name, AT_EMPTY_PATH) ? errno : 0;
+  }
+  // AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH, /proc doesn't
+  char proc[32];
+  snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+  return linkat(AT_FDCWD, proc, dir->dirfd, name, AT_SYMLINK_FOLLOW) ? errno
+                                                                      : 0;
+}
+
+// can we create anonymous files here, and how do they get a name?
+static int probe_tmpfile(struct temp_dir *dir) {
+  int fd = openat(dir->dirfd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return NO_TMPFILE; // EOPNOTSUPP, EISDIR (old kernels)...
+  }
+  char name[TEMP_NAME_MAX];
+  int found = NO_TMPFILE;
+  for (int how = TMPFILE_EMPTY_PATH; how <= TMPFILE_PROC && !found; how++) {
+    dir->tmpfile = how;
+    if (!temp_name(dir, name, sizeof(name)) && !link_anon(dir, fd, name)) {
+      unlinkat(dir->dirfd, name, 0);
+      found = how;
+    }
+  }
+  close(fd);
+  return found;
+}
+
+int temp_dir_open(struct temp_dir *dir, const char *path, const char *prefix,
+                  mode_t mode, int flags) {
+  if (!dir || !path || !prefix || strlen(prefix) >= TEMP_PREFIX_MAX) {
+    return EINVAL;
+  }
+  memset(dir, 0, sizeof(*dir));
+  dir->dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir->dirfd < 0) {
+    return errno;
+  }
+  dir->flags = flags;
+  dir->mode = mode;
+  strcpy(dir->prefix, prefix);
+  dir->tmpfile = flags & TEMP_DIR_NO_TMPFILE ? NO_TMPFILE : probe_tmpfile(dir);
+  return 0;
+}
+
+void temp_dir_close(struct temp_dir *dir) {
+  if (dir->dirfd >= 0) {
+    close(dir->dirfd);
+    dir->dirfd = -1;
+  }
+}
+
+int temp_file_create(struct temp_dir *dir, struct temp_file *file, int flags) {
+  file->name[0] = '\0';
+  file->named = 0;
+  if (dir->tmpfile && !(flags & TEMP_FILE_NAMED)) {
+    file->fd = openat(dir->dirfd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC,
+                      dir->mode);
+    if (file->fd < 0) {
+      return errno;
+    }
+    count(&dir->created);
+    return 0;
+  }
+
+  // named right away: one O_EXCL open, cheaper than O_TMPFILE + linkat()
+  for (unsigned int i = 0; i < TEMP_RETRIES; i++) {
+    int rc = temp_name(dir, file->name, sizeof(file->name));
+    if (rc) {
+      return rc;
+    }
+    file->fd = openat(dir->dirfd, file->name,
+                      O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, dir->mode);
+    if (file->fd >= 0) {
+      file->named = 1;
+      count(&dir->created);
+      return 0;
+    }
+    if (errno != EEXIST) {
+      return errno;
+    }
+    count(&dir->collisions);
+  }
+  return EEXIST;
+}
+
+int temp_file_link(struct temp_dir *dir, struct temp_file *file) {
+  if (file->named) {
+    return 0;
+  }
+  for (unsigned int i = 0; i < TEMP_RETRIES; i++) {
+    int rc = temp_name(dir, file->name, sizeof(file->name));
+    if (!rc) {
+      rc = link_anon(dir, file->fd, file->name);
+    }
+    if (!rc) {
+      file->named = 1;
+      count(&dir->linked);
+      return 0;
+    }
+    if (rc != EEXIST) {
+      file->name[0] = '\0';
+      return rc;
+    }
+    count(&dir->collisions);
+  }
+  file->name[0] = '\0';
+  return EEXIST;
+}
+
+int temp_file_close(struct temp_dir *dir, struct temp_file *file, int flags) {
+  int rc = 0;
+  if (file->named && !(flags & TEMP_FILE_KEEP) &&
+      unlinkat(dir->dirfd, file->name, 0)) {
+    rc = errno;
+  }
+  if (close(file->fd) && !rc) {
+    rc = errno;
+  }
+  file->fd = -1;
+  return rc;
+}
@@ -0,0 +1,70 @@
+/*
+ * Unique temporary files, at a high rate from many threads.
+ *
+ * populate_file_name() in 04_file_operation/file_operation_demo.c names
+ * files "<pid>-<time(NULL)>.txt": two calls in the same second give the
+ * same name (the demo sleep()s in between), and open(O_CREAT) then silently
+ * reuses the existing file. A temp_dir hands out files which never collide:
+ *
+ * - names are <prefix>-<pid>-<thread no.>-<counter>-<random>: a per-thread
+ *   counter makes them unique within the process without any shared state,
+ *   64 random bits per name (a per-thread generator seeded by getrandom())
+ *   keep other processes, and pid reuse, from picking the same one.
+ * - files are created with O_CREAT | O_EXCL, so even a collision is caught
+ *   (and a new name drawn) instead of opening someone else's file.
+ * - where the filesystem supports O_TMPFILE, files start anonymous: they
+ *   cannot clash at all, and vanish on close unless temp_file_link() gives
+ *   them a name, which publishes them fully written (linkat()).
+ *
+ * A temp_dir may be shared by any number of threads.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef TEMP_FILE_H
+#define TEMP_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TEMP_PREFIX_MAX 32U
+#define TEMP_NAME_MAX 96U
+
+#define TEMP_DIR_NO_TMPFILE 0x1 // always named O_EXCL files
+
+#define TEMP_FILE_NAMED 0x1 // needs a name right away
+#define TEMP_FILE_KEEP 0x2  // temp_file_close(): keep the named file
+
+struct temp_dir {
+  int dirfd;
+  int flags;
+  int tmpfile; // O_TMPFILE works in the directory
+  mode_t mode;
+  char prefix[TEMP_PREFIX_MAX];
+  uint64_t created; // counters, updated atomically
+  uint64_t linked;
+  uint64_t collisions; // EEXIST, retried with a new name
+};
+
+struct temp_file {
+  int fd;
+  int named;
+  char name[TEMP_NAME_MAX]; // relative to the temp_dir, "" if anonymous
+};
+
+// path: directory for the files, prefix: start of their names
+int temp_dir_open(struct temp_dir *dir, const char *path, const char *prefix,
+                  mode_t mode, int flags);
+void temp_dir_close(struct temp_dir *dir);
+
+// a fresh name, without creating anything
+int temp_name(struct temp_dir *dir, char *name, size_t len);
+
+// opened O_RDWR; anonymous if possible, unless TEMP_FILE_NAMED
+int temp_file_create(struct temp_dir *dir, struct temp_file *file, int flags);
+// names an anonymous file, no-op for a named one
+int temp_file_link(struct temp_dir *dir, struct temp_file *file);
+// closes, and unlinks a named file unless TEMP_FILE_KEEP
+int temp_file_close(struct temp_dir *dir, struct temp_file *file, int flags);
+
+#endif // TEMP_FILE_H
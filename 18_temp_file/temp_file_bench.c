@@ -0,0 +1,185 @@
+/*
+ * Temporary file creation from 1..N threads in one directory.
+ *
+ * Every thread creates its share of the files as fast as it can, with:
+ * - pid-time:  populate_file_name() of 04_file_operation/file_operation_demo.c
+ *              and open(O_CREAT), counting the names which were taken
+ * - mkstemp(): glibc's random six letter template
+ * - temp_file named:     O_EXCL open of a temp_name()
+ * - temp_file anonymous: O_TMPFILE, gone on close
+ * - temp_file linked:    O_TMPFILE, 16 bytes written, then linkat()
+ * and reports files/s plus collisions. Files are removed after each run.
+ *
+ * usage: ./temp_file_bench [max threads] [files per thread]
+ */
+#define _GNU_SOURCE
+
+#include "temp_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_MAX_THREADS 8U
+#define DEF_FILES 5000U
+#define PAYLOAD "temp_file_bench\n"
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum method { PID_TIME, MKSTEMP, NAMED, ANONYMOUS, LINKED, METHOD_NUM };
+
+static const char *method_name[METHOD_NUM] = {
+    [PID_TIME] = "pid-time + O_CREAT",
+    [MKSTEMP] = "mkstemp()",
+    [NAMED] = "temp_file named",
+    [ANONYMOUS] = "temp_file anonymous",
+    [LINKED] = "temp_file linked",
+};
+
+struct worker {
+  enum method method;
+  struct temp_dir *dir;
+  size_t files;
+  char (*names)[TEMP_NAME_MAX]; // to remove afterwards, "" if none
+  uint64_t collisions;
+};
+
+static void *create_files(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  for (size_t i = 0; i < w->files; i++) {
+    char *name = w->names[i];
+    int fd = -1, rc = 0;
+    switch (w->method) {
+    case PID_TIME:
+      snprintf(name, TEMP_NAME_MAX, "%d-%ld.txt", getpid(), time(NULL));
+      fd = open(name, O_CREAT | O_EXCL | O_WRONLY, 0644);
+      if (fd < 0 && errno == EEXIST) { // the demo would just reuse it
+        w->collisions++;
+        fd = open(name, O_CREAT | O_WRONLY, 0644);
+        name[0] = '\0'; // removed by whoever created it
+      }
+      rc = fd < 0 ? errno : 0;
+      break;
+    case MKSTEMP:
+      snprintf(name, TEMP_NAME_MAX, "%d-mkstemp-XXXXXX", getpid());
+      fd = mkstemp(name);
+      rc = fd < 0 ? errno : 0;
+      break;
+    default: {
+      struct temp_file file;
+      rc = temp_file_create(w->dir, &file, w->method == NAMED
+                                               ? TEMP_FILE_NAMED
+                                               : 0);
+      if (!rc && w->method == LINKED) {
+        if (write(file.fd, PAYLOAD, sizeof(PAYLOAD) - 1) < 0) {
+          rc = errno;
+        }
+        if (!rc) {
+          rc = temp_file_link(w->dir, &file);
+        }
+      }
+      if (!rc) {
+        memcpy(name, file.name, TEMP_NAME_MAX);
+        rc = temp_file_close(w->dir, &file, TEMP_FILE_KEEP);
+      }
+      break;
+    }
+    }
+    ERROR_CHECK(rc, 0);
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  return NULL;
+}
+
+static void bench(enum method method, struct temp_dir *dir, size_t threads,
+                  size_t files) {
+  pthread_t tids[threads];
+  struct worker workers[threads];
+  uint64_t collisions_before = dir->collisions;
+  for (size_t t = 0; t < threads; t++) {
+    workers[t] = (struct worker){
+        .method = method,
+        .dir = dir,
+        .files = files,
+        .names = calloc(files, TEMP_NAME_MAX),
+    };
+    if (!workers[t].names) {
+      ERROR_CHECK(ENOMEM, 0);
+    }
+  }
+  uint64_t start = now_ns();
+  for (size_t t = 0; t < threads; t++) {
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &create_files, &workers[t]),
+                0);
+  }
+  uint64_t collisions = 0;
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    collisions += workers[t].collisions;
+  }
+  uint64_t elapsed = now_ns() - start;
+  collisions += dir->collisions - collisions_before;
+  printf("  %-22s %2zu threads %10.0f files/s  %8llu collisions\n",
+         method_name[method], threads, threads * files * 1e9 / elapsed,
+         (unsigned long long)collisions);
+
+  for (size_t t = 0; t < threads; t++) {
+    for (size_t i = 0; i < files; i++) {
+      if (workers[t].names[i][0]) {
+        unlink(workers[t].names[i]);
+      }
+    }
+    free(workers[t].names);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_THREADS;
+  size_t files = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_FILES;
+  if (!max_threads || !files) {
+    printf("usage: %s [max threads] [files per thread]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char prefix[TEMP_PREFIX_MAX];
+  snprintf(prefix, sizeof(prefix), "%d-temp", getpid());
+  struct temp_dir dir;
+  ERROR_CHECK(temp_dir_open(&dir, ".", prefix, 0644, 0), 0);
+  printf("O_TMPFILE: %s\n", dir.tmpfile ? "yes" : "no");
+
+  for (enum method m = PID_TIME; m < METHOD_NUM; m++) {
+    if (!dir.tmpfile && (m == ANONYMOUS || m == LINKED)) {
+      continue;
+    }
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+      bench(m, &dir, threads, files);
+    }
+  }
+  printf("temp_dir: %llu created, %llu linked, %llu collisions\n",
+         (unsigned long long)dir.created, (unsigned long long)dir.linked,
+         (unsigned long long)dir.collisions);
+  temp_dir_close(&dir);
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include "ring_buffer.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static int capacity_ok(size_t capacity) {
+  return capacity >= 2 && !(capacity & (capacity - 1));
+}
+
+static size_t min_size(size_t a, size_t b) { return a < b ? a : b; }
+
+/* spsc_ring */
+
+int spsc_ring_init(struct spsc_ring *ring, size_t capacity) {
+  if (!ring || !capacity_ok(capacity)) {
+    return EINVAL; // must be a power of two
+  }
+  ring->buf = calloc(capacity, sizeof(*ring->buf));
+  if (!ring->buf) {
+    return ENOMEM;
+  }
+  ring->mask = capacity - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->tail_cache = 0;
+  ring->head_cache = 0;
+  return 0;
+}
+
+void spsc_ring_destroy(struct spsc_ring *ring) {
+  free(ring->buf);
+  ring->buf = NULL;
+}
+
+// free slots as the producer sees them, refreshing head if needed
+static size_t spsc_space(struct spsc_ring *ring, size_t tail, size_t want) {
+  size_t space = ring->mask + 1 - (tail - ring->head_cache);
+  if (space < want) {
+    ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+    space = ring->mask + 1 - (tail - ring->head_cache);
+  }
+  return space;
+}
+
+// filled slots as the consumer sees them, refreshing tail if needed
+static size_t spsc_filled(struct spsc_ring *ring, size_t head, size_t want) {
+  size_t filled = ring->tail_cache - head;
+  if (filled < want) {
+    ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    filled = ring->tail_cache - head;
+  }
+  return filled;
+}
+
+int spsc_ring_push(struct spsc_ring *ring, void *msg) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (!spsc_space(ring, tail, 1)) {
+    return EAGAIN;
+  }
+  ring->buf[tail & ring->mask] = msg;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return 0;
+}
+
+int spsc_ring_pop(struct spsc_ring *ring, void **msg) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (!spsc_filled(ring, head, 1)) {
+    return EAGAIN;
+  }
+  *msg = ring->buf[head & ring->mask];
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+size_t spsc_ring_push_batch(struct spsc_ring *ring, void *const *msgs,
+                            size_t num) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t n = min_size(num, spsc_space(ring, tail, num));
+  for (size_t i = 0; i < n; i++) {
+    ring->buf[(tail + i) & ring->mask] = msgs[i];
+  }
+  if (n) {
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  }
+  return n;
+}
+
+size_t spsc_ring_pop_batch(struct spsc_ring *ring, void **msgs, size_t num) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t n = min_size(num, spsc_filled(ring, head, num));
+  for (size_t i = 0; i < n; i++) {
+    msgs[i] = ring->buf[(head + i) & ring->mask];
+  }
+  if (n) {
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  }
+  return n;
+}
+
+/* mpmc_ring */
+
+int mpmc_ring_init(struct mpmc_ring *ring, size_t capacity) {
+  if (!ring || !capacity_ok(capacity)) {
+    return EINVAL;
+  }
+  ring->cells = calloc(capacity, sizeof(*ring->cells));
+  if (!ring->cells) {
+    return ENOMEM;
+  }
+  ring->mask = capacity - 1;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&ring->cells[i].seq, i); // free for the push of position i
+  }
+  atomic_init(&ring->enqueue_pos, 0);
+  atomic_init(&ring->dequeue_pos, 0);
+  return 0;
+}
+
+void mpmc_ring_destroy(struct mpmc_ring *ring) {
+  free(ring->cells);
+  ring->cells = NULL;
+}
+
+/*
+ * cell seq == pos:           free for the push of pos
+ * cell seq == pos + 1:       holds the message of pos
+ * cell seq == pos + mask + 1: free for the push one lap later
+ */
+
+int mpmc_ring_push(struct mpmc_ring *ring, void *msg) {
+  size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  struct mpmc_cell *cell;
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (!diff) {
+      if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return EAGAIN; // still holds last lap's message
+    } else {
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    }
+  }
+  cell->data = msg;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return 0;
+}
+
+int mpmc_ring_pop(struct mpmc_ring *ring, void **msg) {
+  size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+  struct mpmc_cell *cell;
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (!diff) {
+      if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return EAGAIN; // not written yet
+    } else {
+      pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    }
+  }
+  *msg = cell->data;
+  atomic_store_explicit(&cell->seq, pos + ring->mask + 1,
+                        memory_order_release);
+  return 0;
+}
+
+// claims up to num positions of *pos_ptr whose cells are ready now
+// (seq == position + ready), checked before the CAS as in the single
+// push/pop: once claimed, nobody else is using any of them
+static size_t claim(struct mpmc_ring *ring, atomic_size_t *pos_ptr,
+                    size_t ready, size_t num, size_t *first) {
+  size_t pos = atomic_load_explicit(pos_ptr, memory_order_relaxed);
+  for (;;) {
+    size_t seq = atomic_load_explicit(&ring->cells[pos & ring->mask].seq,
+                                      memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + ready);
+    if (diff < 0) {
+      return 0; // full (push) or empty (pop)
+    }
+    if (diff > 0) { // pos is stale
+      pos = atomic_load_explicit(pos_ptr, memory_order_relaxed);
+      continue;
+    }
+    // recomputed before every CAS, a failed one reloads pos
+    size_t n = 1;
+    while (n < num &&
+           atomic_load_explicit(&ring->cells[(pos + n) & ring->mask].seq,
+                                memory_order_acquire) == pos + n + ready) {
+      n++;
+    }
+    if (atomic_compare_exchange_weak_explicit(pos_ptr, &pos, pos + n,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      *first = pos;
+      return n;
+    }
+  }
+}
+
+size_t mpmc_ring_push_batch(struct mpmc_ring *ring, void *const *msgs,
+                            size_t num) {
+  size_t pos;
+  size_t n = num ? claim(ring, &ring->enqueue_pos, 0, num, &pos) : 0;
+  for (size_t i = 0; i < n; i++) {
+    struct mpmc_cell *cell = &ring->cells[(pos + i) & ring->mask];
+    cell->data = msgs[i];
+    atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+  }
+  return n;
+}
+
+size_t mpmc_ring_pop_batch(struct mpmc_ring *ring, void **msgs, size_t num) {
+  size_t pos;
+  size_t n = num ? claim(ring, &ring->dequeue_pos, 1, num, &pos) : 0;
+  for (size_t i = 0; i < n; i++) {
+    struct mpmc_cell *cell = &ring->cells[(pos + i) & ring->mask];
+    msgs[i] = cell->data;
+    atomic_store_explicit(&cell->seq, pos + i + ring->mask + 1,
+                          memory_order_release);
+  }
+  return n;
+}
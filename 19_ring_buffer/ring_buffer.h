@@ -0,0 +1,69 @@
+/*
+ * Bounded lock-free ring buffers of pointers.
+ *
+ * So far threads talk through a sem_t (sync_for_detatched_thread in
+ * 03_pthread_attributes/pthread_attr_demo.c) or a mutex guarded queue
+ * (05_thread_pool). These rings pass messages without any lock:
+ *
+ * - spsc_ring: one producer, one consumer. Each side owns its index, on
+ *   its own cache line, and keeps a cached copy of the other side's, so
+ *   the shared lines are only touched when the cached view runs out.
+ * - mpmc_ring: any number of producers and consumers, Dmitry Vyukov's
+ *   bounded MPMC queue: every cell carries a sequence number telling
+ *   whose turn it is, so producers and consumers only contend on their
+ *   own index (one CAS per message).
+ *
+ * Both have a fixed power-of-two capacity and never block: push fails
+ * with EAGAIN when full, pop when empty; the caller decides whether to
+ * spin, yield or sleep. The _batch calls move up to num messages at once
+ * (one index update for all of them) and return how many they moved.
+ * An mpmc batch takes the run of cells that are ready right now (their
+ * previous occupant done with them), checked before its one CAS, so it
+ * may move fewer than are queued but never waits on another thread.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+struct spsc_ring {
+  _Alignas(64) atomic_size_t head; // next to pop, written by the consumer
+  size_t tail_cache;               // consumer's view of tail
+  _Alignas(64) atomic_size_t tail; // next to push, written by the producer
+  size_t head_cache;               // producer's view of head
+  _Alignas(64) void **buf;
+  size_t mask;
+};
+
+struct mpmc_cell {
+  atomic_size_t seq;
+  void *data;
+};
+
+struct mpmc_ring {
+  _Alignas(64) atomic_size_t enqueue_pos;
+  _Alignas(64) atomic_size_t dequeue_pos;
+  _Alignas(64) struct mpmc_cell *cells;
+  size_t mask;
+};
+
+int spsc_ring_init(struct spsc_ring *ring, size_t capacity);
+void spsc_ring_destroy(struct spsc_ring *ring);
+int spsc_ring_push(struct spsc_ring *ring, void *msg);
+int spsc_ring_pop(struct spsc_ring *ring, void **msg);
+size_t spsc_ring_push_batch(struct spsc_ring *ring, void *const *msgs,
+                            size_t num);
+size_t spsc_ring_pop_batch(struct spsc_ring *ring, void **msgs, size_t num);
+
+int mpmc_ring_init(struct mpmc_ring *ring, size_t capacity);
+void mpmc_ring_destroy(struct mpmc_ring *ring);
+int mpmc_ring_push(struct mpmc_ring *ring, void *msg);
+int mpmc_ring_pop(struct mpmc_ring *ring, void **msg);
+size_t mpmc_ring_push_batch(struct mpmc_ring *ring, void *const *msgs,
+                            size_t num);
+size_t mpmc_ring_pop_batch(struct mpmc_ring *ring, void **msgs, size_t num);
+
+#endif // RING_BUFFER_H
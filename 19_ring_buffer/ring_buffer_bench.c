@@ -0,0 +1,386 @@
+/*
+ * Message passing between threads: rings vs. locks and semaphores.
+ *
+ * Channels compared:
+ * - spsc_ring and mpmc_ring, one message or batches at a time; an empty
+ *   or full ring is retried after a pause, then sched_yield()
+ * - a bounded queue under a mutex with two condition variables
+ * - a one slot sem_t handoff, like sync_for_detatched_thread in
+ *   03_pthread_attributes/pthread_attr_demo.c (one producer/consumer)
+ * measuring:
+ * - throughput: producers send their share of the messages, consumers
+ *   take them until all arrived; messages/s, with a checksum
+ * - latency: one thread pings, the other pongs it back; half the round
+ *   trip is the handoff latency
+ *
+ * usage: ./ring_buffer_bench [messages] [max producers] [batch]
+ */
+#define _GNU_SOURCE
+
+#include "ring_buffer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_MESSAGES 2000000U
+#define DEF_MAX_PRODUCERS 4U
+#define DEF_BATCH 32U
+#define CAPACITY 1024U
+#define PINGS 100000U
+#define SPIN_LIMIT 64U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* channels */
+
+enum kind { SPSC, MPMC, MUTEX_COND, SEMAPHORE, KIND_NUM };
+
+static const char *kind_name[KIND_NUM] = {
+    [SPSC] = "spsc_ring",
+    [MPMC] = "mpmc_ring",
+    [MUTEX_COND] = "mutex + condvar",
+    [SEMAPHORE] = "sem_t handoff",
+};
+
+struct chan {
+  enum kind kind;
+  atomic_int closed;
+  struct spsc_ring spsc;
+  struct mpmc_ring mpmc;
+  // MUTEX_COND
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty, not_full;
+  void **buf;
+  size_t head, count;
+  // SEMAPHORE
+  sem_t empty, full;
+  void *slot;
+};
+
+static void chan_init(struct chan *ch, enum kind kind) {
+  memset(ch, 0, sizeof(*ch));
+  ch->kind = kind;
+  switch (kind) {
+  case SPSC:
+    ERROR_CHECK(spsc_ring_init(&ch->spsc, CAPACITY), 0);
+    break;
+  case MPMC:
+    ERROR_CHECK(mpmc_ring_init(&ch->mpmc, CAPACITY), 0);
+    break;
+  case MUTEX_COND:
+    pthread_mutex_init(&ch->lock, NULL);
+    pthread_cond_init(&ch->not_empty, NULL);
+    pthread_cond_init(&ch->not_full, NULL);
+    ch->buf = calloc(CAPACITY, sizeof(*ch->buf));
+    if (!ch->buf) {
+      ERROR_CHECK(ENOMEM, 0);
+    }
+    break;
+  default:
+    sem_init(&ch->empty, 0, 1);
+    sem_init(&ch->full, 0, 0);
+  }
+}
+
+static void chan_destroy(struct chan *ch) {
+  switch (ch->kind) {
+  case SPSC:
+    spsc_ring_destroy(&ch->spsc);
+    break;
+  case MPMC:
+    mpmc_ring_destroy(&ch->mpmc);
+    break;
+  case MUTEX_COND:
+    free(ch->buf);
+    pthread_cond_destroy(&ch->not_full);
+    pthread_cond_destroy(&ch->not_empty);
+    pthread_mutex_destroy(&ch->lock);
+    break;
+  default:
+    sem_destroy(&ch->full);
+    sem_destroy(&ch->empty);
+  }
+}
+
+// wakes consumers waiting on an empty channel, once all is sent
+static void chan_close(struct chan *ch) {
+  atomic_store(&ch->closed, 1);
+  if (ch->kind == MUTEX_COND) {
+    pthread_mutex_lock(&ch->lock);
+    pthread_cond_broadcast(&ch->not_empty);
+    pthread_mutex_unlock(&ch->lock);
+  }
+}
+
+static void backoff(unsigned int *spins) {
+  if ((*spins)++ < SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else {
+    sched_yield();
+  }
+}
+
+// sends all num messages, batch at a time (1: single push)
+static void chan_send(struct chan *ch, void **msgs, size_t num, size_t batch) {
+  unsigned int spins = 0;
+  while (num) {
+    size_t n = 0, want = num < batch ? num : batch;
+    switch (ch->kind) {
+    case SPSC:
+      n = batch > 1 ? spsc_ring_push_batch(&ch->spsc, msgs, want)
+                    : !spsc_ring_push(&ch->spsc, msgs[0]);
+      break;
+    case MPMC:
+      n = batch > 1 ? mpmc_ring_push_batch(&ch->mpmc, msgs, want)
+                    : !mpmc_ring_push(&ch->mpmc, msgs[0]);
+      break;
+    case MUTEX_COND:
+      pthread_mutex_lock(&ch->lock);
+      while (ch->count == CAPACITY) {
+        pthread_cond_wait(&ch->not_full, &ch->lock);
+      }
+      for (; n < want && ch->count < CAPACITY; n++, ch->count++) {
+        ch->buf[(ch->head + ch->count) % CAPACITY] = msgs[n];
+      }
+      pthread_cond_signal(&ch->not_empty);
+      pthread_mutex_unlock(&ch->lock);
+      break;
+    default:
+      while (sem_wait(&ch->empty)) {
+      }
+      ch->slot = msgs[0];
+      sem_post(&ch->full);
+      n = 1;
+    }
+    if (!n) {
+      backoff(&spins);
+      continue;
+    }
+    spins = 0;
+    msgs += n;
+    num -= n;
+  }
+}
+
+// receives 1..max messages; 0 once the channel is closed and empty
+static size_t chan_recv(struct chan *ch, void **msgs, size_t max) {
+  unsigned int spins = 0;
+  for (;;) {
+    size_t n = 0;
+    switch (ch->kind) {
+    case SPSC:
+      n = max > 1 ? spsc_ring_pop_batch(&ch->spsc, msgs, max)
+                  : !spsc_ring_pop(&ch->spsc, msgs);
+      break;
+    case MPMC:
+      n = max > 1 ? mpmc_ring_pop_batch(&ch->mpmc, msgs, max)
+                  : !mpmc_ring_pop(&ch->mpmc, msgs);
+      break;
+    case MUTEX_COND:
+      pthread_mutex_lock(&ch->lock);
+      while (!ch->count && !atomic_load(&ch->closed)) {
+        pthread_cond_wait(&ch->not_empty, &ch->lock);
+      }
+      for (; n < max && ch->count; n++, ch->count--) {
+        msgs[n] = ch->buf[ch->head];
+        ch->head = (ch->head + 1) % CAPACITY;
+      }
+      pthread_cond_signal(&ch->not_full);
+      pthread_mutex_unlock(&ch->lock);
+      return n;
+    default: // one consumer, which stops after the last message
+      while (sem_wait(&ch->full)) {
+      }
+      msgs[0] = ch->slot;
+      sem_post(&ch->empty);
+      return 1;
+    }
+    if (n) {
+      return n;
+    }
+    if (atomic_load(&ch->closed)) { // a last look after seeing closed
+      if (ch->kind == SPSC) {
+        return spsc_ring_pop_batch(&ch->spsc, msgs, max);
+      }
+      return mpmc_ring_pop_batch(&ch->mpmc, msgs, max);
+    }
+    backoff(&spins);
+  }
+}
+
+/* throughput */
+
+struct side {
+  struct chan *ch;
+  size_t num;  // producer: messages to send
+  size_t first; // producer: value of its first message
+  size_t batch;
+  uint64_t sum; // consumer: checksum of what it got
+  atomic_size_t *left; // consumer (semaphore): messages still to come
+};
+
+static void *producer(void *arg) {
+  struct side *s = (struct side *)arg;
+  void *msgs[s->batch];
+  for (size_t sent = 0; sent < s->num;) {
+    size_t n = s->num - sent < s->batch ? s->num - sent : s->batch;
+    for (size_t i = 0; i < n; i++) {
+      msgs[i] = (void *)(uintptr_t)(s->first + sent + i + 1);
+    }
+    chan_send(s->ch, msgs, n, s->batch);
+    sent += n;
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg) {
+  struct side *s = (struct side *)arg;
+  void *msgs[s->batch];
+  for (;;) {
+    if (s->ch->kind == SEMAPHORE && !atomic_load(s->left)) {
+      break;
+    }
+    size_t n = chan_recv(s->ch, msgs, s->batch);
+    if (!n) {
+      break;
+    }
+    for (size_t i = 0; i < n; i++) {
+      s->sum += (uintptr_t)msgs[i];
+    }
+    atomic_fetch_sub(s->left, n);
+  }
+  return NULL;
+}
+
+static void throughput(enum kind kind, size_t threads, size_t messages,
+                       size_t batch) {
+  struct chan ch;
+  chan_init(&ch, kind);
+  pthread_t prod[threads], cons[threads];
+  struct side ps[threads], cs[threads];
+  atomic_size_t left = messages;
+  size_t share = messages / threads;
+  uint64_t start = now_ns();
+  for (size_t t = 0; t < threads; t++) {
+    cs[t] = (struct side){.ch = &ch, .batch = batch, .left = &left};
+    ps[t] = (struct side){
+        .ch = &ch,
+        .num = t == threads - 1 ? messages - share * t : share,
+        .first = share * t,
+        .batch = batch,
+    };
+    ERROR_CHECK(pthread_create(&cons[t], NULL, &consumer, &cs[t]), 0);
+    ERROR_CHECK(pthread_create(&prod[t], NULL, &producer, &ps[t]), 0);
+  }
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(prod[t], NULL);
+  }
+  chan_close(&ch);
+  uint64_t sum = 0;
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(cons[t], NULL);
+    sum += cs[t].sum;
+  }
+  uint64_t elapsed = now_ns() - start;
+  uint64_t expected = (uint64_t)messages * (messages + 1) / 2;
+  char name[48];
+  snprintf(name, sizeof(name), "%s%s", kind_name[kind],
+           batch > 1 ? " batch" : "");
+  printf("  %-22s %zu:%zu %12.0f msgs/s%s\n", name, threads, threads,
+         messages * 1e9 / elapsed, sum == expected ? "" : "  checksum BAD");
+  chan_destroy(&ch);
+}
+
+/* latency */
+
+struct pong {
+  struct chan *ping, *pong;
+};
+
+static void *ponger(void *arg) {
+  struct pong *p = (struct pong *)arg;
+  void *msg;
+  for (size_t i = 0; i < PINGS; i++) {
+    while (!chan_recv(p->ping, &msg, 1)) {
+    }
+    chan_send(p->pong, &msg, 1, 1);
+  }
+  return NULL;
+}
+
+static void latency(enum kind kind) {
+  struct chan ping, pong;
+  chan_init(&ping, kind);
+  chan_init(&pong, kind);
+  struct pong p = {.ping = &ping, .pong = &pong};
+  pthread_t tid;
+  ERROR_CHECK(pthread_create(&tid, NULL, &ponger, &p), 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < PINGS; i++) {
+    void *msg = (void *)(uintptr_t)(i + 1);
+    chan_send(&ping, &msg, 1, 1);
+    while (!chan_recv(&pong, &msg, 1)) {
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  pthread_join(tid, NULL);
+  printf("  %-22s %10.0f ns one way\n", kind_name[kind],
+         elapsed / (2.0 * PINGS));
+  chan_destroy(&pong);
+  chan_destroy(&ping);
+}
+
+int main(int argc, char *argv[]) {
+  size_t messages = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MESSAGES;
+  size_t max_threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_MAX_PRODUCERS;
+  size_t batch = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_BATCH;
+  if (!messages || !max_threads || !batch) {
+    printf("usage: %s [messages] [max producers] [batch]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("throughput, %zu messages (producers:consumers):\n", messages);
+  for (enum kind k = SPSC; k < KIND_NUM; k++) {
+    throughput(k, 1, messages, 1);
+    if (batch > 1 && k != SEMAPHORE) {
+      throughput(k, 1, messages, batch);
+    }
+  }
+  for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+    throughput(MPMC, threads, messages, 1);
+    throughput(MPMC, threads, messages, batch);
+    throughput(MUTEX_COND, threads, messages, 1);
+    throughput(MUTEX_COND, threads, messages, batch);
+  }
+
+  printf("latency, %u ping-pongs:\n", PINGS);
+  for (enum kind k = SPSC; k < KIND_NUM; k++) {
+    latency(k);
+  }
+  return 0;
+}
@@ -0,0 +1,253 @@
+// for syscall()
+#define _GNU_SOURCE
+
+#include "futex_sync.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define MAX_SPIN 100U // glibc's limit for PTHREAD_MUTEX_ADAPTIVE_NP
+
+static int futex_wait(uint32_t *addr, uint32_t val) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr, int num) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+}
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// spinning only helps if whoever we wait for runs meanwhile
+static uint32_t max_spin(void) {
+  static int spin = -1;
+  int s = __atomic_load_n(&spin, __ATOMIC_RELAXED);
+  if (s < 0) {
+    s = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? (int)MAX_SPIN : 0;
+    __atomic_store_n(&spin, s, __ATOMIC_RELAXED);
+  }
+  return s;
+}
+
+// spins while *addr == val, for at most limit rounds; 1 if it changed
+static int spin_while(uint32_t *addr, uint32_t val, uint32_t limit) {
+  for (uint32_t i = 0; i < limit; i++) {
+    if (__atomic_load_n(addr, __ATOMIC_ACQUIRE) != val) {
+      return 1;
+    }
+    cpu_relax();
+  }
+  return __atomic_load_n(addr, __ATOMIC_ACQUIRE) != val;
+}
+
+/* fmutex */
+
+void fmutex_init(struct fmutex *mutex) {
+  mutex->state = 0;
+  mutex->spins = 0;
+}
+
+int fmutex_trylock(struct fmutex *mutex) {
+  uint32_t c = 0;
+  return __atomic_compare_exchange_n(&mutex->state, &c, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+             ? 0
+             : EBUSY;
+}
+
+void fmutex_lock(struct fmutex *mutex) {
+  if (!fmutex_trylock(mutex)) {
+    return;
+  }
+  // spin a bit longer than the hand-overs we saw lately, like glibc's
+  // adaptive mutex, and learn from how long this one took
+  uint32_t limit = max_spin();
+  if (limit) {
+    uint32_t spins = __atomic_load_n(&mutex->spins, __ATOMIC_RELAXED);
+    if (spins * 2 + 10 < limit) {
+      limit = spins * 2 + 10;
+    }
+    for (uint32_t cnt = 1; cnt <= limit; cnt++) {
+      cpu_relax();
+      if (!__atomic_load_n(&mutex->state, __ATOMIC_RELAXED) &&
+          !fmutex_trylock(mutex)) {
+        __atomic_store_n(&mutex->spins, spins + ((int)cnt - (int)spins) / 8,
+                         __ATOMIC_RELAXED);
+        return;
+      }
+    }
+    __atomic_store_n(&mutex->spins, spins + ((int)limit - (int)spins) / 8,
+                     __ATOMIC_RELAXED);
+  }
+
+  // park: mark the mutex contended, so unlock wakes us
+  uint32_t c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  while (c) {
+    futex_wait(&mutex->state, 2);
+    c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void fmutex_unlock(struct fmutex *mutex) {
+  if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+    __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+    futex_wake(&mutex->state, 1);
+  }
+}
+
+/* fevent */
+
+void fevent_init(struct fevent *event) { event->state = 0; }
+
+void fevent_set(struct fevent *event) {
+  if (__atomic_exchange_n(&event->state, 1, __ATOMIC_RELEASE) == 2) {
+    futex_wake(&event->state, INT_MAX);
+  }
+}
+
+void fevent_reset(struct fevent *event) {
+  uint32_t s = 1;
+  __atomic_compare_exchange_n(&event->state, &s, 0, 0, __ATOMIC_RELAXED,
+                              __ATOMIC_RELAXED);
+}
+
+int fevent_is_set(struct fevent *event) {
+  return __atomic_load_n(&event->state, __ATOMIC_ACQUIRE) == 1;
+}
+
+void fevent_wait(struct fevent *event) {
+  spin_while(&event->state, 0, max_spin());
+  for (;;) {
+    uint32_t s = __atomic_load_n(&event->state, __ATOMIC_ACQUIRE);
+    if (s == 1) {
+      return;
+    }
+    if (!s && !__atomic_compare_exchange_n(&event->state, &s, 2, 0,
+                                           __ATOMIC_ACQUIRE,
+                                           __ATOMIC_RELAXED)) {
+      continue;
+    }
+    futex_wait(&event->state, 2);
+  }
+}
+
+/* flatch */
+
+int flatch_init(struct flatch *latch, uint32_t count) {
+  if (!latch) {
+    return EINVAL;
+  }
+  latch->count = count;
+  latch->sleepers = 0;
+  return 0;
+}
+
+void flatch_count_down(struct flatch *latch) {
+  uint32_t c = __atomic_load_n(&latch->count, __ATOMIC_RELAXED);
+  do {
+    if (!c) {
+      return; // already open
+    }
+  } while (!__atomic_compare_exchange_n(&latch->count, &c, c - 1, 1,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  // seq_cst pairs with the waiter's sleepers++ then count load: either it
+  // sees zero, or we see it sleeping
+  if (c == 1 && __atomic_load_n(&latch->sleepers, __ATOMIC_SEQ_CST)) {
+    futex_wake(&latch->count, INT_MAX);
+  }
+}
+
+void flatch_wait(struct flatch *latch) {
+  spin_while(&latch->count, __atomic_load_n(&latch->count, __ATOMIC_ACQUIRE),
+             max_spin());
+  if (!__atomic_load_n(&latch->count, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  __atomic_fetch_add(&latch->sleepers, 1, __ATOMIC_SEQ_CST);
+  uint32_t c;
+  while ((c = __atomic_load_n(&latch->count, __ATOMIC_SEQ_CST))) {
+    futex_wait(&latch->count, c);
+  }
+  __atomic_fetch_sub(&latch->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/* fbarrier */
+
+int fbarrier_init(struct fbarrier *barrier, uint32_t threads) {
+  if (!barrier || !threads) {
+    return EINVAL;
+  }
+  barrier->count = threads;
+  barrier->generation = 0;
+  barrier->threads = threads;
+  return 0;
+}
+
+int fbarrier_wait(struct fbarrier *barrier) {
+  uint32_t gen = __atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE);
+  if (__atomic_fetch_sub(&barrier->count, 1, __ATOMIC_ACQ_REL) == 1) {
+    // last one in: rearm, then release the round
+    __atomic_store_n(&barrier->count, barrier->threads, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&barrier->generation, 1, __ATOMIC_RELEASE);
+    futex_wake(&barrier->generation, INT_MAX);
+    return 1;
+  }
+  spin_while(&barrier->generation, gen, max_spin());
+  while (__atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE) == gen) {
+    futex_wait(&barrier->generation, gen);
+  }
+  return 0;
+}
+
+/* fonce */
+
+void fonce_call(struct fonce *once, void (*fn)(void *), void *arg) {
+  uint32_t s = __atomic_load_n(&once->state, __ATOMIC_ACQUIRE);
+  if (s == 3) {
+    return; // the common case: one load
+  }
+  if (!s && __atomic_compare_exchange_n(&once->state, &s, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    fn(arg);
+    if (__atomic_exchange_n(&once->state, 3, __ATOMIC_RELEASE) == 2) {
+      futex_wake(&once->state, INT_MAX);
+    }
+    return;
+  }
+  // someone else runs it
+  spin_while(&once->state, 1, max_spin());
+  while ((s = __atomic_load_n(&once->state, __ATOMIC_ACQUIRE)) != 3) {
+    if (s == 1 && !__atomic_compare_exchange_n(&once->state, &s, 2, 0,
+                                               __ATOMIC_ACQUIRE,
+                                               __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    futex_wait(&once->state, 2);
+  }
+}
+
+/* fcompletion */
+
+void fcompletion_init(struct fcompletion *completion) {
+  fevent_init(&completion->done);
+  completion->value = NULL;
+}
+
+void fcompletion_complete(struct fcompletion *completion, void *value) {
+  completion->value = value;
+  fevent_set(&completion->done); // release: value is visible to waiters
+}
+
+void *fcompletion_wait(struct fcompletion *completion) {
+  fevent_wait(&completion->done);
+  return completion->value;
+}
@@ -0,0 +1,90 @@
+/*
+ * Synchronization primitives on top of futex(2).
+ *
+ * 03_pthread_attributes/pthread_attr_demo.c hands a result over with a
+ * sem_t and loops on sem_wait(); pthread_once() style init and waiting
+ * for N threads need yet other objects. These are each a 32 bit word (or
+ * two) in user space, which only enter the kernel when a thread really
+ * has to sleep or someone sleeping has to be woken:
+ *
+ * - fmutex:   Drepper's three state mutex ("Futexes Are Tricky"):
+ *             unlocked, locked, locked with sleepers; unlock only calls
+ *             futex_wake() in the last case.
+ * - fevent:   set once (or reset), any number of waiters.
+ * - flatch:   counts down to zero, waiters are released at zero.
+ * - fbarrier: reusable barrier for a fixed number of threads.
+ * - fonce:    runs an init function exactly once, callers wait for it.
+ * - fcompletion: one-shot handoff of a value from one thread to others.
+ *
+ * Waiting is adaptive: first spin (pause) for a while, then park in
+ * futex_wait(). The fmutex learns how long it is worth spinning from the
+ * lock hand-overs it has seen; on a single CPU nothing spins, as the
+ * owner cannot run while we do. All of these are process private.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef FUTEX_SYNC_H
+#define FUTEX_SYNC_H
+
+#include <stdint.h>
+
+struct fmutex {
+  uint32_t state;  // 0: unlocked, 1: locked, 2: locked, maybe sleepers
+  uint32_t spins;  // learned spin budget
+};
+
+struct fevent {
+  uint32_t state; // 0: unset, 1: set, 2: unset with sleepers
+};
+
+struct flatch {
+  uint32_t count;
+  uint32_t sleepers;
+};
+
+struct fbarrier {
+  uint32_t count; // threads still to arrive this round
+  uint32_t generation;
+  uint32_t threads;
+};
+
+struct fonce {
+  uint32_t state; // 0: not run, 1: running, 2: running w/ sleepers, 3: done
+};
+
+struct fcompletion {
+  struct fevent done;
+  void *value;
+};
+
+#define FMUTEX_INIT {0, 0}
+#define FEVENT_INIT {0}
+#define FONCE_INIT {0}
+#define FCOMPLETION_INIT {FEVENT_INIT, NULL}
+
+void fmutex_init(struct fmutex *mutex);
+void fmutex_lock(struct fmutex *mutex);
+int fmutex_trylock(struct fmutex *mutex); // 0 or EBUSY
+void fmutex_unlock(struct fmutex *mutex);
+
+void fevent_init(struct fevent *event);
+void fevent_set(struct fevent *event); // wakes every waiter
+void fevent_reset(struct fevent *event);
+int fevent_is_set(struct fevent *event);
+void fevent_wait(struct fevent *event);
+
+int flatch_init(struct flatch *latch, uint32_t count);
+void flatch_count_down(struct flatch *latch);
+void flatch_wait(struct flatch *latch);
+
+int fbarrier_init(struct fbarrier *barrier, uint32_t threads);
+// 1 for one of the threads of each round (the last to arrive), else 0
+int fbarrier_wait(struct fbarrier *barrier);
+
+void fonce_call(struct fonce *once, void (*fn)(void *), void *arg);
+
+void fcompletion_init(struct fcompletion *completion);
+void fcompletion_complete(struct fcompletion *completion, void *value);
+void *fcompletion_wait(struct fcompletion *completion);
+
+#endif // FUTEX_SYNC_H
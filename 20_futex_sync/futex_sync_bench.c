@@ -0,0 +1,295 @@
+/*
+ * futex_sync primitives vs. their pthread / sem_t counterparts.
+ *
+ * - mutex:   1..N threads increment a shared counter under
+ *            pthread_mutex (default and adaptive) or fmutex; ops/s
+ * - handoff: ping-pong between two threads through a pair of sem_t
+ *            (the pthread_attr_demo.c handoff) or a pair of fevents
+ * - barrier: 1..N threads through pthread_barrier or fbarrier; rounds/s
+ * - once:    1..N threads calling pthread_once() or fonce_call() after
+ *            the init ran; calls/s
+ * Every run starts its threads together behind an flatch.
+ *
+ * usage: ./futex_sync_bench [max threads] [ops]
+ */
+#define _GNU_SOURCE
+
+#include "futex_sync.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEF_MAX_THREADS 64U
+#define DEF_OPS 1000000U
+#define PINGS 100000U
+#define ROUNDS 10000U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum impl { PTHREAD, PTHREAD_ADAPTIVE, FUTEX, IMPL_NUM };
+
+static const char *impl_name[IMPL_NUM] = {
+    [PTHREAD] = "pthread",
+    [PTHREAD_ADAPTIVE] = "pthread adaptive",
+    [FUTEX] = "futex_sync",
+};
+
+struct shared {
+  enum impl impl;
+  size_t threads;
+  size_t ops; // per thread
+  struct flatch start;
+  pthread_mutex_t mutex;
+  struct fmutex fmutex;
+  pthread_barrier_t barrier;
+  struct fbarrier fbarrier;
+  pthread_once_t once;
+  struct fonce fonce;
+  uint64_t counter;
+};
+
+// runs fn on every thread, returns the time from the start to the last join
+static uint64_t run(struct shared *s, void *(*fn)(void *)) {
+  pthread_t tids[s->threads];
+  flatch_init(&s->start, 1);
+  for (size_t t = 0; t < s->threads; t++) {
+    ERROR_CHECK(pthread_create(&tids[t], NULL, fn, s), 0);
+  }
+  uint64_t start = now_ns();
+  flatch_count_down(&s->start);
+  for (size_t t = 0; t < s->threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  return now_ns() - start;
+}
+
+/* mutex */
+
+static void *mutex_worker(void *arg) {
+  struct shared *s = (struct shared *)arg;
+  flatch_wait(&s->start);
+  for (size_t i = 0; i < s->ops; i++) {
+    if (s->impl == FUTEX) {
+      fmutex_lock(&s->fmutex);
+      s->counter++;
+      fmutex_unlock(&s->fmutex);
+    } else {
+      pthread_mutex_lock(&s->mutex);
+      s->counter++;
+      pthread_mutex_unlock(&s->mutex);
+    }
+  }
+  return NULL;
+}
+
+static void bench_mutex(size_t max_threads, size_t ops) {
+  printf("mutex, %zu increments:\n", ops);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("  %2zu threads", threads);
+    for (enum impl i = PTHREAD; i < IMPL_NUM; i++) {
+      struct shared s = {.impl = i, .threads = threads, .ops = ops / threads};
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init(&attr);
+      if (i == PTHREAD_ADAPTIVE) {
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+      }
+      pthread_mutex_init(&s.mutex, &attr);
+      pthread_mutexattr_destroy(&attr);
+      fmutex_init(&s.fmutex);
+      uint64_t elapsed = run(&s, &mutex_worker);
+      printf("  %s %10.0f ops/s%s", impl_name[i],
+             s.counter * 1e9 / elapsed,
+             s.counter == s.ops * threads ? "" : " (lost updates!)");
+      pthread_mutex_destroy(&s.mutex);
+    }
+    printf("\n");
+  }
+}
+
+/* handoff */
+
+struct pingpong {
+  enum impl impl;
+  sem_t sem[2];
+  struct fevent event[2];
+};
+
+static void give(struct pingpong *p, int i) {
+  if (p->impl == FUTEX) {
+    fevent_set(&p->event[i]);
+  } else {
+    sem_post(&p->sem[i]);
+  }
+}
+
+static void take(struct pingpong *p, int i) {
+  if (p->impl == FUTEX) {
+    fevent_wait(&p->event[i]);
+    fevent_reset(&p->event[i]); // nobody sets it again before we give back
+  } else {
+    while (sem_wait(&p->sem[i])) {
+    }
+  }
+}
+
+static void *ponger(void *arg) {
+  struct pingpong *p = (struct pingpong *)arg;
+  for (size_t i = 0; i < PINGS; i++) {
+    take(p, 0);
+    give(p, 1);
+  }
+  return NULL;
+}
+
+static void bench_handoff(void) {
+  printf("handoff, %u ping-pongs:\n", PINGS);
+  for (enum impl i = PTHREAD; i < IMPL_NUM; i += 2) { // sem_t, fevent
+    struct pingpong p = {.impl = i};
+    sem_init(&p.sem[0], 0, 0);
+    sem_init(&p.sem[1], 0, 0);
+    fevent_init(&p.event[0]);
+    fevent_init(&p.event[1]);
+    pthread_t tid;
+    ERROR_CHECK(pthread_create(&tid, NULL, &ponger, &p), 0);
+    uint64_t start = now_ns();
+    for (size_t n = 0; n < PINGS; n++) {
+      give(&p, 0);
+      take(&p, 1);
+    }
+    uint64_t elapsed = now_ns() - start;
+    pthread_join(tid, NULL);
+    printf("  %-10s %8.0f ns one way\n", i == FUTEX ? "fevent" : "sem_t",
+           elapsed / (2.0 * PINGS));
+    sem_destroy(&p.sem[0]);
+    sem_destroy(&p.sem[1]);
+  }
+}
+
+/* barrier */
+
+static void *barrier_worker(void *arg) {
+  struct shared *s = (struct shared *)arg;
+  flatch_wait(&s->start);
+  for (size_t i = 0; i < s->ops; i++) {
+    int last = s->impl == FUTEX
+                   ? fbarrier_wait(&s->fbarrier)
+                   : pthread_barrier_wait(&s->barrier) ==
+                         PTHREAD_BARRIER_SERIAL_THREAD;
+    if (last) {
+      s->counter++; // one per round, ordered by the barrier
+    }
+  }
+  return NULL;
+}
+
+static void bench_barrier(size_t max_threads) {
+  printf("barrier, %u rounds:\n", ROUNDS);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("  %2zu threads", threads);
+    for (enum impl i = PTHREAD; i < IMPL_NUM; i += 2) {
+      struct shared s = {.impl = i, .threads = threads, .ops = ROUNDS};
+      pthread_barrier_init(&s.barrier, NULL, threads);
+      fbarrier_init(&s.fbarrier, threads);
+      uint64_t elapsed = run(&s, &barrier_worker);
+      printf("  %s %9.0f rounds/s%s", impl_name[i], ROUNDS * 1e9 / elapsed,
+             s.counter == ROUNDS ? "" : " (bad round count!)");
+      pthread_barrier_destroy(&s.barrier);
+    }
+    printf("\n");
+  }
+}
+
+/* once */
+
+static uint64_t inits;
+
+static void init_once(void) { __atomic_fetch_add(&inits, 1, __ATOMIC_RELAXED); }
+
+static void finit_once(void *arg) {
+  (void)arg;
+  init_once();
+}
+
+static void *once_worker(void *arg) {
+  struct shared *s = (struct shared *)arg;
+  flatch_wait(&s->start);
+  for (size_t i = 0; i < s->ops; i++) {
+    if (s->impl == FUTEX) {
+      fonce_call(&s->fonce, &finit_once, NULL);
+    } else {
+      pthread_once(&s->once, &init_once);
+    }
+  }
+  return NULL;
+}
+
+static void bench_once(size_t max_threads, size_t ops) {
+  printf("once, %zu calls:\n", ops);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("  %2zu threads", threads);
+    for (enum impl i = PTHREAD; i < IMPL_NUM; i += 2) {
+      struct shared s = {
+          .impl = i,
+          .threads = threads,
+          .ops = ops / threads,
+          .once = PTHREAD_ONCE_INIT,
+          .fonce = FONCE_INIT,
+      };
+      inits = 0;
+      uint64_t elapsed = run(&s, &once_worker);
+      printf("  %s %11.0f calls/s%s", impl_name[i],
+             s.ops * threads * 1e9 / elapsed,
+             inits == 1 ? "" : " (init ran more than once!)");
+    }
+    printf("\n");
+  }
+}
+
+static void *complete_later(void *arg) {
+  fcompletion_complete((struct fcompletion *)arg, &inits);
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_THREADS;
+  size_t ops = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_OPS;
+  if (!max_threads || !ops) {
+    printf("usage: %s [max threads] [ops]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  bench_mutex(max_threads, ops);
+  bench_handoff();
+  bench_barrier(max_threads);
+  bench_once(max_threads, ops * 10);
+
+  // one-shot handoff of a result, the pthread_attr_demo.c use of sem_t
+  struct fcompletion done = FCOMPLETION_INIT;
+  pthread_t tid;
+  ERROR_CHECK(pthread_create(&tid, NULL, &complete_later, &done), 0);
+  if (fcompletion_wait(&done) != &inits) {
+    printf("fcompletion lost the value\n");
+  }
+  pthread_join(tid, NULL);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include "thread_launch.h"
+
+#include <errno.h>
+
+static void *launch_trampoline(void *arg) {
+  struct thread_launch_slot *slot = (struct thread_launch_slot *)arg;
+  struct thread_launch *l = slot->launch;
+  const void *targ = l->args ? l->args + slot->index * l->arg_size : NULL;
+  void *result = l->results ? l->results + slot->index * l->result_size : NULL;
+  slot->status = l->call(l->fn, targ, result, slot->index);
+  return NULL;
+}
+
+int thread_launch_start(struct thread_launch *launch,
+                        struct thread_launch_slot *slots, size_t num,
+                        const pthread_attr_t *attr, thread_launch_call call,
+                        void (*fn)(void), const void *args, size_t arg_size,
+                        void *results, size_t result_size) {
+  if (!launch || !slots || !call || !fn) {
+    return EINVAL;
+  }
+  launch->slots = slots;
+  launch->num = 0;
+  launch->call = call;
+  launch->fn = fn;
+  launch->args = (const char *)args;
+  launch->arg_size = arg_size;
+  launch->results = (char *)results;
+  launch->result_size = result_size;
+
+  // every field a thread reads is written before its pthread_create()
+  for (size_t i = 0; i < num; i++) {
+    slots[i].launch = launch;
+    slots[i].index = i;
+    slots[i].status = 0;
+    int rc = pthread_create(&slots[i].tid, attr, &launch_trampoline,
+                            &slots[i]);
+    if (rc) {
+      thread_launch_join(launch); // the ones already running
+      return rc;
+    }
+    launch->num++;
+  }
+  return 0;
+}
+
+int thread_launch_join(struct thread_launch *launch) {
+  int first = 0;
+  for (size_t i = 0; i < launch->num; i++) {
+    void *ret;
+    int rc = pthread_join(launch->slots[i].tid, &ret);
+    if (!rc && ret == PTHREAD_CANCELED) {
+      launch->slots[i].status = ECANCELED;
+    }
+    if (!first) {
+      first = rc ? rc : launch->slots[i].status;
+    }
+  }
+  launch->num = 0;
+  return first;
+}
@@ -0,0 +1,80 @@
+/*
+ * Launching N threads with their own typed argument and result slot.
+ *
+ * 01_pthread_basic/pthread_demo.c and 03_pthread_attributes/
+ * pthread_attr_demo.c hand every thread the address of one static int
+ * which the spawning loop overwrites, and usleep(100) so each thread
+ * reads it in time (a race, and 100 us per thread); results come back as
+ * malloc()ed exit codes. A thread_launch instead:
+ *
+ * - passes thread i &args[i] and &results[i], both arrays preallocated
+ *   by the caller, so nothing is shared, nothing is allocated and no
+ *   thread waits for another.
+ * - keeps per thread state in caller provided slots, one per thread
+ *   (an array on the caller's stack will do).
+ * - collects the int returned by every thread function in its slot;
+ *   thread_launch_join() returns the first non-zero one.
+ *
+ * THREAD_LAUNCH_TYPED(name, arg_type, result_type) declares
+ * name_launch(launch, slots, num, attr, fn, args, results) for
+ *   int fn(const arg_type *arg, result_type *result, size_t index)
+ * so arguments and results are type checked.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef THREAD_LAUNCH_H
+#define THREAD_LAUNCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef int (*thread_launch_call)(void (*fn)(void), const void *arg,
+                                  void *result, size_t index);
+
+struct thread_launch;
+
+struct thread_launch_slot {
+  pthread_t tid;
+  struct thread_launch *launch;
+  size_t index;
+  int status; // return value of the thread function
+};
+
+struct thread_launch {
+  struct thread_launch_slot *slots;
+  size_t num; // threads started
+  thread_launch_call call;
+  void (*fn)(void);
+  const char *args;
+  size_t arg_size;
+  char *results;
+  size_t result_size;
+};
+
+// attr may be NULL; untyped, see THREAD_LAUNCH_TYPED()
+int thread_launch_start(struct thread_launch *launch,
+                        struct thread_launch_slot *slots, size_t num,
+                        const pthread_attr_t *attr, thread_launch_call call,
+                        void (*fn)(void), const void *args, size_t arg_size,
+                        void *results, size_t result_size);
+// joins every started thread; the first non-zero status, or 0
+int thread_launch_join(struct thread_launch *launch);
+
+#define THREAD_LAUNCH_TYPED(name, arg_type, result_type)                       \
+  typedef int (*name##_fn)(const arg_type *arg, result_type *result,           \
+                           size_t index);                                      \
+  static inline int name##_call(void (*fn)(void), const void *arg,             \
+                                void *result, size_t index) {                  \
+    return ((name##_fn)fn)((const arg_type *)arg, (result_type *)result,       \
+                           index);                                             \
+  }                                                                            \
+  static inline int name##_launch(                                             \
+      struct thread_launch *launch, struct thread_launch_slot *slots,          \
+      size_t num, const pthread_attr_t *attr, name##_fn fn,                    \
+      const arg_type *args, result_type *results) {                            \
+    return thread_launch_start(launch, slots, num, attr, &name##_call,         \
+                               (void (*)(void))fn, args, sizeof(arg_type),     \
+                               results, sizeof(result_type));                  \
+  }
+
+#endif // THREAD_LAUNCH_H
@@ -0,0 +1,177 @@
+/*
+ * How fast N threads are started and joined, and whether each got its
+ * own argument:
+ * - demo:          the pthread_demo.c loop: one static int arg overwritten
+ *                  per pthread_create(), usleep(100) after each, malloc()ed
+ *                  exit code
+ * - demo no sleep: the same without the usleep(), racing for arg
+ * - thread_launch: typed per-thread args and result slots
+ * - thread_launch 64 KB stacks: same, smaller stacks to map
+ * Every thread reports the task number it saw; "wrong args" counts task
+ * numbers seen by zero or several threads.
+ *
+ * usage: ./thread_launch_bench [threads] [rounds]
+ */
+#include "thread_launch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_THREADS 64U
+#define DEF_ROUNDS 20U
+#define SMALL_STACK (64U * 1024)
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int *seen; // per task number: threads which saw it
+
+/* the demos' way */
+
+static int arg;
+
+static void *demo_thread(void *param) {
+  int *exit_code = malloc(sizeof(int));
+  int task_no = __atomic_load_n((int *)param, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&seen[task_no], 1, __ATOMIC_RELAXED);
+  if (exit_code) {
+    *exit_code = 0;
+  }
+  return exit_code;
+}
+
+static void demo_round(size_t threads, int sleep_us) {
+  pthread_t tids[threads];
+  for (size_t i = 0; i < threads; i++) {
+    __atomic_store_n(&arg, (int)i, __ATOMIC_RELAXED);
+    ERROR_CHECK(pthread_create(&tids[i], NULL, &demo_thread, &arg), 0);
+    if (sleep_us) {
+      usleep(sleep_us);
+    }
+  }
+  for (size_t i = 0; i < threads; i++) {
+    void *exit_code;
+    pthread_join(tids[i], &exit_code);
+    free(exit_code);
+  }
+}
+
+/* thread_launch */
+
+struct task_arg {
+  int task_no;
+};
+
+struct task_result {
+  int twice;
+};
+
+THREAD_LAUNCH_TYPED(task, struct task_arg, struct task_result)
+
+static int task_thread(const struct task_arg *arg, struct task_result *result,
+                       size_t index) {
+  (void)index;
+  __atomic_fetch_add(&seen[arg->task_no], 1, __ATOMIC_RELAXED);
+  result->twice = arg->task_no * 2;
+  return 0;
+}
+
+static void launch_round(size_t threads, const pthread_attr_t *attr,
+                         struct task_arg *args, struct task_result *results,
+                         struct thread_launch_slot *slots) {
+  struct thread_launch launch;
+  ERROR_CHECK(task_launch(&launch, slots, threads, attr, &task_thread, args,
+                          results),
+              0);
+  ERROR_CHECK(thread_launch_join(&launch), 0);
+  for (size_t i = 0; i < threads; i++) {
+    if (results[i].twice != args[i].task_no * 2) {
+      printf("thread %zu: wrong result\n", i);
+    }
+  }
+}
+
+enum method { DEMO, DEMO_NO_SLEEP, LAUNCH, LAUNCH_SMALL_STACK, METHOD_NUM };
+
+static const char *method_name[METHOD_NUM] = {
+    [DEMO] = "demo (usleep(100))",
+    [DEMO_NO_SLEEP] = "demo no sleep",
+    [LAUNCH] = "thread_launch",
+    [LAUNCH_SMALL_STACK] = "thread_launch 64 KB stacks",
+};
+
+int main(int argc, char *argv[]) {
+  size_t threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_THREADS;
+  size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_ROUNDS;
+  if (!threads || !rounds) {
+    printf("usage: %s [threads] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  seen = calloc(threads, sizeof(*seen));
+  struct task_arg *args = calloc(threads, sizeof(*args));
+  struct task_result *results = calloc(threads, sizeof(*results));
+  struct thread_launch_slot *slots = calloc(threads, sizeof(*slots));
+  if (!seen || !args || !results || !slots) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t i = 0; i < threads; i++) {
+    args[i].task_no = (int)i;
+  }
+  pthread_attr_t small;
+  pthread_attr_init(&small);
+  ERROR_CHECK(pthread_attr_setstacksize(&small, SMALL_STACK), 0);
+
+  printf("%zu threads, %zu rounds:\n", threads, rounds);
+  for (enum method m = DEMO; m < METHOD_NUM; m++) {
+    size_t wrong = 0;
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < rounds; r++) {
+      memset(seen, 0, threads * sizeof(*seen));
+      switch (m) {
+      case DEMO:
+        demo_round(threads, 100);
+        break;
+      case DEMO_NO_SLEEP:
+        demo_round(threads, 0);
+        break;
+      case LAUNCH:
+        launch_round(threads, NULL, args, results, slots);
+        break;
+      default:
+        launch_round(threads, &small, args, results, slots);
+      }
+      for (size_t i = 0; i < threads; i++) {
+        wrong += seen[i] != 1;
+      }
+    }
+    uint64_t elapsed = now_ns() - start;
+    printf("  %-28s %9.1f us/round %8.0f ns/thread  %5zu wrong args\n",
+           method_name[m], elapsed / 1e3 / rounds,
+           (double)elapsed / rounds / threads, wrong);
+  }
+  pthread_attr_destroy(&small);
+  free(slots);
+  free(results);
+  free(args);
+  free(seen);
+  return 0;
+}
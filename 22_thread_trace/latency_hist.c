@@ -0,0 +1,71 @@
+#include "latency_hist.h"
+
+#include <string.h>
+
+void latency_hist_init(struct latency_hist *hist) {
+  memset(hist, 0, sizeof(*hist));
+  hist->min = UINT64_MAX;
+}
+
+void latency_hist_merge(struct latency_hist *into,
+                        const struct latency_hist *from) {
+  for (unsigned int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    into->buckets[i] += from->buckets[i];
+  }
+  into->count += from->count;
+  into->sum += from->sum;
+  if (from->min < into->min) {
+    into->min = from->min;
+  }
+  if (from->max > into->max) {
+    into->max = from->max;
+  }
+}
+
+// largest value falling into bucket index
+static uint64_t bucket_top(unsigned int index) {
+  if (index < LATENCY_HIST_SUB) {
+    return index;
+  }
+  unsigned int shift = (index >> LATENCY_HIST_SUB_BITS) - 1;
+  uint64_t sub = (index & (LATENCY_HIST_SUB - 1)) + LATENCY_HIST_SUB;
+  return ((sub + 1) << shift) - 1;
+}
+
+uint64_t latency_hist_percentile(const struct latency_hist *hist,
+                                 double percentile) {
+  if (!hist->count) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      uint64_t top = bucket_top(i);
+      return top < hist->max ? top : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+void latency_hist_print(const struct latency_hist *hist, const char *name,
+                        FILE *out) {
+  if (!hist->count) {
+    fprintf(out, "  %-20s no samples\n", name);
+    return;
+  }
+  fprintf(out,
+          "  %-20s n %8llu  min %6llu  mean %8.0f  p50 %6llu  p90 %6llu  "
+          "p99 %7llu  p99.9 %8llu  max %8llu\n",
+          name, (unsigned long long)hist->count,
+          (unsigned long long)hist->min, (double)hist->sum / hist->count,
+          (unsigned long long)latency_hist_percentile(hist, 50),
+          (unsigned long long)latency_hist_percentile(hist, 90),
+          (unsigned long long)latency_hist_percentile(hist, 99),
+          (unsigned long long)latency_hist_percentile(hist, 99.9),
+          (unsigned long long)hist->max);
+}
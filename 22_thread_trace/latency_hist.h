@@ -0,0 +1,62 @@
+/*
+ * HDR style latency histogram.
+ *
+ * Values (ns, or any unit) are counted in log-linear buckets: every power
+ * of two range is split into 2^LATENCY_HIST_SUB_BITS equal sub-buckets,
+ * so any value is kept with a relative error below 1/32 (3%), from 1 ns
+ * up to 2^64, in a fixed 15 KB array. Recording is an index computation
+ * and an increment, no allocation, no lock: keep one histogram per
+ * thread and latency_hist_merge() them when done.
+ */
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LATENCY_HIST_SUB_BITS 5U
+#define LATENCY_HIST_SUB (1U << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_BUCKETS                                                   \
+  ((64U - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB)
+
+struct latency_hist {
+  uint64_t count;
+  uint64_t min, max;
+  uint64_t sum;
+  uint64_t buckets[LATENCY_HIST_BUCKETS];
+};
+
+void latency_hist_init(struct latency_hist *hist);
+
+static inline unsigned int latency_hist_index(uint64_t value) {
+  if (value < LATENCY_HIST_SUB) {
+    return (unsigned int)value;
+  }
+  unsigned int shift = 63 - __builtin_clzll(value) - LATENCY_HIST_SUB_BITS;
+  return ((shift + 1) << LATENCY_HIST_SUB_BITS) +
+         (unsigned int)(value >> shift) - LATENCY_HIST_SUB;
+}
+
+static inline void latency_hist_record(struct latency_hist *hist,
+                                       uint64_t value) {
+  hist->buckets[latency_hist_index(value)]++;
+  hist->count++;
+  hist->sum += value;
+  if (value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+}
+
+void latency_hist_merge(struct latency_hist *into,
+                        const struct latency_hist *from);
+// value at percentile (0..100], the upper end of its bucket
+uint64_t latency_hist_percentile(const struct latency_hist *hist,
+                                 double percentile);
+// count, min, mean, p50, p90, p99, p99.9, max on one line
+void latency_hist_print(const struct latency_hist *hist, const char *name,
+                        FILE *out);
+
+#endif // LATENCY_HIST_H
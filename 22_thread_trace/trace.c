@@ -0,0 +1,220 @@
+// for syscall(), gettid
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#define CALIBRATE_NS 10000000ULL // first tsc to ns estimate over 10 ms
+
+static struct {
+  size_t capacity;
+  enum trace_clock clock;
+  uint64_t generation; // bumped by init: thread buffers of older ones are gone
+  struct trace_buffer *buffers;
+  uint64_t tick0, ns0;
+} session;
+
+static __thread struct trace_buffer *self_buf;
+static __thread uint64_t self_generation;
+
+static const char *type_name[TRACE_TYPE_NUM] = {
+    [TRACE_SPAWN] = "spawn", [TRACE_START] = "start",
+    [TRACE_CANCEL] = "cancel", [TRACE_EXIT] = "exit",
+    [TRACE_JOIN] = "join", [TRACE_BEGIN] = "begin",
+    [TRACE_END] = "end", [TRACE_INSTANT] = "instant",
+};
+
+static uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t trace_now(void) {
+#if HAVE_TSC
+  if (session.clock == TRACE_CLOCK_TSC) {
+    return __rdtsc();
+  }
+#endif
+  return mono_ns();
+}
+
+double trace_ns_per_tick(void) {
+  if (session.clock != TRACE_CLOCK_TSC) {
+    return 1.0;
+  }
+  // the longer the interval since init, the better the estimate
+  uint64_t ticks = trace_now() - session.tick0;
+  return ticks ? (double)(mono_ns() - session.ns0) / ticks : 1.0;
+}
+
+int trace_init(size_t capacity, enum trace_clock clock) {
+  if (!capacity || (capacity & (capacity - 1))) {
+    return EINVAL; // must be a power of two
+  }
+  if (clock == TRACE_CLOCK_TSC && !HAVE_TSC) {
+    clock = TRACE_CLOCK_MONOTONIC;
+  }
+  session.capacity = capacity;
+  session.clock = clock;
+  session.buffers = NULL;
+  __atomic_fetch_add(&session.generation, 1, __ATOMIC_RELEASE);
+  session.tick0 = trace_now();
+  session.ns0 = mono_ns();
+  if (clock == TRACE_CLOCK_TSC) {
+    struct timespec nap = {0, CALIBRATE_NS};
+    nanosleep(&nap, NULL);
+  }
+  return 0;
+}
+
+void trace_shutdown(void) {
+  struct trace_buffer *b = __atomic_exchange_n(&session.buffers, NULL,
+                                               __ATOMIC_ACQUIRE);
+  while (b) {
+    struct trace_buffer *next = b->next;
+    free(b);
+    b = next;
+  }
+  __atomic_fetch_add(&session.generation, 1, __ATOMIC_RELEASE);
+}
+
+static struct trace_buffer *buffer_create(void) {
+  struct trace_buffer *b =
+      malloc(sizeof(*b) + session.capacity * sizeof(b->events[0]));
+  if (!b) {
+    return NULL;
+  }
+  b->tid = (int)syscall(SYS_gettid);
+  snprintf(b->name, sizeof(b->name), "thread %d", b->tid);
+  b->mask = session.capacity - 1;
+  b->head = 0;
+  b->next = __atomic_load_n(&session.buffers, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&session.buffers, &b->next, b, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  self_buf = b;
+  self_generation = __atomic_load_n(&session.generation, __ATOMIC_ACQUIRE);
+  return b;
+}
+
+static struct trace_buffer *self_buffer(void) {
+  if (self_buf &&
+      self_generation ==
+          __atomic_load_n(&session.generation, __ATOMIC_RELAXED)) {
+    return self_buf;
+  }
+  return session.capacity ? buffer_create() : NULL;
+}
+
+int trace_thread_init(const char *name) {
+  struct trace_buffer *b = self_buffer();
+  if (!b) {
+    return session.capacity ? ENOMEM : EINVAL;
+  }
+  if (name) {
+    snprintf(b->name, sizeof(b->name), "%s", name);
+  }
+  return 0;
+}
+
+void trace_record_at(enum trace_type type, const char *name, uint64_t arg,
+                     uint64_t ts) {
+  struct trace_buffer *b = self_buffer();
+  if (!b) {
+    return; // no memory: the event is lost
+  }
+  uint64_t head = __atomic_load_n(&b->head, __ATOMIC_RELAXED);
+  struct trace_event *e = &b->events[head & b->mask];
+  e->ts = ts;
+  e->name = name;
+  e->arg = arg;
+  e->type = type;
+  __atomic_store_n(&b->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_counts(uint64_t *recorded, uint64_t *overwritten) {
+  *recorded = *overwritten = 0;
+  for (struct trace_buffer *b =
+           __atomic_load_n(&session.buffers, __ATOMIC_ACQUIRE);
+       b; b = b->next) {
+    uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    *recorded += head;
+    *overwritten += head > b->mask + 1 ? head - b->mask - 1 : 0;
+  }
+}
+
+/* chrome trace JSON */
+
+static void json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', out);
+    }
+    if ((unsigned char)*s >= 0x20) {
+      fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+int trace_dump_chrome(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    return errno;
+  }
+  double ns_per_tick = trace_ns_per_tick();
+  int pid = getpid(), first = 1;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (struct trace_buffer *b =
+           __atomic_load_n(&session.buffers, __ATOMIC_ACQUIRE);
+       b; b = b->next) {
+    fprintf(out,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",", pid, b->tid);
+    json_string(out, b->name);
+    fprintf(out, "}}");
+    first = 0;
+
+    uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    uint64_t from = head > b->mask + 1 ? head - b->mask - 1 : 0;
+    for (uint64_t i = from; i < head; i++) {
+      const struct trace_event *e = &b->events[i & b->mask];
+      const char *type =
+          e->type < TRACE_TYPE_NUM ? type_name[e->type] : "?"; // garbled
+      const char *ph = e->type == TRACE_BEGIN ? "B"
+                       : e->type == TRACE_END ? "E"
+                                              : "i";
+      double us =
+          (double)(int64_t)(e->ts - session.tick0) * ns_per_tick / 1e3;
+      fprintf(out, ",\n{\"name\":");
+      json_string(out, e->name ? e->name : type);
+      fprintf(out,
+              ",\"cat\":\"%s\",\"ph\":\"%s\",%s\"ts\":%.3f,\"pid\":%d,"
+              "\"tid\":%d,\"args\":{\"arg\":%llu}}",
+              type, ph, *ph == 'i' ? "\"s\":\"t\"," : "", us, pid, b->tid,
+              (unsigned long long)e->arg);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  int rc = ferror(out) ? EIO : 0;
+  if (fclose(out) && !rc) {
+    rc = errno;
+  }
+  return rc;
+}
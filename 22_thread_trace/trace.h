@@ -0,0 +1,85 @@
+/*
+ * Per-thread event tracing.
+ *
+ * hello_thread_function() in 01_pthread_basic/pthread_demo.c and
+ * print_attr() in 03_pthread_attributes/pthread_attr_demo.c report what
+ * they do with printf(): every call takes stdout's lock, so the threads
+ * queue up on it and the timings they print include each other. Here a
+ * thread records an event by writing 32 bytes into its own buffer:
+ *
+ * - one ring buffer per thread, allocated on its first event (or by
+ *   trace_thread_init()), written by that thread only: no lock, no atomic
+ *   read-modify-write, just a release store of the head. When full, the
+ *   oldest events are overwritten (a flight recorder).
+ * - timestamps from rdtsc on x86 (TRACE_CLOCK_TSC), converted to ns
+ *   against CLOCK_MONOTONIC when dumped, or clock_gettime() directly.
+ * - thread life cycle events (spawn, start, cancel, exit, join), spans
+ *   (begin/end) and instants, each with a static name and a 64 bit arg.
+ * - trace_dump_chrome(): JSON for chrome://tracing or ui.perfetto.dev.
+ *
+ * Buffers outlive their threads until trace_shutdown(), so a dump after
+ * the joins sees everything. Dump while threads still record and the
+ * events being overwritten at that moment may come out garbled.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum trace_clock { TRACE_CLOCK_TSC, TRACE_CLOCK_MONOTONIC };
+
+enum trace_type {
+  TRACE_SPAWN, // recorded by the parent, arg: child's index
+  TRACE_START,
+  TRACE_CANCEL,
+  TRACE_EXIT,
+  TRACE_JOIN, // recorded by the parent, arg: child's index
+  TRACE_BEGIN,
+  TRACE_END,
+  TRACE_INSTANT,
+  TRACE_TYPE_NUM
+};
+
+struct trace_event {
+  uint64_t ts; // clock ticks
+  const char *name;
+  uint64_t arg;
+  uint32_t type;
+};
+
+struct trace_buffer {
+  struct trace_buffer *next;
+  int tid;
+  char name[16];
+  size_t mask;
+  uint64_t head; // events written, release stored by the owner
+  struct trace_event events[];
+};
+
+// capacity: events per thread, a power of two
+int trace_init(size_t capacity, enum trace_clock clock);
+void trace_shutdown(void);
+
+// names the calling thread and allocates its buffer up front
+int trace_thread_init(const char *name);
+
+uint64_t trace_now(void);
+void trace_record_at(enum trace_type type, const char *name, uint64_t arg,
+                     uint64_t ts);
+static inline void trace_record(enum trace_type type, const char *name,
+                                uint64_t arg) {
+  trace_record_at(type, name, arg, trace_now());
+}
+
+// ticks of trace_now() to ns
+double trace_ns_per_tick(void);
+
+// events recorded (and lost to wrapping) over all threads
+void trace_counts(uint64_t *recorded, uint64_t *overwritten);
+
+int trace_dump_chrome(const char *path);
+
+#endif // TRACE_H
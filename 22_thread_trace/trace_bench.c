@@ -0,0 +1,238 @@
+/*
+ * Cost of tracing, and a traced version of the pthread_demo.c life cycle.
+ *
+ * - overhead: cpu ns per trace_record() with the tsc (next to a bare
+ *   rdtsc, the floor) and CLOCK_MONOTONIC clocks and per
+ *   latency_hist_record(), against fprintf() of the same event to
+ *   /dev/null, from 1..N threads (fprintf() shares the FILE lock)
+ * - demo: threads are spawned, start, run timed work spans, and half of
+ *   them cancel themselves while the rest exit (like hello_thread_function);
+ *   the parent records spawn and join. Work latencies are kept in per
+ *   thread histograms, merged at the end, and the whole run is dumped as
+ *   Chrome trace JSON (kept if a path is given, else removed).
+ *
+ * usage: ./trace_bench [max threads] [trace.json]
+ */
+#define _GNU_SOURCE
+
+#include "latency_hist.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_MAX_THREADS 8U
+#define EVENTS 1000000U // per thread, overhead runs
+#define CAPACITY 65536U // events per thread buffer
+#define WORK_ITEMS 2000U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* overhead */
+
+enum method { CLOCK, TRACE, HIST, FPRINTF, METHOD_NUM };
+
+struct overhead {
+  enum method method;
+  FILE *devnull;
+  uint64_t elapsed; // cpu time of the thread, not disturbed by the others
+  uint64_t sink;
+};
+
+static uint64_t thread_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *record_events(void *arg) {
+  struct overhead *o = (struct overhead *)arg;
+  struct latency_hist *hist = malloc(sizeof(*hist));
+  if (!hist) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  latency_hist_init(hist);
+  trace_thread_init(NULL); // buffer allocation outside the timing
+  uint64_t start = thread_cpu_ns();
+  for (uint64_t i = 0; i < EVENTS; i++) {
+    switch (o->method) {
+    case CLOCK:
+      o->sink += trace_now();
+      break;
+    case TRACE:
+      trace_record(TRACE_INSTANT, "tick", i);
+      break;
+    case HIST:
+      latency_hist_record(hist, i & 0xffff);
+      break;
+    default:
+      fprintf(o->devnull, "%llu instant tick %llu\n",
+              (unsigned long long)now_ns(), (unsigned long long)i);
+    }
+  }
+  o->elapsed = thread_cpu_ns() - start;
+  free(hist);
+  return NULL;
+}
+
+static double overhead_run(enum method method, size_t threads, FILE *devnull) {
+  pthread_t tids[threads];
+  struct overhead o[threads];
+  for (size_t t = 0; t < threads; t++) {
+    o[t] = (struct overhead){.method = method, .devnull = devnull};
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &record_events, &o[t]), 0);
+  }
+  uint64_t elapsed = 0;
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    elapsed += o[t].elapsed;
+  }
+  return (double)elapsed / threads / EVENTS;
+}
+
+static void bench_overhead(size_t max_threads) {
+  FILE *devnull = fopen("/dev/null", "w");
+  if (!devnull) {
+    ERROR_CHECK(errno, 0);
+  }
+  printf("cpu ns per event (%u events per thread):\n", EVENTS);
+  printf("  threads  rdtsc  trace tsc  trace mono  hist record  fprintf\n");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    double ns[5];
+    ERROR_CHECK(trace_init(CAPACITY, TRACE_CLOCK_TSC), 0);
+    ns[0] = overhead_run(CLOCK, threads, devnull);
+    ns[1] = overhead_run(TRACE, threads, devnull);
+    trace_shutdown();
+    ERROR_CHECK(trace_init(CAPACITY, TRACE_CLOCK_MONOTONIC), 0);
+    ns[2] = overhead_run(TRACE, threads, devnull);
+    ns[3] = overhead_run(HIST, threads, devnull);
+    ns[4] = overhead_run(FPRINTF, threads, devnull);
+    trace_shutdown();
+    printf("  %7zu %6.1f %10.1f %11.1f %12.1f %8.1f\n", threads, ns[0],
+           ns[1], ns[2], ns[3], ns[4]);
+  }
+  fclose(devnull);
+}
+
+/* demo */
+
+struct worker {
+  size_t index;
+  struct latency_hist hist;
+};
+
+static void record_cancel(void *arg) {
+  trace_record(TRACE_CANCEL, NULL, ((struct worker *)arg)->index);
+}
+
+static void *traced_thread(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  char name[16];
+  snprintf(name, sizeof(name), "task no %zu", w->index);
+  trace_thread_init(name);
+  trace_record(TRACE_START, NULL, w->index);
+  pthread_cleanup_push(&record_cancel, w);
+
+  unsigned int seed = (unsigned int)w->index;
+  double ns_per_tick = trace_ns_per_tick();
+  volatile uint64_t sink = 0;
+  for (size_t i = 0; i < WORK_ITEMS; i++) {
+    uint64_t start = trace_now();
+    trace_record_at(TRACE_BEGIN, "work", i, start);
+    for (unsigned int n = rand_r(&seed) % 2000; n; n--) {
+      sink += n;
+    }
+    uint64_t end = trace_now();
+    trace_record_at(TRACE_END, "work", i, end);
+    latency_hist_record(&w->hist, (uint64_t)((end - start) * ns_per_tick));
+  }
+
+  if (!(w->index % 2)) { // even ones cancel, like the demo
+    pthread_cancel(pthread_self());
+    pthread_testcancel();
+  }
+  pthread_cleanup_pop(0);
+  trace_record(TRACE_EXIT, NULL, w->index);
+  return NULL;
+}
+
+static void demo(size_t threads, const char *keep) {
+  ERROR_CHECK(trace_init(CAPACITY, TRACE_CLOCK_TSC), 0);
+  trace_thread_init("main");
+  pthread_t tids[threads];
+  struct worker *workers = calloc(threads, sizeof(*workers));
+  if (!workers) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t t = 0; t < threads; t++) {
+    workers[t].index = t;
+    latency_hist_init(&workers[t].hist);
+    trace_record(TRACE_SPAWN, NULL, t);
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &traced_thread, &workers[t]),
+                0);
+  }
+  struct latency_hist all;
+  latency_hist_init(&all);
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    trace_record(TRACE_JOIN, NULL, t);
+    latency_hist_merge(&all, &workers[t].hist);
+  }
+
+  printf("demo, %zu threads x %u work spans, latency in ns:\n", threads,
+         WORK_ITEMS);
+  latency_hist_print(&workers[0].hist, "task no 0", stdout);
+  latency_hist_print(&all, "all threads", stdout);
+
+  char path[64];
+  snprintf(path, sizeof(path), "%d-trace.json", getpid());
+  const char *out = keep ? keep : path;
+  uint64_t recorded, overwritten, start = now_ns();
+  ERROR_CHECK(trace_dump_chrome(out), 0);
+  uint64_t elapsed = now_ns() - start;
+  trace_counts(&recorded, &overwritten);
+  struct stat st;
+  ERROR_CHECK(stat(out, &st) ? errno : 0, 0);
+  printf("  %llu events (%llu overwritten), %lld bytes of JSON in %.1f ms "
+         "-> %s\n",
+         (unsigned long long)recorded, (unsigned long long)overwritten,
+         (long long)st.st_size, elapsed / 1e6, keep ? out : "removed");
+  if (!keep) {
+    unlink(out);
+  }
+  trace_shutdown();
+  free(workers);
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_THREADS;
+  if (!max_threads) {
+    printf("usage: %s [max threads] [trace.json]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  bench_overhead(max_threads);
+  demo(max_threads, argc > 2 ? argv[2] : NULL);
+  return 0;
+}
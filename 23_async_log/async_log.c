@@ -0,0 +1,348 @@
+// for syscall(), gettid
+#define _GNU_SOURCE
+
+#include "async_log.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DRAIN_BUFFERS 64U // per writev(), two iovecs each (ring wrap)
+
+struct log_buffer {
+  struct log_buffer *next;
+  int retired;                  // its thread is gone
+  struct log_stats stats;       // written by the owner, relaxed atomics
+  size_t mask;
+  _Alignas(64) uint64_t head;   // bytes published by the owner
+  _Alignas(64) uint64_t tail;   // bytes written out by the drainer
+  _Alignas(64) char data[];
+};
+
+static __thread int self_tid;
+
+static void count(uint64_t *counter, uint64_t n) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+                   __ATOMIC_RELAXED); // single writer
+}
+
+static void retire_buffer(void *arg) {
+  struct log_buffer *b = (struct log_buffer *)arg;
+  __atomic_store_n(&b->retired, 1, __ATOMIC_RELEASE);
+}
+
+static struct log_buffer *self_buffer(struct logger *log) {
+  struct log_buffer *b = pthread_getspecific(log->key);
+  if (b) {
+    return b;
+  }
+  b = aligned_alloc(64, sizeof(*b) + log->buf_size);
+  if (!b) {
+    return NULL;
+  }
+  memset(b, 0, sizeof(*b));
+  b->mask = log->buf_size - 1;
+  if (pthread_setspecific(log->key, b)) {
+    free(b);
+    return NULL;
+  }
+  pthread_mutex_lock(&log->lock);
+  b->next = log->buffers;
+  log->buffers = b;
+  pthread_mutex_unlock(&log->lock);
+  return b;
+}
+
+static size_t room(struct log_buffer *b) {
+  uint64_t tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+  return b->mask + 1 - (b->head - tail);
+}
+
+static void wake_drainer(struct logger *log) {
+  pthread_mutex_lock(&log->lock);
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->lock);
+}
+
+int log_printf(struct logger *log, const char *fmt, ...) {
+  struct log_buffer *b = self_buffer(log);
+  if (!b) {
+    return ENOMEM;
+  }
+  if (!self_tid) {
+    self_tid = (int)syscall(SYS_gettid); // once per thread, not per line
+  }
+
+  char line[LOG_LINE_MAX];
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  int len = snprintf(line, sizeof(line), "[%lld.%06ld] [%d] ",
+                     (long long)ts.tv_sec, ts.tv_nsec / 1000, self_tid);
+  va_list ap;
+  va_start(ap, fmt);
+  int body = vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+  va_end(ap);
+  if (body < 0) {
+    return EINVAL;
+  }
+  len = len + body < (int)sizeof(line) ? len + body : (int)sizeof(line) - 1;
+  if (line[len - 1] != '\n') { // terminate (truncated) lines
+    if (len == (int)sizeof(line) - 1) {
+      len--;
+    }
+    line[len++] = '\n';
+  }
+
+  if (__atomic_load_n(&log->error, __ATOMIC_RELAXED)) {
+    count(&b->stats.dropped, 1);
+    return __atomic_load_n(&log->error, __ATOMIC_RELAXED);
+  }
+  if (room(b) < (size_t)len) {
+    if (log->policy == LOG_DROP) {
+      count(&b->stats.dropped, 1);
+      // an awake drainer is on its way already: no lock per dropped line
+      if (__atomic_load_n(&log->sleeping, __ATOMIC_RELAXED)) {
+        wake_drainer(log);
+      }
+      return EAGAIN;
+    }
+    count(&b->stats.blocked, 1);
+    pthread_mutex_lock(&log->lock);
+    pthread_cond_signal(&log->wake);
+    while (room(b) < (size_t)len && !log->error) {
+      pthread_cond_wait(&log->room, &log->lock);
+    }
+    int err = log->error;
+    pthread_mutex_unlock(&log->lock);
+    if (err) {
+      count(&b->stats.dropped, 1);
+      return err;
+    }
+  }
+
+  size_t at = b->head & b->mask, first = b->mask + 1 - at;
+  if (first >= (size_t)len) {
+    memcpy(b->data + at, line, len);
+  } else { // wraps around
+    memcpy(b->data + at, line, first);
+    memcpy(b->data, line + first, len - first);
+  }
+  __atomic_store_n(&b->head, b->head + len, __ATOMIC_RELEASE);
+  count(&b->stats.lines, 1);
+  count(&b->stats.bytes, len);
+  if (room(b) < (b->mask + 1) / 2 &&
+      __atomic_load_n(&log->sleeping, __ATOMIC_RELAXED)) {
+    wake_drainer(log);
+  }
+  return 0;
+}
+
+/* drainer */
+
+static int write_all(int fd, struct iovec *iov, int cnt, uint64_t *writes) {
+  while (cnt) {
+    ssize_t n = writev(fd, iov, cnt);
+    (*writes)++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    for (; cnt && (size_t)n >= iov->iov_len; iov++, cnt--) {
+      n -= iov->iov_len;
+    }
+    if (cnt) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static void add_stats(struct log_stats *into, struct log_stats *from) {
+  into->lines += __atomic_load_n(&from->lines, __ATOMIC_RELAXED);
+  into->bytes += __atomic_load_n(&from->bytes, __ATOMIC_RELAXED);
+  into->dropped += __atomic_load_n(&from->dropped, __ATOMIC_RELAXED);
+  into->blocked += __atomic_load_n(&from->blocked, __ATOMIC_RELAXED);
+}
+
+// one writev() of what the buffers hold, up to DRAIN_BUFFERS of them from
+// where the last pass stopped, so the ones at the list end get their turn
+// too; returns the bytes drained, *end: the pass reached the list end
+static size_t drain_pass(struct logger *log, int *end) {
+  struct iovec iov[2 * DRAIN_BUFFERS];
+  struct log_buffer *bufs[DRAIN_BUFFERS];
+  uint64_t heads[DRAIN_BUFFERS];
+  size_t num = 0, cnt = 0, bytes = 0;
+
+  // buffers are only freed by this thread, so the pointers stay valid
+  // after unlocking; new ones are added at the list head
+  pthread_mutex_lock(&log->lock);
+  struct log_buffer *b = log->cursor ? log->cursor : log->buffers;
+  for (; b && num < DRAIN_BUFFERS; b = b->next) {
+    uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = b->tail;
+    if (head == tail) {
+      continue;
+    }
+    size_t at = tail & b->mask, len = head - tail;
+    size_t first = b->mask + 1 - at < len ? b->mask + 1 - at : len;
+    iov[cnt++] = (struct iovec){b->data + at, first};
+    if (first < len) {
+      iov[cnt++] = (struct iovec){b->data, len - first};
+    }
+    bufs[num] = b;
+    heads[num++] = head;
+    bytes += len;
+  }
+  log->cursor = b; // NULL: the next pass starts a sweep from the head
+  *end = !b;
+  pthread_mutex_unlock(&log->lock);
+
+  uint64_t writes = 0;
+  int rc = cnt ? write_all(log->fd, iov, (int)cnt, &writes) : 0;
+  for (size_t i = 0; i < num; i++) {
+    __atomic_store_n(&bufs[i]->tail, heads[i], __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_lock(&log->lock);
+  log->writes += writes;
+  if (rc && !log->error) {
+    __atomic_store_n(&log->error, rc, __ATOMIC_RELAXED);
+  }
+  // free the buffers of exited threads once they are empty
+  for (struct log_buffer **pb = &log->buffers; *pb;) {
+    struct log_buffer *b = *pb;
+    if (__atomic_load_n(&b->retired, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) == b->tail) {
+      *pb = b->next;
+      if (log->cursor == b) {
+        log->cursor = b->next;
+      }
+      add_stats(&log->retired, &b->stats);
+      free(b);
+    } else {
+      pb = &b->next;
+    }
+  }
+  log->drained += *end;
+  pthread_cond_broadcast(&log->room);
+  pthread_mutex_unlock(&log->lock);
+  return bytes;
+}
+
+static void *drainer(void *arg) {
+  struct logger *log = (struct logger *)arg;
+  size_t bytes = 0; // in this sweep over the buffers
+  for (;;) {
+    int end;
+    bytes += drain_pass(log, &end);
+    if (!end) {
+      continue; // idle or stopping is decided on whole sweeps
+    }
+    pthread_mutex_lock(&log->lock);
+    if (!bytes && log->stopping) {
+      pthread_mutex_unlock(&log->lock);
+      break;
+    }
+    if (!bytes && !log->flushers) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_nsec += LOG_DRAIN_INTERVAL_NS;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      __atomic_store_n(&log->sleeping, 1, __ATOMIC_RELAXED);
+      pthread_cond_timedwait(&log->wake, &log->lock, &deadline);
+      __atomic_store_n(&log->sleeping, 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&log->lock);
+    bytes = 0;
+  }
+  return NULL;
+}
+
+/* setup */
+
+int logger_init(struct logger *log, int fd, size_t buf_size,
+                enum log_policy policy) {
+  if (!log || fd < 0 || buf_size < 2 * LOG_LINE_MAX ||
+      (buf_size & (buf_size - 1))) {
+    return EINVAL;
+  }
+  memset(log, 0, sizeof(*log));
+  log->fd = fd;
+  log->buf_size = buf_size;
+  log->policy = policy;
+  int rc = pthread_key_create(&log->key, &retire_buffer);
+  if (rc) {
+    return rc;
+  }
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&log->wake, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&log->room, NULL);
+  rc = pthread_create(&log->drainer, NULL, &drainer, log);
+  if (rc) {
+    pthread_cond_destroy(&log->room);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->lock);
+    pthread_key_delete(log->key);
+  }
+  return rc;
+}
+
+void logger_destroy(struct logger *log) {
+  pthread_mutex_lock(&log->lock);
+  log->stopping = 1;
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->drainer, NULL);
+
+  while (log->buffers) {
+    struct log_buffer *b = log->buffers;
+    log->buffers = b->next;
+    free(b);
+  }
+  pthread_key_delete(log->key);
+  pthread_cond_destroy(&log->room);
+  pthread_cond_destroy(&log->wake);
+  pthread_mutex_destroy(&log->lock);
+}
+
+int logger_flush(struct logger *log) {
+  pthread_mutex_lock(&log->lock);
+  // a sweep running now may have looked at our buffer already: wait for
+  // the one after it
+  uint64_t target = log->drained + 2;
+  log->flushers++;
+  pthread_cond_signal(&log->wake);
+  while (log->drained < target) {
+    pthread_cond_wait(&log->room, &log->lock);
+  }
+  log->flushers--;
+  int rc = log->error;
+  pthread_mutex_unlock(&log->lock);
+  return rc;
+}
+
+void logger_get_stats(struct logger *log, struct log_stats *stats) {
+  pthread_mutex_lock(&log->lock);
+  *stats = log->retired;
+  for (struct log_buffer *b = log->buffers; b; b = b->next) {
+    add_stats(stats, &b->stats);
+  }
+  stats->writes = log->writes;
+  pthread_mutex_unlock(&log->lock);
+}
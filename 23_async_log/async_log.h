@@ -0,0 +1,85 @@
+/*
+ * Asynchronous logging: threads format, one background thread writes.
+ *
+ * hello_thread_function() in 01_pthread_basic/pthread_demo.c printf()s on
+ * every iteration: stdio's lock serializes all the threads, and each call
+ * may end in a write() of its own. With a logger:
+ *
+ * - log_printf() formats the line (with a timestamp and the cached tid)
+ *   into the calling thread's own ring buffer; no lock, no syscall, one
+ *   release store to publish it. Buffers are created on a thread's first
+ *   line and drained and freed after the thread exits (pthread key
+ *   destructor).
+ * - a drainer thread gathers whatever the buffers hold into iovecs and
+ *   writes them with one writev() per pass, to a file or stdout. A pass
+ *   takes up to 64 buffers and the next one goes on from there, so with
+ *   more threads every buffer still gets its turn.
+ *   It wakes up every LOG_DRAIN_INTERVAL_NS, or when a buffer gets half
+ *   full.
+ * - memory is bounded by buf_size per thread. When a buffer is full:
+ *     LOG_DROP:  the line is dropped and counted, log_printf() returns
+ *                EAGAIN; the hot path never waits
+ *     LOG_BLOCK: the thread waits for the drainer to make room
+ * - logger_flush() returns once everything logged before it is written.
+ *
+ * Lines of one thread keep their order; lines of different threads are
+ * interleaved per drain pass, use the timestamps to merge them.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_LINE_MAX 512U
+#define LOG_DRAIN_INTERVAL_NS 5000000U // 5 ms
+
+enum log_policy { LOG_DROP, LOG_BLOCK };
+
+struct log_buffer;
+
+struct log_stats {
+  uint64_t lines;
+  uint64_t bytes;
+  uint64_t dropped;
+  uint64_t blocked; // times a thread had to wait for room
+  uint64_t writes;  // writev() calls
+};
+
+struct logger {
+  int fd;
+  enum log_policy policy;
+  size_t buf_size;
+  pthread_key_t key; // thread -> its log_buffer, to retire it at exit
+
+  pthread_mutex_t lock; // buffer list, drainer sleep, blocked writers
+  pthread_cond_t wake;  // drainer
+  pthread_cond_t room;  // blocked writers, logger_flush()
+  struct log_buffer *buffers;
+  struct log_buffer *cursor; // where the next drain pass starts, NULL: head
+  pthread_t drainer;
+  int stopping;
+  int sleeping;
+  int flushers;     // threads in logger_flush(), keep draining
+  uint64_t drained; // completed sweeps of the drain passes over buffers
+  int error;        // first write error, lines are dropped from then on
+
+  struct log_stats retired; // of freed buffers
+  uint64_t writes;
+};
+
+// buf_size: bytes per thread, a power of two of at least 2 * LOG_LINE_MAX
+int logger_init(struct logger *log, int fd, size_t buf_size,
+                enum log_policy policy);
+// drains everything, then stops the drainer; no more log_printf() after
+void logger_destroy(struct logger *log);
+
+int log_printf(struct logger *log, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+int logger_flush(struct logger *log);
+void logger_get_stats(struct logger *log, struct log_stats *stats);
+
+#endif // ASYNC_LOG_H
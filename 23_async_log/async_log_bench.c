@@ -0,0 +1,180 @@
+/*
+ * Log lines/s from 1..N threads: stdio vs. the async logger.
+ *
+ * Every thread logs its share of the lines, formatted like the
+ * hello_thread_function() output of 01_pthread_basic/pthread_demo.c, to a
+ * file through:
+ * - fprintf() line buffered: what printf() to a terminal does, one
+ *   write() per line under the FILE lock (plus gettid() per line, as the
+ *   demo does)
+ * - fprintf() fully buffered: printf() to a file or pipe
+ * - log_printf(), LOG_DROP and LOG_BLOCK
+ * Reported: lines/s while the threads log, and including the time until
+ * everything is on disk (flush), lines dropped, and syscalls.
+ *
+ * usage: ./async_log_bench [max threads] [lines] [buffer KB per thread]
+ */
+#define _GNU_SOURCE
+
+#include "async_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_MAX_THREADS 64U
+#define DEF_LINES 400000U
+#define DEF_BUF_KB 64U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum method { STDIO_LINE, STDIO_FULL, ASYNC_DROP, ASYNC_BLOCK, METHOD_NUM };
+
+static const char *method_name[METHOD_NUM] = {
+    [STDIO_LINE] = "fprintf line buffered",
+    [STDIO_FULL] = "fprintf fully buffered",
+    [ASYNC_DROP] = "log_printf LOG_DROP",
+    [ASYNC_BLOCK] = "log_printf LOG_BLOCK",
+};
+
+struct worker {
+  enum method method;
+  FILE *file;
+  struct logger *log;
+  int task_no;
+  size_t lines;
+};
+
+static void *log_lines(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  for (size_t i = 0; i < w->lines; i++) {
+    if (w->method == STDIO_LINE || w->method == STDIO_FULL) {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      fprintf(w->file, "[%lld.%06ld] [%ld] task no %d: counter %zu\n",
+              (long long)ts.tv_sec, ts.tv_nsec / 1000, syscall(SYS_gettid),
+              w->task_no, i);
+    } else {
+      log_printf(w->log, "task no %d: counter %zu\n", w->task_no, i);
+    }
+  }
+  return NULL;
+}
+
+static void bench(enum method method, size_t threads, size_t lines,
+                  size_t buf_size) {
+  char path[64];
+  snprintf(path, sizeof(path), "%d-log.txt", getpid());
+  int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_APPEND, 0644);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  FILE *file = NULL;
+  struct logger log;
+  if (method == STDIO_LINE || method == STDIO_FULL) {
+    file = fdopen(fd, "w");
+    if (!file) {
+      ERROR_CHECK(errno, 0);
+    }
+    setvbuf(file, NULL, method == STDIO_LINE ? _IOLBF : _IOFBF, BUFSIZ);
+  } else {
+    ERROR_CHECK(logger_init(&log, fd, buf_size,
+                            method == ASYNC_DROP ? LOG_DROP : LOG_BLOCK),
+                0);
+  }
+
+  pthread_t tids[threads];
+  struct worker workers[threads];
+  uint64_t start = now_ns();
+  for (size_t t = 0; t < threads; t++) {
+    workers[t] = (struct worker){
+        .method = method,
+        .file = file,
+        .log = &log,
+        .task_no = (int)t,
+        .lines = lines / threads,
+    };
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &log_lines, &workers[t]), 0);
+  }
+  for (size_t t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  uint64_t logged = now_ns() - start;
+
+  struct log_stats st = {0};
+  if (file) {
+    fflush(file);
+  } else {
+    ERROR_CHECK(logger_flush(&log), 0);
+    logger_get_stats(&log, &st);
+  }
+  uint64_t flushed = now_ns() - start;
+  if (file) {
+    fclose(file);
+  } else {
+    logger_destroy(&log);
+    close(fd);
+  }
+
+  struct stat sb;
+  ERROR_CHECK(stat(path, &sb) ? errno : 0, 0);
+  unlink(path);
+  size_t total = lines / threads * threads;
+  printf("  %-23s %2zu threads %10.0f lines/s %10.0f flushed",
+         method_name[method], threads, total * 1e9 / logged,
+         total * 1e9 / flushed);
+  if (!file) {
+    printf("  %7llu dropped %6llu writev %4.0f KB/writev",
+           (unsigned long long)st.dropped, (unsigned long long)st.writes,
+           st.writes ? sb.st_size / 1024.0 / st.writes : 0.0);
+    if ((uint64_t)sb.st_size != st.bytes) {
+      printf("  (file %lld bytes, logged %llu!)", (long long)sb.st_size,
+             (unsigned long long)st.bytes);
+    }
+  }
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_THREADS;
+  size_t lines = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_LINES;
+  size_t buf_kb = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_BUF_KB;
+  size_t buf_size = buf_kb * 1024;
+  if (!max_threads || !lines || buf_size < 2 * LOG_LINE_MAX ||
+      (buf_size & (buf_size - 1))) {
+    printf("usage: %s [max threads] [lines] [buffer KB per thread, power of "
+           "two]\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf("%zu lines, %zu KB buffer per thread:\n", lines, buf_kb);
+  for (enum method m = STDIO_LINE; m < METHOD_NUM; m++) {
+    for (size_t threads = 1; threads <= max_threads; threads *= 4) {
+      bench(m, threads, lines, buf_size);
+    }
+  }
+  return 0;
+}
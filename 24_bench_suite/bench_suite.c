@@ -0,0 +1,663 @@
+/*
+ * Non-interactive benchmarks of what the first four chapters demo.
+ *
+ * pthread_demo.c and file_operation_demo.c are walkthroughs: they sleep,
+ * printf() and wait on getchar(), and the Makefiles build them with
+ * different flags. This runs the same operations in tight loops, all
+ * built with the same flags, for every thread count asked for:
+ * - spawn_join:  pthread_create() + pthread_join() of N threads
+ *                (01_pthread_basic)
+ * - tsd_get:     pthread_getspecific() of the hello_key TSD, and tls_get,
+ *                the __thread variable it is compared to there
+ * - sem_handoff: ping-pong between thread pairs over two sem_t, like the
+ *                detached thread sync of 03_pthread_attributes (one pair
+ *                for 1 thread), iterations / 10 round trips per pair;
+ *                its rows give the threads that ran (2 per pair)
+ * - file_write, file_read: one file per thread, written and fsync()ed,
+ *                then read back in blocks from the page cache
+ *                (04_file_operation)
+ * - readdir:     opendir()/readdir() loop over a directory of entries,
+ *                by every thread
+ * tsd_get and tls_get report cpu time, the others wall time from the
+ * first thread's start to the last one's end.
+ *
+ * Every case is repeated, and min/median/mean/max of the repeats are
+ * printed as a table, CSV or JSON (for regression tracking: keep the
+ * files, diff the medians). Several formats from one run: -f csv,json
+ * -o base writes base.csv and base.json.
+ *
+ * usage: ./bench_suite [-t threads,...] [-s file bytes] [-b block bytes]
+ *                      [-n dir entries] [-i iterations] [-r repeats]
+ *                      [-c case,...] [-f text|csv|json,...] [-o out file]
+ *        sizes take a K, M or G suffix
+ */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_THREADS "1,4,16"
+#define DEF_FILE_SIZE (8U << 20)
+#define DEF_BLOCK_SIZE (64U << 10)
+#define DEF_ENTRIES 1000U
+#define DEF_ITERATIONS 1000000U
+#define DEF_REPEATS 5U
+#define MAX_THREAD_COUNTS 16U
+#define MAX_REPEATS 100U
+#define SPAWN_ROUNDS 100U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct output {
+  enum { TEXT, CSV, JSON } format;
+  FILE *file;
+};
+
+struct config {
+  size_t threads[MAX_THREAD_COUNTS];
+  size_t thread_counts;
+  size_t file_size;
+  size_t block_size;
+  size_t entries;
+  size_t iterations;
+  size_t repeats;
+  const char *cases;
+  struct output outputs[3]; // one per format
+  size_t output_num;
+};
+
+/* runner: threads start together, the run lasts from the first start to
+ * the last end */
+
+struct run;
+typedef void (*run_fn)(struct run *run, size_t index);
+
+struct run {
+  const struct config *cfg;
+  run_fn fn;
+  size_t threads;
+  pthread_barrier_t start;
+  char dir[64];
+  sem_t *sems; // sem_handoff: two per pair
+  uint64_t first_start, last_end;
+  uint64_t cpu_ns; // summed over the threads
+  pthread_mutex_t lock;
+};
+
+struct runner_arg {
+  struct run *run;
+  size_t index;
+};
+
+static uint64_t thread_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *runner(void *arg) {
+  struct runner_arg *a = (struct runner_arg *)arg;
+  struct run *run = a->run;
+  pthread_barrier_wait(&run->start);
+  uint64_t start = now_ns(), cpu = thread_cpu_ns();
+  run->fn(run, a->index);
+  cpu = thread_cpu_ns() - cpu;
+  uint64_t end = now_ns();
+  pthread_mutex_lock(&run->lock);
+  run->cpu_ns += cpu;
+  if (!run->first_start || start < run->first_start) {
+    run->first_start = start;
+  }
+  if (end > run->last_end) {
+    run->last_end = end;
+  }
+  pthread_mutex_unlock(&run->lock);
+  return NULL;
+}
+
+static uint64_t run_threads(struct run *run) {
+  pthread_t tids[run->threads];
+  struct runner_arg args[run->threads];
+  run->first_start = run->last_end = run->cpu_ns = 0;
+  ERROR_CHECK(pthread_barrier_init(&run->start, NULL, (unsigned)run->threads),
+              0);
+  for (size_t t = 0; t < run->threads; t++) {
+    args[t] = (struct runner_arg){run, t};
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &runner, &args[t]), 0);
+  }
+  for (size_t t = 0; t < run->threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  pthread_barrier_destroy(&run->start);
+  return run->last_end - run->first_start;
+}
+
+/* cases */
+
+static void *empty_thread(void *arg) { return arg; }
+
+static double spawn_join(struct run *run) {
+  pthread_t tids[run->threads];
+  uint64_t start = now_ns();
+  for (size_t r = 0; r < SPAWN_ROUNDS; r++) {
+    for (size_t t = 0; t < run->threads; t++) {
+      ERROR_CHECK(pthread_create(&tids[t], NULL, &empty_thread, NULL), 0);
+    }
+    for (size_t t = 0; t < run->threads; t++) {
+      pthread_join(tids[t], NULL);
+    }
+  }
+  return (double)(now_ns() - start) / (SPAWN_ROUNDS * run->threads);
+}
+
+static pthread_key_t tsd_key;
+static __thread int tls_task_no;
+static int sink; // keeps the loops, written with relaxed stores
+
+static void tsd_thread(struct run *run, size_t index) {
+  int task_no = (int)index;
+  pthread_setspecific(tsd_key, &task_no);
+  int sum = 0;
+  for (size_t i = 0; i < run->cfg->iterations; i++) {
+    sum += *(int *)pthread_getspecific(tsd_key);
+    __asm__ volatile("" ::: "memory"); // one lookup per iteration
+  }
+  __atomic_store_n(&sink, sum, __ATOMIC_RELAXED);
+}
+
+static void tls_thread(struct run *run, size_t index) {
+  tls_task_no = (int)index;
+  int sum = 0;
+  for (size_t i = 0; i < run->cfg->iterations; i++) {
+    sum += tls_task_no;
+    __asm__ volatile("" ::: "memory");
+  }
+  __atomic_store_n(&sink, sum, __ATOMIC_RELAXED);
+}
+
+static void handoff_thread(struct run *run, size_t index) {
+  sem_t *mine = &run->sems[index], *other = &run->sems[index ^ 1];
+  for (size_t i = 0; i < run->cfg->iterations / 10; i++) {
+    if (index & 1) {
+      while (sem_wait(mine))
+        ;
+      sem_post(other);
+    } else {
+      sem_post(other);
+      while (sem_wait(mine))
+        ;
+    }
+  }
+}
+
+static void file_path(struct run *run, size_t index, char *path, size_t len) {
+  snprintf(path, len, "%s/file-%zu", run->dir, index);
+}
+
+static void write_thread(struct run *run, size_t index) {
+  char path[96];
+  file_path(run, index, path, sizeof(path));
+  int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  char *block = malloc(run->cfg->block_size);
+  if (!block) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  memset(block, 'a' + (int)(index % 26), run->cfg->block_size);
+  for (size_t done = 0; done < run->cfg->file_size;) {
+    size_t len = run->cfg->file_size - done < run->cfg->block_size
+                     ? run->cfg->file_size - done
+                     : run->cfg->block_size;
+    ssize_t n = write(fd, block, len);
+    if (n < 0) {
+      ERROR_CHECK(errno, 0);
+    }
+    done += (size_t)n;
+  }
+  ERROR_CHECK(fsync(fd) ? errno : 0, 0);
+  close(fd);
+  free(block);
+}
+
+static void read_thread(struct run *run, size_t index) {
+  char path[96];
+  file_path(run, index, path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  char *block = malloc(run->cfg->block_size);
+  if (!block) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  ssize_t n;
+  while ((n = read(fd, block, run->cfg->block_size)) > 0) {
+  }
+  if (n < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  close(fd);
+  free(block);
+}
+
+static void readdir_thread(struct run *run, size_t index) {
+  (void)index;
+  char path[96];
+  snprintf(path, sizeof(path), "%s/entries", run->dir);
+  DIR *dir = opendir(path);
+  if (!dir) {
+    ERROR_CHECK(errno, 0);
+  }
+  size_t count = 0;
+  while (readdir(dir)) {
+    count++;
+  }
+  closedir(dir);
+  __atomic_store_n(&sink, (int)count, __ATOMIC_RELAXED);
+}
+
+static void make_entries(struct run *run) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/entries", run->dir);
+  ERROR_CHECK(mkdir(path, 0755) ? errno : 0, 0);
+  for (size_t i = 0; i < run->cfg->entries; i++) {
+    snprintf(path, sizeof(path), "%s/entries/entry-%zu", run->dir, i);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    if (fd < 0) {
+      ERROR_CHECK(errno, 0);
+    }
+    close(fd);
+  }
+}
+
+static void remove_files(struct run *run) {
+  char path[128];
+  for (size_t i = 0; i < run->cfg->entries; i++) {
+    snprintf(path, sizeof(path), "%s/entries/entry-%zu", run->dir, i);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/entries", run->dir);
+  rmdir(path);
+  for (size_t t = 0; t < run->threads; t++) {
+    file_path(run, t, path, sizeof(path));
+    unlink(path);
+  }
+  rmdir(run->dir);
+}
+
+/* results */
+
+struct result {
+  const char *name;
+  const char *unit;
+  size_t threads;
+  size_t param; // bytes or entries the case worked on, 0 if none
+  double values[MAX_REPEATS];
+};
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void print_result(const struct config *cfg, struct result *res,
+                         int first) {
+  size_t n = cfg->repeats;
+  qsort(res->values, n, sizeof(double), cmp_double);
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += res->values[i];
+  }
+  double median = n % 2 ? res->values[n / 2]
+                        : (res->values[n / 2 - 1] + res->values[n / 2]) / 2;
+  double min = res->values[0], max = res->values[n - 1], mean = sum / n;
+
+  for (size_t o = 0; o < cfg->output_num; o++) {
+    FILE *f = cfg->outputs[o].file;
+    switch (cfg->outputs[o].format) {
+    case TEXT:
+      fprintf(f, "  %-12s %7zu %10zu %-10s %12.1f %12.1f %12.1f %12.1f\n",
+              res->name, res->threads, res->param, res->unit, min, median,
+              mean, max);
+      break;
+    case CSV:
+      fprintf(f, "%s,%zu,%zu,%s,%zu,%.3f,%.3f,%.3f,%.3f\n", res->name,
+              res->threads, res->param, res->unit, n, min, median, mean, max);
+      break;
+    case JSON:
+      fprintf(f,
+              "%s    {\"case\": \"%s\", \"threads\": %zu, \"param\": %zu, "
+              "\"unit\": \"%s\", \"repeats\": %zu, \"min\": %.3f, "
+              "\"median\": %.3f, \"mean\": %.3f, \"max\": %.3f}",
+              first ? "" : ",\n", res->name, res->threads, res->param,
+              res->unit, n, min, median, mean, max);
+      break;
+    }
+  }
+}
+
+static void print_header(const struct config *cfg) {
+  struct utsname un;
+  uname(&un);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (size_t o = 0; o < cfg->output_num; o++) {
+    FILE *f = cfg->outputs[o].file;
+    switch (cfg->outputs[o].format) {
+    case TEXT:
+      fprintf(f, "%s %s, %ld cpus, %zu repeats:\n", un.sysname, un.release,
+              cpus, cfg->repeats);
+      fprintf(f, "  %-12s %7s %10s %-10s %12s %12s %12s %12s\n", "case",
+              "threads", "param", "unit", "min", "median", "mean", "max");
+      break;
+    case CSV:
+      fprintf(f, "case,threads,param,unit,repeats,min,median,mean,max\n");
+      break;
+    case JSON:
+      fprintf(f,
+              "{\n  \"system\": \"%s %s %s\",\n  \"cpus\": %ld,\n  "
+              "\"timestamp\": %lld,\n  \"results\": [\n",
+              un.sysname, un.release, un.machine, cpus, (long long)time(NULL));
+      break;
+    }
+  }
+}
+
+static void print_footer(const struct config *cfg) {
+  for (size_t o = 0; o < cfg->output_num; o++) {
+    if (cfg->outputs[o].format == JSON) {
+      fprintf(cfg->outputs[o].file, "\n  ]\n}\n");
+    }
+  }
+}
+
+/* driver */
+
+static int selected(const struct config *cfg, const char *name) {
+  if (!cfg->cases) {
+    return 1;
+  }
+  size_t len = strlen(name);
+  for (const char *c = cfg->cases; (c = strstr(c, name)); c += len) {
+    if ((c == cfg->cases || c[-1] == ',') && (!c[len] || c[len] == ',')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void bench_threads(const struct config *cfg, size_t threads,
+                          int *first) {
+  struct run run = {.cfg = cfg, .threads = threads};
+  pthread_mutex_init(&run.lock, NULL);
+  snprintf(run.dir, sizeof(run.dir), "%d-bench", getpid());
+  ERROR_CHECK(mkdir(run.dir, 0755) ? errno : 0, 0);
+
+  // sem_handoff runs whole pairs: the threads it reports are those
+  size_t pairs = threads > 1 ? threads / 2 : 1;
+  struct result res[7] = {
+      {"spawn_join", "ns/thread", threads, 0, {0}},
+      {"tsd_get", "ns/op", threads, 0, {0}},
+      {"tls_get", "ns/op", threads, 0, {0}},
+      {"sem_handoff", "ns/handoff", 2 * pairs, 0, {0}},
+      {"file_write", "MB/s", threads, cfg->file_size, {0}},
+      {"file_read", "MB/s", threads, cfg->file_size, {0}},
+      {"readdir", "entries/s", threads, cfg->entries, {0}},
+  };
+  int want[7];
+  for (size_t i = 0; i < 7; i++) {
+    want[i] = selected(cfg, res[i].name);
+  }
+  if (want[6]) {
+    make_entries(&run);
+  }
+  sem_t sems[2 * pairs];
+  run.sems = sems;
+  double mb = (double)cfg->file_size * threads / (1 << 20);
+  for (size_t r = 0; r < cfg->repeats; r++) {
+    if (want[0]) {
+      res[0].values[r] = spawn_join(&run);
+    }
+    // cpu time per access: with more threads than cpus, wall time would
+    // count the other threads' time slices too
+    double ops = (double)cfg->iterations * threads;
+    if (want[1]) {
+      run.fn = &tsd_thread;
+      run_threads(&run);
+      res[1].values[r] = run.cpu_ns / ops;
+    }
+    if (want[2]) {
+      run.fn = &tls_thread;
+      run_threads(&run);
+      res[2].values[r] = run.cpu_ns / ops;
+    }
+    if (want[3]) {
+      for (size_t s = 0; s < 2 * pairs; s++) {
+        sem_init(&sems[s], 0, 0);
+      }
+      run.fn = &handoff_thread;
+      run.threads = 2 * pairs;
+      double handoffs = (double)(cfg->iterations / 10) * 2 * pairs;
+      res[3].values[r] = run_threads(&run) / handoffs;
+      run.threads = threads;
+      for (size_t s = 0; s < 2 * pairs; s++) {
+        sem_destroy(&sems[s]);
+      }
+    }
+    if (want[4] || want[5]) { // file_read reads what file_write wrote
+      run.fn = &write_thread;
+      res[4].values[r] = mb * 1e9 / run_threads(&run);
+    }
+    if (want[5]) {
+      run.fn = &read_thread;
+      res[5].values[r] = mb * 1e9 / run_threads(&run);
+    }
+    if (want[6]) {
+      run.fn = &readdir_thread;
+      res[6].values[r] =
+          (double)(cfg->entries + 2) * threads * 1e9 / run_threads(&run);
+    }
+  }
+
+  for (size_t i = 0; i < 7; i++) {
+    if (want[i]) {
+      print_result(cfg, &res[i], *first);
+      *first = 0;
+    }
+  }
+  remove_files(&run);
+  pthread_mutex_destroy(&run.lock);
+}
+
+static int parse_size(const char *s, size_t *out) {
+  char *end;
+  unsigned long long v = strtoull(s, &end, 0);
+  switch (*end) {
+  case 'G':
+  case 'g':
+    v <<= 10; // fall through
+  case 'M':
+  case 'm':
+    v <<= 10; // fall through
+  case 'K':
+  case 'k':
+    v <<= 10;
+    end++;
+    break;
+  }
+  if (*end || !v) {
+    return EINVAL;
+  }
+  *out = (size_t)v;
+  return 0;
+}
+
+static int parse_threads(const char *s, struct config *cfg) {
+  cfg->thread_counts = 0;
+  while (*s) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if (!v || end == s || cfg->thread_counts == MAX_THREAD_COUNTS) {
+      return EINVAL;
+    }
+    cfg->threads[cfg->thread_counts++] = v;
+    s = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',') {
+      return EINVAL;
+    }
+  }
+  return cfg->thread_counts ? 0 : EINVAL;
+}
+
+static const char *const format_names[] = {"text", "csv", "json"};
+#define FORMAT_NUM (sizeof(format_names) / sizeof(format_names[0]))
+
+static int parse_formats(const char *s, struct config *cfg) {
+  cfg->output_num = 0;
+  while (*s) {
+    size_t len = strcspn(s, ",");
+    size_t f = 0;
+    while (f < FORMAT_NUM && (strlen(format_names[f]) != len ||
+                              strncmp(s, format_names[f], len))) {
+      f++;
+    }
+    if (f == FORMAT_NUM) {
+      return EINVAL;
+    }
+    for (size_t o = 0; o < cfg->output_num; o++) {
+      if (cfg->outputs[o].format == f) {
+        return EINVAL;
+      }
+    }
+    cfg->outputs[cfg->output_num++].format = f;
+    s += len + (s[len] == ',');
+  }
+  return cfg->output_num ? 0 : EINVAL;
+}
+
+// one format: to out_path as is; several: to out_path.<format> each
+static int open_outputs(struct config *cfg, const char *out_path) {
+  for (size_t o = 0; o < cfg->output_num; o++) {
+    struct output *out = &cfg->outputs[o];
+    out->file = stdout;
+    if (!out_path) {
+      continue;
+    }
+    char path[PATH_MAX];
+    int len = cfg->output_num == 1
+                  ? snprintf(path, sizeof(path), "%s", out_path)
+                  : snprintf(path, sizeof(path), "%s.%s", out_path,
+                             format_names[out->format]);
+    if (len >= (int)sizeof(path)) {
+      return ENAMETOOLONG;
+    }
+    if (!(out->file = fopen(path, "w"))) {
+      return errno;
+    }
+    printf("results -> %s\n", path);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct config cfg = {
+      .file_size = DEF_FILE_SIZE,
+      .block_size = DEF_BLOCK_SIZE,
+      .entries = DEF_ENTRIES,
+      .iterations = DEF_ITERATIONS,
+      .repeats = DEF_REPEATS,
+      .outputs = {{.format = TEXT}},
+      .output_num = 1,
+  };
+  const char *out_path = NULL;
+  int bad = parse_threads(DEF_THREADS, &cfg);
+  int opt;
+  while ((opt = getopt(argc, argv, "t:s:b:n:i:r:c:f:o:")) != -1) {
+    switch (opt) {
+    case 't':
+      bad |= parse_threads(optarg, &cfg);
+      break;
+    case 's':
+      bad |= parse_size(optarg, &cfg.file_size);
+      break;
+    case 'b':
+      bad |= parse_size(optarg, &cfg.block_size);
+      break;
+    case 'n':
+      bad |= parse_size(optarg, &cfg.entries);
+      break;
+    case 'i':
+      bad |= parse_size(optarg, &cfg.iterations);
+      break;
+    case 'r':
+      bad |= parse_size(optarg, &cfg.repeats);
+      break;
+    case 'c':
+      cfg.cases = optarg;
+      break;
+    case 'f':
+      bad |= parse_formats(optarg, &cfg);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    default:
+      bad = 1;
+    }
+  }
+  if (bad || optind != argc || cfg.repeats > MAX_REPEATS ||
+      cfg.iterations < 10) {
+    printf("usage: %s [-t threads,...] [-s file bytes] [-b block bytes]\n"
+           "       [-n dir entries] [-i iterations] [-r repeats (max %u)]\n"
+           "       [-c case,...] [-f text|csv|json,...] [-o out file]\n"
+           "cases: spawn_join tsd_get tls_get sem_handoff file_write "
+           "file_read readdir\n",
+           argv[0], MAX_REPEATS);
+    return EXIT_FAILURE;
+  }
+  int rc = open_outputs(&cfg, out_path);
+  ERROR_CHECK(rc, 0);
+
+  ERROR_CHECK(pthread_key_create(&tsd_key, NULL), 0);
+  print_header(&cfg);
+  int first = 1;
+  for (size_t i = 0; i < cfg.thread_counts; i++) {
+    bench_threads(&cfg, cfg.threads[i], &first);
+  }
+  print_footer(&cfg);
+  pthread_key_delete(tsd_key);
+  for (size_t o = 0; o < cfg.output_num; o++) {
+    if (cfg.outputs[o].file != stdout) {
+      fclose(cfg.outputs[o].file);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,224 @@
+#include "checksum.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82f63b78U // reflected Castagnoli polynomial
+
+/* crc32c, tables */
+
+static uint32_t crc_table[8][256];
+static int crc_hw;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init(void) {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = n;
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc_table[0][n] = crc;
+  }
+  for (uint32_t n = 0; n < 256; n++) {
+    for (int k = 1; k < 8; k++) {
+      crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^
+                        crc_table[0][crc_table[k - 1][n] & 0xff];
+    }
+  }
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  crc_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+  pthread_once(&crc_once, &crc32c_init);
+  const unsigned char *p = data;
+  crc = ~crc;
+  for (; len && ((uintptr_t)p & 7); len--) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+  }
+  for (; len >= 8; len -= 8, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, 8); // little endian
+    word ^= crc;
+    crc = crc_table[7][word & 0xff] ^ crc_table[6][(word >> 8) & 0xff] ^
+          crc_table[5][(word >> 16) & 0xff] ^
+          crc_table[4][(word >> 24) & 0xff] ^
+          crc_table[3][(word >> 32) & 0xff] ^
+          crc_table[2][(word >> 40) & 0xff] ^
+          crc_table[1][(word >> 48) & 0xff] ^ crc_table[0][word >> 56];
+  }
+  for (; len; len--) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+  }
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const void *data, size_t len) {
+  const unsigned char *p = data;
+  uint64_t crc64 = ~crc;
+  for (; len && ((uintptr_t)p & 7); len--) {
+    crc64 = _mm_crc32_u8((uint32_t)crc64, *p++);
+  }
+  for (; len >= 8; len -= 8, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  for (; len; len--) {
+    crc64 = _mm_crc32_u8((uint32_t)crc64, *p++);
+  }
+  return ~(uint32_t)crc64;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+  pthread_once(&crc_once, &crc32c_init);
+#if defined(__x86_64__)
+  if (crc_hw) {
+    return crc32c_hw(crc, data, len);
+  }
+#endif
+  return crc32c_sw(crc, data, len);
+}
+
+const char *crc32c_impl(void) {
+  pthread_once(&crc_once, &crc32c_init);
+  return crc_hw ? "sse4.2" : "table";
+}
+
+/* crc32c_combine: appending len2 zero bytes to A is a linear operator on
+ * crc(A), applied by squaring a 32x32 GF(2) matrix (as zlib does) */
+
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec; vec >>= 1, mat++) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+  }
+  return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = gf2_times(mat, mat[n]);
+  }
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  if (!len2) {
+    return crc1 ^ crc2;
+  }
+  uint32_t even[32], odd[32]; // operators for 2^k zero bits
+  odd[0] = CRC32C_POLY;       // one zero bit
+  for (int n = 1; n < 32; n++) {
+    odd[n] = 1U << (n - 1);
+  }
+  gf2_square(even, odd); // two zero bits
+  gf2_square(odd, even); // four zero bits
+  // first pass: one zero byte, then two, four...
+  for (;;) {
+    gf2_square(even, odd);
+    if (len2 & 1) {
+      crc1 = gf2_times(even, crc1);
+    }
+    if (!(len2 >>= 1)) {
+      break;
+    }
+    gf2_square(odd, even);
+    if (len2 & 1) {
+      crc1 = gf2_times(odd, crc1);
+    }
+    if (!(len2 >>= 1)) {
+      break;
+    }
+  }
+  return crc1 ^ crc2;
+}
+
+void crc32c_combine_gen(uint32_t op[32], uint64_t len2) {
+  // the operator is linear: its columns are the images of the basis
+  for (int n = 0; n < 32; n++) {
+    op[n] = crc32c_combine(1U << n, 0, len2);
+  }
+}
+
+/* xxh64 */
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_P2;
+  return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+  const unsigned char *p = data, *end = p + len;
+  uint64_t h;
+  if (len >= 32) {
+    uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed,
+             v4 = seed - XXH_P1;
+    for (; end - p >= 32; p += 32) { // four lanes, no dependency between
+      v1 = xxh_round(v1, read64(p));
+      v2 = xxh_round(v2, read64(p + 8));
+      v3 = xxh_round(v3, read64(p + 16));
+      v4 = xxh_round(v4, read64(p + 24));
+    }
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh_merge(h, v1);
+    h = xxh_merge(h, v2);
+    h = xxh_merge(h, v3);
+    h = xxh_merge(h, v4);
+  } else {
+    h = seed + XXH_P5;
+  }
+  h += len;
+  for (; end - p >= 8; p += 8) {
+    h ^= xxh_round(0, read64(p));
+    h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+  }
+  if (end - p >= 4) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    h ^= v * XXH_P1;
+    h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * XXH_P5;
+    h = rotl64(h, 11) * XXH_P1;
+  }
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
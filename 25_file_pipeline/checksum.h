@@ -0,0 +1,43 @@
+/*
+ * CRC32C and XXH64 checksums of file chunks.
+ *
+ * - crc32c(): the SSE4.2 crc32 instruction, 8 bytes per step, when the
+ *   cpu has it (checked once at run time); slicing-by-8 tables otherwise.
+ *   Same conventions as zlib's crc32(): start with 0 and pass the
+ *   previous value to continue over more data.
+ * - crc32c_combine(): crc of A||B from crc(A), crc(B) and len(B), so
+ *   chunks checksummed out of order on several threads give the crc of
+ *   the whole file (crc32c_combine_gen() once per chunk size makes that
+ *   cheap).
+ * - xxh64(): XXH64 with four independent 64-bit lanes; no combine, a
+ *   chunked file gets a hash chained over its chunk hashes instead.
+ */
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+// the portable table version, for comparison
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+// the same for many B of one length: op is computed once (32 combines),
+// then applying it is 32 steps instead of a matrix squaring per bit
+void crc32c_combine_gen(uint32_t op[32], uint64_t len2);
+static inline uint32_t crc32c_combine_op(const uint32_t op[32], uint32_t crc1,
+                                         uint32_t crc2) {
+  uint32_t sum = 0;
+  for (int n = 0; crc1; crc1 >>= 1, n++) {
+    if (crc1 & 1) {
+      sum ^= op[n];
+    }
+  }
+  return sum ^ crc2;
+}
+// "sse4.2" or "table"
+const char *crc32c_impl(void);
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,324 @@
+// for copy_file_range()
+#define _GNU_SOURCE
+
+#include "file_pipeline.h"
+#include "checksum.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// one per chunk in flight: chunk index uses slot index % depth, so the
+// reader can only run depth chunks ahead of the oldest unfinished one,
+// and the checksums are combined in file order as chunks finish
+struct chunk_slot {
+  struct pipeline *pipe;
+  char *buf;
+  uint64_t index;
+  off_t offset;
+  size_t len;
+  int has_data; // buf holds the chunk
+  int done;
+  uint64_t sum;
+};
+
+struct pipeline {
+  const struct pipe_opts *opts;
+  int in_fd;
+  int out_fd;
+  size_t depth;
+  struct chunk_slot *slots;
+
+  pthread_mutex_t lock;
+  pthread_cond_t advanced; // next moved
+  uint64_t next;           // chunks below are finished and combined
+  uint64_t checksum;
+  uint32_t crc_op[32]; // crc32c_combine() for a full chunk
+  int error;
+
+  pthread_mutex_t out_lock; // sendfile() writes at the file position
+  struct pipe_stats stats;  // *_ns and fallbacks, atomics
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add(uint64_t *counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/* io */
+
+static int pread_full(int fd, char *buf, size_t len, off_t offset) {
+  while (len) {
+    ssize_t n = pread(fd, buf, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (!n) {
+      return EIO; // the file shrank under us
+    }
+    buf += n;
+    len -= (size_t)n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int pwrite_full(int fd, const char *buf, size_t len, off_t offset) {
+  while (len) {
+    ssize_t n = pwrite(fd, buf, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    buf += n;
+    len -= (size_t)n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int copy_range(struct pipeline *pipe, struct chunk_slot *slot) {
+  loff_t in_off = slot->offset, out_off = slot->offset;
+  size_t left = slot->len;
+  while (left) {
+    ssize_t n = copy_file_range(pipe->in_fd, &in_off, pipe->out_fd, &out_off,
+                                left, 0);
+    if (n > 0) {
+      left -= (size_t)n;
+      continue;
+    }
+    if (!n) {
+      return EIO;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EXDEV && errno != EOPNOTSUPP && errno != ENOSYS &&
+        errno != EINVAL) {
+      return errno;
+    }
+    // not for this pair of files: the rest through the buffer
+    add(&pipe->stats.fallbacks, 1);
+    size_t done = slot->len - left;
+    if (!slot->has_data) {
+      int rc = pread_full(pipe->in_fd, slot->buf + done, left, in_off);
+      if (rc) {
+        return rc;
+      }
+    }
+    return pwrite_full(pipe->out_fd, slot->buf + done, left, out_off);
+  }
+  return 0;
+}
+
+static int send_chunk(struct pipeline *pipe, struct chunk_slot *slot) {
+  off_t in_off = slot->offset;
+  size_t left = slot->len;
+  int rc = 0;
+  pthread_mutex_lock(&pipe->out_lock);
+  if (lseek(pipe->out_fd, slot->offset, SEEK_SET) < 0) {
+    rc = errno;
+  }
+  while (!rc && left) {
+    ssize_t n = sendfile(pipe->out_fd, pipe->in_fd, &in_off, left);
+    if (n > 0) {
+      left -= (size_t)n;
+    } else if (!n) {
+      rc = EIO;
+    } else if (errno != EINTR) {
+      rc = errno;
+    }
+  }
+  pthread_mutex_unlock(&pipe->out_lock);
+  return rc;
+}
+
+/* stages */
+
+// under lock: fold the finished chunks at the front into the checksum
+static void combine(struct pipeline *pipe) {
+  for (;;) {
+    struct chunk_slot *slot = &pipe->slots[pipe->next % pipe->depth];
+    if (!slot->done || slot->index != pipe->next) {
+      break;
+    }
+    if (pipe->opts->sum == PIPE_SUM_CRC32C) {
+      uint32_t crc = (uint32_t)pipe->checksum, sum = (uint32_t)slot->sum;
+      if (!slot->index) {
+        crc = sum;
+      } else if (slot->len == pipe->opts->chunk_size) {
+        crc = crc32c_combine_op(pipe->crc_op, crc, sum);
+      } else { // the short last chunk
+        crc = crc32c_combine(crc, sum, slot->len);
+      }
+      pipe->checksum = crc;
+    } else if (pipe->opts->sum == PIPE_SUM_XXH64) {
+      uint64_t pair[2] = {pipe->checksum, slot->sum};
+      pipe->checksum = xxh64(pair, sizeof(pair), 0);
+    }
+    slot->done = 0;
+    pipe->next++;
+  }
+}
+
+static void chunk_task(void *arg) {
+  struct chunk_slot *slot = (struct chunk_slot *)arg;
+  struct pipeline *pipe = slot->pipe;
+  const struct pipe_opts *opts = pipe->opts;
+  int rc = 0;
+  uint64_t start = now_ns();
+
+  if (opts->sum != PIPE_SUM_NONE && !slot->has_data) {
+    rc = pread_full(pipe->in_fd, slot->buf, slot->len, slot->offset);
+    slot->has_data = !rc;
+    uint64_t end = now_ns();
+    add(&pipe->stats.read_ns, end - start);
+    start = end;
+  }
+  if (!rc && opts->sum != PIPE_SUM_NONE) {
+    slot->sum = opts->sum == PIPE_SUM_CRC32C
+                    ? crc32c(0, slot->buf, slot->len)
+                    : xxh64(slot->buf, slot->len, 0);
+    uint64_t end = now_ns();
+    add(&pipe->stats.sum_ns, end - start);
+    start = end;
+  }
+  if (!rc && opts->copy != PIPE_COPY_NONE) {
+    switch (opts->copy) {
+    case PIPE_COPY_PWRITE:
+      rc = pwrite_full(pipe->out_fd, slot->buf, slot->len, slot->offset);
+      break;
+    case PIPE_COPY_RANGE:
+      rc = copy_range(pipe, slot);
+      break;
+    default:
+      rc = send_chunk(pipe, slot);
+    }
+    add(&pipe->stats.write_ns, now_ns() - start);
+  }
+
+  pthread_mutex_lock(&pipe->lock);
+  if (rc && !pipe->error) {
+    pipe->error = rc;
+  }
+  slot->done = 1;
+  combine(pipe);
+  pthread_cond_broadcast(&pipe->advanced);
+  pthread_mutex_unlock(&pipe->lock);
+}
+
+/* setup */
+
+int file_pipeline_run(struct thread_pool *pool, int in_fd, int out_fd,
+                      const struct pipe_opts *opts, struct pipe_stats *stats) {
+  if (!pool || in_fd < 0 || !opts || !opts->chunk_size ||
+      (opts->copy != PIPE_COPY_NONE && out_fd < 0)) {
+    return EINVAL;
+  }
+  struct stat st;
+  if (fstat(in_fd, &st)) {
+    return errno;
+  }
+  if (opts->copy != PIPE_COPY_NONE && ftruncate(out_fd, st.st_size)) {
+    return errno;
+  }
+
+  struct pipeline pipe = {
+      .opts = opts,
+      .in_fd = in_fd,
+      .out_fd = out_fd,
+      .depth = opts->depth ? opts->depth : 2 * pool->worker_num,
+  };
+  uint64_t chunks = ((uint64_t)st.st_size + opts->chunk_size - 1) /
+                    opts->chunk_size;
+  pipe.slots = calloc(pipe.depth, sizeof(*pipe.slots));
+  if (!pipe.slots) {
+    return ENOMEM;
+  }
+  int rc = 0;
+  for (size_t i = 0; i < pipe.depth && !rc; i++) {
+    pipe.slots[i].pipe = &pipe;
+    pipe.slots[i].buf = aligned_alloc(4096, (opts->chunk_size + 4095) &
+                                                ~(size_t)4095);
+    rc = pipe.slots[i].buf ? 0 : ENOMEM;
+  }
+  if (opts->sum == PIPE_SUM_CRC32C) {
+    crc32c_combine_gen(pipe.crc_op, opts->chunk_size);
+  }
+  pthread_mutex_init(&pipe.lock, NULL);
+  pthread_cond_init(&pipe.advanced, NULL);
+  pthread_mutex_init(&pipe.out_lock, NULL);
+
+  // the reader stage
+  int read_here =
+      opts->copy == PIPE_COPY_PWRITE || opts->copy == PIPE_COPY_NONE;
+  uint64_t issued = 0;
+  for (; !rc && issued < chunks; issued++) {
+    pthread_mutex_lock(&pipe.lock);
+    while (issued >= pipe.next + pipe.depth && !pipe.error) {
+      pthread_cond_wait(&pipe.advanced, &pipe.lock);
+    }
+    rc = pipe.error;
+    pthread_mutex_unlock(&pipe.lock);
+    if (rc) {
+      break;
+    }
+    struct chunk_slot *slot = &pipe.slots[issued % pipe.depth];
+    slot->index = issued;
+    slot->offset = (off_t)(issued * opts->chunk_size);
+    slot->len = issued + 1 < chunks
+                    ? opts->chunk_size
+                    : (size_t)(st.st_size - slot->offset);
+    slot->has_data = 0;
+    if (read_here) {
+      uint64_t start = now_ns();
+      rc = pread_full(in_fd, slot->buf, slot->len, slot->offset);
+      add(&pipe.stats.read_ns, now_ns() - start);
+      slot->has_data = !rc;
+    }
+    if (!rc) {
+      rc = thread_pool_submit(pool, &chunk_task, slot);
+    }
+    if (rc) {
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&pipe.lock);
+  while (pipe.next < issued) {
+    pthread_cond_wait(&pipe.advanced, &pipe.lock);
+  }
+  if (!rc) {
+    rc = pipe.error;
+  }
+  pthread_mutex_unlock(&pipe.lock);
+
+  if (stats) {
+    *stats = pipe.stats;
+    stats->bytes = rc ? 0 : (uint64_t)st.st_size;
+    stats->chunks = pipe.next;
+    stats->checksum = pipe.checksum;
+  }
+  pthread_mutex_destroy(&pipe.out_lock);
+  pthread_cond_destroy(&pipe.advanced);
+  pthread_mutex_destroy(&pipe.lock);
+  for (size_t i = 0; i < pipe.depth; i++) {
+    free(pipe.slots[i].buf);
+  }
+  free(pipe.slots);
+  return rc;
+}
@@ -0,0 +1,76 @@
+/*
+ * Chunked, pipelined file copy and checksum.
+ *
+ * 04_file_operation/file_operation_demo.c write()s and read()s one record
+ * on one thread. Here a file is split into chunk_size chunks that move
+ * through stages, several chunks in flight at once:
+ *
+ *   reader (the caller):  pread() a chunk into a free buffer, hand it to
+ *                         the pool (05_thread_pool)
+ *   workers:              checksum the chunk (CRC32C or XXH64), write it
+ *                         at its offset, give the buffer back
+ *
+ * Chunks are independent (pread/pwrite at offsets, per chunk checksums
+ * combined in file order at the end), so they finish in any order on any
+ * worker. depth buffers bound the memory and the read ahead: the reader
+ * waits for a free one.
+ *
+ * Copy paths:
+ * - PIPE_COPY_PWRITE:   data goes through the buffer, pwrite()
+ * - PIPE_COPY_RANGE:    copy_file_range() per chunk, in the kernel (a
+ *                       reflink or server side copy where the filesystem
+ *                       can); falls back to pread/pwrite where it is not
+ *                       supported (e.g. across filesystems on old kernels)
+ * - PIPE_COPY_SENDFILE: sendfile(), in the kernel too, but it writes at
+ *                       the output file position: chunks are written one
+ *                       at a time under a lock. Meant for sockets.
+ * - PIPE_COPY_NONE:     checksum only
+ * The zero copy paths never bring the data to user space: with a checksum
+ * the worker pread()s the chunk itself (from the page cache, which the
+ * copy fills anyway).
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef FILE_PIPELINE_H
+#define FILE_PIPELINE_H
+
+#include "thread_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum pipe_copy {
+  PIPE_COPY_NONE,
+  PIPE_COPY_PWRITE,
+  PIPE_COPY_RANGE,
+  PIPE_COPY_SENDFILE
+};
+enum pipe_sum { PIPE_SUM_NONE, PIPE_SUM_CRC32C, PIPE_SUM_XXH64 };
+
+struct pipe_opts {
+  size_t chunk_size;
+  size_t depth; // chunks in flight, 0: twice the pool workers
+  enum pipe_copy copy;
+  enum pipe_sum sum;
+};
+
+struct pipe_stats {
+  uint64_t bytes;
+  uint64_t chunks;
+  // PIPE_SUM_CRC32C: crc32c() of the whole file
+  // PIPE_SUM_XXH64: h = xxh64({h, xxh64(chunk)}) over the chunks in
+  //                 order, from h = 0; depends on chunk_size
+  uint64_t checksum;
+  uint64_t read_ns; // pread(), summed over the threads
+  uint64_t sum_ns;
+  uint64_t write_ns;  // pwrite(), copy_file_range(), sendfile()
+  uint64_t fallbacks; // chunks copy_file_range() could not do
+};
+
+// copies in_fd to out_fd (truncated to the size of in_fd; ignored with
+// PIPE_COPY_NONE) using the pool's workers; the pool may be shared, only
+// the tasks of this call are waited for
+int file_pipeline_run(struct thread_pool *pool, int in_fd, int out_fd,
+                      const struct pipe_opts *opts, struct pipe_stats *stats);
+
+#endif // FILE_PIPELINE_H
@@ -0,0 +1,248 @@
+/*
+ * GB/s of the chunked pipeline by copy path, chunk size and thread count.
+ *
+ * - checksums alone, one thread, on a buffer in memory: crc32c with
+ *   tables and with sse4.2, xxh64
+ * - baseline: read() + write() 64 KB at a time on one thread (the
+ *   file_operation_demo loop with a bigger buffer), crc32c of the whole
+ *   file on the side: the reference every pipeline checksum must match
+ * - file_pipeline_run() with 64 KB, 1 MB and 8 MB chunks on 1..N pool
+ *   workers: read + checksum, pwrite copy + crc32c, copy_file_range and
+ *   sendfile, with and without crc32c. Copies are checked against the
+ *   source crc32c.
+ * Source and copies are in the page cache: this measures copies, syscalls
+ * and checksums, not the disk (use a file bigger than RAM for that).
+ *
+ * usage: ./file_pipeline_bench [file MB] [max threads]
+ */
+#define _GNU_SOURCE
+
+#include "checksum.h"
+#include "file_pipeline.h"
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_FILE_MB 256U
+#define DEF_MAX_THREADS 4U
+#define BLOCK_SIZE (64U * 1024)
+#define SUM_BUF_SIZE (1U << 20)
+#define SUM_ROUNDS 256U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static char src_path[64], dst_path[64];
+static size_t file_size;
+
+static void make_source(void) {
+  int fd = open(src_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  uint64_t *block = malloc(BLOCK_SIZE), state = 88172645463325252ULL;
+  if (!block) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t done = 0; done < file_size; done += BLOCK_SIZE) {
+    for (size_t i = 0; i < BLOCK_SIZE / 8; i++) {
+      block[i] = xorshift(&state);
+    }
+    if (write(fd, block, BLOCK_SIZE) != BLOCK_SIZE) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+  free(block);
+  close(fd);
+}
+
+static void bench_checksums(void) {
+  uint64_t *buf = malloc(SUM_BUF_SIZE), state = 1;
+  if (!buf) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t i = 0; i < SUM_BUF_SIZE / 8; i++) {
+    buf[i] = xorshift(&state);
+  }
+  double gbs[3];
+  volatile uint64_t sink = 0;
+  for (int m = 0; m < 3; m++) {
+    uint64_t start = now_ns();
+    for (size_t r = 0; r < SUM_ROUNDS; r++) {
+      sink += m == 0   ? crc32c_sw(0, buf, SUM_BUF_SIZE)
+              : m == 1 ? crc32c(0, buf, SUM_BUF_SIZE)
+                       : xxh64(buf, SUM_BUF_SIZE, 0);
+    }
+    gbs[m] = (double)SUM_BUF_SIZE * SUM_ROUNDS / (now_ns() - start);
+  }
+  printf("checksum GB/s, one thread: crc32c table %.2f, crc32c %s %.2f, "
+         "xxh64 %.2f\n",
+         gbs[0], crc32c_impl(), gbs[1], gbs[2]);
+  free(buf);
+}
+
+// read() + write() loop; returns the source crc32c
+static uint32_t bench_baseline(void) {
+  int in = open(src_path, O_RDONLY);
+  int out = open(dst_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (in < 0 || out < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  char *block = malloc(BLOCK_SIZE);
+  if (!block) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  uint32_t crc = 0;
+  uint64_t start = now_ns(), sum_ns = 0;
+  ssize_t n;
+  while ((n = read(in, block, BLOCK_SIZE)) > 0) {
+    uint64_t sum_start = now_ns();
+    crc = crc32c(crc, block, (size_t)n);
+    sum_ns += now_ns() - sum_start;
+    if (write(out, block, (size_t)n) != n) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+  if (n < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  uint64_t elapsed = now_ns() - start - sum_ns;
+  close(in);
+  close(out);
+  free(block);
+  printf("read() + write() 64 KB, one thread: %.2f GB/s (crc32c %08x, its "
+         "time not counted)\n\n",
+         (double)file_size / elapsed, crc);
+  return crc;
+}
+
+struct mode {
+  const char *name;
+  enum pipe_copy copy;
+  enum pipe_sum sum;
+};
+
+static const struct mode modes[] = {
+    {"read + crc32c", PIPE_COPY_NONE, PIPE_SUM_CRC32C},
+    {"read + xxh64", PIPE_COPY_NONE, PIPE_SUM_XXH64},
+    {"pwrite", PIPE_COPY_PWRITE, PIPE_SUM_NONE},
+    {"pwrite + crc32c", PIPE_COPY_PWRITE, PIPE_SUM_CRC32C},
+    {"copy_file_range", PIPE_COPY_RANGE, PIPE_SUM_NONE},
+    {"copy_file_range + crc32c", PIPE_COPY_RANGE, PIPE_SUM_CRC32C},
+    {"sendfile", PIPE_COPY_SENDFILE, PIPE_SUM_NONE},
+};
+
+// checksums the copy with the pipeline itself
+static int copy_matches(struct thread_pool *pool, uint32_t crc) {
+  int fd = open(dst_path, O_RDONLY);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  struct pipe_opts opts = {.chunk_size = 1U << 20,
+                           .copy = PIPE_COPY_NONE,
+                           .sum = PIPE_SUM_CRC32C};
+  struct pipe_stats st;
+  ERROR_CHECK(file_pipeline_run(pool, fd, -1, &opts, &st), 0);
+  close(fd);
+  return (uint32_t)st.checksum == crc;
+}
+
+static double run(const struct mode *mode, struct thread_pool *pool,
+                  size_t chunk_size, uint32_t crc, int *ok) {
+  int in = open(src_path, O_RDONLY);
+  int out = mode->copy == PIPE_COPY_NONE
+                ? -1
+                : open(dst_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (in < 0 || (mode->copy != PIPE_COPY_NONE && out < 0)) {
+    ERROR_CHECK(errno, 0);
+  }
+  struct pipe_opts opts = {
+      .chunk_size = chunk_size, .copy = mode->copy, .sum = mode->sum};
+  struct pipe_stats st;
+  uint64_t start = now_ns();
+  ERROR_CHECK(file_pipeline_run(pool, in, out, &opts, &st), 0);
+  uint64_t elapsed = now_ns() - start;
+  close(in);
+  if (out >= 0) {
+    close(out);
+  }
+  if (mode->sum == PIPE_SUM_CRC32C && (uint32_t)st.checksum != crc) {
+    *ok = 0;
+  }
+  if (mode->copy != PIPE_COPY_NONE && !copy_matches(pool, crc)) {
+    *ok = 0;
+  }
+  return (double)st.bytes / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  size_t file_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_FILE_MB;
+  size_t max_threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_MAX_THREADS;
+  if (!file_mb || !max_threads) {
+    printf("usage: %s [file MB] [max threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  file_size = file_mb << 20;
+  snprintf(src_path, sizeof(src_path), "%d-src", getpid());
+  snprintf(dst_path, sizeof(dst_path), "%d-dst", getpid());
+  make_source();
+
+  bench_checksums();
+  uint32_t crc = bench_baseline();
+
+  static const size_t chunks[] = {64U << 10, 1U << 20, 8U << 20};
+  printf("file_pipeline_run(), %zu MB, GB/s by pool workers:\n", file_mb);
+  printf("  %-25s %6s", "path", "chunk");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf(" %7zu", threads);
+  }
+  printf("  check\n");
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+      printf("  %-25s %5zuK", modes[m].name, chunks[c] >> 10);
+      int ok = 1;
+      for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        struct thread_pool pool;
+        ERROR_CHECK(thread_pool_create(&pool, threads, 2 * threads, NULL), 0);
+        printf(" %7.2f", run(&modes[m], &pool, chunks[c], crc, &ok));
+        fflush(stdout);
+        thread_pool_shutdown(&pool);
+      }
+      printf("  %s\n", ok ? "ok" : "MISMATCH");
+    }
+  }
+  unlink(dst_path);
+  unlink(src_path);
+  return 0;
+}
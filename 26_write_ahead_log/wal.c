@@ -0,0 +1,271 @@
+#include "wal.h"
+#include "buffered_io.h"
+#include "checksum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WAL_HEADER 8U
+#define WAL_RECORD_MAX (64U << 20) // longer lengths are garbage
+#define REPLAY_BUF_SIZE (1U << 20)
+
+static uint32_t record_crc(uint32_t len, const void *data) {
+  return crc32c(crc32c(0, &len, sizeof(len)), data, len);
+}
+
+/* replay */
+
+int wal_replay(const char *path, wal_replay_fn fn, void *arg,
+               off_t *valid_end) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno;
+  }
+  struct buf_reader r;
+  int rc = buf_reader_open(&r, fd, REPLAY_BUF_SIZE, 0);
+  if (rc) {
+    close(fd);
+    return rc;
+  }
+  char *data = NULL;
+  size_t data_cap = 0;
+  off_t end = 0;
+  for (uint64_t lsn = 1;; lsn++) {
+    uint32_t header[2];
+    size_t got;
+    rc = buf_reader_read(&r, header, sizeof(header), &got);
+    if (rc || got < sizeof(header) || header[0] > WAL_RECORD_MAX) {
+      break;
+    }
+    if (header[0] > data_cap) {
+      char *bigger = realloc(data, header[0]);
+      if (!bigger) {
+        rc = ENOMEM;
+        break;
+      }
+      data = bigger;
+      data_cap = header[0];
+    }
+    rc = buf_reader_read(&r, data, header[0], &got);
+    if (rc || got < header[0] || record_crc(header[0], data) != header[1]) {
+      break; // torn or garbage: the log ends before it
+    }
+    end += WAL_HEADER + header[0];
+    if (fn && (rc = fn(lsn, data, header[0], arg))) {
+      break;
+    }
+  }
+  free(data);
+  buf_reader_close(&r);
+  close(fd);
+  if (valid_end) {
+    *valid_end = end;
+  }
+  return rc;
+}
+
+static int count_record(uint64_t lsn, const void *data, size_t len,
+                        void *arg) {
+  (void)data;
+  (void)len;
+  *(uint64_t *)arg = lsn;
+  return 0;
+}
+
+/* committer */
+
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static void *committer(void *arg) {
+  struct wal *wal = (struct wal *)arg;
+  pthread_mutex_lock(&wal->lock);
+  for (;;) {
+    while (!wal->len && !wal->stopping) {
+      pthread_cond_wait(&wal->work, &wal->lock);
+    }
+    if (!wal->len) {
+      break; // stopping, all committed
+    }
+    // take the open batch, producers continue in the other buffer
+    char *batch = wal->bufs[wal->open];
+    size_t len = wal->len;
+    uint64_t last = wal->next_lsn - 1, records = last - wal->durable_lsn;
+    wal->open ^= 1;
+    wal->len = 0;
+    pthread_cond_broadcast(&wal->room);
+    pthread_mutex_unlock(&wal->lock);
+
+    int rc = write_all(wal->fd, batch, len);
+    if (!rc && wal->sync != WAL_SYNC_NONE &&
+        (wal->sync == WAL_SYNC_DATA ? fdatasync(wal->fd) : fsync(wal->fd))) {
+      rc = errno;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (rc) {
+      wal->error = rc;
+      pthread_cond_broadcast(&wal->room);
+    } else {
+      wal->durable_lsn = last;
+      wal->offset += (off_t)len;
+      wal->stats.records += records;
+      wal->stats.bytes += len;
+      wal->stats.groups++;
+      if (records > wal->stats.max_group) {
+        wal->stats.max_group = records;
+      }
+    }
+    pthread_cond_broadcast(&wal->committed);
+    if (rc) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&wal->lock);
+  return NULL;
+}
+
+/* setup */
+
+int wal_open(struct wal *wal, const char *path, size_t buf_size,
+             enum wal_sync sync) {
+  if (!wal || !path || buf_size <= WAL_HEADER) {
+    return EINVAL;
+  }
+  memset(wal, 0, sizeof(*wal));
+  wal->sync = sync;
+  wal->buf_size = buf_size;
+  wal->fd = open(path, O_CREAT | O_RDWR, 0644);
+  if (wal->fd < 0) {
+    return errno;
+  }
+  // recover: the log ends at the last record that checks out
+  uint64_t last = 0;
+  int rc = wal_replay(path, &count_record, &last, &wal->offset);
+  if (!rc && ftruncate(wal->fd, wal->offset)) {
+    rc = errno;
+  }
+  if (!rc && lseek(wal->fd, wal->offset, SEEK_SET) < 0) {
+    rc = errno;
+  }
+  wal->next_lsn = last + 1;
+  wal->durable_lsn = last;
+  if (!rc) {
+    wal->bufs[0] = malloc(buf_size);
+    wal->bufs[1] = malloc(buf_size);
+    rc = wal->bufs[0] && wal->bufs[1] ? 0 : ENOMEM;
+  }
+  if (!rc) {
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->work, NULL);
+    pthread_cond_init(&wal->room, NULL);
+    pthread_cond_init(&wal->committed, NULL);
+    rc = pthread_create(&wal->committer, NULL, &committer, wal);
+    if (rc) {
+      pthread_cond_destroy(&wal->committed);
+      pthread_cond_destroy(&wal->room);
+      pthread_cond_destroy(&wal->work);
+      pthread_mutex_destroy(&wal->lock);
+    }
+  }
+  if (rc) {
+    free(wal->bufs[0]);
+    free(wal->bufs[1]);
+    close(wal->fd);
+  }
+  return rc;
+}
+
+int wal_close(struct wal *wal) {
+  pthread_mutex_lock(&wal->lock);
+  wal->stopping = 1;
+  pthread_cond_signal(&wal->work);
+  pthread_mutex_unlock(&wal->lock);
+  pthread_join(wal->committer, NULL);
+
+  int rc = wal->error;
+  if (close(wal->fd) && !rc) {
+    rc = errno;
+  }
+  free(wal->bufs[0]);
+  free(wal->bufs[1]);
+  pthread_cond_destroy(&wal->committed);
+  pthread_cond_destroy(&wal->room);
+  pthread_cond_destroy(&wal->work);
+  pthread_mutex_destroy(&wal->lock);
+  return rc;
+}
+
+/* producers */
+
+int wal_append(struct wal *wal, const void *data, size_t len, uint64_t *lsn) {
+  size_t size = WAL_HEADER + len;
+  if (size > wal->buf_size || len > WAL_RECORD_MAX) {
+    return EMSGSIZE;
+  }
+  uint32_t header[2] = {(uint32_t)len, record_crc((uint32_t)len, data)};
+
+  pthread_mutex_lock(&wal->lock);
+  while (wal->len + size > wal->buf_size && !wal->error) {
+    pthread_cond_wait(&wal->room, &wal->lock);
+  }
+  int rc = wal->error;
+  if (!rc) {
+    char *at = wal->bufs[wal->open] + wal->len;
+    memcpy(at, header, WAL_HEADER);
+    memcpy(at + WAL_HEADER, data, len);
+    if (!wal->len) { // the committer waits for a non-empty batch
+      pthread_cond_signal(&wal->work);
+    }
+    wal->len += size;
+    if (lsn) {
+      *lsn = wal->next_lsn;
+    }
+    wal->next_lsn++;
+  }
+  pthread_mutex_unlock(&wal->lock);
+  return rc;
+}
+
+int wal_wait(struct wal *wal, uint64_t lsn) {
+  pthread_mutex_lock(&wal->lock);
+  while (wal->durable_lsn < lsn && !wal->error) {
+    pthread_cond_wait(&wal->committed, &wal->lock);
+  }
+  int rc = wal->durable_lsn < lsn ? wal->error : 0;
+  pthread_mutex_unlock(&wal->lock);
+  return rc;
+}
+
+int wal_commit(struct wal *wal, const void *data, size_t len, uint64_t *lsn) {
+  uint64_t mine;
+  int rc = wal_append(wal, data, len, &mine);
+  if (!rc) {
+    rc = wal_wait(wal, mine);
+  }
+  if (!rc && lsn) {
+    *lsn = mine;
+  }
+  return rc;
+}
+
+void wal_get_stats(struct wal *wal, struct wal_stats *stats) {
+  pthread_mutex_lock(&wal->lock);
+  *stats = wal->stats;
+  pthread_mutex_unlock(&wal->lock);
+}
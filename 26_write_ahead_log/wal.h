@@ -0,0 +1,89 @@
+/*
+ * Append-only write-ahead log with group commit.
+ *
+ * 04_file_operation/file_operation_demo.c opens its file with
+ * O_CREAT | O_RDWR (O_APPEND mentioned as an option) and never syncs: a
+ * crash can lose or tear any record. Making every record durable with
+ * its own write() + fdatasync() costs a device flush per record, and
+ * with many threads they queue up behind each other's flushes.
+ *
+ * Group commit: producers copy their records into the open batch buffer
+ * (a short critical section, no syscall) and get a log sequence number.
+ * One committer thread takes the whole batch, write()s it and calls
+ * fdatasync() once, then wakes every producer whose record it covered.
+ * While one batch is being synced the next one fills up, so the busier
+ * the log, the more records share a flush.
+ *
+ * - wal_append():  queue a record, get its lsn (1, 2, ... in log order)
+ * - wal_wait():    block until a lsn is durable
+ * - wal_commit():  both
+ * - wal_open() scans the existing log and cuts a torn tail (a record
+ *   whose length or crc32c does not check out) before appending;
+ *   wal_replay() reads the records back.
+ *
+ * Record on disk: u32 length, u32 crc32c of the length and the payload,
+ * payload; little endian, no padding.
+ *
+ * APIs return 0 or an errno value; after a write or sync error the log
+ * stops and every append and wait returns that error.
+ */
+#ifndef WAL_H
+#define WAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum wal_sync { WAL_SYNC_NONE, WAL_SYNC_DATA, WAL_SYNC_FULL };
+
+struct wal_stats {
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t groups;    // write() + sync per group
+  uint64_t max_group; // records
+};
+
+struct wal {
+  int fd;
+  enum wal_sync sync;
+  size_t buf_size;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work;      // committer: a batch is open
+  pthread_cond_t room;      // producers: the open batch is full
+  pthread_cond_t committed; // waiters: durable_lsn moved
+  char *bufs[2];            // open batch and the one being written
+  int open;
+  size_t len;        // bytes in the open batch
+  uint64_t next_lsn; // of the next record
+  uint64_t durable_lsn;
+  int stopping;
+  int error;
+  pthread_t committer;
+
+  off_t offset; // end of the log
+  struct wal_stats stats;
+};
+
+typedef int (*wal_replay_fn)(uint64_t lsn, const void *data, size_t len,
+                             void *arg);
+
+// buf_size: bytes per batch (two are allocated), limits the record size
+int wal_open(struct wal *wal, const char *path, size_t buf_size,
+             enum wal_sync sync);
+// commits what is queued, stops the committer and closes the file
+int wal_close(struct wal *wal);
+
+int wal_append(struct wal *wal, const void *data, size_t len, uint64_t *lsn);
+int wal_wait(struct wal *wal, uint64_t lsn);
+int wal_commit(struct wal *wal, const void *data, size_t len, uint64_t *lsn);
+void wal_get_stats(struct wal *wal, struct wal_stats *stats);
+
+// calls fn for every valid record of the log at path, stops at the first
+// invalid one or when fn returns non-zero (returned); *valid_end (may be
+// NULL) gets the offset after the last valid record
+int wal_replay(const char *path, wal_replay_fn fn, void *arg,
+               off_t *valid_end);
+
+#endif // WAL_H
@@ -0,0 +1,228 @@
+/*
+ * Durable commits/s and commit latency: one fdatasync() per record vs.
+ * group commit, from 1..N producer threads.
+ *
+ * Every producer commits 100 byte records (the file_operation_demo record
+ * size) for a fixed time:
+ * - write + fdatasync: write() to a shared O_APPEND fd, then fdatasync(),
+ *   per record
+ * - group commit:      wal_commit() with WAL_SYNC_DATA
+ * - group, no sync:    wal_commit() with WAL_SYNC_NONE, the cost of the
+ *                      batching itself
+ * and reports commits/s, latency percentiles (per thread histograms from
+ * 22_thread_trace, merged) and records per group. The group commit logs
+ * are replayed to check that every committed record is there.
+ * Last, a torn record is appended to a log to show wal_open() recovery.
+ *
+ * usage: ./wal_bench [max producers] [ms per run]
+ */
+#define _GNU_SOURCE
+
+#include "latency_hist.h"
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_MAX_PRODUCERS 64U
+#define DEF_RUN_MS 1000U
+#define RECORD_SIZE 100U
+#define BATCH_SIZE (1U << 20)
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum method { SYNC_EACH, GROUP, GROUP_NO_SYNC, METHOD_NUM };
+
+static const char *method_name[METHOD_NUM] = {
+    [SYNC_EACH] = "write + fdatasync",
+    [GROUP] = "group commit",
+    [GROUP_NO_SYNC] = "group, no sync",
+};
+
+struct producer {
+  enum method method;
+  int fd;
+  struct wal *wal;
+  int task_no;
+  uint64_t deadline;
+  uint64_t commits;
+  struct latency_hist hist; // ns per commit
+};
+
+static void *produce(void *arg) {
+  struct producer *p = (struct producer *)arg;
+  char record[RECORD_SIZE];
+  for (uint64_t start = now_ns(); start < p->deadline; p->commits++) {
+    int len = snprintf(record, sizeof(record), "task no %d: record %llu",
+                       p->task_no, (unsigned long long)p->commits);
+    memset(record + len, ' ', sizeof(record) - len - 1);
+    record[sizeof(record) - 1] = '\n';
+    if (p->method == SYNC_EACH) {
+      if (write(p->fd, record, sizeof(record)) != sizeof(record) ||
+          fdatasync(p->fd)) {
+        ERROR_CHECK(errno, 0);
+      }
+    } else {
+      ERROR_CHECK(wal_commit(p->wal, record, sizeof(record), NULL), 0);
+    }
+    uint64_t end = now_ns();
+    latency_hist_record(&p->hist, end - start);
+    start = end;
+  }
+  return NULL;
+}
+
+static int last_lsn(uint64_t lsn, const void *data, size_t len, void *arg) {
+  (void)data;
+  (void)len;
+  *(uint64_t *)arg = lsn;
+  return 0;
+}
+
+static void bench(enum method method, size_t producers, unsigned run_ms) {
+  char path[64];
+  snprintf(path, sizeof(path), "%d-wal.log", getpid());
+  unlink(path);
+  struct wal wal;
+  int fd = -1;
+  if (method == SYNC_EACH) {
+    fd = open(path, O_CREAT | O_WRONLY | O_APPEND, 0644);
+    if (fd < 0) {
+      ERROR_CHECK(errno, 0);
+    }
+  } else {
+    ERROR_CHECK(wal_open(&wal, path, BATCH_SIZE,
+                         method == GROUP ? WAL_SYNC_DATA : WAL_SYNC_NONE),
+                0);
+  }
+
+  pthread_t tids[producers];
+  struct producer *ps = calloc(producers, sizeof(*ps));
+  if (!ps) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  uint64_t start = now_ns(), deadline = start + run_ms * 1000000ULL;
+  for (size_t t = 0; t < producers; t++) {
+    ps[t].method = method;
+    ps[t].fd = fd;
+    ps[t].wal = &wal;
+    ps[t].task_no = (int)t;
+    ps[t].deadline = deadline;
+    latency_hist_init(&ps[t].hist);
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &produce, &ps[t]), 0);
+  }
+  struct latency_hist all;
+  latency_hist_init(&all);
+  uint64_t commits = 0;
+  for (size_t t = 0; t < producers; t++) {
+    pthread_join(tids[t], NULL);
+    latency_hist_merge(&all, &ps[t].hist);
+    commits += ps[t].commits;
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  printf("  %-17s %3zu %10.0f %8.1f %8.1f %9.1f", method_name[method],
+         producers, commits * 1e9 / elapsed,
+         latency_hist_percentile(&all, 50) / 1e3,
+         latency_hist_percentile(&all, 99) / 1e3, all.max / 1e3);
+  if (method == SYNC_EACH) {
+    close(fd);
+    printf("\n");
+  } else {
+    struct wal_stats st;
+    wal_get_stats(&wal, &st);
+    ERROR_CHECK(wal_close(&wal), 0);
+    uint64_t last = 0;
+    ERROR_CHECK(wal_replay(path, &last_lsn, &last, NULL), 0);
+    printf(" %8.1f %6llu  %s\n", (double)st.records / st.groups,
+           (unsigned long long)st.max_group,
+           last == commits && st.records == commits ? "ok" : "MISSING");
+  }
+  unlink(path);
+  free(ps);
+}
+
+static int print_record(uint64_t lsn, const void *data, size_t len,
+                        void *arg) {
+  (void)arg;
+  printf("    lsn %llu: %.*s\n", (unsigned long long)lsn, (int)len,
+         (const char *)data);
+  return 0;
+}
+
+static void recovery(void) {
+  char path[64];
+  snprintf(path, sizeof(path), "%d-wal.log", getpid());
+  unlink(path);
+  struct wal wal;
+  ERROR_CHECK(wal_open(&wal, path, BATCH_SIZE, WAL_SYNC_DATA), 0);
+  for (int i = 0; i < 3; i++) {
+    char record[32];
+    int len = snprintf(record, sizeof(record), "task no %d: committed", i);
+    ERROR_CHECK(wal_commit(&wal, record, (size_t)len, NULL), 0);
+  }
+  ERROR_CHECK(wal_close(&wal), 0);
+
+  // a crash in the middle of the next record's write()
+  int fd = open(path, O_WRONLY | O_APPEND);
+  if (fd < 0) {
+    ERROR_CHECK(errno, 0);
+  }
+  uint32_t torn[3] = {100, 0xdeadbeef, 0x41414141};
+  if (write(fd, torn, sizeof(torn)) != sizeof(torn)) {
+    ERROR_CHECK(errno, 0);
+  }
+  close(fd);
+
+  uint64_t lsn;
+  ERROR_CHECK(wal_open(&wal, path, BATCH_SIZE, WAL_SYNC_DATA), 0);
+  ERROR_CHECK(wal_commit(&wal, "after recovery", 14, &lsn), 0);
+  ERROR_CHECK(wal_close(&wal), 0);
+  printf("recovery: %zu torn bytes cut, next record got lsn %llu:\n",
+         sizeof(torn), (unsigned long long)lsn);
+  ERROR_CHECK(wal_replay(path, &print_record, NULL, NULL), 0);
+  unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_producers =
+      argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_MAX_PRODUCERS;
+  unsigned run_ms = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : DEF_RUN_MS;
+  if (!max_producers || !run_ms) {
+    printf("usage: %s [max producers] [ms per run]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf("%u byte records, %u ms per run, latency in us:\n", RECORD_SIZE,
+         run_ms);
+  printf("  %-17s %3s %10s %8s %8s %9s %8s %6s\n", "method", "thr",
+         "commits/s", "p50", "p99", "max", "per sync", "max");
+  for (enum method m = SYNC_EACH; m < METHOD_NUM; m++) {
+    for (size_t producers = 1; producers <= max_producers; producers *= 4) {
+      bench(m, producers, run_ms);
+    }
+  }
+  recovery();
+  return 0;
+}
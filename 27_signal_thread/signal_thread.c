@@ -0,0 +1,186 @@
+// for NSIG
+#define _GNU_SOURCE
+
+#include "signal_thread.h"
+#include "cancel_token.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define SIGNAL_BATCH 16U // siginfos per read()
+
+struct pool_delivery {
+  signal_handler_fn fn;
+  void *arg;
+  struct signalfd_siginfo info;
+};
+
+int signal_thread_block(const sigset_t *set) {
+  return pthread_sigmask(SIG_BLOCK, set, NULL);
+}
+
+static void run_delivery(void *arg) {
+  struct pool_delivery *d = (struct pool_delivery *)arg;
+  d->fn(&d->info, d->arg);
+  free(d);
+}
+
+static void dispatch(struct signal_thread *st,
+                     const struct signalfd_siginfo *info) {
+  if (info->ssi_signo >= NSIG || !st->handlers[info->ssi_signo].fn) {
+    return;
+  }
+  signal_handler_fn fn = st->handlers[info->ssi_signo].fn;
+  void *arg = st->handlers[info->ssi_signo].arg;
+  if (st->handlers[info->ssi_signo].run == SIGNAL_RUN_POOL) {
+    struct pool_delivery *d = malloc(sizeof(*d));
+    if (d) {
+      *d = (struct pool_delivery){fn, arg, *info};
+      if (!thread_pool_try_submit(st->pool, &run_delivery, d)) {
+        return;
+      }
+      free(d);
+    }
+    st->inline_fallbacks++; // never lose a shutdown or reload
+  }
+  fn(info, arg);
+}
+
+static void *signal_loop(void *arg) {
+  struct signal_thread *st = (struct signal_thread *)arg;
+  struct epoll_event events[SIGNAL_THREAD_MAX_FDS + 2];
+  for (;;) {
+    int n = epoll_wait(st->epfd, events,
+                       sizeof(events) / sizeof(events[0]), -1);
+    if (n < 0) {
+      if (errno == EINTR) { // a signal outside the set, e.g. SIGSTOP/SIGCONT
+        continue;
+      }
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &st->stop_fd) {
+        return NULL;
+      }
+      if (ptr == &st->sfd) {
+        struct signalfd_siginfo infos[SIGNAL_BATCH];
+        ssize_t got = read(st->sfd, infos, sizeof(infos));
+        for (ssize_t k = 0; k < got / (ssize_t)sizeof(infos[0]); k++) {
+          st->received++;
+          dispatch(st, &infos[k]);
+        }
+        continue;
+      }
+      size_t idx =
+          (size_t)((char *)ptr - (char *)st->fds) / sizeof(st->fds[0]);
+      st->fds[idx].fn(st->fds[idx].fd, events[i].events, st->fds[idx].arg);
+    }
+  }
+  return NULL;
+}
+
+/* setup */
+
+int signal_thread_init(struct signal_thread *st, const sigset_t *set,
+                       struct thread_pool *pool) {
+  if (!st || !set) {
+    return EINVAL;
+  }
+  memset(st, 0, sizeof(*st));
+  st->set = *set;
+  st->pool = pool;
+  st->sfd = st->epfd = st->stop_fd = -1;
+  int rc = signal_thread_block(set); // in case main() did not
+  if (rc) {
+    return rc;
+  }
+  st->sfd = signalfd(-1, set, SFD_NONBLOCK | SFD_CLOEXEC);
+  st->epfd = epoll_create1(EPOLL_CLOEXEC);
+  st->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (st->sfd < 0 || st->epfd < 0 || st->stop_fd < 0) {
+    rc = errno;
+  }
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &st->sfd};
+  if (!rc && epoll_ctl(st->epfd, EPOLL_CTL_ADD, st->sfd, &ev)) {
+    rc = errno;
+  }
+  ev.data.ptr = &st->stop_fd;
+  if (!rc && epoll_ctl(st->epfd, EPOLL_CTL_ADD, st->stop_fd, &ev)) {
+    rc = errno;
+  }
+  if (rc) {
+    signal_thread_stop(st);
+  }
+  return rc;
+}
+
+int signal_thread_on(struct signal_thread *st, int signo, signal_handler_fn fn,
+                     void *arg, enum signal_run run) {
+  if (signo <= 0 || signo >= NSIG || !sigismember(&st->set, signo) ||
+      (run == SIGNAL_RUN_POOL && !st->pool) || st->running) {
+    return EINVAL;
+  }
+  st->handlers[signo].fn = fn;
+  st->handlers[signo].arg = arg;
+  st->handlers[signo].run = run;
+  return 0;
+}
+
+int signal_thread_on_fd(struct signal_thread *st, int fd, uint32_t events,
+                        signal_fd_fn fn, void *arg) {
+  if (fd < 0 || !fn || st->running) {
+    return EINVAL;
+  }
+  if (st->fd_num == SIGNAL_THREAD_MAX_FDS) {
+    return ENOSPC;
+  }
+  size_t idx = st->fd_num;
+  st->fds[idx].fd = fd;
+  st->fds[idx].fn = fn;
+  st->fds[idx].arg = arg;
+  struct epoll_event ev = {.events = events, .data.ptr = &st->fds[idx]};
+  if (epoll_ctl(st->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+    return errno;
+  }
+  st->fd_num++;
+  return 0;
+}
+
+int signal_thread_start(struct signal_thread *st) {
+  if (st->running) {
+    return EBUSY;
+  }
+  int rc = pthread_create(&st->tid, NULL, &signal_loop, st);
+  st->running = !rc;
+  return rc;
+}
+
+void signal_thread_stop(struct signal_thread *st) {
+  if (st->running) {
+    uint64_t one = 1;
+    while (write(st->stop_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+    pthread_join(st->tid, NULL);
+    st->running = 0;
+  }
+  if (st->stop_fd >= 0) {
+    close(st->stop_fd);
+  }
+  if (st->epfd >= 0) {
+    close(st->epfd);
+  }
+  if (st->sfd >= 0) {
+    close(st->sfd);
+  }
+  st->sfd = st->epfd = st->stop_fd = -1;
+}
+
+void signal_cancel_token(const struct signalfd_siginfo *info, void *arg) {
+  (void)info;
+  cancel_token_cancel((struct cancel_token *)arg);
+}
@@ -0,0 +1,98 @@
+/*
+ * Signals consumed by one thread through signalfd + epoll.
+ *
+ * 02_POSIX_headers/posix_include.h pulls in signal.h, but nothing in the
+ * demos routes signals: a SIGTERM kills the process wherever its threads
+ * are, and a handler installed with sigaction() runs on whatever thread
+ * the kernel picks, in async-signal context (no malloc(), no locks, no
+ * printf()), and makes that thread's blocking calls fail with EINTR.
+ *
+ * Here the signals of a set are blocked in every thread and read as
+ * plain data from a signalfd by one signal thread, in an epoll loop:
+ *
+ * 1. signal_thread_block(): in main(), before any thread is created,
+ *    including the pool workers, so that they all inherit the mask
+ * 2. signal_thread_on(): what to run per signal, as a normal function:
+ *    SIGNAL_RUN_INLINE on the signal thread (e.g. signal_cancel_token()
+ *    for SIGINT/SIGTERM, 09_graceful_shutdown's token which the workers
+ *    poll in their loops), SIGNAL_RUN_POOL as a task on the 05_thread_pool
+ *    pool (e.g. a SIGHUP config reload), with its own copy of the siginfo
+ * 3. signal_thread_on_fd(): other fds for the same epoll loop
+ * 4. signal_thread_start(), signal_thread_stop()
+ *
+ * No thread is interrupted, no call returns EINTR for these signals.
+ * Queued real time signals (sigqueue()) arrive one by one with their
+ * value; standard signals pending at once are merged by the kernel.
+ *
+ * Synchronous signals (SIGFPE from an enabled FP trap, SIGSEGV, SIGBUS,
+ * SIGILL) hit the faulting thread even when blocked, so they cannot be
+ * routed: check FP exceptions with fetestexcept() (pthread_demo.c's
+ * commented feraiseexcept(FE_DIVBYZERO) only raises the flag by default).
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef SIGNAL_THREAD_H
+#define SIGNAL_THREAD_H
+
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+
+#define SIGNAL_THREAD_MAX_FDS 16U
+
+enum signal_run { SIGNAL_RUN_INLINE, SIGNAL_RUN_POOL };
+
+typedef void (*signal_handler_fn)(const struct signalfd_siginfo *info,
+                                  void *arg);
+typedef void (*signal_fd_fn)(int fd, uint32_t events, void *arg);
+
+struct signal_thread {
+  sigset_t set;
+  struct thread_pool *pool;
+  int sfd;  // signalfd
+  int epfd; // epoll
+  int stop_fd; // eventfd, wakes the loop to stop
+  pthread_t tid;
+  int running;
+
+  struct {
+    signal_handler_fn fn;
+    void *arg;
+    enum signal_run run;
+  } handlers[NSIG];
+  struct {
+    int fd;
+    signal_fd_fn fn;
+    void *arg;
+  } fds[SIGNAL_THREAD_MAX_FDS];
+  size_t fd_num;
+
+  uint64_t received; // signals read from the signalfd
+  uint64_t inline_fallbacks; // pool queue full, ran on the signal thread
+};
+
+// pthread_sigmask(SIG_BLOCK) for the calling thread and so the threads it
+// creates from now on
+int signal_thread_block(const sigset_t *set);
+
+// pool may be NULL if nothing uses SIGNAL_RUN_POOL
+int signal_thread_init(struct signal_thread *st, const sigset_t *set,
+                       struct thread_pool *pool);
+// register before signal_thread_start(); signals in set without a handler
+// are read and dropped
+int signal_thread_on(struct signal_thread *st, int signo, signal_handler_fn fn,
+                     void *arg, enum signal_run run);
+int signal_thread_on_fd(struct signal_thread *st, int fd, uint32_t events,
+                        signal_fd_fn fn, void *arg);
+int signal_thread_start(struct signal_thread *st);
+// stops and joins the signal thread, closes its fds; the signals stay
+// blocked (pending ones are not lost to a default action)
+void signal_thread_stop(struct signal_thread *st);
+
+// handler for SIGNAL_RUN_INLINE: arg is a struct cancel_token *
+void signal_cancel_token(const struct signalfd_siginfo *info, void *arg);
+
+#endif // SIGNAL_THREAD_H
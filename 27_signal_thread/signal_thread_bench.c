@@ -0,0 +1,252 @@
+/*
+ * Signal to handler latency, and what signals do to busy workers.
+ *
+ * N workers run the demo's loop shape (work, then a short nanosleep(),
+ * check the cancel token) while queued signals (sigqueue(), the send
+ * time as value) are sent one at a time to the process, and handled by:
+ * - sigaction():  an SA_SIGINFO handler, the signal left unblocked in
+ *                 the workers only: it interrupts one of them
+ * - sigwaitinfo(): a thread of its own, blocked in sigwaitinfo()
+ * - signalfd:     the signal thread, handler inline
+ * - signalfd pool: the signal thread hands the siginfo to a pool task
+ * Latency percentiles (22_thread_trace histograms) in us, and the EINTR
+ * failures the workers' nanosleep() saw, per method.
+ * Then a SIGHUP reload runs on the pool, and a SIGTERM shuts the workers
+ * down through the cancel token: time from kill() to all joined.
+ *
+ * usage: ./signal_thread_bench [workers] [signals]
+ */
+#define _GNU_SOURCE
+
+#include "cancel_token.h"
+#include "latency_hist.h"
+#include "signal_thread.h"
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_WORKERS 4U
+#define DEF_SIGNALS 10000U
+#define WORK_SPINS 20000U
+#define NAP_NS 50000L
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define SIG_FD (SIGRTMIN)
+#define SIG_ACTION (SIGRTMIN + 1)
+#define SIG_WAIT (SIGRTMIN + 2)
+#define SIG_FD_POOL (SIGRTMIN + 3)
+
+static struct cancel_token token;
+static atomic_uint_fast64_t eintr_count;
+static atomic_int config_generation;
+static sem_t handled;
+static atomic_uint_fast64_t latency; // handler -> sender, one at a time
+
+/* workers */
+
+static void *worker(void *arg) {
+  (void)arg;
+  // the only threads the sigaction() signal can be delivered to
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIG_ACTION);
+  pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+  volatile uint64_t sink = 0;
+  while (!cancel_token_is_cancelled(&token)) {
+    for (unsigned i = 0; i < WORK_SPINS; i++) {
+      sink += i;
+    }
+    struct timespec nap = {0, NAP_NS};
+    if (nanosleep(&nap, NULL) && errno == EINTR) {
+      atomic_fetch_add_explicit(&eintr_count, 1, memory_order_relaxed);
+    }
+  }
+  return NULL;
+}
+
+/* handlers */
+
+// async-signal-safe: an atomic store and sem_post()
+static void record(uint64_t sent) {
+  atomic_store_explicit(&latency, now_ns() - sent, memory_order_relaxed);
+  sem_post(&handled);
+}
+
+static void on_sigaction(int signo, siginfo_t *info, void *ctx) {
+  (void)signo;
+  (void)ctx;
+  int saved = errno;
+  record((uint64_t)(uintptr_t)info->si_value.sival_ptr);
+  errno = saved;
+}
+
+static void *sigwait_thread(void *arg) {
+  (void)arg;
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIG_WAIT);
+  for (;;) {
+    siginfo_t info;
+    if (sigwaitinfo(&set, &info) < 0) {
+      continue;
+    }
+    if (!info.si_value.sival_ptr) {
+      return NULL; // stop
+    }
+    record((uint64_t)(uintptr_t)info.si_value.sival_ptr);
+  }
+}
+
+static void on_signalfd(const struct signalfd_siginfo *info, void *arg) {
+  (void)arg;
+  record(info->ssi_ptr);
+}
+
+static void on_reload(const struct signalfd_siginfo *info, void *arg) {
+  (void)info;
+  (void)arg;
+  atomic_fetch_add(&config_generation, 1); // re-read the config here
+  sem_post(&handled);
+}
+
+/* runs */
+
+static void measure(const char *name, int signo, unsigned signals) {
+  struct latency_hist hist;
+  latency_hist_init(&hist);
+  atomic_store(&eintr_count, 0);
+  for (unsigned i = 0; i < signals; i++) {
+    union sigval value = {.sival_ptr = (void *)(uintptr_t)now_ns()};
+    ERROR_CHECK(sigqueue(getpid(), signo, value) ? errno : 0, 0);
+    while (sem_wait(&handled)) {
+    }
+    latency_hist_record(&hist, atomic_load_explicit(&latency,
+                                                    memory_order_relaxed));
+  }
+  printf("  %-14s %8.1f %8.1f %8.1f %9.1f %8llu\n", name,
+         latency_hist_percentile(&hist, 50) / 1e3,
+         latency_hist_percentile(&hist, 99) / 1e3,
+         latency_hist_percentile(&hist, 99.9) / 1e3, hist.max / 1e3,
+         (unsigned long long)atomic_load(&eintr_count));
+}
+
+int main(int argc, char *argv[]) {
+  size_t workers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_WORKERS;
+  unsigned signals =
+      argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : DEF_SIGNALS;
+  if (!workers || !signals) {
+    printf("usage: %s [workers] [signals]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // 1. block everything before the first thread exists
+  sigset_t all, routed;
+  sigemptyset(&routed);
+  sigaddset(&routed, SIGINT);
+  sigaddset(&routed, SIGTERM);
+  sigaddset(&routed, SIGHUP);
+  sigaddset(&routed, SIG_FD);
+  sigaddset(&routed, SIG_FD_POOL);
+  all = routed;
+  sigaddset(&all, SIG_ACTION);
+  sigaddset(&all, SIG_WAIT);
+  ERROR_CHECK(signal_thread_block(&all), 0);
+
+  struct sigaction sa = {.sa_sigaction = &on_sigaction, .sa_flags = SA_SIGINFO};
+  sigemptyset(&sa.sa_mask);
+  ERROR_CHECK(sigaction(SIG_ACTION, &sa, NULL) ? errno : 0, 0);
+  sem_init(&handled, 0, 0);
+  ERROR_CHECK(cancel_token_init(&token), 0);
+
+  // 2. pool and signal thread
+  struct thread_pool pool;
+  ERROR_CHECK(thread_pool_create(&pool, 2, 16, NULL), 0);
+  struct signal_thread st;
+  ERROR_CHECK(signal_thread_init(&st, &routed, &pool), 0);
+  ERROR_CHECK(signal_thread_on(&st, SIGINT, &signal_cancel_token, &token,
+                               SIGNAL_RUN_INLINE),
+              0);
+  ERROR_CHECK(signal_thread_on(&st, SIGTERM, &signal_cancel_token, &token,
+                               SIGNAL_RUN_INLINE),
+              0);
+  ERROR_CHECK(signal_thread_on(&st, SIGHUP, &on_reload, NULL, SIGNAL_RUN_POOL),
+              0);
+  ERROR_CHECK(signal_thread_on(&st, SIG_FD, &on_signalfd, NULL,
+                               SIGNAL_RUN_INLINE),
+              0);
+  ERROR_CHECK(signal_thread_on(&st, SIG_FD_POOL, &on_signalfd, NULL,
+                               SIGNAL_RUN_POOL),
+              0);
+  ERROR_CHECK(signal_thread_start(&st), 0);
+
+  pthread_t waiter, tids[workers];
+  ERROR_CHECK(pthread_create(&waiter, NULL, &sigwait_thread, NULL), 0);
+  for (size_t t = 0; t < workers; t++) {
+    ERROR_CHECK(pthread_create(&tids[t], NULL, &worker, NULL), 0);
+  }
+
+  printf("%zu busy workers, %u signals each, latency in us:\n", workers,
+         signals);
+  printf("  %-14s %8s %8s %8s %9s %8s\n", "method", "p50", "p99", "p99.9",
+         "max", "EINTR");
+  measure("sigaction", SIG_ACTION, signals);
+  measure("sigwaitinfo", SIG_WAIT, signals);
+  measure("signalfd", SIG_FD, signals);
+  measure("signalfd pool", SIG_FD_POOL, signals);
+
+  // reload on the pool, then shutdown through the token
+  ERROR_CHECK(kill(getpid(), SIGHUP) ? errno : 0, 0);
+  while (sem_wait(&handled)) {
+  }
+  uint64_t start = now_ns();
+  ERROR_CHECK(kill(getpid(), SIGTERM) ? errno : 0, 0);
+  for (size_t t = 0; t < workers; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  uint64_t elapsed = now_ns() - start;
+  printf("SIGHUP: config generation %d (reloaded on the pool)\n",
+         atomic_load(&config_generation));
+  printf("SIGTERM: %zu workers joined %.1f us after kill(), EINTR %llu\n",
+         workers, elapsed / 1e3,
+         (unsigned long long)atomic_load(&eintr_count));
+
+  union sigval stop = {.sival_ptr = NULL};
+  sigqueue(getpid(), SIG_WAIT, stop);
+  pthread_join(waiter, NULL);
+  signal_thread_stop(&st);
+  printf("signal thread: %llu signals read, %llu run inline for a full "
+         "pool\n",
+         (unsigned long long)st.received,
+         (unsigned long long)st.inline_fallbacks);
+  thread_pool_shutdown(&pool);
+  cancel_token_destroy(&token);
+  sem_destroy(&handled);
+  return 0;
+}
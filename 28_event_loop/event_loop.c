@@ -0,0 +1,357 @@
+#include "event_loop.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WHEEL_MASK (EVENT_WHEEL_SLOTS - 1)
+#define WHEEL_SPAN (1ULL << (EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS))
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* wheel */
+
+// timer->expires >= loop->now
+static void wheel_insert(struct event_loop *loop, struct event_timer *timer) {
+  uint64_t delta = timer->expires - loop->now;
+  uint64_t expires = timer->expires;
+  unsigned int level = 0;
+  while (level + 1 < EVENT_WHEEL_LEVELS &&
+         delta >> (EVENT_WHEEL_BITS * (level + 1))) {
+    level++;
+  }
+  if (delta >= WHEEL_SPAN) { // past the top level: park in its last slot
+    expires = loop->now + WHEEL_SPAN - 1;
+  }
+  struct event_timer **head =
+      &loop->wheel[level][(expires >> (EVENT_WHEEL_BITS * level)) & WHEEL_MASK];
+  timer->next = *head;
+  if (timer->next) {
+    timer->next->pprev = &timer->next;
+  }
+  *head = timer;
+  timer->pprev = head;
+  timer->level = level;
+  loop->level_count[level]++;
+}
+
+static void wheel_remove(struct event_loop *loop, struct event_timer *timer) {
+  *timer->pprev = timer->next;
+  if (timer->next) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = NULL;
+  timer->pprev = NULL;
+  loop->level_count[timer->level]--;
+}
+
+// expiry tick from the deadline: the first tick boundary at or after it,
+// and never a tick already processed
+static void schedule(struct event_loop *loop, struct event_timer *timer) {
+  uint64_t tick = 0;
+  if (timer->deadline_ns > loop->start_ns) {
+    tick = (timer->deadline_ns - loop->start_ns + loop->tick_ns - 1) /
+           loop->tick_ns;
+  }
+  timer->expires = tick > loop->now ? tick : loop->now + 1;
+  wheel_insert(loop, timer);
+}
+
+static int wheel_empty(const struct event_loop *loop) {
+  for (unsigned int level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+    if (loop->level_count[level]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// loop->now was just moved to the tick to process
+static void run_tick(struct event_loop *loop) {
+  uint64_t tick = loop->now;
+  unsigned int top = 0;
+  while (top + 1 < EVENT_WHEEL_LEVELS &&
+         !(tick & ((1ULL << (EVENT_WHEEL_BITS * (top + 1))) - 1))) {
+    top++;
+  }
+  for (unsigned int level = top; level > 0; level--) {
+    struct event_timer **head =
+        &loop->wheel[level][(tick >> (EVENT_WHEEL_BITS * level)) & WHEEL_MASK];
+    while (*head) {
+      struct event_timer *timer = *head;
+      wheel_remove(loop, timer);
+      wheel_insert(loop, timer);
+      loop->cascaded++;
+    }
+  }
+
+  // nothing started from here can land in this slot again (expires > now)
+  struct event_timer **head = &loop->wheel[0][tick & WHEEL_MASK];
+  while (*head) {
+    struct event_timer *timer = *head;
+    wheel_remove(loop, timer);
+    uint64_t period_ns = timer->period_ns;
+    loop->firing = timer;
+    loop->fired++;
+    timer->fn(timer, timer->arg);
+    // a one-shot timer belongs to its owner again once fn is called: it
+    // may be freed or reused by now, never touch it after the callback
+    if (period_ns && loop->firing == timer && !timer->pprev) {
+      timer->deadline_ns += timer->period_ns; // keeps the phase
+      schedule(loop, timer);
+    }
+  }
+  loop->firing = NULL;
+}
+
+// process every tick up to the current time, skipping the empty ones
+static void advance(struct event_loop *loop) {
+  uint64_t target = (now_ns() - loop->start_ns) / loop->tick_ns;
+  while (loop->now < target) {
+    if (loop->level_count[0]) {
+      loop->now++;
+      run_tick(loop);
+      continue;
+    }
+    uint64_t cascade = (loop->now | WHEEL_MASK) + 1;
+    if (cascade > target || wheel_empty(loop)) {
+      loop->now = target;
+      break;
+    }
+    loop->now = cascade;
+    run_tick(loop);
+  }
+}
+
+// next tick with a level 0 timer, else the next cascade, 0 if none
+static uint64_t next_tick(const struct event_loop *loop) {
+  if (loop->level_count[0]) {
+    for (uint64_t i = 1; i < EVENT_WHEEL_SLOTS; i++) {
+      if (loop->wheel[0][(loop->now + i) & WHEEL_MASK]) {
+        return loop->now + i;
+      }
+    }
+  }
+  return wheel_empty(loop) ? 0 : (loop->now | WHEEL_MASK) + 1;
+}
+
+static void arm(struct event_loop *loop) {
+  uint64_t tick = next_tick(loop);
+  if (tick == loop->armed) {
+    return;
+  }
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its)); // disarms
+  if (tick) {
+    uint64_t at = loop->start_ns + tick * loop->tick_ns;
+    its.it_value.tv_sec = (time_t)(at / 1000000000ULL);
+    its.it_value.tv_nsec = (long)(at % 1000000000ULL);
+  }
+  timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+  loop->armed = tick;
+}
+
+/* loop thread */
+
+// returns 1 to stop
+static int take_incoming(struct event_loop *loop) {
+  uint64_t value;
+  while (read(loop->wake_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+  pthread_mutex_lock(&loop->lock);
+  struct event_timer *timer = loop->incoming;
+  loop->incoming = NULL;
+  int stop = loop->stop;
+  pthread_mutex_unlock(&loop->lock);
+  if (stop) {
+    return 1;
+  }
+  while (timer) {
+    struct event_timer *next = timer->next;
+    schedule(loop, timer);
+    timer = next;
+  }
+  return 0;
+}
+
+static void *loop_thread(void *arg) {
+  struct event_loop *loop = (struct event_loop *)arg;
+  struct epoll_event events[EVENT_LOOP_MAX_FDS + 2];
+  for (;;) {
+    arm(loop);
+    int n = epoll_wait(loop->epfd, events,
+                       sizeof(events) / sizeof(events[0]), -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    loop->wakeups++;
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &loop->timer_fd) {
+        uint64_t expirations;
+        ssize_t got = read(loop->timer_fd, &expirations, sizeof(expirations));
+        (void)got; // EAGAIN if re-armed since it fired
+        loop->armed = 0;
+      } else if (ptr == &loop->wake_fd) {
+        if (take_incoming(loop)) {
+          return NULL;
+        }
+      } else {
+        size_t idx =
+            (size_t)((char *)ptr - (char *)loop->fds) / sizeof(loop->fds[0]);
+        loop->fds[idx].fn(loop->fds[idx].fd, events[i].events,
+                          loop->fds[idx].arg);
+      }
+    }
+    advance(loop);
+  }
+  return NULL;
+}
+
+/* setup */
+
+int event_loop_init(struct event_loop *loop, uint64_t tick_ns) {
+  if (!loop) {
+    return EINVAL;
+  }
+  memset(loop, 0, sizeof(*loop));
+  loop->tick_ns = tick_ns ? tick_ns : EVENT_LOOP_DEF_TICK_NS;
+  loop->start_ns = now_ns();
+  pthread_mutex_init(&loop->lock, NULL);
+  int rc = 0;
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  loop->timer_fd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->epfd < 0 || loop->timer_fd < 0 || loop->wake_fd < 0) {
+    rc = errno;
+  }
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &loop->timer_fd};
+  if (!rc && epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->timer_fd, &ev)) {
+    rc = errno;
+  }
+  ev.data.ptr = &loop->wake_fd;
+  if (!rc && epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wake_fd, &ev)) {
+    rc = errno;
+  }
+  if (rc) {
+    event_loop_stop(loop);
+  }
+  return rc;
+}
+
+int event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                      event_fd_fn fn, void *arg) {
+  if (fd < 0 || !fn) {
+    return EINVAL;
+  }
+  if (loop->fd_num == EVENT_LOOP_MAX_FDS) {
+    return ENOSPC;
+  }
+  size_t idx = loop->fd_num;
+  loop->fds[idx].fd = fd;
+  loop->fds[idx].fn = fn;
+  loop->fds[idx].arg = arg;
+  struct epoll_event ev = {.events = events, .data.ptr = &loop->fds[idx]};
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+    return errno;
+  }
+  loop->fd_num++;
+  return 0;
+}
+
+int event_loop_start(struct event_loop *loop) {
+  if (loop->running) {
+    return EBUSY;
+  }
+  int rc = pthread_create(&loop->tid, NULL, &loop_thread, loop);
+  loop->running = !rc;
+  return rc;
+}
+
+void event_loop_stop(struct event_loop *loop) {
+  if (loop->running) {
+    pthread_mutex_lock(&loop->lock);
+    loop->stop = 1;
+    pthread_mutex_unlock(&loop->lock);
+    uint64_t one = 1;
+    while (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+    pthread_join(loop->tid, NULL);
+    loop->running = 0;
+  }
+  if (loop->wake_fd >= 0) {
+    close(loop->wake_fd);
+  }
+  if (loop->timer_fd >= 0) {
+    close(loop->timer_fd);
+  }
+  if (loop->epfd >= 0) {
+    close(loop->epfd);
+  }
+  loop->epfd = loop->timer_fd = loop->wake_fd = -1;
+  pthread_mutex_destroy(&loop->lock);
+}
+
+/* timers */
+
+void event_timer_init(struct event_timer *timer, event_timer_fn fn,
+                      void *arg) {
+  memset(timer, 0, sizeof(*timer));
+  timer->fn = fn;
+  timer->arg = arg;
+}
+
+int event_timer_start(struct event_loop *loop, struct event_timer *timer,
+                      uint64_t delay_ns, uint64_t period_ns) {
+  if (!loop || !timer || !timer->fn) {
+    return EINVAL;
+  }
+  timer->deadline_ns = now_ns() + delay_ns;
+  timer->period_ns = period_ns;
+  if (loop->running && !pthread_equal(pthread_self(), loop->tid)) {
+    timer->loop = loop;
+    pthread_mutex_lock(&loop->lock);
+    int wake = !loop->incoming;
+    timer->next = loop->incoming;
+    loop->incoming = timer;
+    pthread_mutex_unlock(&loop->lock);
+    if (wake) {
+      uint64_t one = 1;
+      while (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+      }
+    }
+    return 0;
+  }
+  event_timer_stop(timer); // restart
+  timer->loop = loop;
+  schedule(loop, timer);
+  return 0;
+}
+
+void event_timer_stop(struct event_timer *timer) {
+  if (!timer->loop) {
+    return;
+  }
+  if (timer->pprev) {
+    wheel_remove(timer->loop, timer);
+  }
+  if (timer->loop->firing == timer) {
+    timer->loop->firing = NULL; // no re-arm after the callback
+  }
+}
+
+int event_timer_pending(const struct event_timer *timer) {
+  return timer->pprev != NULL;
+}
@@ -0,0 +1,121 @@
+/*
+ * Event loop thread: epoll + timerfd + eventfd, with a hierarchical timing
+ * wheel for the timers.
+ *
+ * pthread_demo.c's hello_thread_function() keeps its period with
+ * sleep(task_no + 1), one sleeping thread per periodic task, and
+ * 02_POSIX_headers/posix_include.h includes time.h "for creating &
+ * managing timers" without any timer in sight. Here one loop thread runs
+ * any number of periodic and one-shot timers, and a few loops (one per
+ * thread) share hundreds of thousands of them:
+ *
+ * - the wheel (Varghese & Lauck): EVENT_WHEEL_LEVELS levels of
+ *   EVENT_WHEEL_SLOTS slots, level l slot s holds the timers due in
+ *   [SLOTS^l, SLOTS^(l+1)) ticks, hashed by their expiry tick. Starting,
+ *   stopping and firing a timer is O(1); a timer moves down one level
+ *   ("cascades") when its slot's turn comes, at most LEVELS - 1 times.
+ *   Ticks in which nothing is due are skipped, not visited one by one.
+ * - the timerfd (CLOCK_MONOTONIC, absolute) is armed for the next tick
+ *   with anything due in level 0, or the next cascade, so an idle loop
+ *   sleeps in epoll_wait() instead of waking every tick
+ * - the eventfd wakes the loop for timers started from other threads and
+ *   for event_loop_stop()
+ * - event_loop_add_fd(): other fds for the same epoll loop
+ *
+ * Timers fire on the first tick boundary at or after their deadline,
+ * never early: tick_ns is the resolution/cost trade-off. Periodic timers
+ * keep their phase (deadline += period), they do not drift with the
+ * callback's run time. Timers are caller owned (no allocation per timer);
+ * callbacks run on the loop thread and must not block. The loop does not
+ * touch a one-shot timer once its callback is called: the callback (or
+ * a thread it hands the timer to) may free or reuse it right away. A
+ * periodic timer must be stopped before it is freed.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_WHEEL_BITS 8U
+#define EVENT_WHEEL_SLOTS (1U << EVENT_WHEEL_BITS)
+#define EVENT_WHEEL_LEVELS 4U // 2^32 ticks: 49 days at 1 ms
+#define EVENT_LOOP_MAX_FDS 16U
+#define EVENT_LOOP_DEF_TICK_NS 1000000ULL // 1 ms
+
+struct event_loop;
+struct event_timer;
+
+typedef void (*event_timer_fn)(struct event_timer *timer, void *arg);
+typedef void (*event_fd_fn)(int fd, uint32_t events, void *arg);
+
+struct event_timer {
+  struct event_timer *next;   // wheel slot list, or the incoming list
+  struct event_timer **pprev; // NULL while not in the wheel
+  uint64_t expires;           // tick
+  uint64_t deadline_ns;       // CLOCK_MONOTONIC, the one being waited for
+  uint64_t period_ns;         // 0 = one-shot
+  event_timer_fn fn;
+  void *arg;
+  struct event_loop *loop;
+  unsigned int level;
+};
+
+struct event_loop {
+  int epfd;
+  int timer_fd;
+  int wake_fd;
+  pthread_t tid;
+  int running;
+
+  uint64_t tick_ns;
+  uint64_t start_ns; // tick 0
+  uint64_t now;      // last tick processed
+  uint64_t armed;    // tick the timerfd is set for, 0 = disarmed
+  struct event_timer *wheel[EVENT_WHEEL_LEVELS][EVENT_WHEEL_SLOTS];
+  size_t level_count[EVENT_WHEEL_LEVELS];
+  struct event_timer *firing; // callback running, NULL if it stopped it
+
+  pthread_mutex_t lock; // incoming and stop
+  struct event_timer *incoming;
+  int stop;
+
+  struct {
+    int fd;
+    event_fd_fn fn;
+    void *arg;
+  } fds[EVENT_LOOP_MAX_FDS];
+  size_t fd_num;
+
+  // loop thread only: read them after event_loop_stop()
+  uint64_t fired;
+  uint64_t cascaded; // timers moved down a level
+  uint64_t wakeups;  // epoll_wait() returns
+};
+
+// tick_ns 0 = EVENT_LOOP_DEF_TICK_NS
+int event_loop_init(struct event_loop *loop, uint64_t tick_ns);
+// before event_loop_start(), or from the loop thread
+int event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                      event_fd_fn fn, void *arg);
+int event_loop_start(struct event_loop *loop);
+// stops and joins the loop thread, closes its fds; pending timers are
+// dropped, not fired
+void event_loop_stop(struct event_loop *loop);
+
+void event_timer_init(struct event_timer *timer, event_timer_fn fn,
+                      void *arg);
+// fire after delay_ns, then every period_ns if not 0. From any thread,
+// but a timer is started from outside the loop thread only while it is
+// not pending (re-arm it from its own callback instead)
+int event_timer_start(struct event_loop *loop, struct event_timer *timer,
+                      uint64_t delay_ns, uint64_t period_ns);
+// from the loop thread (e.g. a callback, including the timer's own), or
+// before event_loop_start()
+void event_timer_stop(struct event_timer *timer);
+int event_timer_pending(const struct event_timer *timer);
+
+#endif // EVENT_LOOP_H
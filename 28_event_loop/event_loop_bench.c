@@ -0,0 +1,266 @@
+/*
+ * Timer firing accuracy and fires/s: one sleeping thread per periodic task
+ * (pthread_demo.c's sleep(task_no + 1) shape) vs. timing wheel loops.
+ *
+ * Every task fires every PERIOD_MS, phases spread over the period:
+ * - sleeping threads: a thread per task in clock_nanosleep(TIMER_ABSTIME)
+ * - wheel:            an event_timer per task, on [loops] event loops,
+ *                     with a 1 ms and a 100 us tick, then [timers] of them
+ * - one-shot:         [timers] one-shot timers at random delays within
+ *                     the run, started from main() while the loops run
+ * and reports fires/s, lateness percentiles (fire time - deadline, per
+ * thread 22_thread_trace histograms, merged), the CPU the process used
+ * and its context switches per second.
+ *
+ * usage: ./event_loop_bench [timers] [threads] [loops] [ms per run]
+ */
+#define _GNU_SOURCE
+
+#include "event_loop.h"
+#include "latency_hist.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEF_TIMERS 100000U
+#define DEF_THREADS 1000U
+#define DEF_LOOPS 2U
+#define DEF_RUN_MS 2000U
+#define PERIOD_MS 100U
+#define SLEEPER_STACK (64U * 1024U)
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct timespec to_timespec(uint64_t ns) {
+  struct timespec ts = {(time_t)(ns / 1000000000ULL),
+                        (long)(ns % 1000000000ULL)};
+  return ts;
+}
+
+/* reporting */
+
+struct usage {
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+  uint64_t switches;
+};
+
+static struct usage usage_now(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  struct usage u = {
+      .wall_ns = now_ns(),
+      .cpu_ns = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) *
+                    1000000000ULL +
+                (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000,
+      .switches = (uint64_t)(ru.ru_nvcsw + ru.ru_nivcsw),
+  };
+  return u;
+}
+
+static void report(const char *method, const char *tick, size_t tasks,
+                   size_t threads, const struct latency_hist *hist,
+                   struct usage from) {
+  struct usage to = usage_now();
+  double secs = (to.wall_ns - from.wall_ns) / 1e9;
+  printf("  %-16s %6s %7zu %7zu %10.0f %8.1f %8.1f %9.1f %5.1f %9.0f\n",
+         method, tick, tasks, threads, hist->count / secs,
+         latency_hist_percentile(hist, 50) / 1e3,
+         latency_hist_percentile(hist, 99) / 1e3, hist->max / 1e3,
+         100.0 * (to.cpu_ns - from.cpu_ns) / (to.wall_ns - from.wall_ns),
+         (to.switches - from.switches) / secs);
+}
+
+/* sleeping threads */
+
+struct sleeper {
+  uint64_t first_ns;
+  uint64_t period_ns;
+  uint64_t end_ns;
+  struct latency_hist hist;
+};
+
+static void *sleeper_thread(void *arg) {
+  struct sleeper *s = (struct sleeper *)arg;
+  for (uint64_t due = s->first_ns; due < s->end_ns; due += s->period_ns) {
+    struct timespec ts = to_timespec(due);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR) {
+    }
+    latency_hist_record(&s->hist, now_ns() - due);
+  }
+  return NULL;
+}
+
+static void bench_sleepers(size_t tasks, unsigned run_ms) {
+  struct sleeper *ss = calloc(tasks, sizeof(*ss));
+  pthread_t *tids = calloc(tasks, sizeof(*tids));
+  if (!ss || !tids) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, SLEEPER_STACK > PTHREAD_STACK_MIN
+                                       ? SLEEPER_STACK
+                                       : PTHREAD_STACK_MIN);
+  uint64_t period = PERIOD_MS * 1000000ULL;
+  struct usage from = usage_now();
+  for (size_t i = 0; i < tasks; i++) {
+    ss[i].period_ns = period;
+    ss[i].first_ns = from.wall_ns + period * (i + 1) / tasks;
+    ss[i].end_ns = from.wall_ns + run_ms * 1000000ULL;
+    latency_hist_init(&ss[i].hist);
+    ERROR_CHECK(pthread_create(&tids[i], &attr, &sleeper_thread, &ss[i]), 0);
+  }
+  struct latency_hist all;
+  latency_hist_init(&all);
+  for (size_t i = 0; i < tasks; i++) {
+    pthread_join(tids[i], NULL);
+    latency_hist_merge(&all, &ss[i].hist);
+  }
+  report("sleeping threads", "-", tasks, tasks, &all, from);
+  pthread_attr_destroy(&attr);
+  free(tids);
+  free(ss);
+}
+
+/* wheel */
+
+static void on_timer(struct event_timer *timer, void *arg) {
+  latency_hist_record((struct latency_hist *)arg,
+                      now_ns() - timer->deadline_ns);
+}
+
+// every loop records into its own histogram, merged once they are joined
+static void stop_loops(struct event_loop *loops, struct latency_hist *hists,
+                       size_t loop_num, struct latency_hist *all) {
+  latency_hist_init(all);
+  for (size_t l = 0; l < loop_num; l++) {
+    event_loop_stop(&loops[l]);
+    latency_hist_merge(all, &hists[l]);
+  }
+}
+
+static void bench_wheel(size_t tasks, size_t loop_num, uint64_t tick_ns,
+                        unsigned run_ms) {
+  struct event_loop *loops = calloc(loop_num, sizeof(*loops));
+  struct latency_hist *hists = calloc(loop_num, sizeof(*hists));
+  struct event_timer *timers = calloc(tasks, sizeof(*timers));
+  if (!loops || !hists || !timers) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  uint64_t period = PERIOD_MS * 1000000ULL;
+  for (size_t l = 0; l < loop_num; l++) {
+    ERROR_CHECK(event_loop_init(&loops[l], tick_ns), 0);
+    latency_hist_init(&hists[l]);
+  }
+  // before the loops run: straight into their wheels
+  for (size_t i = 0; i < tasks; i++) {
+    event_timer_init(&timers[i], &on_timer, &hists[i % loop_num]);
+    ERROR_CHECK(event_timer_start(&loops[i % loop_num], &timers[i],
+                                  period * (i + 1) / tasks, period),
+                0);
+  }
+  struct usage from = usage_now();
+  for (size_t l = 0; l < loop_num; l++) {
+    ERROR_CHECK(event_loop_start(&loops[l]), 0);
+  }
+  struct timespec run = to_timespec(run_ms * 1000000ULL);
+  while (nanosleep(&run, &run) && errno == EINTR) {
+  }
+  struct latency_hist all;
+  stop_loops(loops, hists, loop_num, &all);
+  char tick[16];
+  snprintf(tick, sizeof(tick), tick_ns < 1000000 ? "%.0fus" : "%.0fms",
+           tick_ns < 1000000 ? tick_ns / 1e3 : tick_ns / 1e6);
+  report("wheel", tick, tasks, loop_num, &all, from);
+  free(timers);
+  free(hists);
+  free(loops);
+}
+
+static void bench_one_shot(size_t tasks, size_t loop_num, unsigned run_ms) {
+  struct event_loop *loops = calloc(loop_num, sizeof(*loops));
+  struct latency_hist *hists = calloc(loop_num, sizeof(*hists));
+  struct event_timer *timers = calloc(tasks, sizeof(*timers));
+  if (!loops || !hists || !timers) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  for (size_t l = 0; l < loop_num; l++) {
+    ERROR_CHECK(event_loop_init(&loops[l], 0), 0);
+    latency_hist_init(&hists[l]);
+    ERROR_CHECK(event_loop_start(&loops[l]), 0);
+  }
+  // from another thread: through each loop's incoming list and eventfd
+  struct usage from = usage_now();
+  uint64_t run_ns = run_ms * 1000000ULL, seed = 88172645463325252ULL;
+  for (size_t i = 0; i < tasks; i++) {
+    seed ^= seed << 13; // xorshift64
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    event_timer_init(&timers[i], &on_timer, &hists[i % loop_num]);
+    ERROR_CHECK(event_timer_start(&loops[i % loop_num], &timers[i],
+                                  seed % run_ns, 0),
+                0);
+  }
+  uint64_t started = now_ns() - from.wall_ns;
+  // the last deadline, plus a tick and some slack
+  struct timespec run =
+      to_timespec(from.wall_ns + started + run_ns + 10000000ULL);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &run, NULL) ==
+         EINTR) {
+  }
+  struct latency_hist all;
+  stop_loops(loops, hists, loop_num, &all);
+  report("one-shot", "1ms", tasks, loop_num, &all, from);
+  printf("  (one-shot: %.1f M starts/s from main(), %llu of %zu fired)\n",
+         tasks / (started / 1e3), (unsigned long long)all.count, tasks);
+  free(timers);
+  free(hists);
+  free(loops);
+}
+
+int main(int argc, char *argv[]) {
+  size_t timers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_TIMERS;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_THREADS;
+  size_t loops = argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_LOOPS;
+  unsigned run_ms = argc > 4 ? (unsigned)strtoul(argv[4], NULL, 0) : DEF_RUN_MS;
+  if (!timers || !threads || !loops || !run_ms) {
+    printf("usage: %s [timers] [threads] [loops] [ms per run]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf("period %u ms, %u ms per run, lateness in us:\n", PERIOD_MS,
+         run_ms);
+  printf("  %-16s %6s %7s %7s %10s %8s %8s %9s %5s %9s\n", "method", "tick",
+         "tasks", "threads", "fires/s", "p50", "p99", "max", "cpu%",
+         "csw/s");
+  bench_sleepers(threads, run_ms);
+  bench_wheel(threads, loops, 1000000ULL, run_ms);
+  bench_wheel(threads, loops, 100000ULL, run_ms);
+  bench_wheel(timers, loops, 1000000ULL, run_ms);
+  bench_one_shot(timers, loops, run_ms);
+  return 0;
+}
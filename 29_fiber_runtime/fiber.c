@@ -0,0 +1,496 @@
+#include "fiber.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__) || defined(FIBER_UCONTEXT)
+#define FIBER_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+// the sanitizers have to be told about stack switches, or they report
+// (ASan) or lose track of (TSan) everything running on a fiber stack
+#if defined(__SANITIZE_ADDRESS__)
+#define FIBER_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+#if defined(__SANITIZE_THREAD__)
+#define FIBER_TSAN
+#include <sanitizer/tsan_interface.h>
+#endif
+
+#define IO_BATCH 64U // epoll events per epoll_wait()
+
+struct fiber_ctx {
+#ifdef FIBER_USE_UCONTEXT
+  ucontext_t uc;
+#else
+  void *sp;
+#endif
+};
+
+enum fiber_state { FIBER_READY, FIBER_SLEEP, FIBER_WAIT_FD, FIBER_DONE };
+
+// at the top of its own stack
+struct fiber {
+  struct fiber_ctx ctx;
+  struct fiber *next; // ready queue
+  struct fiber_sched *sched;
+  struct stack_pool_stack *stack;
+  fiber_fn fn;
+  void *arg;
+
+  // why it gave the worker back, and what for
+  enum fiber_state state;
+  uint64_t sleep_ns;
+  int wait_fd;
+  uint32_t wait_events;
+  int wait_rc;
+  struct event_timer timer;
+
+#ifdef FIBER_ASAN
+  void *fake_stack;
+#endif
+#ifdef FIBER_TSAN
+  void *tsan;
+#endif
+};
+
+struct fiber_worker {
+  struct fiber_sched *sched;
+  pthread_t tid;
+  struct fiber_ctx ctx; // on the worker thread's own stack
+  struct fiber *current;
+#ifdef FIBER_ASAN
+  void *fake_stack;
+  const void *stack_bottom;
+  size_t stack_size;
+#endif
+#ifdef FIBER_TSAN
+  void *tsan;
+#endif
+};
+
+static __thread struct fiber_worker *tls_worker;
+
+// neither inlined nor analysed: a fiber can resume on another worker, so
+// the thread pointer behind a thread local must be read again after every
+// switch, never reused from before it (errno's __errno_location() is
+// declared const, and would be)
+static __attribute__((noipa)) struct fiber_worker *current_worker(void) {
+  return tls_worker;
+}
+
+static __attribute__((noipa)) int *errno_location(void) { return &errno; }
+
+/* context switch */
+
+#ifdef FIBER_USE_UCONTEXT
+static void fiber_switch(struct fiber_ctx *from, struct fiber_ctx *to) {
+  swapcontext(&from->uc, &to->uc);
+}
+#else
+// void fiber_switch(struct fiber_ctx *from, struct fiber_ctx *to): the
+// System V callee-saved registers, MXCSR and the x87 control word go on
+// the current stack, its pointer into from->sp; then the same, reversed,
+// from to->sp. Everything else is saved by the caller around the call.
+void fiber_switch(struct fiber_ctx *from, struct fiber_ctx *to);
+__asm__(".text\n"
+        ".globl fiber_switch\n"
+        ".hidden fiber_switch\n"
+        ".type fiber_switch, @function\n"
+        ".p2align 4\n"
+        "fiber_switch:\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r12\n"
+        "  pushq %r13\n"
+        "  pushq %r14\n"
+        "  pushq %r15\n"
+        "  subq $8, %rsp\n"
+        "  stmxcsr (%rsp)\n"
+        "  fnstcw 4(%rsp)\n"
+        "  movq %rsp, (%rdi)\n"
+        "  movq (%rsi), %rsp\n"
+        "  ldmxcsr (%rsp)\n"
+        "  fldcw 4(%rsp)\n"
+        "  addq $8, %rsp\n"
+        "  popq %r15\n"
+        "  popq %r14\n"
+        "  popq %r13\n"
+        "  popq %r12\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        ".size fiber_switch, .-fiber_switch\n");
+#endif
+
+// worker -> fiber, back when the fiber parks
+static void switch_to_fiber(struct fiber_worker *w, struct fiber *f) {
+  w->current = f;
+#ifdef FIBER_ASAN
+  __sanitizer_start_switch_fiber(&w->fake_stack, f->stack->stack,
+                                 f->stack->stack_size);
+#endif
+#ifdef FIBER_TSAN
+  __tsan_switch_to_fiber(f->tsan, 0);
+#endif
+  fiber_switch(&w->ctx, &f->ctx);
+#ifdef FIBER_ASAN
+  __sanitizer_finish_switch_fiber(w->fake_stack, NULL, NULL);
+#endif
+  w->current = NULL;
+}
+
+// on the fiber: just switched to from a worker, maybe not the last one
+static void resumed(struct fiber *f) {
+#ifdef FIBER_ASAN
+  struct fiber_worker *w = current_worker();
+  __sanitizer_finish_switch_fiber(f->fake_stack, &w->stack_bottom,
+                                  &w->stack_size);
+#else
+  (void)f;
+#endif
+}
+
+// fiber -> its worker; returns when a worker switches back to it
+static void park(struct fiber_worker *w, struct fiber *f,
+                 enum fiber_state state) {
+  f->state = state;
+#ifdef FIBER_ASAN
+  __sanitizer_start_switch_fiber(state == FIBER_DONE ? NULL : &f->fake_stack,
+                                 w->stack_bottom, w->stack_size);
+#endif
+#ifdef FIBER_TSAN
+  __tsan_switch_to_fiber(w->tsan, 0);
+#endif
+  fiber_switch(&f->ctx, &w->ctx);
+  resumed(f);
+}
+
+static void fiber_main(void) {
+  struct fiber *f = current_worker()->current;
+  resumed(f);
+  f->fn(f->arg);
+  park(current_worker(), f, FIBER_DONE); // does not return
+}
+
+static int ctx_init(struct fiber *f) {
+#ifdef FIBER_USE_UCONTEXT
+  if (getcontext(&f->ctx.uc)) {
+    return errno;
+  }
+  f->ctx.uc.uc_stack.ss_sp = f->stack->stack;
+  f->ctx.uc.uc_stack.ss_size = (size_t)((char *)f - (char *)f->stack->stack);
+  f->ctx.uc.uc_link = NULL;
+  makecontext(&f->ctx.uc, &fiber_main, 0);
+#else
+  // the frame fiber_switch() pops: "ret" enters fiber_main() with the
+  // stack aligned as after a call (rsp % 16 == 8)
+  uint64_t *top = (uint64_t *)((uintptr_t)f & ~(uintptr_t)15);
+  top[-1] = 0;
+  top[-2] = (uint64_t)(uintptr_t)&fiber_main;
+  for (int i = 3; i <= 8; i++) {
+    top[-i] = 0; // rbp, rbx, r12 .. r15
+  }
+  top[-9] = 0x037FULL << 32 | 0x1F80; // x87 control word, MXCSR defaults
+  f->ctx.sp = &top[-9];
+#endif
+  return 0;
+}
+
+/* scheduler */
+
+static void enqueue(struct fiber_sched *sched, struct fiber *f) {
+  f->next = NULL;
+  pthread_mutex_lock(&sched->lock);
+  if (sched->tail) {
+    sched->tail->next = f;
+  } else {
+    sched->head = f;
+  }
+  sched->tail = f;
+  pthread_cond_signal(&sched->not_empty);
+  pthread_mutex_unlock(&sched->lock);
+}
+
+// on the loop thread. f may run, return and have its stack (with the
+// timer) unmapped at once: the loop leaves one-shot timers alone after
+// their callback
+static void on_timer(struct event_timer *timer, void *arg) {
+  (void)timer;
+  struct fiber *f = (struct fiber *)arg;
+  enqueue(f->sched, f);
+}
+
+// on the loop thread: the scheduler's epoll fd is readable
+static void on_io(int fd, uint32_t events, void *arg) {
+  (void)events;
+  struct epoll_event ready[IO_BATCH];
+  int n = epoll_wait(fd, ready, IO_BATCH, 0);
+  for (int i = 0; i < n; i++) {
+    enqueue((struct fiber_sched *)arg, (struct fiber *)ready[i].data.ptr);
+  }
+}
+
+// the worker is off f's stack now: hand f to whatever wakes it. Once it
+// is handed over, f may already run elsewhere, do not touch it anymore
+static void parked(struct fiber_sched *sched, struct fiber *f) {
+  switch (f->state) {
+  case FIBER_READY:
+    enqueue(sched, f);
+    break;
+  case FIBER_SLEEP: {
+    f->wait_rc = 0;
+    int rc = event_timer_start(&sched->loop, &f->timer, f->sleep_ns, 0);
+    if (rc) {
+      f->wait_rc = rc;
+      enqueue(sched, f);
+    }
+    break;
+  }
+  case FIBER_WAIT_FD: {
+    f->wait_rc = 0;
+    struct epoll_event ev = {.events = f->wait_events | EPOLLONESHOT,
+                             .data.ptr = f};
+    // still registered, disabled, after its last one-shot wait
+    if (epoll_ctl(sched->epfd, EPOLL_CTL_MOD, f->wait_fd, &ev) &&
+        (errno != ENOENT ||
+         epoll_ctl(sched->epfd, EPOLL_CTL_ADD, f->wait_fd, &ev))) {
+      f->wait_rc = errno;
+      enqueue(sched, f);
+    }
+    break;
+  }
+  case FIBER_DONE: {
+#ifdef FIBER_TSAN
+    __tsan_destroy_fiber(f->tsan);
+#endif
+    stack_pool_put(&sched->stacks, f->stack); // f is gone with it
+    pthread_mutex_lock(&sched->lock);
+    if (!--sched->live) {
+      pthread_cond_broadcast(&sched->idle);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    break;
+  }
+  }
+}
+
+static void *worker_main(void *arg) {
+  struct fiber_worker *w = (struct fiber_worker *)arg;
+  struct fiber_sched *sched = w->sched;
+  tls_worker = w;
+#ifdef FIBER_TSAN
+  w->tsan = __tsan_get_current_fiber();
+#endif
+  for (;;) {
+    pthread_mutex_lock(&sched->lock);
+    while (!sched->head && !sched->shutdown) {
+      pthread_cond_wait(&sched->not_empty, &sched->lock);
+    }
+    struct fiber *f = sched->head;
+    if (f) {
+      sched->head = f->next;
+      if (!sched->head) {
+        sched->tail = NULL;
+      }
+    }
+    pthread_mutex_unlock(&sched->lock);
+    if (!f) {
+      break; // shutdown, and nothing left to run
+    }
+    switch_to_fiber(w, f);
+    parked(sched, f);
+  }
+  return NULL;
+}
+
+/* setup */
+
+static void teardown(struct fiber_sched *sched) {
+  pthread_mutex_lock(&sched->lock);
+  sched->shutdown = 1;
+  pthread_cond_broadcast(&sched->not_empty);
+  pthread_mutex_unlock(&sched->lock);
+  for (size_t i = 0; i < sched->worker_num; i++) {
+    pthread_join(sched->workers[i].tid, NULL);
+  }
+  free(sched->workers);
+  sched->workers = NULL;
+  sched->worker_num = 0;
+  event_loop_stop(&sched->loop);
+  close(sched->epfd);
+  sched->epfd = -1;
+  pthread_cond_destroy(&sched->idle);
+  pthread_cond_destroy(&sched->not_empty);
+  pthread_mutex_destroy(&sched->lock);
+  stack_pool_destroy(&sched->stacks);
+}
+
+int fiber_sched_init(struct fiber_sched *sched, size_t worker_num,
+                     size_t stack_size, size_t guard_size) {
+  if (!sched || !worker_num) {
+    return EINVAL;
+  }
+  memset(sched, 0, sizeof(*sched));
+  int rc = stack_pool_init(&sched->stacks, stack_size, guard_size,
+                           FIBER_STACK_CACHE, 0);
+  if (rc) {
+    return rc;
+  }
+  pthread_mutex_init(&sched->lock, NULL);
+  pthread_cond_init(&sched->not_empty, NULL);
+  pthread_cond_init(&sched->idle, NULL);
+  sched->epfd = epoll_create1(EPOLL_CLOEXEC);
+  rc = sched->epfd < 0 ? errno : event_loop_init(&sched->loop, 0);
+  if (rc) {
+    if (sched->epfd >= 0) {
+      close(sched->epfd);
+    }
+    pthread_cond_destroy(&sched->idle);
+    pthread_cond_destroy(&sched->not_empty);
+    pthread_mutex_destroy(&sched->lock);
+    stack_pool_destroy(&sched->stacks);
+    return rc;
+  }
+
+  rc = event_loop_add_fd(&sched->loop, sched->epfd, EPOLLIN, &on_io, sched);
+  if (!rc) {
+    rc = event_loop_start(&sched->loop);
+  }
+  if (!rc) {
+    sched->workers = calloc(worker_num, sizeof(*sched->workers));
+    rc = sched->workers ? 0 : ENOMEM;
+  }
+  for (size_t i = 0; !rc && i < worker_num; i++) {
+    sched->workers[i].sched = sched;
+    rc = pthread_create(&sched->workers[i].tid, NULL, &worker_main,
+                        &sched->workers[i]);
+    sched->worker_num += !rc;
+  }
+  if (rc) {
+    teardown(sched);
+  }
+  return rc;
+}
+
+int fiber_sched_wait(struct fiber_sched *sched) {
+  if (!sched) {
+    return EINVAL;
+  }
+  pthread_mutex_lock(&sched->lock);
+  while (sched->live) {
+    pthread_cond_wait(&sched->idle, &sched->lock);
+  }
+  pthread_mutex_unlock(&sched->lock);
+  return 0;
+}
+
+void fiber_sched_destroy(struct fiber_sched *sched) { teardown(sched); }
+
+int fiber_spawn(struct fiber_sched *sched, fiber_fn fn, void *arg) {
+  if (!sched || !fn) {
+    return EINVAL;
+  }
+  struct stack_pool_stack *stack;
+  int rc = stack_pool_get(&sched->stacks, &stack);
+  if (rc) {
+    return rc;
+  }
+  uintptr_t top = (uintptr_t)stack->stack + stack->stack_size;
+  struct fiber *f =
+      (struct fiber *)((top - sizeof(struct fiber)) & ~(uintptr_t)63);
+  memset(f, 0, sizeof(*f));
+  f->sched = sched;
+  f->stack = stack;
+  f->fn = fn;
+  f->arg = arg;
+  event_timer_init(&f->timer, &on_timer, f);
+  rc = ctx_init(f);
+  if (rc) {
+    stack_pool_put(&sched->stacks, stack);
+    return rc;
+  }
+#ifdef FIBER_TSAN
+  f->tsan = __tsan_create_fiber(0);
+#endif
+  pthread_mutex_lock(&sched->lock);
+  sched->live++;
+  pthread_mutex_unlock(&sched->lock);
+  enqueue(sched, f);
+  return 0;
+}
+
+/* in a fiber */
+
+void fiber_yield(void) {
+  struct fiber_worker *w = current_worker();
+  if (w && w->current) {
+    park(w, w->current, FIBER_READY);
+  }
+}
+
+int fiber_sleep(uint64_t ns) {
+  struct fiber_worker *w = current_worker();
+  if (!w || !w->current) {
+    return ENOTSUP;
+  }
+  struct fiber *f = w->current;
+  f->sleep_ns = ns;
+  park(w, f, FIBER_SLEEP);
+  return f->wait_rc;
+}
+
+int fiber_wait_fd(int fd, uint32_t events) {
+  struct fiber_worker *w = current_worker();
+  if (!w || !w->current) {
+    return ENOTSUP;
+  }
+  if (fd < 0 || !(events & (EPOLLIN | EPOLLOUT))) {
+    return EINVAL;
+  }
+  struct fiber *f = w->current;
+  f->wait_fd = fd;
+  f->wait_events = events;
+  park(w, f, FIBER_WAIT_FD);
+  return f->wait_rc;
+}
+
+ssize_t fiber_read(int fd, void *buf, size_t len) {
+  for (;;) {
+    ssize_t n = read(fd, buf, len);
+    if (n >= 0) {
+      return n;
+    }
+    int err = *errno_location();
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      err = fiber_wait_fd(fd, EPOLLIN);
+    }
+    if (err && err != EINTR) {
+      *errno_location() = err;
+      return -1;
+    }
+  }
+}
+
+ssize_t fiber_write(int fd, const void *buf, size_t len) {
+  for (;;) {
+    ssize_t n = write(fd, buf, len);
+    if (n >= 0) {
+      return n;
+    }
+    int err = *errno_location();
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      err = fiber_wait_fd(fd, EPOLLOUT);
+    }
+    if (err && err != EINTR) {
+      *errno_location() = err;
+      return -1;
+    }
+  }
+}
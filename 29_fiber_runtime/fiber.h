@@ -0,0 +1,100 @@
+/*
+ * M:N fibers: stackful coroutines on small mmap()ed stacks, run by a few
+ * worker threads.
+ *
+ * 03_pthread_attributes/pthread_attr_demo.c hands a thread a custom stack
+ * with pthread_attr_setstack(), and 10_thread_stack_pool recycles such
+ * stacks, but every unit of work is still a kernel thread: a kernel stack,
+ * a task_struct, a scheduler entry and a syscall for every switch. Here a
+ * task is a fiber, a stack from a 10_thread_stack_pool pool plus a saved
+ * stack pointer, switched in user space:
+ *
+ * - fiber_switch: callee-saved registers, MXCSR and the x87 control word
+ *   pushed on the old stack, the stack pointer swapped, popped from the
+ *   new one (x86-64 assembly, ~10 instructions, no syscall). Elsewhere,
+ *   or built with -DFIBER_UCONTEXT, swapcontext(), which also saves and
+ *   restores the signal mask with a syscall every switch.
+ * - workers: worker_num threads pop fibers off one ready queue and switch
+ *   to them; a fiber runs until it yields, waits or returns, then may
+ *   resume on any worker (M fibers on N threads).
+ * - fiber_yield(): back to the end of the ready queue
+ * - fiber_sleep(), fiber_wait_fd(): park the fiber on a 28_event_loop
+ *   loop, a timing wheel timer or an EPOLLONESHOT registration in the
+ *   scheduler's epoll fd, which the loop watches; the loop thread puts it
+ *   back on the ready queue. fiber_read()/fiber_write() on O_NONBLOCK
+ *   fds look blocking to the fiber but never block the worker
+ *
+ * A parked fiber is only handed to the queue, the epoll fd or the timer
+ * once the worker is off its stack, so it can never run on two threads.
+ *
+ * The fiber's struct lives at the top of its own stack, no other memory
+ * per fiber. Guard pages cost a kernel VMA each (guard and stack are two
+ * mappings), and vm.max_map_count (65530 by default) caps the number of
+ * guarded fibers around 32k: 100k+ fibers need guard_size 0, or a higher
+ * limit.
+ *
+ * Thread locals, errno included, must not be cached across a yield in a
+ * fiber: after it the fiber may run on another worker. The fiber_*()
+ * calls re-read what they need.
+ *
+ * APIs return 0 or an errno value.
+ */
+#ifndef FIBER_H
+#define FIBER_H
+
+#include "event_loop.h"
+#include "stack_pool.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FIBER_STACK_CACHE 1024U // finished fibers' stacks kept for reuse
+
+typedef void (*fiber_fn)(void *arg);
+
+struct fiber;
+struct fiber_worker;
+
+struct fiber_sched {
+  struct stack_pool stacks;
+  struct event_loop loop; // fiber_sleep() timers, epfd readiness
+  int epfd;               // fiber_wait_fd() registrations
+
+  struct fiber_worker *workers;
+  size_t worker_num;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty; // workers wait here
+  pthread_cond_t idle;      // fiber_sched_wait() waits here
+  struct fiber *head;       // ready queue
+  struct fiber *tail;
+  size_t live; // spawned, not yet returned
+  int shutdown;
+};
+
+// stack_size is rounded up to PTHREAD_STACK_MIN and pages; guard_size 0
+// for no guard page
+int fiber_sched_init(struct fiber_sched *sched, size_t worker_num,
+                     size_t stack_size, size_t guard_size);
+// blocks until every fiber has returned
+int fiber_sched_wait(struct fiber_sched *sched);
+// joins the workers and the loop, frees the cached stacks; call after
+// fiber_sched_wait()
+void fiber_sched_destroy(struct fiber_sched *sched);
+
+// from any thread, fibers included
+int fiber_spawn(struct fiber_sched *sched, fiber_fn fn, void *arg);
+
+// from a fiber (no-op / ENOTSUP from a plain thread)
+void fiber_yield(void);
+int fiber_sleep(uint64_t ns);
+// events: EPOLLIN and/or EPOLLOUT; one waiting fiber per fd
+int fiber_wait_fd(int fd, uint32_t events);
+// read()/write() for O_NONBLOCK fds, waiting on EAGAIN; -1 and errno on
+// failure
+ssize_t fiber_read(int fd, void *buf, size_t len);
+ssize_t fiber_write(int fd, const void *buf, size_t len);
+
+#endif // FIBER_H
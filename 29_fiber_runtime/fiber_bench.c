@@ -0,0 +1,444 @@
+/*
+ * Context switch cost and memory per task: fibers vs. pthreads.
+ *
+ * - switch, ns each:
+ *   - fiber_yield():  fibers yielding in turn on 1 worker, each yield is
+ *                     fiber -> worker -> next fiber, through the ready queue
+ *   - swapcontext():  two ucontexts switching back and forth, raw
+ *   - pthread + sem:  two threads handing a turn back and forth with
+ *                     semaphores (futex wake, sleep, kernel switch)
+ * - tasks: [fibers] fibers (16 kB stacks, without and with a guard page)
+ *   or [threads] threads (default attributes), all alive at once, parked
+ *   in fiber_sleep() / pthread_cond_wait(): spawn time per task, resident
+ *   memory (RSS) and address space per task (/proc/self/statm), and the
+ *   time from their release to all of them finished
+ * - pipes: pairs of tasks ping-pong a byte over two pipes, fibers with
+ *   fiber_read()/fiber_write() on O_NONBLOCK pipes (2 workers) vs. a
+ *   thread per side in blocking read()/write()
+ * - sleep + exit: rounds of fibers that fiber_sleep() 1 us and return on
+ *   8 workers, so a stack (and the timer in it) is freed right after its
+ *   timer fired, while the loop thread may still be in that tick
+ *
+ * usage: ./fiber_bench [fibers] [threads] [switches]
+ */
+#define _GNU_SOURCE
+
+#include "fiber.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define DEF_FIBERS 100000U
+#define DEF_THREADS 5000U
+#define DEF_SWITCHES 1000000U
+#define FIBER_STACK (16U * 1024U)
+#define GUARDED_MAX 30000U // vm.max_map_count: 2 mappings per fiber
+#define HOLD_MS 3000U      // tasks stay parked until then
+#define PAIRS 100U
+#define ROUND_TRIPS 1000U
+#define CHURN_WORKERS 8U
+#define CHURN_FIBERS 20000U
+#define CHURN_ROUNDS 20U
+
+#define ERROR_CHECK(X, WARN)                                                   \
+  do {                                                                         \
+    if (X) {                                                                   \
+      printf("Error occured %d, %s @ line no. %d\n", X, strerror(X),           \
+             __LINE__);                                                        \
+      if (!WARN) {                                                             \
+        exit(EXIT_FAILURE);                                                    \
+      }                                                                        \
+    }                                                                          \
+  } while (0);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void nap_ms(unsigned ms) {
+  struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+  while (nanosleep(&ts, &ts) && errno == EINTR) {
+  }
+}
+
+// address space and resident set, bytes
+static void statm(uint64_t *size, uint64_t *resident) {
+  unsigned long pages = 0, rss = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp) {
+    if (fscanf(fp, "%lu %lu", &pages, &rss) != 2) {
+      pages = rss = 0;
+    }
+    fclose(fp);
+  }
+  *size = (uint64_t)pages * getpagesize();
+  *resident = (uint64_t)rss * getpagesize();
+}
+
+/* switch */
+
+static void yielder(void *arg) {
+  for (unsigned long i = *(unsigned long *)arg; i; i--) {
+    fiber_yield();
+  }
+}
+
+static void switch_fibers(size_t fibers, unsigned long switches) {
+  struct fiber_sched sched;
+  ERROR_CHECK(fiber_sched_init(&sched, 1, FIBER_STACK, 0), 0);
+  unsigned long each = switches / fibers;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < fibers; i++) {
+    ERROR_CHECK(fiber_spawn(&sched, &yielder, &each), 0);
+  }
+  fiber_sched_wait(&sched);
+  uint64_t elapsed = now_ns() - start;
+  fiber_sched_destroy(&sched);
+  char name[32];
+  snprintf(name, sizeof(name), "fiber_yield(), %zu", fibers);
+  printf("  %-22s %8.1f\n", name, (double)elapsed / (each * fibers));
+}
+
+static ucontext_t main_uc, co_uc;
+static unsigned long co_left;
+
+static void co_main(void) {
+  while (co_left--) {
+    swapcontext(&co_uc, &main_uc);
+  }
+  swapcontext(&co_uc, &main_uc);
+}
+
+static void switch_ucontext(unsigned long switches) {
+  size_t stack_size = 64 * 1024;
+  void *stack = malloc(stack_size);
+  if (!stack) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  getcontext(&co_uc);
+  co_uc.uc_stack.ss_sp = stack;
+  co_uc.uc_stack.ss_size = stack_size;
+  co_uc.uc_link = NULL;
+  makecontext(&co_uc, &co_main, 0);
+  co_left = switches / 2;
+  uint64_t start = now_ns();
+  for (unsigned long i = 0; i <= switches / 2; i++) {
+    swapcontext(&main_uc, &co_uc);
+  }
+  uint64_t elapsed = now_ns() - start;
+  printf("  %-22s %8.1f\n", "swapcontext()",
+         (double)elapsed / (2 * (switches / 2 + 1)));
+  free(stack);
+}
+
+static sem_t ping_sem, pong_sem;
+
+static void *ponger(void *arg) {
+  for (unsigned long i = *(unsigned long *)arg; i; i--) {
+    while (sem_wait(&ping_sem)) {
+    }
+    sem_post(&pong_sem);
+  }
+  return NULL;
+}
+
+static void switch_threads(unsigned long handoffs) {
+  sem_init(&ping_sem, 0, 0);
+  sem_init(&pong_sem, 0, 0);
+  pthread_t tid;
+  ERROR_CHECK(pthread_create(&tid, NULL, &ponger, &handoffs), 0);
+  uint64_t start = now_ns();
+  for (unsigned long i = 0; i < handoffs; i++) {
+    sem_post(&ping_sem);
+    while (sem_wait(&pong_sem)) {
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  pthread_join(tid, NULL);
+  printf("  %-22s %8.1f\n", "pthread + sem", (double)elapsed / (2 * handoffs));
+  sem_destroy(&pong_sem);
+  sem_destroy(&ping_sem);
+}
+
+/* tasks */
+
+static atomic_size_t parked;
+static uint64_t release_ns; // CLOCK_MONOTONIC, written before any task
+
+struct task_usage {
+  uint64_t size;
+  uint64_t rss;
+  uint64_t start_ns;
+};
+
+static struct task_usage task_usage_now(void) {
+  struct task_usage u;
+  statm(&u.size, &u.rss);
+  u.start_ns = now_ns();
+  return u;
+}
+
+// once all tasks are parked: per task spawn time, memory
+static void report_tasks(const char *name, size_t tasks,
+                         struct task_usage from, uint64_t spawn_ns) {
+  struct task_usage to = task_usage_now();
+  printf("  %-22s %7zu %9.2f %9.1f %11.1f", name, tasks,
+         spawn_ns / 1e3 / tasks, (double)(to.rss - from.rss) / 1024 / tasks,
+         (double)(to.size - from.size) / 1024 / tasks);
+}
+
+static void wait_parked(size_t tasks) {
+  while (atomic_load(&parked) < tasks) {
+    nap_ms(1);
+  }
+}
+
+static void fiber_sleeper(void *arg) {
+  (void)arg;
+  atomic_fetch_add(&parked, 1);
+  uint64_t now = now_ns();
+  if (release_ns > now) {
+    fiber_sleep(release_ns - now);
+  }
+}
+
+static void tasks_fibers(size_t fibers, size_t guard) {
+  struct fiber_sched sched;
+  ERROR_CHECK(fiber_sched_init(&sched, 1, FIBER_STACK, guard), 0);
+  atomic_store(&parked, 0);
+  struct task_usage from = task_usage_now();
+  release_ns = from.start_ns + HOLD_MS * 1000000ULL;
+  for (size_t i = 0; i < fibers; i++) {
+    ERROR_CHECK(fiber_spawn(&sched, &fiber_sleeper, NULL), 0);
+  }
+  uint64_t spawn = now_ns() - from.start_ns;
+  wait_parked(fibers);
+  report_tasks(guard ? "fibers + guard page" : "fibers", fibers, from, spawn);
+  fiber_sched_wait(&sched);
+  printf(" %9.1f\n", (now_ns() - release_ns) / 1e6);
+  fiber_sched_destroy(&sched);
+}
+
+static pthread_mutex_t release_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t release_cond = PTHREAD_COND_INITIALIZER;
+static int released;
+
+static void *thread_sleeper(void *arg) {
+  (void)arg;
+  atomic_fetch_add(&parked, 1);
+  pthread_mutex_lock(&release_lock);
+  while (!released) {
+    pthread_cond_wait(&release_cond, &release_lock);
+  }
+  pthread_mutex_unlock(&release_lock);
+  return NULL;
+}
+
+static void tasks_threads(size_t threads) {
+  pthread_t *tids = calloc(threads, sizeof(*tids));
+  if (!tids) {
+    ERROR_CHECK(ENOMEM, 0);
+  }
+  atomic_store(&parked, 0);
+  released = 0;
+  struct task_usage from = task_usage_now();
+  for (size_t i = 0; i < threads; i++) {
+    ERROR_CHECK(pthread_create(&tids[i], NULL, &thread_sleeper, NULL), 0);
+  }
+  uint64_t spawn = now_ns() - from.start_ns;
+  wait_parked(threads);
+  report_tasks("pthreads", threads, from, spawn);
+  uint64_t start = now_ns();
+  pthread_mutex_lock(&release_lock);
+  released = 1;
+  pthread_cond_broadcast(&release_cond);
+  pthread_mutex_unlock(&release_lock);
+  for (size_t i = 0; i < threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  printf(" %9.1f\n", (now_ns() - start) / 1e6);
+  free(tids);
+}
+
+/* pipes */
+
+struct pipe_pair {
+  int ping[2]; // pinger -> ponger
+  int pong[2]; // ponger -> pinger
+};
+
+static void open_pairs(struct pipe_pair *pairs, size_t n, int flags) {
+  for (size_t i = 0; i < n; i++) {
+    if (pipe2(pairs[i].ping, flags) || pipe2(pairs[i].pong, flags)) {
+      ERROR_CHECK(errno, 0);
+    }
+  }
+}
+
+static void close_pairs(struct pipe_pair *pairs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    close(pairs[i].ping[0]);
+    close(pairs[i].ping[1]);
+    close(pairs[i].pong[0]);
+    close(pairs[i].pong[1]);
+  }
+}
+
+static void fiber_pinger(void *arg) {
+  struct pipe_pair *pair = (struct pipe_pair *)arg;
+  char byte = 'x';
+  for (unsigned i = 0; i < ROUND_TRIPS; i++) {
+    if (fiber_write(pair->ping[1], &byte, 1) != 1 ||
+        fiber_read(pair->pong[0], &byte, 1) != 1) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+}
+
+static void fiber_ponger(void *arg) {
+  struct pipe_pair *pair = (struct pipe_pair *)arg;
+  char byte;
+  for (unsigned i = 0; i < ROUND_TRIPS; i++) {
+    if (fiber_read(pair->ping[0], &byte, 1) != 1 ||
+        fiber_write(pair->pong[1], &byte, 1) != 1) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+}
+
+static void *thread_pinger(void *arg) {
+  struct pipe_pair *pair = (struct pipe_pair *)arg;
+  char byte = 'x';
+  for (unsigned i = 0; i < ROUND_TRIPS; i++) {
+    if (write(pair->ping[1], &byte, 1) != 1 ||
+        read(pair->pong[0], &byte, 1) != 1) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+  return NULL;
+}
+
+static void *thread_ponger(void *arg) {
+  struct pipe_pair *pair = (struct pipe_pair *)arg;
+  char byte;
+  for (unsigned i = 0; i < ROUND_TRIPS; i++) {
+    if (read(pair->ping[0], &byte, 1) != 1 ||
+        write(pair->pong[1], &byte, 1) != 1) {
+      int err = errno ? errno : EIO;
+      ERROR_CHECK(err, 0);
+    }
+  }
+  return NULL;
+}
+
+static void pipes_fibers(void) {
+  struct pipe_pair pairs[PAIRS];
+  open_pairs(pairs, PAIRS, O_NONBLOCK | O_CLOEXEC);
+  struct fiber_sched sched;
+  ERROR_CHECK(fiber_sched_init(&sched, 2, FIBER_STACK, 0), 0);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < PAIRS; i++) {
+    ERROR_CHECK(fiber_spawn(&sched, &fiber_ponger, &pairs[i]), 0);
+    ERROR_CHECK(fiber_spawn(&sched, &fiber_pinger, &pairs[i]), 0);
+  }
+  fiber_sched_wait(&sched);
+  uint64_t elapsed = now_ns() - start;
+  fiber_sched_destroy(&sched);
+  close_pairs(pairs, PAIRS);
+  printf("  %-22s %12.0f\n", "fibers, 2 workers",
+         PAIRS * ROUND_TRIPS * 1e9 / elapsed);
+}
+
+static void pipes_threads(void) {
+  struct pipe_pair pairs[PAIRS];
+  open_pairs(pairs, PAIRS, O_CLOEXEC);
+  pthread_t tids[2 * PAIRS];
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < PAIRS; i++) {
+    ERROR_CHECK(
+        pthread_create(&tids[2 * i], NULL, &thread_ponger, &pairs[i]), 0);
+    ERROR_CHECK(
+        pthread_create(&tids[2 * i + 1], NULL, &thread_pinger, &pairs[i]), 0);
+  }
+  for (size_t i = 0; i < 2 * PAIRS; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t elapsed = now_ns() - start;
+  close_pairs(pairs, PAIRS);
+  printf("  %-22s %12.0f\n", "pthreads", PAIRS * ROUND_TRIPS * 1e9 / elapsed);
+}
+
+/* sleep + exit */
+
+static void fiber_napper(void *arg) {
+  (void)arg;
+  fiber_sleep(1000);
+}
+
+static void sleep_exit(size_t fibers) {
+  struct fiber_sched sched;
+  ERROR_CHECK(fiber_sched_init(&sched, CHURN_WORKERS, FIBER_STACK, 0), 0);
+  uint64_t start = now_ns();
+  for (unsigned round = 0; round < CHURN_ROUNDS; round++) {
+    for (size_t i = 0; i < fibers; i++) {
+      ERROR_CHECK(fiber_spawn(&sched, &fiber_napper, NULL), 0);
+    }
+    fiber_sched_wait(&sched);
+  }
+  uint64_t elapsed = now_ns() - start;
+  fiber_sched_destroy(&sched);
+  printf("  %-22s %12.0f\n", "fibers", fibers * CHURN_ROUNDS * 1e9 / elapsed);
+}
+
+int main(int argc, char *argv[]) {
+  size_t fibers = argc > 1 ? strtoul(argv[1], NULL, 0) : DEF_FIBERS;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEF_THREADS;
+  unsigned long switches =
+      argc > 3 ? strtoul(argv[3], NULL, 0) : DEF_SWITCHES;
+  if (!fibers || !threads || switches < 1000) {
+    printf("usage: %s [fibers] [threads] [switches >= 1000]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("context switch, ns:\n");
+  switch_fibers(2, switches);
+  switch_fibers(1000, switches);
+  switch_ucontext(switches);
+  switch_threads(switches / 10);
+
+  printf("tasks alive at once, parked (%u kB fiber stacks):\n",
+         FIBER_STACK / 1024);
+  printf("  %-22s %7s %9s %9s %11s %9s\n", "", "tasks", "spawn us",
+         "RSS kB", "address kB", "finish ms");
+  tasks_fibers(fibers, 0);
+  tasks_fibers(fibers < GUARDED_MAX ? fibers : GUARDED_MAX, 4096);
+  tasks_threads(threads);
+
+  printf("%u pipe ping-pong pairs, %u round trips each:\n", PAIRS,
+         ROUND_TRIPS);
+  printf("  %-22s %12s\n", "", "round trips/s");
+  pipes_fibers();
+  pipes_threads();
+
+  size_t churn = fibers < CHURN_FIBERS ? fibers : CHURN_FIBERS;
+  printf("sleep + exit, %u rounds of %zu fibers, %u workers:\n",
+         CHURN_ROUNDS, churn, CHURN_WORKERS);
+  printf("  %-22s %12s\n", "", "fibers/s");
+  sleep_exit(churn);
+  return 0;
+}